@@ -23,9 +23,11 @@
 #include <linux/version.h>
 
 /* On kernels earlier than 2.6.35, there is no "filp" argument in the
- * bin_attribute write() method.
+ * bin_attribute read() and write() methods.
  */
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
+#define pb_attr_loaded_read(filp, kobj, attr, buf, off, len) \
+	pb_attr_loaded_read(kobj, attr, buf, off, len)
 #define pb_attr_program_write(filp, kobj, attr, buf, off, len) \
 	pb_attr_program_write(kobj, attr, buf, off, len)
 #define pb_attr_bin_write(filp, kobj, attr, buf, off, len, handle) \
@@ -24,18 +24,51 @@
 #include <linux/sched.h>
 #include <linux/delay.h>
 #include <linux/semaphore.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/crc32.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
 #include "pulseblaster.h"
+#include "pulseblaster_ioctl.h"
+#include "pulseblaster_shadow.h"
 #include "compat.h"
 
+#define CREATE_TRACE_POINTS
+#include "pulseblaster_trace.h"
+
 /** Pulseblaster driver name */
 #define PB_NAME "pulseblaster"
 
 /** Pulseblaster class */
 static struct class *pb_class;
 
+/** Pulseblaster debugfs directory */
+static struct dentry *pb_debugfs;
+
+/** Pulseblaster asynchronous programming workqueue */
+static struct workqueue_struct *pb_wq;
+
 /** Automatically stop devices on module load */
 static int autostop;
 
+/** Busy-wait budget (in microseconds) before falling back to sleeping */
+static unsigned int spin_budget = 50;
+
+/** Skip reprogramming of the unchanged part of a program */
+static int shadow = 1;
+
 /*****************************************************************************
  *
  * Old AMCC bridge protocol
@@ -55,6 +88,9 @@ enum pulseblaster_old_amcc_register {
 /** Maximum number of retry attempts */
 #define PB_OLD_AMCC_MAX_RETRIES 10
 
+/** Minimum busy-wait budget (in microseconds) when we may not sleep */
+#define PB_OLD_AMCC_ATOMIC_BUDGET 1000
+
 /**
  * Write to old AMCC bridge output register
  *
@@ -81,30 +117,58 @@ static inline unsigned int pb_old_amcc_in(struct pulseblaster *pb)
  *
  * @pb:			Pulseblaster device
  * @state:		Desired state
+ *
+ * The bridge almost always reaches the desired state within a few
+ * microseconds, so we first busy-wait for up to spin_budget
+ * microseconds (kicking the bridge on each poll, just as the sleeping
+ * retry loop does) before falling back to the (much slower) sleeping
+ * retry loop.  If we may not sleep, we busy-wait for longer, and then
+ * give up.
  */
 static int pb_old_amcc_wait(struct pulseblaster *pb, unsigned int state)
 {
 	uint8_t data;
+	unsigned int budget = spin_budget;
+	unsigned int spins;
 	unsigned int retries;
 
+	if (pb->atomic)
+		budget = max_t(unsigned int, budget, PB_OLD_AMCC_ATOMIC_BUDGET);
+
+	for (spins = 0 ; spins <= budget ; spins++) {
+		data = pb_old_amcc_in(pb);
+		if ((data & 0x07) == state) {
+			atomic_long_add(spins, &pb->spins);
+			return 0;
+		}
+		pb_old_amcc_out(pb, (data << 4));
+		cpu_relax();
+		udelay(1);
+	}
+	atomic_long_add(spins, &pb->spins);
+	if (pb->atomic)
+		goto err_stuck;
+
 	for (retries = 0 ; retries <= PB_OLD_AMCC_MAX_RETRIES ; retries++) {
 		data = pb_old_amcc_in(pb);
 		if ((data & 0x07) == state) {
 			if (retries) {
-				printk(KERN_INFO "%s: needed %d retries to "
-				       "reach state 0x%02x\n",
-				       pb->name, retries, state);
+				atomic_long_add(retries, &pb->retries);
+				trace_pb_bridge_retry(pb, state, retries);
 			}
 			return 0;
 		}
 		pb_old_amcc_out(pb, (data << 4));
+		atomic_long_inc(&pb->sleeps);
 		msleep_interruptible(1);
 		if (signal_pending(current))
 			return -EINTR;
 	}
 
+ err_stuck:
 	printk(KERN_ERR "%s: bridge stuck waiting for state 0x%02x\n",
 	       pb->name, state);
+	atomic_long_inc(&pb->timeouts);
 	return -ETIMEDOUT;
 }
 
@@ -164,6 +228,45 @@ static struct pulseblaster_type pb_old_amcc_type = {
  *****************************************************************************
  */
 
+/** Command primitive names, by register */
+static const char *pb_cmd_names[PB_NUM_REGISTERS] = {
+	[PB_DEVICE_RESET]		= "reset",
+	[PB_DEVICE_START]		= "start",
+	[PB_SELECT_BPW]			= "select_bpw",
+	[PB_SELECT_DEVICE]		= "select_device",
+	[PB_CLEAR_ADDRESS_COUNTER]	= "clear_address_counter",
+	[PB_FLAG_STROBE]		= "strobe",
+	[PB_DATA_TRANSFER]		= "transfer",
+	[PB_PROGRAMMING_FINISHED]	= "finished",
+};
+
+/**
+ * Issue command
+ *
+ * @pb:			Pulseblaster device
+ * @address:		Register address
+ * @data:		Data value
+ *
+ * The command latency is recorded in the per-register histogram.
+ */
+static int pb_cmd(struct pulseblaster *pb, enum pulseblaster_register address,
+		  unsigned int data)
+{
+	ktime_t start;
+	s64 ns;
+	int rc;
+
+	start = ktime_get();
+	rc = pb_writeb(pb, address, data);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pb->latency[address][min_t(unsigned int,
+				   (ns > 0 ? ilog2(ns) : 0),
+				   (PB_LATENCY_BUCKETS - 1))]++;
+	trace_pb_cmd(pb, address, data, rc, ns);
+
+	return rc;
+}
+
 /**
  * Stop program
  *
@@ -171,7 +274,7 @@ static struct pulseblaster_type pb_old_amcc_type = {
  */
 static inline int pb_cmd_stop(struct pulseblaster *pb)
 {
-	return pb_writeb(pb, PB_DEVICE_RESET, 0);
+	return pb_cmd(pb, PB_DEVICE_RESET, 0);
 }
 
 /**
@@ -181,7 +284,7 @@ static inline int pb_cmd_stop(struct pulseblaster *pb)
  */
 static inline int pb_cmd_start(struct pulseblaster *pb)
 {
-	return pb_writeb(pb, PB_DEVICE_START, 0);
+	return pb_cmd(pb, PB_DEVICE_START, 0);
 }
 
 /**
@@ -192,7 +295,7 @@ static inline int pb_cmd_start(struct pulseblaster *pb)
  */
 static inline int pb_cmd_select_bpw(struct pulseblaster *pb, unsigned int bpw)
 {
-	return pb_writeb(pb, PB_SELECT_BPW, bpw);
+	return pb_cmd(pb, PB_SELECT_BPW, bpw);
 }
 
 /**
@@ -204,7 +307,7 @@ static inline int pb_cmd_select_bpw(struct pulseblaster *pb, unsigned int bpw)
 static inline int pb_cmd_select_device(struct pulseblaster *pb,
 				       unsigned int dev)
 {
-	return pb_writeb(pb, PB_SELECT_DEVICE, dev);
+	return pb_cmd(pb, PB_SELECT_DEVICE, dev);
 }
 
 /**
@@ -214,7 +317,7 @@ static inline int pb_cmd_select_device(struct pulseblaster *pb,
  */
 static inline int pb_cmd_clear_address_counter(struct pulseblaster *pb)
 {
-	return pb_writeb(pb, PB_CLEAR_ADDRESS_COUNTER, 0);
+	return pb_cmd(pb, PB_CLEAR_ADDRESS_COUNTER, 0);
 }
 
 /**
@@ -224,7 +327,7 @@ static inline int pb_cmd_clear_address_counter(struct pulseblaster *pb)
  */
 static inline int pb_cmd_strobe(struct pulseblaster *pb)
 {
-	return pb_writeb(pb, PB_FLAG_STROBE, 0);
+	return pb_cmd(pb, PB_FLAG_STROBE, 0);
 }
 
 /**
@@ -235,7 +338,7 @@ static inline int pb_cmd_strobe(struct pulseblaster *pb)
  */
 static inline int pb_cmd_transfer(struct pulseblaster *pb, unsigned int data)
 {
-	return pb_writeb(pb, PB_DATA_TRANSFER, data);
+	return pb_cmd(pb, PB_DATA_TRANSFER, data);
 }
 
 /**
@@ -245,7 +348,7 @@ static inline int pb_cmd_transfer(struct pulseblaster *pb, unsigned int data)
  */
 static inline int pb_cmd_finished(struct pulseblaster *pb)
 {
-	return pb_writeb(pb, PB_PROGRAMMING_FINISHED, 0);
+	return pb_cmd(pb, PB_PROGRAMMING_FINISHED, 0);
 }
 
 /*****************************************************************************
@@ -277,6 +380,27 @@ static int pb_write_enable(struct pulseblaster *pb)
 	if (rc)
 		return rc;
 	pb->offset = 0;
+	pb->programming = 1;
+	pb->image_len = 0;
+	pb->image_crc = ~0;
+
+	return 0;
+}
+
+/**
+ * Finish programming
+ *
+ * @pb:			Pulseblaster device
+ */
+static int pb_write_disable(struct pulseblaster *pb)
+{
+	int rc;
+
+	rc = pb_cmd_finished(pb);
+	if (rc)
+		return rc;
+	pb->offset = 0;
+	pb->programming = 0;
 
 	return 0;
 }
@@ -290,15 +414,14 @@ static int pb_arm(struct pulseblaster *pb)
 {
 	int rc;
 
-	if (pb->offset == 0) {
+	if (!pb->programming) {
 		rc = pb_write_enable(pb);
 		if (rc)
 			return rc;
 	}
-	rc = pb_cmd_finished(pb);
+	rc = pb_write_disable(pb);
 	if (rc)
 		return rc;
-	pb->offset = 0;
 
 	return 0;
 }
@@ -312,11 +435,10 @@ static int pb_continue(struct pulseblaster *pb)
 {
 	int rc;
 
-        if (pb->offset != 0) {
-                rc = pb_cmd_finished(pb);
+        if (pb->programming) {
+                rc = pb_write_disable(pb);
                	if (rc)
                         return rc;
-                pb->offset = 0;
        	}
 	rc = pb_cmd_start(pb);
 	if (rc)
@@ -353,11 +475,10 @@ static int pb_stop(struct pulseblaster *pb)
 {
 	int rc;
 
-	if (pb->offset != 0) {
-		rc = pb_cmd_finished(pb);
+	if (pb->programming) {
+		rc = pb_write_disable(pb);
 		if (rc)
 			return rc;
-		pb->offset = 0;
 	}
 	rc = pb_cmd_stop(pb);
 	if (rc)
@@ -366,6 +487,40 @@ static int pb_stop(struct pulseblaster *pb)
 	return 0;
 }
 
+/**
+ * Stop and re-arm program
+ *
+ * @pb:			Pulseblaster device
+ */
+static int pb_stop_arm(struct pulseblaster *pb)
+{
+	int rc;
+
+	rc = pb_stop(pb);
+	if (rc)
+		return rc;
+	rc = pb_arm(pb);
+	if (rc)
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Invalidate shadow copy of program memory
+ *
+ * @pb:			Pulseblaster device
+ *
+ * This must be called whenever the contents of the program memory
+ * can no longer be known.
+ */
+static void pb_shadow_invalidate(struct pulseblaster *pb)
+{
+	pb->shadow_len = 0;
+	pb->image_len = 0;
+	pb->image_crc = ~0;
+}
+
 /**
  * Program device
  *
@@ -379,21 +534,358 @@ static int pb_program(struct pulseblaster *pb, char *buf, loff_t off,
 {
 	int rc;
 
+	trace_pb_program_enter(pb, off, len);
 	if (off == 0) {
 		rc = pb_write_enable(pb);
 		if (rc)
-			return rc;
+			goto err;
 	}
 	if (off != pb->offset) {
 		printk(KERN_ERR "%s: cannot perform out-of-order write to "
 		       "0x%llx while at 0x%llx\n", pb->name, off, pb->offset);
-		return -ENOTSUPP;
+		rc = -ENOTSUPP;
+		goto err;
 	}
 	for (; len ; len--, buf++, pb->offset++) {
 		rc = pb_cmd_transfer(pb, *buf);
+		if (rc) {
+			pb_shadow_invalidate(pb);
+			goto err;
+		}
+		pb->programmed++;
+		if ((pb->offset < PB_MAX_SIZE) &&
+		    (pb->offset <= pb->shadow_len)) {
+			pb->shadow[pb->offset] = *buf;
+			if (pb->shadow_len <= pb->offset)
+				pb->shadow_len = (pb->offset + 1);
+		} else {
+			pb_shadow_invalidate(pb);
+		}
+	}
+	if (pb->offset <= pb->shadow_len) {
+		pb->image_crc = crc32_le(pb->image_crc,
+					 (pb->shadow + off),
+					 (pb->offset - off));
+		pb->image_len = pb->offset;
+	}
+	rc = 0;
+
+ err:
+	trace_pb_program_exit(pb, pb->offset, rc);
+	return rc;
+}
+
+/**
+ * Program device with the start of a program image
+ *
+ * @pb:			Pulseblaster device
+ * @image:		Program image
+ * @len:		Length of data to program
+ * @cancel:		Cancellation flag, or NULL if not cancellable
+ * @progress:		Progress counter, or NULL if not reported
+ *
+ * The data is programmed in chunks, updating the progress counter and
+ * checking for cancellation in between.  Programming zero bytes just
+ * prepares the device for programming.
+ */
+static int pb_program_image(struct pulseblaster *pb, char *image, size_t len,
+			    const int *cancel, size_t *progress)
+{
+	size_t frag_len;
+	loff_t off;
+	int rc;
+
+	if (!len)
+		return pb_write_enable(pb);
+
+	for (off = 0 ; off < len ; off += frag_len) {
+		if (cancel && ACCESS_ONCE(*cancel)) {
+			pb_shadow_invalidate(pb);
+			return -ECANCELED;
+		}
+		frag_len = min_t(size_t, (len - off), PB_PROGRESS_CHUNK);
+		rc = pb_program(pb, (image + off), off, frag_len);
+		if (rc)
+			return rc;
+		if (progress)
+			*progress = (off + frag_len);
+	}
+
+	return 0;
+}
+
+/**
+ * Find end of changed part of program image
+ *
+ * @pb:			Pulseblaster device
+ * @image:		Program image
+ * @len:		Length of program image
+ *
+ * Returns the offset just beyond the highest instruction word that
+ * differs from the shadow copy of the program memory (or zero if
+ * there are no differences).  The calculation is shared with the
+ * emulator in pb_utils, which tests it.
+ */
+static size_t pb_changed_len(struct pulseblaster *pb, const char *image,
+			     size_t len)
+{
+	return pb_shadow_changed_len((const unsigned char *)image, len,
+				     (const unsigned char *)pb->shadow,
+				     pb->shadow_len, PB_WORDSIZE);
+}
+
+/**
+ * Load complete program image
+ *
+ * @pb:			Pulseblaster device
+ * @image:		Program image
+ * @len:		Length of program image
+ * @cancel:		Cancellation flag, or NULL if not cancellable
+ * @progress:		Progress counter, or NULL if not reported
+ *
+ * The program memory can only be written sequentially from address
+ * zero, since the address counter can be cleared but not set.  An
+ * unchanged prefix must therefore still be rewritten, but an
+ * unchanged tail can be left alone: the memory beyond the highest
+ * changed word already holds the correct contents, exactly as if the
+ * whole image had been reprogrammed.  If nothing has changed, the
+ * program memory is left untouched, and the device is merely left in
+ * the same state as if it had been reprogrammed.
+ */
+static int pb_load(struct pulseblaster *pb, char *image, size_t len,
+		   const int *cancel, size_t *progress)
+{
+	size_t changed_len;
+	u32 crc;
+	int rc;
+
+	if (progress)
+		*progress = 0;
+
+	/* Reprogram everything if the shadow copy is disabled */
+	if (!(shadow && len)) {
+		rc = pb_program_image(pb, image, len, cancel, progress);
 		if (rc)
 			return rc;
+		if (progress)
+			*progress = len;
+		return 0;
+	}
+
+	/* Reprogram only as far as the highest changed word */
+	crc = crc32_le(~0, image, len);
+	changed_len = pb_changed_len(pb, image, len);
+	rc = pb_program_image(pb, image, changed_len, cancel, progress);
+	if (rc) {
+		pb_shadow_invalidate(pb);
+		return rc;
+	}
+	pb->image_len = len;
+	pb->image_crc = crc;
+	pb->saved += (len - changed_len);
+	if (!changed_len)
+		pb->skips++;
+	if (progress)
+		*progress = len;
+
+	return 0;
+}
+
+/**
+ * Load complete program image, without cancellation
+ *
+ * @pb:			Pulseblaster device
+ * @image:		Program image
+ * @len:		Length of program image
+ */
+static int pb_load_image(struct pulseblaster *pb, char *image, size_t len)
+{
+	return pb_load(pb, image, len, NULL, NULL);
+}
+
+/**
+ * Stop and re-arm program, then continue it
+ *
+ * @pb:			Pulseblaster device
+ */
+static int pb_stop_arm_continue(struct pulseblaster *pb)
+{
+	int rc;
+
+	rc = pb_stop_arm(pb);
+	if (rc)
+		return rc;
+	rc = pb_continue(pb);
+	if (rc)
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Stop program, load new program image, and arm it
+ *
+ * @pb:			Pulseblaster device
+ * @image:		Program image
+ * @len:		Length of program image
+ */
+static int pb_stop_program_arm(struct pulseblaster *pb, char *image,
+			       size_t len)
+{
+	int rc;
+
+	rc = pb_stop(pb);
+	if (rc)
+		return rc;
+	rc = pb_load(pb, image, len, NULL, NULL);
+	if (rc)
+		return rc;
+	rc = pb_arm(pb);
+	if (rc)
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Load new program image, and start it
+ *
+ * @pb:			Pulseblaster device
+ * @image:		Program image
+ * @len:		Length of program image
+ */
+static int pb_program_start(struct pulseblaster *pb, char *image,
+			    size_t len)
+{
+	int rc;
+
+	rc = pb_load(pb, image, len, NULL, NULL);
+	if (rc)
+		return rc;
+	rc = pb_start(pb);
+	if (rc)
+		return rc;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *
+ * Device groups
+ *
+ *****************************************************************************
+ *
+ * Several cards may be enrolled into a group, which can then be
+ * started (or continued) together.  All the preparation that might
+ * sleep is done first; the start register writes are then issued
+ * back to back, with interrupts disabled, to minimise the skew
+ * between the cards.
+ *
+ */
+
+/** Enrolled devices */
+static LIST_HEAD(pb_group);
+
+/** Device group lock */
+static DEFINE_MUTEX(pb_group_mutex);
+
+/** Spread of start register write completion times in last group start */
+static s64 pb_group_skew;
+
+/**
+ * Enrol device into group, or remove it from group
+ *
+ * @pb:			Pulseblaster device
+ * @enrol:		Device should be enrolled
+ */
+static void pb_group_enrol(struct pulseblaster *pb, int enrol)
+{
+	mutex_lock(&pb_group_mutex);
+	if (enrol && !pb->grouped) {
+		list_add_tail(&pb->group, &pb_group);
+		pb->grouped = 1;
+	} else if (pb->grouped && !enrol) {
+		list_del(&pb->group);
+		pb->grouped = 0;
+	}
+	mutex_unlock(&pb_group_mutex);
+}
+
+/**
+ * Start or continue all devices in group
+ *
+ * @prepare:		Preparation to be carried out on each device
+ * @skew:		Spread of start register write completion times
+ *
+ * The caller must not hold any device semaphore.
+ */
+static int pb_group_start(int (*prepare)(struct pulseblaster *pb), s64 *skew)
+{
+	struct pulseblaster *pb;
+	struct pulseblaster *locked;
+	unsigned long flags;
+	ktime_t first;
+	ktime_t last;
+	int rc;
+
+	mutex_lock(&pb_group_mutex);
+
+	/* Lock and prepare each device in turn */
+	rc = 0;
+	list_for_each_entry(pb, &pb_group, group) {
+		rc = down_interruptible(&pb->sem);
+		if (rc)
+			break;
+		rc = prepare(pb);
+		if (rc) {
+			up(&pb->sem);
+			break;
+		}
+	}
+	if (rc) {
+		locked = pb;
+		list_for_each_entry(pb, &pb_group, group) {
+			if (pb == locked)
+				break;
+			up(&pb->sem);
+		}
+		goto err_prepare;
+	}
+
+	/* Issue start register writes back to back */
+	first = last = ktime_get();
+	local_irq_save(flags);
+	list_for_each_entry(pb, &pb_group, group) {
+		pb->atomic = 1;
+		rc = pb_cmd_start(pb);
+		pb->atomic = 0;
+		if (rc)
+			break;
+		last = ktime_get();
+		if (pb->group.prev == &pb_group)
+			first = last;
 	}
+	local_irq_restore(flags);
+	pb_group_skew = *skew = ktime_to_ns(ktime_sub(last, first));
+
+	/* Unlock devices */
+	list_for_each_entry(pb, &pb_group, group)
+		up(&pb->sem);
+
+ err_prepare:
+	mutex_unlock(&pb_group_mutex);
+	return rc;
+}
+
+/**
+ * Prepare device for group continue
+ *
+ * @pb:			Pulseblaster device
+ */
+static int pb_group_prepare_continue(struct pulseblaster *pb)
+{
+	if (pb->programming)
+		return pb_write_disable(pb);
 	return 0;
 }
 
@@ -511,63 +1003,257 @@ static ssize_t pb_attr_type_read(struct device *dev,
 }
 
 /**
- * Write to start attribute
+ * Read from spins attribute
  *
  * @dev:		Device
  * @attr:		Attribute
  * @buf:		Data buffer
- * @len:		Length of data buffer
  */
-static ssize_t pb_attr_start_write(struct device *dev,
-				   struct device_attribute *attr,
-				   const char *buf, size_t len)
+static ssize_t pb_attr_spins_read(struct device *dev,
+				  struct device_attribute *attr __maybe_unused,
+				  char *buf)
 {
-	return pb_attr_button_write(dev, attr, buf, len, pb_start);
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%ld\n", atomic_long_read(&pb->spins));
 }
 
 /**
- * Write to stop attribute
+ * Read from sleeps attribute
  *
  * @dev:		Device
  * @attr:		Attribute
  * @buf:		Data buffer
- * @len:		Length of data buffer
  */
-static ssize_t pb_attr_stop_write(struct device *dev,
-				  struct device_attribute *attr,
-				  const char *buf, size_t len)
+static ssize_t pb_attr_sleeps_read(struct device *dev,
+				   struct device_attribute *attr __maybe_unused,
+				   char *buf)
 {
-	return pb_attr_button_write(dev, attr, buf, len, pb_stop);
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%ld\n", atomic_long_read(&pb->sleeps));
 }
 
 /**
- * Write to arm attribute
+ * Read from retries attribute
  *
  * @dev:		Device
  * @attr:		Attribute
  * @buf:		Data buffer
- * @len:		Length of data buffer
  */
-static ssize_t pb_attr_arm_write(struct device *dev,
-				 struct device_attribute *attr,
-				 const char *buf, size_t len)
+static ssize_t pb_attr_retries_read(struct device *dev,
+				    struct device_attribute *attr __maybe_unused,
+				    char *buf)
 {
-	return pb_attr_button_write(dev, attr, buf, len, pb_arm);
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%ld\n", atomic_long_read(&pb->retries));
 }
 
 /**
- * Write to continue attribute
+ * Read from timeouts attribute
  *
  * @dev:		Device
  * @attr:		Attribute
  * @buf:		Data buffer
- * @len:		Length of data buffer
  */
-static ssize_t pb_attr_continue_write(struct device *dev,
-				 struct device_attribute *attr,
-				 const char *buf, size_t len)
+static ssize_t pb_attr_timeouts_read(struct device *dev,
+				     struct device_attribute *attr __maybe_unused,
+				     char *buf)
 {
-	return pb_attr_button_write(dev, attr, buf, len, pb_continue);
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%ld\n", atomic_long_read(&pb->timeouts));
+}
+
+/**
+ * Read from programmed attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ */
+static ssize_t pb_attr_programmed_read(struct device *dev,
+				       struct device_attribute *attr __maybe_unused,
+				       char *buf)
+{
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lu\n", pb->programmed);
+}
+
+/**
+ * Read from skips attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ */
+static ssize_t pb_attr_skips_read(struct device *dev,
+				  struct device_attribute *attr __maybe_unused,
+				  char *buf)
+{
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lu\n", pb->skips);
+}
+
+/**
+ * Read from saved attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ */
+static ssize_t pb_attr_saved_read(struct device *dev,
+				  struct device_attribute *attr __maybe_unused,
+				  char *buf)
+{
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lu\n", pb->saved);
+}
+
+/**
+ * Read from checksum attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ */
+static ssize_t pb_attr_checksum_read(struct device *dev,
+				     struct device_attribute *attr
+					__maybe_unused,
+				     char *buf)
+{
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+	ssize_t len;
+	int rc;
+
+	rc = down_interruptible(&pb->sem);
+	if (rc)
+		return rc;
+	len = sprintf(buf, "%08x %zd\n", (pb->image_crc ^ ~0),
+		      pb->image_len);
+	up(&pb->sem);
+
+	return len;
+}
+
+/**
+ * Read from group attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ */
+static ssize_t pb_attr_group_read(struct device *dev,
+				  struct device_attribute *attr __maybe_unused,
+				  char *buf)
+{
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", pb->grouped);
+}
+
+/**
+ * Write to group attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ * @len:		Length of data buffer
+ */
+static ssize_t pb_attr_group_write(struct device *dev,
+				   struct device_attribute *attr
+					__maybe_unused,
+				   const char *buf, size_t len)
+{
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+	unsigned long val;
+	int rc;
+
+	rc = strict_strtoul(buf, 0, &val);
+	if (rc)
+		return rc;
+	pb_group_enrol(pb, (val != 0));
+
+	return len;
+}
+
+/**
+ * Read from group skew attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ */
+static ssize_t pb_attr_group_skew_read(struct device *dev __maybe_unused,
+				       struct device_attribute *attr
+					__maybe_unused,
+				       char *buf)
+{
+	return sprintf(buf, "%lld\n", pb_group_skew);
+}
+
+/**
+ * Write to start attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ * @len:		Length of data buffer
+ */
+static ssize_t pb_attr_start_write(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t len)
+{
+	return pb_attr_button_write(dev, attr, buf, len, pb_start);
+}
+
+/**
+ * Write to stop attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ * @len:		Length of data buffer
+ */
+static ssize_t pb_attr_stop_write(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t len)
+{
+	return pb_attr_button_write(dev, attr, buf, len, pb_stop);
+}
+
+/**
+ * Write to arm attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ * @len:		Length of data buffer
+ */
+static ssize_t pb_attr_arm_write(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t len)
+{
+	return pb_attr_button_write(dev, attr, buf, len, pb_arm);
+}
+
+/**
+ * Write to continue attribute
+ *
+ * @dev:		Device
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ * @len:		Length of data buffer
+ */
+static ssize_t pb_attr_continue_write(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t len)
+{
+	return pb_attr_button_write(dev, attr, buf, len, pb_continue);
 }
 
 /**
@@ -587,9 +1273,60 @@ static ssize_t pb_attr_program_write(struct file *filp, struct kobject *kobj,
 	return pb_attr_bin_write(filp, kobj, attr, buf, off, len, pb_program);
 }
 
+/**
+ * Read from loaded attribute
+ *
+ * @filp:		File
+ * @kobj:		Kernel object
+ * @attr:		Attribute
+ * @buf:		Data buffer
+ * @off:		Starting offset
+ * @len:		Length of data
+ *
+ * This returns the shadow copy of the most recently loaded program,
+ * without touching the hardware.
+ */
+static ssize_t pb_attr_loaded_read(struct file *filp __maybe_unused,
+				   struct kobject *kobj,
+				   struct bin_attribute *attr __maybe_unused,
+				   char *buf, loff_t off, size_t len)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct pulseblaster *pb = dev_get_drvdata(dev);
+	int rc;
+
+	/* Lock device */
+	rc = down_interruptible(&pb->sem);
+	if (rc)
+		return rc;
+
+	/* Copy out shadow */
+	if (off >= pb->image_len) {
+		len = 0;
+	} else {
+		len = min_t(size_t, len, (pb->image_len - off));
+		memcpy(buf, (pb->shadow + off), len);
+	}
+
+	/* Unlock device and return */
+	up(&pb->sem);
+	return len;
+}
+
 /** Pulseblaster simple attributes */
 static struct device_attribute pb_dev_attrs[] = {
 	__ATTR(type, S_IRUGO, pb_attr_type_read, NULL),
+	__ATTR(spins, S_IRUGO, pb_attr_spins_read, NULL),
+	__ATTR(sleeps, S_IRUGO, pb_attr_sleeps_read, NULL),
+	__ATTR(retries, S_IRUGO, pb_attr_retries_read, NULL),
+	__ATTR(timeouts, S_IRUGO, pb_attr_timeouts_read, NULL),
+	__ATTR(programmed, S_IRUGO, pb_attr_programmed_read, NULL),
+	__ATTR(skips, S_IRUGO, pb_attr_skips_read, NULL),
+	__ATTR(saved, S_IRUGO, pb_attr_saved_read, NULL),
+	__ATTR(checksum, S_IRUGO, pb_attr_checksum_read, NULL),
+	__ATTR(group, (S_IRUGO | S_IWUSR), pb_attr_group_read,
+	       pb_attr_group_write),
+	__ATTR(group_skew, S_IRUGO, pb_attr_group_skew_read, NULL),
 	__ATTR(start, S_IWUSR, NULL, pb_attr_start_write),
 	__ATTR(stop, S_IWUSR, NULL, pb_attr_stop_write),
 	__ATTR(arm, S_IWUSR, NULL, pb_attr_arm_write),
@@ -605,6 +1342,502 @@ static struct bin_attribute dev_attr_program = {
 	.write = pb_attr_program_write,
 };
 
+/** Pulseblaster loaded program attribute */
+static struct bin_attribute dev_attr_loaded = {
+	.attr = {
+		.name = "loaded",
+		.mode = S_IRUGO,
+	},
+	.size = PB_MAX_SIZE,
+	.read = pb_attr_loaded_read,
+};
+
+/*****************************************************************************
+ *
+ * Character device
+ *
+ *****************************************************************************
+ */
+
+/**
+ * Free device
+ *
+ * @refcnt:		Reference count
+ */
+static void pb_free(struct kref *refcnt)
+{
+	struct pulseblaster *pb =
+		container_of(refcnt, struct pulseblaster, refcnt);
+
+	vfree(pb->async_image);
+	vfree(pb->staging);
+	vfree(pb->shadow);
+	kfree(pb);
+}
+
+/**
+ * Open character device
+ *
+ * @inode:		Inode
+ * @file:		File
+ *
+ * The open file holds a reference to the device, which therefore
+ * outlives pb_remove() until the file is closed.
+ */
+static int pb_fop_open(struct inode *inode __maybe_unused, struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+	struct pulseblaster *pb = container_of(misc, struct pulseblaster, misc);
+
+	kref_get(&pb->refcnt);
+	file->private_data = pb;
+	return 0;
+}
+
+/**
+ * Close character device
+ *
+ * @inode:		Inode
+ * @file:		File
+ */
+static int pb_fop_release(struct inode *inode __maybe_unused,
+			  struct file *file)
+{
+	struct pulseblaster *pb = file->private_data;
+
+	kref_put(&pb->refcnt, pb_free);
+	return 0;
+}
+
+/**
+ * Write to character device
+ *
+ * @file:		File
+ * @data:		User data buffer
+ * @len:		Length of data
+ * @ppos:		Starting offset
+ *
+ * The whole write is handled under a single hold of the device
+ * semaphore, and is bounced through a page-sized kernel buffer.  A
+ * write() may be only part of the image (cat(1), for example, writes
+ * in 128kB chunks), so every byte is programmed: only a complete
+ * image, loaded via an ioctl() (PB_IOC_PROGRAM, for one which is just
+ * to be loaded), can skip an unchanged tail.
+ */
+static ssize_t pb_fop_write(struct file *file, const char __user *data,
+			    size_t len, loff_t *ppos)
+{
+	struct pulseblaster *pb = file->private_data;
+	size_t remaining = len;
+	size_t frag_len;
+	char *buf;
+	int rc;
+
+	/* Allocate bounce buffer */
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+
+	/* Lock device */
+	rc = down_interruptible(&pb->sem);
+	if (rc)
+		goto err_down;
+	if (pb->removed) {
+		rc = -ENODEV;
+		goto err_removed;
+	}
+
+	/* Program device */
+	for (; remaining ; remaining -= frag_len, data += frag_len) {
+		frag_len = min_t(size_t, remaining, PAGE_SIZE);
+		if (copy_from_user(buf, data, frag_len)) {
+			rc = -EFAULT;
+			goto err_copy;
+		}
+		rc = pb_program(pb, buf, *ppos, frag_len);
+		if (rc)
+			goto err_program;
+		*ppos += frag_len;
+	}
+
+	/* Unlock device and return */
+	up(&pb->sem);
+	kfree(buf);
+	return len;
+
+ err_program:
+ err_copy:
+ err_removed:
+	up(&pb->sem);
+ err_down:
+	kfree(buf);
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Load program image and control character device
+ *
+ * @pb:			Pulseblaster device
+ * @arg:		Argument
+ * @handle:		Command handler
+ *
+ * The program image is copied in and handled under a single hold of
+ * the device semaphore, so that nothing else can intervene between
+ * loading the program and (for example) arming it.
+ */
+static long pb_fop_ioctl_program(struct pulseblaster *pb, unsigned long arg,
+				 int (*handle)(struct pulseblaster *pb,
+					       char *image, size_t len))
+{
+	struct pb_ioc_program program;
+	int rc;
+
+	/* Get program descriptor */
+	if (copy_from_user(&program, (void __user *)arg, sizeof(program)))
+		return -EFAULT;
+	if (program.len > PB_MAX_SIZE)
+		return -EFBIG;
+
+	/* Lock device */
+	rc = down_interruptible(&pb->sem);
+	if (rc)
+		goto err_down;
+	if (pb->removed) {
+		rc = -ENODEV;
+		goto err_removed;
+	}
+
+	/* Copy in program image */
+	if (copy_from_user(pb->staging,
+			   (void __user *)(unsigned long)program.data,
+			   program.len)) {
+		rc = -EFAULT;
+		goto err_copy;
+	}
+
+	/* Handle command */
+	rc = handle(pb, pb->staging, program.len);
+
+ err_copy:
+ err_removed:
+	up(&pb->sem);
+ err_down:
+	return rc;
+}
+
+/**
+ * Program device asynchronously
+ *
+ * @work:		Work item
+ */
+static void pb_async_work(struct work_struct *work)
+{
+	struct pulseblaster *pb =
+		container_of(work, struct pulseblaster, async_work);
+	unsigned long flags;
+	int rc;
+
+	/* Program device */
+	down(&pb->sem);
+	if (pb->removed) {
+		rc = -ENODEV;
+	} else {
+		rc = pb_load(pb, pb->async_image, pb->async_len,
+			     &pb->cancel, &pb->async_progress);
+	}
+	up(&pb->sem);
+
+	/* Record completion and wake up any waiters */
+	spin_lock_irqsave(&pb->async_lock, flags);
+	pb->async_state = PB_ASYNC_DONE;
+	pb->async_rc = rc;
+	pb->cancel = 0;
+	spin_unlock_irqrestore(&pb->async_lock, flags);
+	wake_up_interruptible(&pb->async_wait);
+
+	/* Drop the reference held by the queued work */
+	kref_put(&pb->refcnt, pb_free);
+}
+
+/**
+ * Start asynchronous programming
+ *
+ * @pb:			Pulseblaster device
+ * @arg:		Argument
+ *
+ * The program image is copied in, and the transfer is queued; the
+ * caller is free to do other work meanwhile.  Completion can be
+ * detected by poll()ing the device for writing.
+ */
+static long pb_fop_ioctl_program_async(struct pulseblaster *pb,
+				       unsigned long arg)
+{
+	struct pb_ioc_program program;
+	unsigned long flags;
+	int rc;
+
+	/* Get program descriptor */
+	if (copy_from_user(&program, (void __user *)arg, sizeof(program)))
+		return -EFAULT;
+	if (program.len > PB_MAX_SIZE)
+		return -EFBIG;
+
+	/* Claim asynchronous programming */
+	spin_lock_irqsave(&pb->async_lock, flags);
+	if (pb->async_state == PB_ASYNC_BUSY) {
+		rc = -EBUSY;
+	} else {
+		pb->async_state = PB_ASYNC_BUSY;
+		pb->cancel = 0;
+		rc = 0;
+	}
+	spin_unlock_irqrestore(&pb->async_lock, flags);
+	if (rc)
+		return rc;
+
+	/* Copy in program image */
+	if (copy_from_user(pb->async_image,
+			   (void __user *)(unsigned long)program.data,
+			   program.len)) {
+		spin_lock_irqsave(&pb->async_lock, flags);
+		pb->async_state = PB_ASYNC_IDLE;
+		spin_unlock_irqrestore(&pb->async_lock, flags);
+		return -EFAULT;
+	}
+	pb->async_len = program.len;
+	pb->async_progress = 0;
+
+	/* Queue transfer, holding a reference until it has finished */
+	kref_get(&pb->refcnt);
+	queue_work(pb_wq, &pb->async_work);
+	return 0;
+}
+
+/**
+ * Get asynchronous programming status
+ *
+ * @pb:			Pulseblaster device
+ * @arg:		Argument
+ */
+static long pb_fop_ioctl_async_status(struct pulseblaster *pb,
+				      unsigned long arg)
+{
+	struct pb_ioc_async_status status;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pb->async_lock, flags);
+	status.state = pb->async_state;
+	status.rc = pb->async_rc;
+	spin_unlock_irqrestore(&pb->async_lock, flags);
+	status.progress = ACCESS_ONCE(pb->async_progress);
+	status.len = pb->async_len;
+
+	if (copy_to_user((void __user *)arg, &status, sizeof(status)))
+		return -EFAULT;
+	return 0;
+}
+
+/**
+ * Cancel asynchronous programming
+ *
+ * @pb:			Pulseblaster device
+ */
+static long pb_fop_ioctl_async_cancel(struct pulseblaster *pb)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pb->async_lock, flags);
+	if (pb->async_state == PB_ASYNC_BUSY)
+		pb->cancel = 1;
+	spin_unlock_irqrestore(&pb->async_lock, flags);
+
+	return 0;
+}
+
+/**
+ * Poll character device
+ *
+ * @file:		File
+ * @wait:		Poll table
+ *
+ * The device is writable once there is no asynchronous programming in
+ * progress.  (It is never readable, since there is no read().)
+ */
+static unsigned int pb_fop_poll(struct file *file, poll_table *wait)
+{
+	struct pulseblaster *pb = file->private_data;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(file, &pb->async_wait, wait);
+	spin_lock_irqsave(&pb->async_lock, flags);
+	if (pb->async_state != PB_ASYNC_BUSY)
+		mask |= (POLLOUT | POLLWRNORM);
+	spin_unlock_irqrestore(&pb->async_lock, flags);
+
+	return mask;
+}
+
+/**
+ * Start or continue device group
+ *
+ * @pb:			Pulseblaster device
+ * @arg:		Argument
+ * @prepare:		Preparation to be carried out on each device
+ */
+static long pb_fop_ioctl_group(struct pulseblaster *pb, unsigned long arg,
+			       int (*prepare)(struct pulseblaster *pb))
+{
+	struct pb_ioc_group_status status;
+	s64 skew;
+	int rc;
+
+	if (!pb->grouped)
+		return -EINVAL;
+	rc = pb_group_start(prepare, &skew);
+	if (rc)
+		return rc;
+	status.skew_ns = skew;
+	if (copy_to_user((void __user *)arg, &status, sizeof(status)))
+		return -EFAULT;
+	return 0;
+}
+
+/**
+ * Control character device
+ *
+ * @file:		File
+ * @cmd:		Command
+ * @arg:		Argument
+ */
+static long pb_fop_ioctl(struct file *file, unsigned int cmd,
+			 unsigned long arg)
+{
+	struct pulseblaster *pb = file->private_data;
+	int (*handle)(struct pulseblaster *pb);
+	int rc;
+
+	/* Identify command */
+	switch (cmd) {
+	case PB_IOC_START:
+		handle = pb_start;
+		break;
+	case PB_IOC_STOP:
+		handle = pb_stop;
+		break;
+	case PB_IOC_ARM:
+		handle = pb_arm;
+		break;
+	case PB_IOC_CONTINUE:
+		handle = pb_continue;
+		break;
+	case PB_IOC_STOP_ARM:
+		handle = pb_stop_arm;
+		break;
+	case PB_IOC_STOP_ARM_CONTINUE:
+		handle = pb_stop_arm_continue;
+		break;
+	case PB_IOC_PROGRAM:
+		return pb_fop_ioctl_program(pb, arg, pb_load_image);
+	case PB_IOC_STOP_PROGRAM_ARM:
+		return pb_fop_ioctl_program(pb, arg, pb_stop_program_arm);
+	case PB_IOC_PROGRAM_START:
+		return pb_fop_ioctl_program(pb, arg, pb_program_start);
+	case PB_IOC_PROGRAM_ASYNC:
+		return pb_fop_ioctl_program_async(pb, arg);
+	case PB_IOC_ASYNC_STATUS:
+		return pb_fop_ioctl_async_status(pb, arg);
+	case PB_IOC_ASYNC_CANCEL:
+		return pb_fop_ioctl_async_cancel(pb);
+	case PB_IOC_GROUP_START:
+		return pb_fop_ioctl_group(pb, arg, pb_arm);
+	case PB_IOC_GROUP_CONTINUE:
+		return pb_fop_ioctl_group(pb, arg,
+					  pb_group_prepare_continue);
+	default:
+		return -ENOTTY;
+	}
+
+	/* Lock device */
+	rc = down_interruptible(&pb->sem);
+	if (rc)
+		return rc;
+
+	/* Handle command */
+	rc = (pb->removed ? -ENODEV : handle(pb));
+
+	/* Unlock device and return */
+	up(&pb->sem);
+	return rc;
+}
+
+/** Pulseblaster character device operations */
+static const struct file_operations pb_fops = {
+	.owner		= THIS_MODULE,
+	.open		= pb_fop_open,
+	.release	= pb_fop_release,
+	.write		= pb_fop_write,
+	.poll		= pb_fop_poll,
+	.unlocked_ioctl	= pb_fop_ioctl,
+	.compat_ioctl	= pb_fop_ioctl,
+	.llseek		= default_llseek,
+};
+
+/*****************************************************************************
+ *
+ * Debugfs
+ *
+ *****************************************************************************
+ */
+
+/**
+ * Show command latency histograms
+ *
+ * @seq:		Sequence file
+ * @unused:		Unused
+ *
+ * Bucket N counts commands which took between 2^N and 2^(N+1)
+ * nanoseconds.
+ */
+static int pb_latency_show(struct seq_file *seq, void *unused __maybe_unused)
+{
+	struct pulseblaster *pb = seq->private;
+	unsigned int address;
+	unsigned int bucket;
+
+	for (address = 0 ; address < PB_NUM_REGISTERS ; address++) {
+		seq_printf(seq, "%-22s", pb_cmd_names[address]);
+		for (bucket = 0 ; bucket < PB_LATENCY_BUCKETS ; bucket++)
+			seq_printf(seq, " %lu", pb->latency[address][bucket]);
+		seq_putc(seq, '\n');
+	}
+
+	return 0;
+}
+
+/**
+ * Open command latency histograms
+ *
+ * @inode:		Inode
+ * @file:		File
+ */
+static int pb_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pb_latency_show, inode->i_private);
+}
+
+/** Command latency histogram operations */
+static const struct file_operations pb_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= pb_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 /*****************************************************************************
  *
  * Power management
@@ -629,6 +1862,8 @@ static int __maybe_unused pb_suspend(struct pci_dev *pci, pm_message_t state)
 
 	/* Reset state that will be destroyed by powering off */
 	pb->offset = 0;
+	pb->programming = 0;
+	pb_shadow_invalidate(pb);
 
 	return 0;
 }
@@ -698,9 +1933,22 @@ static int pb_probe(struct pci_dev *pci, const struct pci_device_id *id)
 		rc = -ENOMEM;
 		goto err_alloc;
 	}
+	kref_init(&pb->refcnt);
 	sema_init(&pb->sem, 1);
+	INIT_WORK(&pb->async_work, pb_async_work);
+	spin_lock_init(&pb->async_lock);
+	init_waitqueue_head(&pb->async_wait);
 	snprintf(pb->name, sizeof(pb->name), PB_NAME "%d", pbidx++);
 
+	/* Allocate shadow copy and staging buffer */
+	pb->shadow = vmalloc(PB_MAX_SIZE);
+	pb->staging = vmalloc(PB_MAX_SIZE);
+	pb->async_image = vmalloc(PB_MAX_SIZE);
+	if ((!pb->shadow) || (!pb->staging) || (!pb->async_image)) {
+		rc = -ENOMEM;
+		goto err_vmalloc;
+	}
+
 	/* Enable PCI device */
 	rc = pci_enable_device(pci);
 	if (rc)
@@ -732,6 +1980,27 @@ static int pb_probe(struct pci_dev *pci, const struct pci_device_id *id)
 	if (rc)
 		goto err_device_create_bin_file;
 
+	/* Create loaded program attribute */
+	rc = device_create_bin_file(pb->dev, &dev_attr_loaded);
+	if (rc)
+		goto err_device_create_bin_file_loaded;
+
+	/* Create character device */
+	pb->misc.minor = MISC_DYNAMIC_MINOR;
+	pb->misc.name = pb->name;
+	pb->misc.fops = &pb_fops;
+	pb->misc.parent = &pci->dev;
+	rc = misc_register(&pb->misc);
+	if (rc)
+		goto err_misc_register;
+
+	/* Create latency histogram file (failure is not fatal) */
+	if (pb_debugfs) {
+		pb->debugfs = debugfs_create_file(pb->name, S_IRUGO,
+						  pb_debugfs, pb,
+						  &pb_latency_fops);
+	}
+
 	/* Stop device, if autostop is enabled */
 	if (autostop) {
 		rc = pb_cmd_stop(pb);
@@ -743,6 +2012,11 @@ static int pb_probe(struct pci_dev *pci, const struct pci_device_id *id)
 	return 0;
 
  err_autostop:
+	debugfs_remove(pb->debugfs);
+	misc_deregister(&pb->misc);
+ err_misc_register:
+	device_remove_bin_file(pb->dev, &dev_attr_loaded);
+ err_device_create_bin_file_loaded:
 	device_remove_bin_file(pb->dev, &dev_attr_program);
  err_device_create_bin_file:
 	device_unregister(pb->dev);
@@ -752,6 +2026,10 @@ static int pb_probe(struct pci_dev *pci, const struct pci_device_id *id)
  err_request_regions:
 	pci_disable_device(pci);
  err_enable_device:
+ err_vmalloc:
+	vfree(pb->async_image);
+	vfree(pb->staging);
+	vfree(pb->shadow);
 	kfree(pb);
  err_alloc:
 	return rc;
@@ -766,11 +2044,31 @@ static void pb_remove(struct pci_dev *pci)
 {
 	struct pulseblaster *pb = pci_get_drvdata(pci);
 
+	unsigned long flags;
+
+	/* Prevent any new access */
+	pb_group_enrol(pb, 0);
+	misc_deregister(&pb->misc);
+	debugfs_remove(pb->debugfs);
+	device_remove_bin_file(pb->dev, &dev_attr_loaded);
 	device_remove_bin_file(pb->dev, &dev_attr_program);
 	device_unregister(pb->dev);
+
+	/* Abandon any asynchronous programming, and cut off files
+	 * which are still open
+	 */
+	spin_lock_irqsave(&pb->async_lock, flags);
+	if (pb->async_state == PB_ASYNC_BUSY)
+		pb->cancel = 1;
+	spin_unlock_irqrestore(&pb->async_lock, flags);
+	down(&pb->sem);
+	pb->removed = 1;
+	up(&pb->sem);
+	flush_work(&pb->async_work);
+
 	pci_release_regions(pci);
 	pci_disable_device(pci);
-	kfree(pb);
+	kref_put(&pb->refcnt, pb_free);
 }
 
 /*****************************************************************************
@@ -814,6 +2112,18 @@ static int __init pb_module_init(void)
 	}
 	pb_class->dev_attrs = pb_dev_attrs;
 
+	/* Create asynchronous programming workqueue */
+	pb_wq = alloc_workqueue(PB_NAME, WQ_UNBOUND, 0);
+	if (!pb_wq) {
+		rc = -ENOMEM;
+		goto err_alloc_workqueue;
+	}
+
+	/* Create debugfs directory (failure is not fatal) */
+	pb_debugfs = debugfs_create_dir(PB_NAME, NULL);
+	if (IS_ERR(pb_debugfs))
+		pb_debugfs = NULL;
+
 	/* Register PCI driver */
 	rc = pci_register_driver(&pb_pci_driver);
 	if (rc)
@@ -823,6 +2133,9 @@ static int __init pb_module_init(void)
 
 	pci_unregister_driver(&pb_pci_driver);
  err_pci_register_driver:
+	debugfs_remove(pb_debugfs);
+	destroy_workqueue(pb_wq);
+ err_alloc_workqueue:
 	class_destroy(pb_class);
  err_class_create:
 	return rc;
@@ -835,6 +2148,8 @@ static int __init pb_module_init(void)
 static void __exit pb_module_exit(void)
 {
 	pci_unregister_driver(&pb_pci_driver);
+	debugfs_remove(pb_debugfs);
+	destroy_workqueue(pb_wq);
 	class_destroy(pb_class);
 }
 
@@ -843,6 +2158,10 @@ module_exit(pb_module_exit);
 
 module_param(autostop, int, 0);
 MODULE_PARM_DESC(autostop, "Automatically stop device on module load");
+module_param(spin_budget, uint, 0644);
+MODULE_PARM_DESC(spin_budget, "Busy-wait budget (in us) before sleeping");
+module_param(shadow, int, 0644);
+MODULE_PARM_DESC(shadow, "Skip reprogramming of the unchanged part of a program");
 
 MODULE_AUTHOR("Michael Brown <mbrown@fensystems.co.uk>");
 MODULE_DESCRIPTION("SpinCore PulseBlaster driver");
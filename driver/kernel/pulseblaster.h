@@ -20,6 +20,15 @@
 #ifndef _PULSEBLASTER_H
 #define _PULSEBLASTER_H
 
+#include <linux/types.h>
+#include <linux/miscdevice.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/atomic.h>
+#include <linux/kref.h>
+
 /** Pulseblaster register addresses */
 enum pulseblaster_register {
 	PB_DEVICE_RESET = 0x0,
@@ -32,9 +41,24 @@ enum pulseblaster_register {
 	PB_PROGRAMMING_FINISHED = 0x7,
 };
 
+/** Number of Pulseblaster registers */
+#define PB_NUM_REGISTERS 8
+
+/** Number of (log2 nanosecond) command latency histogram buckets */
+#define PB_LATENCY_BUCKETS 32
+
 /** Pulseblaster instruction word size */
 #define PB_WORDSIZE 10
 
+/** Maximum number of instruction words */
+#define PB_MAX_WORDS 32768
+
+/** Maximum program size */
+#define PB_MAX_SIZE ( PB_MAX_WORDS * PB_WORDSIZE )
+
+/** Programming chunk size, between progress updates */
+#define PB_PROGRESS_CHUNK ( 64 * PB_WORDSIZE )
+
 /** Pulseblaster devices */
 enum pulseblaster_device {
 	PB_PROGRAM_MEMORY = 0x00,
@@ -72,10 +96,72 @@ struct pulseblaster {
 	struct pulseblaster_type *type;
 	/** Class device */
 	struct device *dev;
+	/** Character device */
+	struct miscdevice misc;
+	/** Reference count (held by the PCI device, open files and
+	 * queued asynchronous programming) */
+	struct kref refcnt;
 	/** Device access semaphore */
 	struct semaphore sem;
+	/** Device has been removed */
+	int removed;
 	/** Programming address counter */
 	loff_t offset;
+	/** Programming is in progress */
+	int programming;
+	/** Shadow copy of program memory */
+	char *shadow;
+	/** Length of valid data in shadow copy */
+	size_t shadow_len;
+	/** Length of most recently loaded program image */
+	size_t image_len;
+	/** CRC32 of most recently loaded program image */
+	u32 image_crc;
+	/** Staging buffer for complete program images */
+	char *staging;
+	/** Number of times reprogramming was skipped */
+	unsigned long skips;
+	/** Number of bytes not reprogrammed since they were unchanged */
+	unsigned long saved;
+	/** Asynchronous programming work */
+	struct work_struct async_work;
+	/** Asynchronous programming image */
+	char *async_image;
+	/** Length of asynchronous programming image */
+	size_t async_len;
+	/** Progress of current (or most recent) asynchronous program
+	 * load (never updated by any other load) */
+	size_t async_progress;
+	/** Asynchronous programming state lock */
+	spinlock_t async_lock;
+	/** Asynchronous programming state */
+	int async_state;
+	/** Asynchronous programming result */
+	int async_rc;
+	/** Cancellation of asynchronous programming requested */
+	int cancel;
+	/** Asynchronous programming completion wait queue */
+	wait_queue_head_t async_wait;
+	/** Device group list */
+	struct list_head group;
+	/** Device is enrolled in the device group */
+	int grouped;
+	/** Device may not sleep while waiting for the bridge */
+	int atomic;
+	/** Number of busy-wait polls spent waiting for the bridge */
+	atomic_long_t spins;
+	/** Number of sleeps spent waiting for the bridge */
+	atomic_long_t sleeps;
+	/** Number of sleeping retries needed to reach a bridge state */
+	atomic_long_t retries;
+	/** Number of times the bridge got stuck */
+	atomic_long_t timeouts;
+	/** Number of bytes transferred to program memory */
+	unsigned long programmed;
+	/** Command latency histograms, by register */
+	unsigned long latency[PB_NUM_REGISTERS][PB_LATENCY_BUCKETS];
+	/** Debugfs latency file */
+	struct dentry *debugfs;
 };
 
 /**
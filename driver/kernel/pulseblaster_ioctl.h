@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2013 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef _PULSEBLASTER_IOCTL_H
+#define _PULSEBLASTER_IOCTL_H
+
+/*
+ * Character device interface
+ *
+ * Each card is also exposed as /dev/pulseblasterN.  A program is
+ * loaded by writing the whole image (at offset zero) to the device,
+ * or with PB_IOC_PROGRAM, which can skip the unchanged part of the
+ * image since it is given the whole of it at once; the remaining
+ * controls are ioctls, so that a long-lived process can do everything
+ * through a single file descriptor.
+ *
+ * The compound commands (stop+program+arm, program+start and
+ * stop+arm+continue) are each carried out under a single hold of the
+ * device lock, so the gap between loading a program and arming or
+ * starting it is as short as the hardware allows.
+ *
+ * This header is shared with userspace.
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/** Pulseblaster ioctl magic number */
+#define PB_IOC_MAGIC 0xb5
+
+/** Start program (implicitly arming it first) */
+#define PB_IOC_START		_IO(PB_IOC_MAGIC, 0x01)
+/** Stop program */
+#define PB_IOC_STOP		_IO(PB_IOC_MAGIC, 0x02)
+/** Arm program, ready for a hardware trigger */
+#define PB_IOC_ARM		_IO(PB_IOC_MAGIC, 0x03)
+/** Continue program (from a WAIT, or once armed) */
+#define PB_IOC_CONTINUE		_IO(PB_IOC_MAGIC, 0x04)
+/** Stop program, then re-arm it */
+#define PB_IOC_STOP_ARM		_IO(PB_IOC_MAGIC, 0x05)
+/** Stop program, re-arm it, then continue it */
+#define PB_IOC_STOP_ARM_CONTINUE _IO(PB_IOC_MAGIC, 0x06)
+
+/** A program image, for the compound programming commands */
+struct pb_ioc_program {
+	/** Address of program image (a userspace pointer) */
+	__u64 data;
+	/** Length of program image */
+	__u64 len;
+};
+
+/** Load a new program image (reprogramming only as far as it has changed) */
+#define PB_IOC_PROGRAM		_IOW(PB_IOC_MAGIC, 0x0e, struct pb_ioc_program)
+/** Stop program, load a new program image, and arm it */
+#define PB_IOC_STOP_PROGRAM_ARM	_IOW(PB_IOC_MAGIC, 0x07, struct pb_ioc_program)
+/** Load a new program image, and start it */
+#define PB_IOC_PROGRAM_START	_IOW(PB_IOC_MAGIC, 0x08, struct pb_ioc_program)
+
+/*
+ * Asynchronous programming
+ *
+ * PB_IOC_PROGRAM_ASYNC copies in the program image and returns
+ * immediately, while the transfer continues in the background.  The
+ * device polls as writable (POLLOUT), ready for the next program, once
+ * the transfer has finished (or been cancelled); PB_IOC_ASYNC_STATUS
+ * then gives the result.  There is nothing to read from the device.
+ */
+
+/** Asynchronous programming states */
+enum pb_async_state {
+	/** No asynchronous programming has been requested */
+	PB_ASYNC_IDLE = 0,
+	/** Asynchronous programming is in progress */
+	PB_ASYNC_BUSY = 1,
+	/** Asynchronous programming has finished */
+	PB_ASYNC_DONE = 2,
+};
+
+/** Asynchronous programming status */
+struct pb_ioc_async_status {
+	/** Number of bytes loaded so far (by this asynchronous load
+	 * only: other loads meanwhile do not count) */
+	__u64 progress;
+	/** Length of program image */
+	__u64 len;
+	/** State (enum pb_async_state) */
+	__s32 state;
+	/** Result, once finished (zero or a negative errno) */
+	__s32 rc;
+};
+
+/** Start loading a new program image in the background */
+#define PB_IOC_PROGRAM_ASYNC	_IOW(PB_IOC_MAGIC, 0x09, struct pb_ioc_program)
+/** Get asynchronous programming status */
+#define PB_IOC_ASYNC_STATUS	_IOR(PB_IOC_MAGIC, 0x0a, struct pb_ioc_async_status)
+/** Cancel asynchronous programming */
+#define PB_IOC_ASYNC_CANCEL	_IO(PB_IOC_MAGIC, 0x0b)
+
+/*
+ * Device groups
+ *
+ * Cards are enrolled into the group by writing 1 to their "group"
+ * sysfs attribute.  PB_IOC_GROUP_START (or PB_IOC_GROUP_CONTINUE), on
+ * the fd of any enrolled card, then starts (or continues) all enrolled
+ * cards together, with the start register writes issued back to back
+ * with interrupts disabled.
+ */
+
+/** Device group start status */
+struct pb_ioc_group_status {
+	/** Spread of start register write completion times (in ns) */
+	__s64 skew_ns;
+};
+
+/** Start all cards in the device group */
+#define PB_IOC_GROUP_START	_IOR(PB_IOC_MAGIC, 0x0c, struct pb_ioc_group_status)
+/** Continue all cards in the device group */
+#define PB_IOC_GROUP_CONTINUE	_IOR(PB_IOC_MAGIC, 0x0d, struct pb_ioc_group_status)
+
+#endif /* _PULSEBLASTER_IOCTL_H */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef _PULSEBLASTER_SHADOW_H
+#define _PULSEBLASTER_SHADOW_H
+
+/*
+ * Truncated reprogramming
+ *
+ * When a whole image is loaded, the driver reprograms only as far as
+ * the highest instruction word that differs from its shadow copy of
+ * the program memory.
+ *
+ * This header is shared with userspace: the emulator in pb_utils
+ * uses the same code, so that its tests check the driver's own
+ * calculation.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#endif
+
+/**
+ * Find end of changed part of program image
+ *
+ * @image:		Program image
+ * @len:		Length of program image
+ * @shadow:		Shadow copy of program memory
+ * @shadow_len:		Length of valid data in shadow copy
+ * @wordsize:		Instruction word size
+ *
+ * Returns the offset just beyond the highest instruction word that
+ * differs from the shadow copy (or zero if there are no differences).
+ * Anything beyond the shadow copy is unknown, and so changed.
+ */
+static inline size_t pb_shadow_changed_len(const unsigned char *image,
+					   size_t len,
+					   const unsigned char *shadow,
+					   size_t shadow_len,
+					   size_t wordsize)
+{
+	size_t end = len;
+
+	/* Anything beyond the shadow copy is unknown, and so changed */
+	if (shadow_len < len)
+		return len;
+
+	/* Scan backwards for the highest changed byte */
+	while (end && (image[end - 1] == shadow[end - 1]))
+		end--;
+
+	/* Round up to a whole instruction word */
+	end = (((end + wordsize - 1) / wordsize) * wordsize);
+	return ((end < len) ? end : len);
+}
+
+#endif /* _PULSEBLASTER_SHADOW_H */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2013 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pulseblaster
+
+#if !defined(_PULSEBLASTER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PULSEBLASTER_TRACE_H
+
+#include <linux/tracepoint.h>
+#include "pulseblaster.h"
+
+/** A command primitive has been issued */
+TRACE_EVENT(pb_cmd,
+	TP_PROTO(struct pulseblaster *pb, unsigned int address,
+		 unsigned int data, int rc, s64 ns),
+	TP_ARGS(pb, address, data, rc, ns),
+	TP_STRUCT__entry(
+		__string(name, pb->name)
+		__field(unsigned int, address)
+		__field(unsigned int, data)
+		__field(int, rc)
+		__field(s64, ns)
+	),
+	TP_fast_assign(
+		__assign_str(name, pb->name);
+		__entry->address = address;
+		__entry->data = data;
+		__entry->rc = rc;
+		__entry->ns = ns;
+	),
+	TP_printk("%s: register 0x%x data 0x%02x rc %d in %lld ns",
+		  __get_str(name), __entry->address, __entry->data,
+		  __entry->rc, __entry->ns)
+);
+
+/** The bridge needed sleeping retries to reach a state */
+TRACE_EVENT(pb_bridge_retry,
+	TP_PROTO(struct pulseblaster *pb, unsigned int state,
+		 unsigned int retries),
+	TP_ARGS(pb, state, retries),
+	TP_STRUCT__entry(
+		__string(name, pb->name)
+		__field(unsigned int, state)
+		__field(unsigned int, retries)
+	),
+	TP_fast_assign(
+		__assign_str(name, pb->name);
+		__entry->state = state;
+		__entry->retries = retries;
+	),
+	TP_printk("%s: needed %d retries to reach state 0x%02x",
+		  __get_str(name), __entry->retries, __entry->state)
+);
+
+/** Programming has started */
+TRACE_EVENT(pb_program_enter,
+	TP_PROTO(struct pulseblaster *pb, loff_t off, size_t len),
+	TP_ARGS(pb, off, len),
+	TP_STRUCT__entry(
+		__string(name, pb->name)
+		__field(loff_t, off)
+		__field(size_t, len)
+	),
+	TP_fast_assign(
+		__assign_str(name, pb->name);
+		__entry->off = off;
+		__entry->len = len;
+	),
+	TP_printk("%s: programming 0x%zx bytes at 0x%llx",
+		  __get_str(name), __entry->len, __entry->off)
+);
+
+/** Programming has finished */
+TRACE_EVENT(pb_program_exit,
+	TP_PROTO(struct pulseblaster *pb, loff_t off, int rc),
+	TP_ARGS(pb, off, rc),
+	TP_STRUCT__entry(
+		__string(name, pb->name)
+		__field(loff_t, off)
+		__field(int, rc)
+	),
+	TP_fast_assign(
+		__assign_str(name, pb->name);
+		__entry->off = off;
+		__entry->rc = rc;
+	),
+	TP_printk("%s: programmed up to 0x%llx rc %d",
+		  __get_str(name), __entry->off, __entry->rc)
+);
+
+#endif /* _PULSEBLASTER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pulseblaster_trace
+#include <trace/define_trace.h>
@@ -66,6 +66,8 @@ $SCREAM=false;						//break the 'silence' operator '@'.
 $FATAL_ERROR_DEBUG_IMMORTAL=false;			//make fatal errors non-fatal. only use this for development.
 $HEADER_BINARY="pb_print_config";			//Many definitions for the hardware are in pulseblaster.h (part of pb_utils). This information is transferred via pb_print_config.
 $HEADER_BINARY_DEVEL="../../pb_utils/src/$HEADER_BINARY"; //In development tree. 
+$SIMULATOR="pb_sim";					//Native simulator (part of pb_utils). A full simulation with nothing interactive (just -g/-G/-u) is handed to it.
+$SIMULATOR_DEVEL="../../pb_utils/src/$SIMULATOR";	//In development tree.
 $ASSEMBLER="pb_asm";					//Assembler.
 $PROGRAMMER="pb_prog";					//Programmer/Assembler.
 $SOURCE_EXTN="pbsrc";					//Extension of input file (PulseBlasterSouRCe). We don't really need to require this, but insist for tidiness and error-proofing.
@@ -73,6 +75,8 @@ $OUTPUT_EXTN="vliw";					//Extension of output file (VeryLongInstructionWord).
 $BINARY_EXTN="bin";					//Extension for binary file (for pb_asm)
 $PBSIM_EXTN="pbsim";					//Extension for log file (for target-device simulation)
 $VCD_EXTN="vcd";					//Extension for vcd file (for waveform viewer)
+$CACHE_VERSION="pb_parse_cache 1";			//First line of each entry in the cache of parsed output (shared with pb_utils, see pb_cache); also part of each key.
+$VCD_BUFFER_BYTES=1048576;				//The vcd file is written in blocks of (at least) this size, rather than once per step.
 $PB_PARPORT_OUT="pb_parport-output";			//Program to read from fifo and output bytes to parports. (needs to be in C to use PPWDATA ioctl).
 $PBSIM_SIMULATOR="hawaiisim";				//Simulator that uses pbsim files.
 $WAVE_VIEWER="gtkwave";					//Wavefile viewer program (vcd files)
@@ -249,7 +253,7 @@ if ($FATAL_ERROR_DEBUG_IMMORTAL){
 $binary_name="pb_parse"; 	//clearer than using basename($argv[0]), which changes from pb_parse.php to pb_parse when installed.
 function usage(){
 	global $binary_name, $argv, $SOURCE_EXTN, $OUTPUT_EXTN, $PBSIM_EXTN, $BINARY_EXTN, $VCD_EXTN, $MARK_PREFIX;
-	global $DEV_NULL, $NA, $ASSEMBLER, $PROGRAMMER, $PB_PARPORT_OUT, $PBSIM_SIMULATOR, $WAVE_VIEWER, $EXIT_SUCCESS, $EXIT_FAILURE;
+	global $DEV_NULL, $NA, $ASSEMBLER, $PROGRAMMER, $PB_PARPORT_OUT, $PBSIM_SIMULATOR, $WAVE_VIEWER, $HEADER_BINARY, $EXIT_SUCCESS, $EXIT_FAILURE;
 	global $AUTHOR, $EMAIL, $COPYRIGHT_DATES, $URL, $LICENSE, $VERSION, $RELEASE_DATE;
 	$parser_num_lines = substr_count(file_get_contents($argv[0]),"\n");	//how big are we...
 	$parser_num_preg = substr_count(file_get_contents($argv[0]),"preg_") - 1;
@@ -479,6 +483,11 @@ PERFORMANCE
 	redirecting STDOUT. With -j, performance drops to about 3.4 kips; if output is also viewed
 	on the terminal, perfornmance is nearer 1.1 kips. Realtime parallel-port output (-tj, with
 	$PB_PARPORT_OUT) is possible at up to 1 kips, without significant jitter.
+	An unchanged .$SOURCE_EXTN file isn't parsed again: the .$OUTPUT_EXTN is kept in pb_utils' cache (see pb_cache),
+	under the SHA-256 of the source, its #included files, the -D values, this parser, and the
+	configuration from $HEADER_BINARY. It isn't used with -s, -d or -n, nor for STDIN, nor for a
+	source with #execinc or #echo, or which gives warnings or notices. The cache is in
+	\$PB_CACHE_DIR, else ~/.cache/pb_utils; set PB_CACHE_DIR empty to disable it.
 
 BUGS:
 	* $binary_name can require rather a lot of memory: approx 1kB per line of the .$SOURCE_EXTN file.
@@ -1120,6 +1129,7 @@ $lastline = exec ($hb, $lines_array, $retval);		//read into array, line-at-a-tim
 if ($retval != 0){
 	fatal_error("failed to run command '$hb' (retval: $retval)");
 }
+$HEADER_CONFIG=implode("\n",$lines_array)."\n";		//Keep it all: the configuration is part of each cache key.
 foreach($lines_array as $line){				//For each line...
 	$line=trim($line);
 	$words=preg_split('/: /',$line);		//Split up line by ": ".
@@ -1411,6 +1421,89 @@ function forty_two(){   //Ultimate answer.
 	exit ($EXIT_SUCCESS);
 }
 
+//--------------------------------------------------------------------------------------------------------------
+//CACHE OF PARSED OUTPUT, so that an unchanged .pbsrc file needn't be parsed again. This is pb_utils' cache (see pb_cache), in the same directory.
+//The key is the SHA-256 of everything which determines the .vliw: this parser itself, the configuration (exactly as pb_print_config prints it), the -D
+//values, the source, and each #included file. So there is nothing to invalidate; old entries just stop being used (pb_cache -c removes them).
+//A source with #execinc (whose output may change) or #echo (which must still print) is never cached; nor is one which gives warnings, notices or silences.
+//Each entry is <key>.vliw: a short header ("name: value" lines, ending with a blank line), then the .vliw without its first lines (which name the source
+//file and the date: these are written afresh). Failure of the cache is harmless: the source is just parsed.
+function cache_dir(){					//Where is the cache? Empty if disabled: PB_CACHE_DIR is set, but empty.
+	if (($dir = getenv("PB_CACHE_DIR")) !== false){
+		return ($dir);
+	}elseif ((($dir = getenv("XDG_CACHE_HOME")) !== false) and (substr($dir,0,1) == "/")){
+		return ("$dir/pb_utils");
+	}elseif ((($dir = getenv("HOME")) !== false) and (substr($dir,0,1) == "/")){
+		return ("$dir/.cache/pb_utils");
+	}
+	return ("");
+}
+function cache_key($source){				//The key for $source (the contents of $SOURCE_FILE), or false if it may not be cached.
+	global $CACHE_VERSION, $HEADER_CONFIG, $define_opts, $SOURCE_FILE;
+	$dir = cache_dir();
+	if ((!$dir) or ( (!is_dir($dir)) and (!@mkdir($dir, 0777, true)) )){
+		$dir && print_notice("could not create the cache directory '$dir'. Not using the cache.");
+		return (false);
+	}
+	$inputs = "";
+	foreach ($define_opts as $const => $value){	//-D values, in the order given.
+		$inputs .= "-D$const=$value\n";
+	}
+	$inputs .= "$source\n";
+	preg_match_all('/#include\s[^"\n]*"([^"\n]*)"/', $source, $matches);	//Every #include (perhaps some within comments: no harm).
+	foreach ($matches[1] as $included_file){
+		if (substr($included_file,0,1) != "/" ){	//Relative to the source file, as below.
+			$included_file = dirname($SOURCE_FILE)."/".$included_file;
+		}
+		$contents = is_readable($included_file) ? file_get_contents($included_file) : "(missing)";
+		$inputs .= "#include $included_file\n$contents\n";
+	}
+	if (preg_match('/#(execinc|echo)\b/', $inputs)){
+		return (false);
+	}
+	return (hash("sha256", "$CACHE_VERSION\n".hash_file("sha256", __FILE__)."\n$HEADER_CONFIG$inputs"));
+}
+function cache_count($lookups, $hits, $stores, $saved){	//Add to the running totals in the stats file, under a lock, as pb_utils does. (Failure is harmless)
+	if (!$fp = @fopen(cache_dir()."/stats", "a+")){
+		return;
+	}
+	if (flock($fp, LOCK_EX)){
+		rewind($fp);
+		$stats = array(0, 0, 0, 0);
+		if (preg_match('/^lookups: (\d+)\nhits: (\d+)\nstores: (\d+)\nseconds_saved: ([0-9.]+)/', stream_get_contents($fp), $matches)){
+			$stats = array_slice($matches, 1);
+		}
+		ftruncate($fp, 0);			//(In "a+" mode, writes always go to the end: now, that's the start.)
+		fwrite($fp, sprintf("lookups: %.0f\nhits: %.0f\nstores: %.0f\nseconds_saved: %.6f\n", $stats[0] + $lookups, $stats[1] + $hits, $stats[2] + $stores, $stats[3] + $saved));
+		flock($fp, LOCK_UN);
+	}
+	fclose($fp);
+}
+function cache_get($key){				//Look up $key. Returns the entry as an array (sloc, vliws, parse_seconds, body), or false if it isn't there.
+	global $CACHE_VERSION;
+	$entry = @file_get_contents(cache_dir()."/$key.vliw");
+	if (($entry === false) or (count($parts = explode("\n\n", $entry, 2)) != 2) or
+	    (!preg_match('/^'.preg_quote($CACHE_VERSION, '/').'\nsloc: (\d+)\nvliws: (\d+)\nparse_seconds: ([0-9.]+)$/', $parts[0], $matches))){
+		cache_count(1, 0, 0, 0);		//Missing (or unreadable: treat it as missing).
+		return (false);
+	}
+	cache_count(1, 1, 0, $matches[3]);
+	return (array('sloc' => $matches[1], 'vliws' => $matches[2], 'parse_seconds' => $matches[3], 'body' => $parts[1]));
+}
+function cache_put($key, $body, $sloc, $vliws, $parse_seconds){	//Store an entry: write a temporary file, then rename it into place, so a reader never sees half of one.
+	global $CACHE_VERSION;
+	$dir = cache_dir();
+	if (!$tmp = @tempnam($dir, ".tmp.")){
+		return;
+	}
+	if (file_put_contents($tmp, sprintf("$CACHE_VERSION\nsloc: %d\nvliws: %d\nparse_seconds: %.6f\n\n", $sloc, $vliws, $parse_seconds).$body) and
+	    chmod($tmp, 0644) and rename($tmp, "$dir/$key.vliw")){
+		cache_count(0, 0, 1, 0);
+	}else{
+		@unlink($tmp);
+	}
+}
+
 //--------------------------------------------------------------------------------------------------------------
 //CHECK AND OPEN FILES:
 //Check filenames and extensions. This is very important - it prevents shooting of self in foot by swapping infile with outfile!
@@ -1572,6 +1665,18 @@ if ( $SOURCE_FILE != $DEV_STDIN){
 	}
 }
 
+//Look in the cache. (Not for stdin; nor when simulating, debugging or dumping lines, since those need the parse itself.)
+$cache_key = false;
+if ( ($SOURCE_FILE != $DEV_STDIN) and (!$DO_SIMULATION) and (!$DEBUG) and (!$DO_DUMPLINES) ){
+	$cache_key = cache_key(implode("", $source_contents_array));
+}
+if ( ($cache_key) and ($entry = cache_get($cache_key)) ){
+	$sloc_count = $entry['sloc'];
+	$number_of_code_lines = $entry['vliws'];
+	$number_of_warnings_pre_sim = $number_of_warnings;
+	write_output_and_exit(vliw_header().$entry['body'], "Compiled $sloc_count sloc to $number_of_code_lines vliws: the output was in the cache, which saved $entry[parse_seconds] seconds.");
+}
+
 //--------------------------------------------------------------------------------------------------------------
 //APPEND IDENTIFIERS TO EACH LINE OF SOURCE, SO THAT THEY CAN BE USED IN ERROR MESSAGES.
 //Appending to each line is the only sane way to do it.Otherwise, one has to do something hideous with tracking lines, insertions,deletions, etc. [array_splice() might help, but not much].
@@ -4438,46 +4543,53 @@ function vcd_lbl($bit){				//Get the VCD label. This is an ascii-printable chara
 	return (chr(ord('A') + $bit));		//Start from 'A' for clarity (though we could have a few more identifiers if we started from '!').
 }
 
-function write_vcd(){				//Print line for VCD file.
+function write_vcd($flush=false){		//Print line for VCD file. (Collected in a buffer, and written in blocks of $VCD_BUFFER_BYTES; write_vcd(true) writes out the rest.)
 	global $fp_vcd;				//BUG: This function needs to know more than it should about the way the opcodes work.
 	global $OUTPUT, $INSTR, $STEP, $ELAPSED_TICKS;
-	global $VCD_LABELS;
+	global $VCD_LABELS, $VCD_BUFFER_BYTES;
 
-	static $output_prev;
+	static $output_prev = 0;
+	static $vcd_buffer = '';
+	static $vcd_mask = false;		//The labelled bits, and for each bit (by value, 1 << $bit), its line: "0A\n" or "1A\n".
+	static $vcd_zero = array(), $vcd_one = array();
 
-	$vcd_time = "#$ELAPSED_TICKS\n";	//Timescale is already in ticks. '#' is the VCD identifier.
-
-	$vcd_changes = '';
-	if ($STEP == 0){			//On step 0, must output everything.
-		foreach ($VCD_LABELS as $bit => $name){
-			$value = ($OUTPUT & (1 << $bit));
-			if ($value == 0){
-				$vcd_changes .=  "0".vcd_lbl($bit)."\n";
-			}else{
-				$vcd_changes .=  "1".vcd_lbl($bit)."\n";
-			}
+	if ($flush){
+		if ($vcd_buffer !== ''){
+			fwrite ($fp_vcd, $vcd_buffer);
+			$vcd_buffer = '';
 		}
-	}else{					//Otherwise, only need to output the changes.
+		return (false);
+	}
+	if ($vcd_mask === false){
+		$vcd_mask = 0;
 		foreach ($VCD_LABELS as $bit => $name){
-			$value = ($OUTPUT & (1 << $bit));
-			$value_prev = ($output_prev  & (1 << $bit));
-			if (($value == 0) and ($value_prev != 0)){
-				$vcd_changes .=  "0".vcd_lbl($bit)."\n";
-			}elseif (($value_prev == 0) and ($value != 0)){
-				$vcd_changes .=  "1".vcd_lbl($bit)."\n";
-			}
+			$vcd_mask |= (1 << $bit);
+			$vcd_zero[1 << $bit] = "0".vcd_lbl($bit)."\n";
+			$vcd_one[1 << $bit] = "1".vcd_lbl($bit)."\n";
 		}
-		$output_prev = $OUTPUT;
 	}
 
+	$vcd_time = "#$ELAPSED_TICKS\n";	//Timescale is already in ticks. '#' is the VCD identifier.
+
 	if ($INSTR == 'stop'){			//Stop instruction doesn't set outputs.
-		fwrite ($fp_vcd, "$vcd_time");
-		return (false);
-	}elseif ($INSTR == 'wait'){
-		fwrite ($fp_vcd, "$vcd_time");  //WAIT instruction: Inserting extra timestamp with the same value, for possible detection later
+		$vcd_buffer .= $vcd_time;
+	}else{
+		if ($INSTR == 'wait'){
+			$vcd_buffer .= $vcd_time;  //WAIT instruction: Inserting extra timestamp with the same value, for possible detection later
+		}
+		$vcd_buffer .= $vcd_time;
+		$changed = ($STEP == 0) ? $vcd_mask : (($OUTPUT ^ $output_prev) & $vcd_mask);	//On step 0, must output everything. Otherwise, only the changes: XOR finds them,
+		while ($changed){							//and each is visited in turn (lowest first), without looking at the others.
+			$lowest = $changed & -$changed;
+			$vcd_buffer .= ($OUTPUT & $lowest) ? $vcd_one[$lowest] : $vcd_zero[$lowest];
+			$changed ^= $lowest;
+		}
+		$output_prev = $OUTPUT;
+	}
+	if (strlen($vcd_buffer) >= $VCD_BUFFER_BYTES){
+		fwrite ($fp_vcd, $vcd_buffer);
+		$vcd_buffer = '';
 	}
-
-	fwrite ($fp_vcd, "$vcd_time$vcd_changes");
 }
 
 function sim_output($OUTPUT){		//Do the simulation output - print status, light LEDs in correct mode (if needed), write to the parport/fifo (if needed), and delay (if needed).
@@ -4538,6 +4650,123 @@ function sim_mark_time($cmt_first){	//Mark the time for simulation. This is used
 	}
 }
 
+function simulate_natively(){	//Hand the full simulation to $SIMULATOR (pb_sim), which has exactly the semantics of the loop below, and writes the same .pbsim and .vcd, but natively.
+	global $argv, $SIMULATOR, $SIMULATOR_DEVEL, $NA, $HEADER, $number_of_code_lines, $opcodes_array, $args_array, $outputs_array, $lengths_array, $lines_array;
+	global $PBSIM_FILE, $VCD_FILE, $fp_pbsim, $fp_vcd, $VCD_LABELS, $SIMULATION_STEP_LIMIT;	//Returns true if it did, else false (and nothing has changed: simulate here instead).
+	global $STEP, $ELAPSED_TICKS, $EXIT_REASON, $PC, $OUTPUT, $instruction_visited;
+
+	$simulator = false;				//Find it as we find $HEADER_BINARY: installed next to this file, else in the development tree.
+	foreach (array(dirname($argv[0])."/$SIMULATOR", dirname($argv[0])."/$SIMULATOR_DEVEL") as $candidate){
+		if (is_executable($candidate)){
+			$simulator = $candidate;
+			break;
+		}
+	}
+	if (!$simulator){
+		debug_print_msg("Native simulator '$SIMULATOR' was not found; simulating here instead.");
+		return (false);
+	}
+
+	$vliw = '';					//The program, as .vliw. MARKs keep the first part of their comment (as sim_mark_time() writes it); nothing else needs one.
+	for ($i=0; $i<$number_of_code_lines; $i++){
+		$output = ($outputs_array[$i] === $NA) ? $NA : sprintf("0x%x", $outputs_array[$i]);
+		$cmt = '';
+		if ($opcodes_array[$i] == 'mark'){
+			$info = identify_line($lines_array[$i]);
+			$cmt = substr($info['cmt_first'], 0, $HEADER["VLIWLINE_MAXLEN"] - 100);
+		}
+		$vliw .= "$output\t$opcodes_array[$i]\t$args_array[$i]\t$lengths_array[$i]\t$cmt\n";
+	}
+
+	$cmd = escapeshellarg($simulator)." -H -a";	//-H: we have written the headers, and will write the footer. -a: list the unreached instructions.
+	if ($SIMULATION_STEP_LIMIT){
+		$cmd .= " -u ".escapeshellarg($SIMULATION_STEP_LIMIT);
+	}
+	$sizes = array();
+	if ($PBSIM_FILE){
+		fflush($fp_pbsim);
+		$cmd .= " -g ".escapeshellarg($PBSIM_FILE);
+		$sizes[] = fstat($fp_pbsim);
+	}
+	if ($VCD_FILE){
+		fflush($fp_vcd);
+		$labels = array();			//As -L: from the most significant bit down, with '-' for a bit which isn't in the dump.
+		for ($bit = 23; $bit >= 0; $bit--){
+			$labels[] = isset($VCD_LABELS[$bit]) ? $VCD_LABELS[$bit] : $NA;
+		}
+		$cmd .= " -G ".escapeshellarg($VCD_FILE)." -L ".escapeshellarg(implode(",", $labels));
+		$sizes[] = fstat($fp_vcd);
+	}
+	$cmd .= " -";
+
+	debug_print_msg("Handing the simulation to the native simulator. Running command: $cmd");
+	$stderr_file = tempnam(sys_get_temp_dir(), $SIMULATOR);	//(A file, not a pipe: a pipe could fill, while we wait on stdout.)
+	$proc = proc_open($cmd, array(0 => array("pipe", "r"), 1 => array("pipe", "w"), 2 => array("file", $stderr_file, "w")), $pipes);
+	if (!is_resource($proc)){
+		@unlink($stderr_file);
+		debug_print_msg("Could not run '$cmd'; simulating here instead.");
+		return (false);
+	}
+	fwrite($pipes[0], $vliw);			//It reads all of this before it writes anything.
+	fclose($pipes[0]);
+	$stdout = stream_get_contents($pipes[1]);
+	fclose($pipes[1]);
+	$retval = proc_close($proc);
+	$errors = trim(file_get_contents($stderr_file));
+	unlink($stderr_file);
+
+	$results = array();
+	$unreached = array();
+	foreach (explode("\n", $stdout) as $line){	//'name: value' lines.
+		$parts = explode(": ", $line, 2);
+		if (count($parts) != 2){
+			continue;
+		}
+		if ($parts[0] == "unreached"){
+			$words = explode(" ", $parts[1]);
+			$unreached[] = (int)$words[0];
+		}else{
+			$results[$parts[0]] = $parts[1];
+		}
+	}
+	if (!isset($results['result'])){		//It didn't simulate. If it didn't write anything either, we can still do it here.
+		clearstatcache();
+		$unchanged = true;
+		$fps = array();
+		if ($PBSIM_FILE){
+			$fps[] = $fp_pbsim;
+		}
+		if ($VCD_FILE){
+			$fps[] = $fp_vcd;
+		}
+		foreach ($fps as $n => $fp){
+			$stat = fstat($fp);
+			$unchanged = $unchanged && ($stat['size'] == $sizes[$n]['size']);
+		}
+		if (!$unchanged){
+			fatal_error("native simulator '$simulator' failed (exit status $retval), part way through writing the simulation files. It said:\n$errors");
+		}
+		debug_print_msg("Native simulator could not run this program (exit status $retval); simulating here instead. It said:\n$errors");
+		return (false);
+	}
+
+	$EXIT_REASON = $results['result'];		//Same names as here.
+	$STEP = $results['steps'];
+	$ELAPSED_TICKS = $results['elapsed_ticks'];
+	$PC = $results['pc'];
+	$OUTPUT = hexdec($results['output']);
+	for ($i=0; $i<$number_of_code_lines; $i++){
+		$instruction_visited[$i] = 1;
+	}
+	foreach ($unreached as $i){
+		$instruction_visited[$i] = 0;
+	}
+	$PBSIM_FILE && fseek($fp_pbsim, 0, SEEK_END);	//It appended to the files: carry on after what it wrote (for the footer).
+	$VCD_FILE && fseek($fp_vcd, 0, SEEK_END);
+	print_msg("Simulated natively by $SIMULATOR: $results[steps] instructions, in $results[run_seconds] seconds ($results[steps_per_second] instructions/second).");
+	return (true);
+}
+
 //Read a line from the keyboard, in either blocking or non-blocking way. It's important to do it this way, even for the blocking case, as otherwise Ctrl-C may not work
 //properly (during fgets(STDIN), fgets() may block, and at this point [if we have Ctrl-C handled internally by pcntl_signal()], Ctrl-C is ignored until some data arrives.
 //Ideally, we'd also be able to read single chars (eg 'ESC' or just 'q') with fgetc(), but konsole only sends typed characters to STDIN on receipt of ENTER.
@@ -4846,8 +5075,15 @@ if($DO_SIMULATION){
 	$wait_correction = 0;			//Correction, if needed for total time spent in a wait opcode (or single-step), pending keypress. Negative value, in us.
 	$do_quit = false;
 	
+	//If there is nothing interactive to do (just -g, -G and -u), hand the whole simulation to the native simulator, which is hundreds of times faster.
+	$simulated_natively = false;
+	if ($SIMULATION_VERY_TERSE and !$SIMULATION_USE_LOOPCHEAT and !$SIMULATION_VIRTUAL_LEDS and !$SIMULATION_VERBOSE_REGISTERS and !$SIMULATION_USE_KEYPRESSES and
+	    !$SIMULATION_REALTIME and !$SIMULATION_WAIT_MANUAL and !$SIMULATION_OUTPUT_FIFO and !$SIMULATION_BEEP){
+		$simulated_natively = simulate_natively();
+	}
+
 	//Start the "pulseblaster". We can only stop on a break. Breaks occur a)if we reach STOP  b)If we return to an instruction we have already seen.
-	while (true){
+	while (!$simulated_natively){
 		//Have we run off the end of the program?
 		if ($PC>=$number_of_code_lines){
 			print_msg("\n\n${RED}Error: the program is only $number_of_code_lines lines long, but we have run past the end, and tried to execute instruction '$PC'. Simulation ended with error.${NORM}");
@@ -5103,6 +5339,9 @@ if($DO_SIMULATION){
 		//[PC has already been modified; when we go round this loop again, it takes effect. Here is our rising-edge clock!]
 	}
 	//[Simulation loop is finished]
+	if ($VCD_FILE){
+		write_vcd(true);		//Write out what is left in its buffer.
+	}
 
 
 	//The pulseblaster has stopped, either on encountering a STOP, or we know we reached a repeat in an infinite loop (and don't need to bother any more), or an error occurred.
@@ -5217,7 +5456,9 @@ if($DO_SIMULATION){
 //Each line contains 4 fields: OUTPUT (hex), LENGTH (hex): OPCODE (string), ARG(hex) and an optional COMMENT (string).
 //THese are delimited by whitespace. Output and ARG (and rarely, LENGTH) may sometimes be '-', i.e. explicitly $NA.  pb_prog recognises '-' as zero.
 
-$output_contents= <<<EOT
+function vliw_header(){				//The first lines of the output. (Not cached: they name the source file, and the date.)
+	global $binary_name, $SOURCE_FILE, $SOURCE_EXTN, $date, $HEADER, $ASSEMBLER;
+	$header= <<<EOT
 //This file was auto-generated by $binary_name, from source file '$SOURCE_FILE' on date $date.
 //Generated for a model $HEADER[PB_VERSION] pulseblaster, with a $HEADER[PB_CLOCK_MHZ] MHz ($HEADER[PB_TICK_NS] ns) clock and $HEADER[PB_MEMORY] words of memory.
 //Do not edit this file; edit the original .$SOURCE_EXTN file and re-generate it with pb_parse.
@@ -5226,12 +5467,16 @@ $output_contents= <<<EOT
 
 EOT;
 
-$chunks_array=explode("\n",$output_contents);	//Double-check that the lines in the intro above are not too long for pb_prog's buffer.
-foreach ($chunks_array as $line) {		//Should never happen!
-	if  (strlen($line) > $HEADER["VLIWLINE_MAXLEN"] -2){
-		fatal_error("parser tried to preface vliw file by a comment with an excessive length (> ".($HEADER["VLIWLINE_MAXLEN"] -1) ." characters). This is too large for $ASSEMBLER's buffer.");
+	$chunks_array=explode("\n",$header);		//Double-check that the lines in the intro above are not too long for pb_prog's buffer.
+	foreach ($chunks_array as $line) {		//Should never happen!
+		if  (strlen($line) > $HEADER["VLIWLINE_MAXLEN"] -2){
+			fatal_error("parser tried to preface vliw file by a comment with an excessive length (> ".($HEADER["VLIWLINE_MAXLEN"] -1) ." characters). This is too large for $ASSEMBLER's buffer.");
+		}
 	}
+	return ($header);
 }
+$output_header = vliw_header();
+$output_contents = $output_header;
 
 debug_print_msg("\n################### ${BLUE}WRITE OUT VLIW and OTHER FILES (AND COMPARE WITH SOURCE)${NORM} ##########################################");
 vdebug_print_msg("Here are the ${DBLUE}source lines{$NORM} with ${CYAN}line numbers{$NORM} and the corresponding lines of finished ${MAGENTA}vliw output${NORM}:\n");
@@ -5319,80 +5564,92 @@ $output_contents.="\n//END OF FILE\n";  //For information only.
 //--------------------------------------------------------------------------------------------------------------
 //WRITE OUTPUT TO FILE, ASSEMBLE, and EXIT.
 
-if (!fwrite ($fp_out, $output_contents)){	//Note: if we have already experienced a fatal error, and don't get here, $OUTPUT_FILE will be empty. pb_prog will detect it.
-	fatal_error("could not write output to file '$OUTPUT_FILE'.");
-}else{
-	debug_print_msg("Output has been written to file '$OUTPUT_FILE'.");
-	$outputs_assembly_txt = "output file '$OUTPUT_FILE' ";
-}
+function write_output_and_exit($output_contents, $perf_txt){	//Write the .vliw (and assemble it, if -a), print the summary (ending with $perf_txt), and exit.
+	global $fp_out, $fp_pbsim, $fp_vcd, $fp_sofifo, $OUTPUT_FILE, $BINARY_FILE, $PBSIM_FILE, $VCD_FILE, $DO_ASSEMBLY, $ASSEMBLER, $PROGRAMMER, $DEBUG, $QUIET;
+	global $number_of_notices, $number_of_silences, $number_of_warnings, $number_of_warnings_pre_sim, $HEADER, $EXIT_SUCCESS;
+	global $RED, $GREEN, $AMBER, $NORM;
 
-if ($DO_ASSEMBLY){				//Do the assembly, and output to $BINARY_FILE. Fatal error if this fails.
-	$cmd = "$ASSEMBLER $OUTPUT_FILE $BINARY_FILE 2>&1";
-	debug_print_msg("Now Assmbling the binary. Running command: $cmd");
-	unset($output);
-	$lastline = exec ($cmd,$output,$retval);	//Do the assembly
-	if ($retval != 0){
-		$DEBUG=true;  //on failure, be verbose.
+	if (!fwrite ($fp_out, $output_contents)){	//Note: if we have already experienced a fatal error, and don't get here, $OUTPUT_FILE will be empty. pb_prog will detect it.
+		fatal_error("could not write output to file '$OUTPUT_FILE'.");
+	}else{
+		debug_print_msg("Output has been written to file '$OUTPUT_FILE'.");
+		$outputs_assembly_txt = "output file '$OUTPUT_FILE' ";
 	}
-	debug_print_msg("Command returned value $retval. Assembler output was:");
-	foreach ($output as $line){
-		debug_print_msg(" $ASSEMBLER: $line");
+
+	if ($DO_ASSEMBLY){				//Do the assembly, and output to $BINARY_FILE. Fatal error if this fails.
+		$cmd = "$ASSEMBLER $OUTPUT_FILE $BINARY_FILE 2>&1";
+		debug_print_msg("Now Assmbling the binary. Running command: $cmd");
+		unset($output);
+		$lastline = exec ($cmd,$output,$retval);	//Do the assembly
+		if ($retval != 0){
+			$DEBUG=true;  //on failure, be verbose.
+		}
+		debug_print_msg("Command returned value $retval. Assembler output was:");
+		foreach ($output as $line){
+			debug_print_msg(" $ASSEMBLER: $line");
+		}
+		if ($retval != 0){
+			fatal_error("Error assembling binary. Command '$cmd' exited with error '$retval'.");
+		}
+		debug_print_msg("Assembled binary has been written to file '$BINARY_FILE'. (View it with 'xxd', or program with $PROGRAMMER).");
+		$outputs_assembly_txt .= "and executable file '$BINARY_FILE' ";
 	}
-	if ($retval != 0){
-		fatal_error("Error assembling binary. Command '$cmd' exited with error '$retval'.");
+
+	if ($PBSIM_FILE){
+		fwrite ($fp_pbsim, "//End of file.\n");
+		debug_print_msg("Simulation replay log has been written to file '$PBSIM_FILE'.");
+		$outputs_assembly_txt .= "and simulation replay-log file '$PBSIM_FILE' ";
 	}
-	debug_print_msg("Assembled binary has been written to file '$BINARY_FILE'. (View it with 'xxd', or program with $PROGRAMMER).");
-	$outputs_assembly_txt .= "and executable file '$BINARY_FILE' ";
-}
 
-if ($PBSIM_FILE){
-	fwrite ($fp_pbsim, "//End of file.\n");
-	debug_print_msg("Simulation replay log has been written to file '$PBSIM_FILE'.");
-	$outputs_assembly_txt .= "and simulation replay-log file '$PBSIM_FILE' ";
-}
+	if ($VCD_FILE){
+		#There is no vcd footer.
+		debug_print_msg("Value change dump has been written to file '$VCD_FILE'.");
+		$outputs_assembly_txt .= "and value change dump file '$VCD_FILE' ";
+	}
 
-if ($VCD_FILE){
-	#There is no vcd footer.
-	debug_print_msg("Value change dump has been written to file '$VCD_FILE'.");
-	$outputs_assembly_txt .= "and value change dump file '$VCD_FILE' ";
-}
+	fclose($fp_out);					//Fclose. (Not strictly necessary). On Linux, this implicitly releases any locks.
+	$fp_pbsim && fclose($fp_pbsim);
+	$fp_vcd && fclose($fp_vcd);
+	$fp_sofifo && fclose($fp_sofifo);
 
-fclose($fp_out);					//Fclose. (Not strictly necessary). On Linux, this implicitly releases any locks.
-$fp_pbsim && fclose($fp_pbsim);
-$fp_vcd && fclose($fp_vcd);
-$fp_sofifo && fclose($fp_sofifo);
+	//Print summary.
+	$muted_txt="";
+	if (($QUIET) and ($number_of_notices >0)){	//Warn about missing notices, in QUIET mode.
+		$muted_txt .= "${AMBER}$number_of_notices notice".(($number_of_notices>1)?"s":"")."${NORM} suppressed by '-q'. ";
+	}
+	if ($number_of_silences >0){
+		$muted_txt .="${AMBER}$number_of_silences silence".(($number_of_silences>1)?"s":"")."${NORM} suppressed by '@', use '-S' to scream. ";
+	}
+	$number_of_warnings_sim = $number_of_warnings - $number_of_warnings_pre_sim;
+	if ($number_of_warnings_sim > 0){
+		$muted_txt .= "$number_of_warnings_sim simulation warning(s) occurred. ";
+	}
+	$muted_txt = trim($muted_txt);
+	if ($muted_txt){
+		$muted_txt = "($muted_txt) ";
+	}
 
-//Print summary.
-$muted_txt="";
-if (($QUIET) and ($number_of_notices >0)){	//Warn about missing notices, in QUIET mode.
-	$muted_txt .= "${AMBER}$number_of_notices notice".(($number_of_notices>1)?"s":"")."${NORM} suppressed by '-q'. ";
-}
-if ($number_of_silences >0){
-	$muted_txt .="${AMBER}$number_of_silences silence".(($number_of_silences>1)?"s":"")."${NORM} suppressed by '@', use '-S' to scream. ";
-}
-$number_of_warnings_sim = $number_of_warnings - $number_of_warnings_pre_sim;
-if ($number_of_warnings_sim > 0){
-	$muted_txt .= "$number_of_warnings_sim simulation warning(s) occurred. ";
+	if ($number_of_warnings_pre_sim == 0){	//Count warnings; ignore notices. Only count non-simulation warnings here.
+		print_msg("${GREEN}Finished successfully${NORM}, and with no parser warnings! $muted_txt$perf_txt");
+	}else{
+		print_msg("\n${GREEN}Finished OK${NORM}, but with ${RED}$number_of_warnings_pre_sim parser warning".(($number_of_warnings_pre_sim>1)?"s":"")."${NORM}. $muted_txt$perf_txt"); //Leading newline, to separate this text from the last warning.
+	}
+
+	if (!$QUIET){
+		print_msg("Generated ${outputs_assembly_txt}for a PulseBlaster (model $HEADER[PB_VERSION], $HEADER[PB_CLOCK_MHZ] MHz clock, $HEADER[PB_MEMORY] words). Now use $ASSEMBLER/$PROGRAMMER.");
+	}
+	print_msg("");
+
+	exit ($EXIT_SUCCESS);  //If we get to here, we're happy :-)
 }
-$muted_txt = trim($muted_txt);
-if ($muted_txt){
-	$muted_txt = "($muted_txt) ";
+
+//Store it in the cache (if it may be). Then write it out.
+if ( ($cache_key) and ($number_of_warnings == 0) and ($number_of_notices == 0) and ($number_of_silences == 0) ){
+	cache_put($cache_key, substr($output_contents, strlen($output_header)), $sloc_count, $number_of_code_lines, microtime(true) - $parser_start_time);
 }
 $perf_txt = "Compiled $sloc_count sloc to $number_of_code_lines vliws in $parser_run_time seconds.";
 if ($DO_SIMULATION){
 	$perf_txt.=" Simulated $STEP instructions in $simulation_run_time seconds.";
 }
-
-if ($number_of_warnings_pre_sim == 0){	//Count warnings; ignore notices. Only count non-simulation warnings here.
-	print_msg("${GREEN}Finished successfully${NORM}, and with no parser warnings! $muted_txt$perf_txt");
-}else{
-	print_msg("\n${GREEN}Finished OK${NORM}, but with ${RED}$number_of_warnings_pre_sim parser warning".(($number_of_warnings_pre_sim>1)?"s":"")."${NORM}. $muted_txt$perf_txt"); //Leading newline, to separate this text from the last warning.
-}
-
-if (!$QUIET){
-	print_msg("Generated ${outputs_assembly_txt}for a PulseBlaster (model $HEADER[PB_VERSION], $HEADER[PB_CLOCK_MHZ] MHz clock, $HEADER[PB_MEMORY] words). Now use $ASSEMBLER/$PROGRAMMER.");
-}
-print_msg("");
-
-exit ($EXIT_SUCCESS);  //If we get to here, we're happy :-)
+write_output_and_exit($output_contents, $perf_txt);
 ?>
@@ -0,0 +1,1101 @@
+/* This is libpulseblaster.c which contains the functions that do the work for pb_init, pb_asm, pb_prog, pb_start, pb_stop etc.
+ * The interface is in libpulseblaster.h; all the other definitions are in pulseblaster.h (and in the manual!)
+ * This userspace version pairs with the Linux 2.6 kernel driver, which has /sys/class/pulseblaster.
+ * [It differs from the more complex earlier version which used the 2.4 kernel driver, and had to 'bit-bang' the interface]
+ * Since this is a shared library, no function here will exit: each returns an error-code (PB_ERROR_*, or 0 for success), and the
+ * explanation is printed to the log of the device or encoder concerned. All state is in those handles, so it's reentrant.
+ * The caller (eg pb_prog) decides whether an error is fatal, and what exit code to use.
+
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include "libpulseblaster.h"	/* Library interface. (Includes pulseblaster.h: Pulseblaster configuration/hardware info) */
+#include "pulseblaster_ioctl.h"	/* The driver's ioctls, on the character device. (From driver/kernel, or as installed with the driver) */
+
+/*Helpful macros: print to the log of a device or encoder, if it has one */
+#define lprintf(h, ...)		do { if ((h)->log) fprintf ((h)->log, __VA_ARGS__); } while (0)
+#define warnprintf(h, ...)	do { (h)->warnings++; lprintf ((h), __VA_ARGS__); } while (0)	/* Also counts the warnings (and notices) */
+
+/* The pulseblaster control files in sysfs, as named in pulseblaster.h */
+#define PB_FILE_PROGRAM		0	/* Write a bytestream to this file to program the device */
+#define PB_FILE_START		1	/* Write a "1" (PB_SYS_TRIGGER_STRING) to this file to start the device */
+#define PB_FILE_STOP		2	/* Write a "1" to this file to stop the device */
+#define PB_FILE_ARM		3	/* Write a "1" to this file to arm the device */
+#define PB_FILE_CONT		4	/* Write a "1" to this file to continue the device */
+#define PB_NUM_FILES		5
+static const char *pb_file_names[PB_NUM_FILES] = { PB_PROGRAM, PB_START, PB_STOP, PB_ARM, PB_CONT };
+
+#define PB_PATH_MAXLEN		256	/* Length of a control file's full path, +1 for the terminating NUL */
+
+/* An open PulseBlaster */
+struct pb_device {
+	char dir[PB_PATH_MAXLEN];		/* Directory of the control files */
+	int fd[PB_NUM_FILES];			/* File descriptors of the control files, opened for writing */
+	char chr_path[PB_PATH_MAXLEN];		/* The character device, /dev/pulseblasterN */
+	int chr;				/* Its file descriptor, or -1 if there is none: then the program file in sysfs is used */
+	int dummy;				/* This is the dummy directory, not the real hardware: warn on closing */
+	FILE *log;				/* Messages go here (stderr by default) */
+};
+
+#define STACKSIZE PB_LOOP_MAXDEPTH * 2	/* Size of the stack for the address of the loop instructions. (allocate some extra space too) */
+
+/* The state of an assembly, and its program image */
+struct pb_encoder {
+	int vliw_number;			/* Instruction-number/line-number. 0-based, same as pb_parse, and addresses. */
+	long prev_vliw_length;			/* Save previous vliw_instruction length */
+	int loop_depth;				/* Attempt to track number of nested loops. Note: this catches only the most common trivial error */
+	int loop_addr_count;			/* Stack of the addresses of the loop instructions, to check the ENDLOOPs */
+	int loop_addr_items[STACKSIZE];
+	unsigned char image[PB_MEMORY * PB_BPW_VLIW];	/* The whole program image, built up one VLIW word at a time by pb_encode_vliw() */
+	unsigned int lines[PB_MEMORY];		/* The source line of each word (0 if it didn't come from a line of source) */
+	FILE *log;				/* Messages go here (stderr by default) */
+	unsigned int warnings;			/* Number of warnings (and notices) given */
+};
+
+
+/* Device */
+
+/* Open (all) the pulseblaster device files in sys_dir for writing. If sys_dir is NULL, use the default: PB_DEVICE_DIR.
+ * Returns the device, or NULL (with *error = PB_ERROR_NODEVICE) if there is a problem. Errors are printed to stderr, since there is no handle yet. */
+struct pb_device *pb_device_open (const char *sys_dir, int *error){
+	struct pb_device *dev;
+	struct stat stat_buf;			/* stat, for directory_exists check */
+	char path[PB_PATH_MAXLEN];
+	int i;
+
+	#if DEBUG_FUNCTION_CALLS==1
+	fprintf(stderr, "Now in function pb_device_open(%s)\n", sys_dir ? sys_dir : "NULL");
+	#endif
+
+	if (error){
+		*error = PB_ERROR_NODEVICE;
+	}
+	if ((dev = calloc (1, sizeof(*dev))) == NULL){
+		perror ("Could not allocate the pulseblaster device");
+		return (NULL);
+	}
+	dev->log = stderr;
+	for (i = 0; i < PB_NUM_FILES; i++){
+		dev->fd[i] = -1;
+	}
+	dev->chr = -1;
+	if (sys_dir == NULL){
+		sys_dir = PB_DEVICE_DIR;
+		#if HAVE_PB!=1
+		dev->dummy = 1;
+		#endif
+	}
+	if (strlen (sys_dir) + 1 > sizeof(dev->dir)){
+		fprintf (stderr, "Pulseblaster device directory name is too long: %s\n", sys_dir);
+		free (dev);
+		return (NULL);
+	}
+	strcpy (dev->dir, sys_dir);
+
+	if (dev->dummy){
+		fprintf (stderr, "Dummy run, *WITHOUT* PulseBlaster hardware! ('#define HAVE_PB 0' in pulseblaster.h). "
+			"Faking PB sysfs directory: %s \n", dev->dir);
+		if (stat(dev->dir, &stat_buf) < 0){		/* If we can stat it, directory probably already exists. C's mkdir() doesn't have the "-p" option. */
+			if (mkdir (dev->dir, S_IRWXU) < 0 ){
+				fprintf (stderr, "Could not create pulseblaster dummy directory: %s: %s\n", dev->dir, strerror(errno));
+				free (dev);
+				return (NULL);
+			}
+		}
+	}
+
+	for (i = 0; i < PB_NUM_FILES; i++){
+		if (snprintf (path, sizeof(path), "%s/%s", dev->dir, pb_file_names[i]) >= (int)sizeof(path)){
+			fprintf (stderr, "Pulseblaster device directory name is too long: %s\n", dev->dir);
+			dev->dummy = 0;
+			pb_device_close (dev);
+			return (NULL);
+		}
+		if ((dev->fd[i] = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0){	/* As fopen(path, "w"). (In sysfs, the files always exist) */
+			fprintf (stderr, "Could not open device programming file %s. Has 'pb_driver-load' been run? : %s\n", path, strerror(errno));
+			dev->dummy = 0;
+			pb_device_close (dev);
+			return (NULL);
+		}
+	}
+
+	/* A real device (in /sys) also has a character device, through which a whole image can be loaded in one ioctl(). If it is
+	 * missing (an older driver), the program file is used instead. */
+	if ((!dev->dummy) && (!strncmp (dev->dir, "/sys/", 5)) && (strrchr (dev->dir, '/')[1] != '\0')){
+		if (snprintf (dev->chr_path, sizeof(dev->chr_path), "%s%s", PB_DEV_DIR, strrchr (dev->dir, '/')) >= (int)sizeof(dev->chr_path)){
+			fprintf (stderr, "Pulseblaster device directory name is too long: %s\n", dev->dir);
+			pb_device_close (dev);
+			return (NULL);
+		}
+		if (((dev->chr = open (dev->chr_path, O_WRONLY)) < 0) && (errno != ENOENT)){
+			fprintf (stderr, "Could not open device %s: %s\n", dev->chr_path, strerror(errno));
+			pb_device_close (dev);
+			return (NULL);
+		}
+	}
+
+	if (error){
+		*error = 0;
+	}
+	return (dev);
+}
+
+/* Close the pulseblaster device, and free it */
+void pb_device_close (struct pb_device *dev){
+	int i;
+
+	if (dev == NULL){
+		return;
+	}
+
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf(dev, "Now in function pb_device_close()\n");
+	#endif
+	for (i = 0; i < PB_NUM_FILES; i++){
+		if (dev->fd[i] >= 0){
+			close (dev->fd[i]);
+		}
+	}
+	if (dev->chr >= 0){
+		close (dev->chr);
+	}
+
+	/* warn if this was a dummy run (HAVE_PB is NOT defined to 1). Useful as final status-line, so it doesn't get overlooked. */
+	if (dev->dummy){
+		lprintf (dev, "WARNING: PulseBlaster hardware NOT actually used. This is a dummy run: see: %s\n", dev->dir);
+	}
+	free (dev);
+}
+
+/* Set where messages go. (NULL for silence) */
+void pb_device_set_log (struct pb_device *dev, FILE *log){
+	dev->log = log;
+}
+
+/* The directory containing the control files */
+const char *pb_device_dir (const struct pb_device *dev){
+	return (dev->dir);
+}
+
+
+/* pb_write_control() writes the trigger string to the given control file. Returns 0, or PB_ERROR_NODEVICE */
+static int pb_write_control (struct pb_device *dev, int file){
+	size_t len = strlen (PB_SYS_TRIGGER_STRING);
+
+	#if DEBUG_WRITES==1
+	lprintf (dev, "pb_write_control(): %s/%s\n", dev->dir, pb_file_names[file]);
+	#endif
+	if (write (dev->fd[file], PB_SYS_TRIGGER_STRING, len) != (ssize_t)len){
+		lprintf (dev, "Could not write to PulseBlaster device control file %s/%s: %s\n", dev->dir, pb_file_names[file], strerror(errno));
+		return (PB_ERROR_NODEVICE);
+	}
+	return (0);
+}
+
+/* The pulseblaster control files in /sys are "stop", "start", "arm", "continue". Echoing "1\n" to stop/start/arm puts the Pulseblaster into that
+ * state, irrespective of what it is currently doing. Eg starting an already running pulseblaster means "stop, restart", and is
+ * not (as one might think) a NO-OP.
+ * However, "continue" is used to keep going when in a WAIT state, and is otherwise a NOP when the pulseblaster is running.
+ * [The original distinction of pb_stop() and pb_halt() [stop with and without re-arming] is no longer needed, so pb_halt() has been removed to reduce confusion ]*/
+
+/* Trigger the pulseblaster. Returns PB_ERROR_NODEVICE if there is a problem. */
+/* If the device is idle, it will be STARTED; if it is currently running, it will be STOPPED AND RESTARTED. */
+/* [No need to call pb_device_arm() before doing pb_device_start()] */
+int pb_device_start (struct pb_device *dev){
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf(dev, "Now in function pb_device_start()\n");
+	#endif
+	/* Trigger the pulseblaster */
+	return (pb_write_control (dev, PB_FILE_START));
+}
+
+/* Stop the pulseblaster. Leave it STOPPED and NOT RESPONSIVE to HW_TRIGGER. Returns PB_ERROR_NODEVICE if there is a problem.*/
+/* [After stopping, pb_device_start() will start the PB from software; but HW_TRIGGER won't work until we have done pb_device_arm() ] */
+int pb_device_stop (struct pb_device *dev){
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf(dev, "Now in function pb_device_stop()\n");
+	#endif
+	/* Stop the pulseblaster. Don't re-arm it */
+	return (pb_write_control (dev, PB_FILE_STOP));
+}
+
+/* Arm the pulseblaster, ready for it to start. Returns PB_ERROR_NODEVICE if there is a problem. */
+/* This will STOP the device if it's running, and leave in the ARMED state, ready for an HW_Trigger (or pb_device_start()) */
+/* [Once ARMED, pb_device_cont() will also trigger it ]*/
+int pb_device_arm (struct pb_device *dev){
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf(dev, "Now in function pb_device_arm()\n");
+	#endif
+	/* Arm the pulseblaster. */
+	return (pb_write_control (dev, PB_FILE_ARM));
+}
+
+/* Continue the pulseblaster, (without first resetting it) during a WAIT opcode. Returns PB_ERROR_NODEVICE if there is a problem. */
+/* This will have no effect on the device if it's running (except in WAIT state). "arm; cont" is the same as start. */
+int pb_device_cont (struct pb_device *dev){
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf(dev, "Now in function pb_device_cont()\n");
+	#endif
+	/* Continue the pulseblaster. */
+	return (pb_write_control (dev, PB_FILE_CONT));
+}
+
+
+/* pb_device_program loads a whole program image. Given the whole image at once, in one ioctl() on the character device (PB_IOC_PROGRAM),
+ * the driver reprograms only as far as the highest word which differs from the program already loaded: not at all, if it is the same.
+ * Without the character device (or with a driver which lacks that ioctl), the image is written to the pulseblaster programming file,
+ * from the start (offset 0), in as few write()s as the kernel will take; every byte is then reprogrammed. (A sysfs binary attribute
+ * takes at most a page per write(); the driver then programs it continuously.)
+ * The image is checked first: if it is empty, too big, or not a whole number of VLIW words, no byte of it reaches the hardware. */
+int pb_device_program (struct pb_device *dev, const unsigned char *image, size_t len){
+	struct pb_ioc_program program;
+	size_t done = 0;
+	ssize_t ret;
+
+	if (len == 0){
+		lprintf (dev, "Error: program contains no instructions. Nothing has been written to the PulseBlaster.\n");
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	if (len % PB_BPW_VLIW){
+		lprintf (dev, "Error: program is %lu bytes long, but should be a multiple of %d. Nothing has been written to the PulseBlaster.\n", (unsigned long)len, PB_BPW_VLIW);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	if (len > (size_t)PB_MEMORY * PB_BPW_VLIW){	/* Check we haven't used too much memory. The PulseBlaster driver is unable to do this check, but it will prevent the PB from starting. */
+		lprintf (dev, "Error: program has %lu VLIW instructions, but the PulseBlaster only has %d words available! Nothing has been written to it.\n", (unsigned long)(len / PB_BPW_VLIW), PB_MEMORY);
+		return (PB_ERROR_OUTOFMEM);
+	}
+
+	/* This Endianness is correct: VLIW Output MSB is first in each word, and must be written to the PB device-file first */
+	if (dev->chr >= 0){
+		program.data = (unsigned long)image;
+		program.len = len;
+		if (ioctl (dev->chr, PB_IOC_PROGRAM, &program) == 0){
+			#if DEBUG_WRITES==1
+			lprintf (dev, "pb_device_program(): loaded %d bytes via %s\n", (int)len, dev->chr_path);
+			#endif
+			return (0);
+		}
+		if (errno != ENOTTY){
+			lprintf (dev, "Could not program PulseBlaster device %s: %s\n", dev->chr_path, strerror(errno));
+			return (PB_ERROR_NODEVICE);
+		}
+	}
+	while (done < len){
+		ret = pwrite(dev->fd[PB_FILE_PROGRAM], image + done, len - done, done);
+		if (ret <= 0) {
+			lprintf (dev, "Could not write to PulseBlaster device programming file %s/%s: %s\n", dev->dir, PB_PROGRAM, ret < 0 ? strerror(errno) : "short write");
+			return (PB_ERROR_NODEVICE);
+		}
+		#if DEBUG_WRITES==1
+		lprintf (dev, "pb_device_program(): wrote %d bytes at offset %d\n", (int)ret, (int)done);
+		#endif
+		done += ret;
+	}
+	return (0);
+}
+
+
+/* Write a trivial program to the PulseBlaster so as to set the output values, and run it. Returns PB_ERROR_NODEVICE if there is a problem. */
+int pb_device_init (struct pb_device *dev, unsigned long output){
+	struct pb_encoder *enc;
+	char na[5] = "    ";
+	int ret;
+
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf(dev, "Now in function pb_device_init( 0x%06lx )\n", output);
+	#endif
+	/* Current boards don't support the internal flag register. Writing a short pulseblaster program instead */
+
+	if ((enc = pb_encoder_new()) == NULL){
+		lprintf (dev, "Error: could not allocate an encoder.\n");
+		return (PB_ERROR_GENERIC);
+	}
+	pb_encoder_set_log (enc, dev->log);
+
+	/* Write out a very short, 2-line program. */
+	na[2] = '-';
+	ret = pb_encode_vliw (enc, output, "cont", 0, PB_MINIMUM_DELAY + PB_BUG_PRESTOP_EXTRADELAY, na); 	/* Output the flags. Delay minimum number of cycles possible */
+	na[0] = na[3] = na[2];
+	if (ret == 0){
+		ret = pb_encode_vliw (enc, 0, "stop", 0, 0, na);	/* Stop. N.B. the instruction before a STOP must be longer by PB_BUG_PRESTOP_EXTRADELAY */
+	}
+	if (ret == 0){
+		ret = pb_device_program (dev, pb_encoder_image(enc), pb_encoder_len(enc));
+	}
+	pb_encoder_free (enc);
+
+	/* Run the program */
+	if (ret == 0){
+		ret = pb_device_start (dev);
+	}
+
+	/* The program will execute, and then halt. */
+	/* Sleep briefly before returning, to allow time for the program to execute. (Avoids race condition) */
+	usleep(10 * PB_MINIMUM_DELAY);  /* 900 us. This is actually quite a large safety factor, since PB_MINIMUM_DELAY is in TICKS, and usleep is in us. */
+
+	return (ret);
+}
+
+
+/* Encoder */
+
+/* Create a new encoder, with an empty image. Returns NULL if out of memory */
+struct pb_encoder *pb_encoder_new (void){
+	struct pb_encoder *enc;
+
+	if ((enc = malloc (sizeof(*enc))) == NULL){
+		return (NULL);
+	}
+	enc->log = stderr;
+	pb_encoder_reset (enc);
+	return (enc);
+}
+
+void pb_encoder_free (struct pb_encoder *enc){
+	free (enc);
+}
+
+/* Set where messages go. (NULL for silence) */
+void pb_encoder_set_log (struct pb_encoder *enc, FILE *log){
+	enc->log = log;
+}
+
+/* Empty the image, and start again at address 0 */
+void pb_encoder_reset (struct pb_encoder *enc){
+	enc->vliw_number = 0;
+	enc->prev_vliw_length = 0;
+	enc->loop_depth = 0;
+	enc->loop_addr_count = 0;
+	enc->warnings = 0;
+}
+
+/* Stack push and pop, for the loop addresses. Returns PB_ERROR_LOOPDEPTH if there is a problem */
+static int pb_loop_push (struct pb_encoder *enc, int x){
+	if (enc->loop_addr_count == STACKSIZE){
+		lprintf (enc, "Error at line %d: loop stack overflow\n", enc->vliw_number + 1);
+		return (PB_ERROR_LOOPDEPTH);
+	}
+	enc->loop_addr_items[enc->loop_addr_count++] = x;
+	return (0);
+}
+static int pb_loop_pop (struct pb_encoder *enc, int *x){
+	if (enc->loop_addr_count == 0){
+		lprintf (enc, "Error at line %d: loop stack underflow (ENDLOOP without LOOP)\n", enc->vliw_number + 1);
+		return (PB_ERROR_LOOPDEPTH);
+	}
+	*x = enc->loop_addr_items[--enc->loop_addr_count];
+	return (0);
+}
+
+
+
+/* pb_encode_vliw() takes args in the order (OUTPUT,OPCODE,ARG,LENGTH, NA[4]). It merges them into a very long instruction word (VLIW).	*
+ * This VLIW is then appended to the encoder's image, in Spincore's required order (OUTPUT,DATA,OPCODE,DELAY), merging DATA:0 and OPCODE.	*
+ * The values are sanity-checked and compensated for various Misfeatures in the harware. Then, the image can be written to the device.	*
+ * Returns 0 on success; else error code. The is_N/A values (na[5] are is used to check "-" is used explicitly instead of 0 as needed. 		*
+ *																		*
+ *  The arguments are:																*
+ *	OUTPUT is a hexadecimal number (3 bytes)  [NOT a string!]										*
+ *	OPCODE is a string such as "CONT" (case-insensitive)											*
+ *	ARG    is a hexadecimal number (20 bits). [If not applicable, 0]									*
+ *	LENGTH is a hexadecimal number (4 bytes). [If not applicable, 0]									*
+ *	NA[4]  is an array containing "-  -", depending whether a "-" or 0 was in the source.							*
+ *																		*
+ *  What this means is:  1)Set the outputs. 2) Do the instruction taking length (Prepare, wait, jump to program_counter)			*
+ *      [Note that: "STOP" ignores outputs; "WAIT" has the delay *after* wakeup ]								*
+ *																		*
+ *  This function also:																*
+ *      - Accounts for the PB internal latency (by subtracting PB_INTERNAL_LATENCY) and checks that the delay is larger than PB_MINIMUM_DELAY. 	*
+ *		The LENGTH argument to pb_encode_vliw should be the ACTUAL delay that the user wants.						*
+ * 	- Accounts for the loop count bug (by subtracting PB_BUG_LOOP_OFFSET)									*
+ *	- Accounts for the longdelay bug (by subtracting PB_BUG_LONGDELAY_OFFSET).								*
+ * 	- Converts a LONGDELAY with ARG = 1 (which is illegal) into the (equivalent) a CONT.							*
+ *	- Verifies that the VLIW arguments are all legal and within range.									*
+ * 	- Checks for the Bug with PB_BUG_PRESTOP_EXTRADELAY 											*
+ * 	- Checks for the Bug with PB_BUG_WAIT_NOTFIRST												*
+ * 	- Checks for the Bug with PB_BUG_WAIT_MINFIRSTDELAY											*
+ *	- Checks that the number of instructions will fit within the Pulseblaster's RAM. 							*
+ *	- Checks for loop depth. and for paired address_of(loop) == arg_of(endloop)								*
+ *  It does not check for call depth (stack), as this is impossible (call/return is not nested; numbers of each type not necessarily equal.)    *
+ *  It does not check for idiot-proofing, such as branching out of a loop with a GOTO.								*
+ *  (Both need the control flow of the whole program: pb_verify(), in pb_flow.c, follows every path, and checks them.)			*
+ *  If the instruction is invalid, nothing is appended (but the loop depth still counts it, so the assembly should be abandoned).		*/
+
+int pb_encode_vliw (struct pb_encoder *enc, unsigned long output, const char *opcode, unsigned long arg, unsigned long length, const char na[5]) {
+	unsigned char vliw_output[3], vliw_data[3], vliw_delay[4];	/* function args prefaced with pbv_ for clarity. unsigned long for simplicity! */
+	unsigned char vliw_opcode, vliw_data0_opcode;			/* note state in the encoder: vliw_number, prev_vliw_length, loop_depth */
+	unsigned char vliw_buf[PB_BPW_VLIW];				/* The VLIW word (10 bytes), before it is appended to the image */
+	int loop_addr_prev = 0;
+	int ret;
+
+	#if DEBUG_FUNCTION_CALLS==1
+	lprintf (enc, "Now in function pb_encode_vliw ( 0x%0lx, %s, 0x%02lx, 0x%02lx)\n", output, opcode, arg, length);
+	#endif
+
+	/* Opcodes */					/* Depending on the string value of opcode, assign the correct value to vliw_opcode, and check that arg */
+	if (strcasecmp(opcode,"CONT") == 0){   		/* For some opcodes (STOP, WAIT), there are also checks/modifications for output and length. */
+		vliw_opcode = PB_OPCODE_CONT; /* 0 */	/* OPCODES are defined in pulseblaster.h, the manual, and pulseblaster-opcodes.txt */
+		if (arg != 0){  
+			lprintf (enc, "Error at line %d: argument to opcode CONT must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1, arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "  - ")){		/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode CONT should have exactly one explicit 'N/A' ('-' rather than '0'), as the arg.\n", enc->vliw_number + 1);
+		}
+
+	}else if (strcasecmp(opcode,"LONGDELAY") == 0){
+		vliw_opcode = PB_OPCODE_LONGDELAY; 	/* 7 */
+		if ((arg == 1) && (PB_LONGDELAY_ARG_MIN == 2)){	/* Do what I mean: longdelay(1) is illegal; convert it to  cont(1). */
+			vliw_opcode = PB_OPCODE_CONT;
+			arg = 0;
+			#if DEBUG==1
+			lprintf (enc, "Debug: DWIM at line %d: demoting opcode LONGDELAY (with ARG %d) to CONT. PB_LONGDELAY_ARG_MIN is %d.\n", enc->vliw_number + 1, (int)arg, PB_LONGDELAY_ARG_MIN);
+			#endif
+		}else{
+			if ((arg < PB_LONGDELAY_ARG_MIN) || (arg > PB_ARG_20BIT)){
+				lprintf (enc, "Error at line %d: argument to opcode LONGDELAY must be a counter between %d and 0x%02X (inclusive), but it is 0x%02lx.\n", enc->vliw_number + 1,PB_LONGDELAY_ARG_MIN,PB_ARG_20BIT,arg);
+				return (PB_ERROR_INVALIDINSTRUCTION);
+			}
+			if (strcmp (na, "    ")){	/* '-' vs '0'. */
+				warnprintf (enc, "WARNING at line %d: opcode LONGDELAY should have exactly zero explicit 'N/A' ('-' rather than '0').\n", enc->vliw_number + 1);
+			}
+			arg -= PB_BUG_LONGDELAY_OFFSET;		/* account for pulseblaster longdelay arg being off by two */
+		}
+
+	}else if (strcasecmp(opcode,"LOOP") == 0){
+		vliw_opcode = PB_OPCODE_LOOP; /* 2 */
+		enc->loop_depth++; /* entered loop */
+		if ((ret = pb_loop_push (enc, enc->vliw_number)) != 0){  /* Push ADDRESS of this loop onto stack */
+			return (ret);
+		}
+		if ((arg < PB_LOOP_ARG_MIN) || (arg > PB_ARG_20BIT)){
+			lprintf (enc, "Error at line %d: argument to opcode LOOP must be a counter between %d and 0x%02X (inclusive), but it is 0x%02lx.\n", enc->vliw_number + 1,PB_LOOP_ARG_MIN,PB_ARG_20BIT,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "    ")){	/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode LOOP should have exactly zero explicit 'N/A' ('-' rather than '0').\n", enc->vliw_number + 1);
+		}
+		arg -= PB_BUG_LOOP_OFFSET;		/* account for pulseblaster loop arg being off by one */
+
+	}else if (strcasecmp(opcode,"ENDLOOP") == 0){
+		vliw_opcode=PB_OPCODE_ENDLOOP;  /* 3 */
+		enc->loop_depth--;
+		if ((ret = pb_loop_pop (enc, &loop_addr_prev)) != 0){  /* Pop address of the corresponding (hopefully correctly nested) loop from stack */
+			return (ret);
+		}
+		if (arg >= PB_MEMORY -1){
+			lprintf (enc, "Error at line %d: argument to opcode ENDLOOP must be an address between 0 and 0x%02X, but it is 0x%02lx.\n", enc->vliw_number + 1,PB_MEMORY-1,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "    ")){	/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode ENDLOOP should have exactly zero explicit 'N/A' ('-' rather than '0').\n", enc->vliw_number + 1);
+		}
+		if ((unsigned long)loop_addr_prev != arg){
+			lprintf (enc, "Error at line %d: argument to opcode ENDLOOP must be the address of the corresponding nested loop. Arg = %ld, but address of loop was = %d.\n", enc->vliw_number + 1, arg, loop_addr_prev);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+
+	}else if (strcasecmp(opcode,"GOTO") == 0){
+		vliw_opcode=PB_OPCODE_GOTO;   /* 6 */
+		if (arg >= PB_MEMORY -1){
+			lprintf (enc, "Error at line %d: argument to opcode GOTO must be an address between 0 and 0x%02X, but it is 0x%02lx.\n", enc->vliw_number + 1,PB_MEMORY-1,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "    ")){	/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode GOTO should have exactly zero explicit 'N/A' ('-' rather than '0').\n", enc->vliw_number + 1);
+		}
+
+	}else if (strcasecmp(opcode,"CALL") == 0){
+		vliw_opcode=PB_OPCODE_CALL;    /* 4 */
+		if (arg >= PB_MEMORY - 1){
+			lprintf (enc, "Error at line %d: argument to opcode CALL must be an address between 0 and 0x%02X, but it is 0x%02lx.\n", enc->vliw_number + 1,PB_MEMORY-1,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "    ")){	/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode CALL should have exactly zero explicit 'N/A' ('-' rather than '0').\n", enc->vliw_number + 1);
+		}
+
+	}else if (strcasecmp(opcode,"RETURN") == 0){
+		vliw_opcode=PB_OPCODE_RETURN;    /* 5 */
+		if (arg != 0){
+			lprintf (enc, "Error at line %d: argument to opcode RETURN must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "  - ")){	/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode RETURN should have exactly one explicit 'N/A' ('-' rather than '0'), as the arg.\n", enc->vliw_number + 1);
+		}
+
+	}else if (strcasecmp(opcode,"WAIT") == 0){    /* Note, this test is *also* performed above, to deal with PB_MINIMUM_WAIT_DELAY */
+		vliw_opcode=PB_OPCODE_WAIT;    /* 8 */
+		if (arg != 0){
+			lprintf (enc, "Error at line %d: argument to opcode WAIT must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "  - ")){	/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode WAIT should have exactly one explicit 'N/A' ('-' rather than '0'), as the arg.\n", enc->vliw_number + 1);
+		}
+		if (length < PB_MINIMUM_WAIT_DELAY) {  /* If opcode is WAIT we must also check for PB_MINIMUM_WAIT_DELAY */
+			lprintf (enc, "Error: length for a WAIT instruction must be at least PB_MINIMUM_WAIT_DELAY (%d) (i.e. PB_WAIT_LATENCY (%d) - PB_INTERNAL_LATENCY (%d) + PB_MINIMUM_DELAY (%d)), but it is 0x%02lx.\n",PB_MINIMUM_WAIT_DELAY,PB_WAIT_LATENCY,PB_INTERNAL_LATENCY,PB_MINIMUM_WAIT_DELAY,length);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (PB_BUG_WAIT_NOTFIRST > enc->vliw_number){ /* If opcode is WAIT, it may not come first */
+			lprintf (enc, "Error: The first instruction may NOT be a WAIT.\n");
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if ((enc->vliw_number ==1 ) && (enc->prev_vliw_length < PB_BUG_WAIT_MINFIRSTDELAY)){
+			lprintf (enc, "Error: If WAIT is the 2nd instruction, the previous delay must be at least PB_BUG_WAIT_MINFIRSTDELAY (%d), but but it was only 0x%02lx.\n",PB_BUG_WAIT_MINFIRSTDELAY,enc->prev_vliw_length);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+
+	}else if (strcasecmp(opcode,"STOP") == 0){
+		vliw_opcode=PB_OPCODE_STOP;  /* 1 */
+		if (arg != 0){
+			lprintf (enc, "Error at line %d: argument to opcode STOP must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1,arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "- --")){		/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode STOP should have exactly three explicit 'N/A' ('-' rather than '0'), as out/arg/len.\n", enc->vliw_number + 1);
+		}
+		if (output != 0){  /* Stop keeps the previous output values. Explicitly insist upon this. */
+			lprintf (enc, "Error at line %d: output for opcode STOP must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1,output);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (length != 0){  /* Stop doesn't pay attention to the length. Explicitly insist upon this. */
+			lprintf (enc, "Error at line %d: length for opcode STOP must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1,length);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		length = PB_MINIMUM_DELAY;  /* now set it to PB_MINIMUM_DELAY, just for safety */
+
+		if (enc->prev_vliw_length < PB_MINIMUM_DELAY + PB_BUG_PRESTOP_EXTRADELAY){  /* Note: the PREVIOUS instruction's minimum length is PB_BUG_PRESTOP_EXTRADELAY ( =2) higher than expected */
+			lprintf (enc, "Error at line %d: the instruction *preceding* opcode STOP must have length >= PB_MINIMUM_DELAY + PB_BUG_PRESTOP_EXTRADELAY (i.e. %d), but it is 0x%02lx.\n", enc->vliw_number,PB_MINIMUM_DELAY+PB_BUG_PRESTOP_EXTRADELAY,enc->prev_vliw_length);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		
+	}else if (strcasecmp(opcode,"DEBUG") == 0){   	/* This is to help the programmer. Treated as if it were "CONT". Raises a notice. */
+		vliw_opcode = PB_OPCODE_CONT; /* 0 */	
+		warnprintf (enc, "NOTICE at line %d: found DEBUG instruction. (Treated as CONT).\n", enc->vliw_number + 1);
+		if (arg != 0){ 
+			lprintf (enc, "Error at line %d: argument to opcode DEBUG must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1, arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "  - ")){		/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode DEBUG should have exactly one explicit 'N/A' ('-' rather than '0'), as the arg.\n", enc->vliw_number + 1);
+		}
+	
+		
+	}else if (strcasecmp(opcode,"MARK") == 0){   	/* This is to help the programmer at simulation time. Treated as if it were "CONT". */
+		vliw_opcode = PB_OPCODE_CONT; /* 0 */	
+		if (arg != 0){ 
+			lprintf (enc, "Error at line %d: argument to opcode MARK must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1, arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "  - ")){		/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode MARK should have exactly one explicit 'N/A' ('-' rather than '0'), as the arg.\n", enc->vliw_number + 1);
+		}
+	
+	}else if (strcasecmp(opcode,"NEVER") == 0){   	/* Never is dead-code elimination by pb_parse. It means that this instruction has been jumped over, and program flow never reaches it */
+		vliw_opcode = PB_OPCODE_CONT; /* 0 */	/* It is treated as cont to ensure that the PB sees a valid assembly instruction */
+		if (arg != 0){ 
+			lprintf (enc, "Error at line %d: argument to opcode NEVER must be zero (and is ignored), but it is 0x%02lx.\n", enc->vliw_number + 1, arg);
+			return (PB_ERROR_INVALIDINSTRUCTION);
+		}
+		if (strcmp (na, "  - ")){		/* '-' vs '0'. */
+			warnprintf (enc, "WARNING at line %d: opcode NEVER should have exactly one explicit 'N/A' ('-' rather than '0'), as the arg.\n", enc->vliw_number + 1);
+		}
+
+	}else{
+		lprintf (enc, "Error at line %d: opcode %s is not valid.\n", enc->vliw_number + 1,opcode);
+		return (PB_ERROR_INVALIDINSTRUCTION);
+	}
+
+	/* Outputs */
+	if ((output > PB_OUTPUTS_24BIT)){			/* Check value of output. */
+		lprintf (enc, "Error: output must be between 0 and 0x%02X, but it is 0x%02lx.\n",PB_OUTPUTS_24BIT,output);
+		return (PB_ERROR_INVALIDINSTRUCTION);
+	}else{
+		vliw_output[2] = (output & 0xFF0000) >> 16;	/* Extract individual bytes using bitwise AND and shift. */
+		vliw_output[1] = (output & 0x00FF00) >> 8;
+		vliw_output[0] = (output & 0x0000FF);
+	}
+
+	/* Lengths */
+	enc->prev_vliw_length = length;		/* Save length of this instruction, for check next time */
+	if ((length < PB_MINIMUM_DELAY) || (length > PB_DELAY_32BIT)){  /* Check value of length */
+		lprintf (enc, "Error: length must be between PB_MINIMUM_DELAY (%d) and PB_DELAY_32BIT (0x%02X), but it is 0x%02lx.\n",PB_MINIMUM_DELAY, PB_DELAY_32BIT, length);
+		return (PB_ERROR_INVALIDINSTRUCTION);
+	}
+	length -= PB_INTERNAL_LATENCY;		/* Account for Pulseblaster latency (3 cycles). */
+
+	vliw_delay[3] = (length & 0xFF000000) >> 24;	/* Extract individual bytes using bitwise AND and shift. */
+	vliw_delay[2] = (length & 0x00FF0000) >> 16;
+	vliw_delay[1] = (length & 0x0000FF00) >> 8;
+	vliw_delay[0] = (length & 0x000000FF);
+
+
+	/* Arguments */
+	vliw_data[2] = (arg & 0x0FF000) >> 12;		/* Extract individual bytes using bitwise AND and shift. */
+	vliw_data[1] = (arg & 0x000FF0) >> 4;
+	vliw_data[0] = (arg & 0x00000F) << 4;
+
+	vliw_data0_opcode=(vliw_data[0] | vliw_opcode);	/* Merge the vliw_data[0] and vliw_opcode nibbles together. */
+
+
+	#if DEBUG==1
+	/*print some diagnostics. Note: use 0x%02x, rather than %-#4x  so that 01 prints as 0x01 and not 0x1. */
+	lprintf (enc, "VLIW (line %3d): Out: [2]  [1]  [0]    Data: [2]  [1]  [0:OPCODE]    Delay: [3]  [2]  [1]  [0]  \n"
+		"                      0x%02x 0x%02x 0x%02x         0x%02x 0x%02x 0x%02x                 0x%02x 0x%02x 0x%02x 0x%02x\n",
+		enc->vliw_number + 1, vliw_output[2],vliw_output[1],vliw_output[0],  vliw_data[2],vliw_data[1],vliw_data0_opcode,  vliw_delay[3],vliw_delay[2],vliw_delay[1],vliw_delay[0]);
+	#endif
+
+	vliw_buf[0] = vliw_output[2];	/*Now, assemble the VLIW instruction into the vliw_buffer. This is the order it is written to the hardware */
+	vliw_buf[1] = vliw_output[1];	/*First 3 bytes are the OUTPUT (MSByte first) */
+	vliw_buf[2] = vliw_output[0];
+
+	vliw_buf[3] = vliw_data[2];	/*20 bit data field... */
+	vliw_buf[4] = vliw_data[1];
+	vliw_buf[5] = vliw_data0_opcode;/*...and a 4 bit opcode. (vliw_data0_opcode is 2 nibbles: vliw_data[0] and Opcode.) */
+
+	vliw_buf[6] = vliw_delay[3];	/*Last 4 bytes are the vliw_delay length. */
+	vliw_buf[7] = vliw_delay[2];
+	vliw_buf[8] = vliw_delay[1];
+	vliw_buf[9] = vliw_delay[0];
+
+	if (enc->loop_depth < 0 || enc->loop_depth > PB_LOOP_MAXDEPTH){ /* Check that we aren't too deep in loops. Note: this only catches the most obvious case. */
+		lprintf (enc, "Errror at line %d: loop_depth is %d, but should be between 0 and %d.\n",enc->vliw_number + 1,enc->loop_depth,PB_LOOP_MAXDEPTH);
+		return (PB_ERROR_LOOPDEPTH);
+	}
+
+	if (enc->vliw_number >= PB_MEMORY){		/* Check we haven't used too much memory. (pb_device_program() checks this too) */
+		lprintf (enc, "Error at line %d: this is one line too many to fit in the memory of 0x%02X bytes!\n", enc->vliw_number + 1, PB_MEMORY);
+		return (PB_ERROR_OUTOFMEM);
+	}
+
+	memcpy (&enc->image[enc->vliw_number * PB_BPW_VLIW], vliw_buf, sizeof(vliw_buf));	/* Append it to the image */
+	enc->lines[enc->vliw_number] = 0;		/* (pb_scan_line() fills this in) */
+	enc->vliw_number++;				/* Increment the line counter */
+
+	return (0); /* If we get to here without returning an error, all is well. Resulting VLIW is in the image */
+}
+
+
+/* The .vliw scanner. Each line is scanned once, in place: there is no copy of it, no strtok(), and no strlen() per token, so a whole
+ * (mmap()ed) file can be encoded without ever being NUL-terminated. The diagnostics are exactly those of the original strtok()/strtoul()
+ * parser: tokens are separated by space, tab or newline; a '//' token starts a comment; numbers are parsed as by strtoul(,,0). */
+
+#define PB_IS_SEPARATOR(c)	(((c) == ' ') || ((c) == '\t') || ((c) == '\n'))	/* The whitespace between tokens */
+
+/* Parse the number in the token [s, e), exactly as strtoul(s, &end, 0) would if the token were NUL-terminated: optional leading
+ * whitespace and sign, then hex (0x), octal (leading 0) or decimal. *end_p is where parsing stopped (s, if there were no digits);
+ * *overflow is set if the value was out of range (strtoul()'s ERANGE). */
+static unsigned long pb_scan_ulong (const char *s, const char *e, const char **end_p, int *overflow){
+	const char *p = s;
+	unsigned long value = 0;
+	unsigned int base = 10, digit;
+	int negative = 0, any = 0;
+
+	*overflow = 0;
+	while ((p < e) && ((*p == '\r') || (*p == '\v') || (*p == '\f'))){	/* isspace(), other than the separators */
+		p++;
+	}
+	if ((p < e) && ((*p == '+') || (*p == '-'))){
+		negative = (*p == '-');
+		p++;
+	}
+	if ((p < e) && (*p == '0')){
+		if ((p + 2 < e) && ((p[1] | 0x20) == 'x') && isxdigit((unsigned char)p[2])){
+			base = 16;
+			p += 2;
+		}else{
+			base = 8;
+		}
+	}
+	for (; p < e; p++){
+		if ((*p >= '0') && (*p <= '9')){
+			digit = *p - '0';
+		}else if (((*p | 0x20) >= 'a') && ((*p | 0x20) <= 'f')){
+			digit = (*p | 0x20) - 'a' + 10;
+		}else{
+			break;
+		}
+		if (digit >= base){
+			break;
+		}
+		if (value > (ULONG_MAX - digit) / base){
+			*overflow = 1;
+		}
+		value = value * base + digit;
+		any = 1;
+	}
+	*end_p = any ? p : s;
+	if (*overflow){
+		return (ULONG_MAX);
+	}
+	return (negative ? -value : value);
+}
+
+/* Parse a line of program source, (passed in as src_line, len bytes, including its '\n' if any; it needn't be NUL-terminated).
+ * Parse it into VLIW tokens, append the result to the image; then return 0 */
+/* If the line is invalid, return the error code. If the line is BLANK or a COMMENT, return -1, and the image is unchanged. */
+/* This is where the "-" in .vliw files meaning "not applicable" is converted to 0 for use by pb_encode_vliw() */
+static int pb_scan_line (struct pb_encoder *enc, const char *src_line, size_t len, unsigned int line_num){	/* line_num is for printing the line of source-code affected (so make it 1-based) */
+
+	unsigned int column = 0;			/* which column are we on */
+	char na[5] = "    ";				/* How many "-" have we seen? */
+	const char *token, *end, *p, *line_end;		/* The token is [token, p). end is the unused part, after parsing a number */
+	int overflow = 0;
+	unsigned long output = 0, length = 0, arg = 0;	/* Results, to go into pb_encode_vliw() */
+	char opcode[OPCODE_MAXLEN];
+	size_t n;
+	const char *nul;
+	int ret;
+
+	if ((nul = memchr (src_line, 0, len)) != NULL){	/* As with fgets() and strtok(), anything after a NUL is ignored */
+		len = nul - src_line;
+	}
+	line_end = src_line + len;
+
+	/*If the actual line length (including the trailing \n) > VLIW_MAXLEN -1, then we are in trouble (fgets() would have split it) */
+	if (len > VLIWLINE_MAXLEN - 1){
+		lprintf (enc, "Error in source file at line %u: Line length is too long (> %d characters). Line begins:\n\t%.*s\n", line_num, VLIWLINE_MAXLEN - 1, VLIWLINE_MAXLEN - 1, src_line);
+ 		return (PB_ERROR_TOKENISING);
+	}
+
+	#if DEBUG==1
+	lprintf (enc, "Line %u is: %.*s",line_num, (int)len, src_line);
+	#endif
+
+	for (p = src_line; ; column++){
+		while ((p < line_end) && PB_IS_SEPARATOR(*p)){	/* Find the next whitespace-delimited token. If the line is empty, nothing will be found. */
+			p++;
+		}
+		if (p == line_end){
+			break;
+		}
+		token = p;
+		while ((p < line_end) && !PB_IS_SEPARATOR(*p)){
+			p++;
+		}
+		n = p - token;
+
+		if ((n > 1) && (token[0] == '/') && (token[1] == '/')) {
+			#if DEBUG==1
+			lprintf (enc, "Encountered comment character (//'). Ignoring rest of line\n");  /* Ignore anything after a '//' */
+			#endif
+			break;
+		}
+
+		/* Parse the data, as strtoul() would (the value may be decimal or hex). Catch anything illegal. Note: we rely on "-" being parsed as "-0", i.e. zero. */
+
+		if (token[0] == '-'){
+			na[column] = '-';	/* Explicitly signal "-" rather than 0. (column is at most 4 here; na[4] is never read) */
+			if (n > 1){
+				lprintf (enc, "Error in source at line %u: column %d, '%.*s' is negative. Line is:\n\t%.*s\n", line_num, column +1, (int)n, token, (int)len, src_line);
+				return (PB_ERROR_TOKENISING);
+			}
+		}
+
+		if ((token[0] == '0') && (n > 1) &&(token[1] != 'x')){ /* Why, why, why is leading zero without 0x interpreted as Octal?  Any accidental use of Octal is a human error. */
+			lprintf (enc, "Error in source at line %u: column %d, '%.*s' begins '0' (but not '0x'). Octal is evil! Line is:\n\t%.*s\n", line_num, column +1, (int)n, token, (int)len, src_line);
+			return (PB_ERROR_TOKENISING);
+		}
+
+		if (column == 0){			/* Column 0, is the vliw output value */
+			output = pb_scan_ulong (token, p, &end, &overflow);
+
+		}else if (column == 1){			/* Column 1, is the vliw opcode (string) */
+			if (n > OPCODE_MAXLEN - 1){
+				n = OPCODE_MAXLEN - 1;
+			}
+			memcpy (opcode, token, n);
+			opcode[n] = 0;
+			end = p;  			/* Not parsing a number for this column. Fake success */
+			overflow = 0;
+
+		}else if (column == 2){			/* Column 2, is the output arg */
+			arg = pb_scan_ulong (token, p, &end, &overflow);   /* Note, for human-readable purposes, a '-' here means N/A, and is treated as a zero. */
+
+		}else if (column == 3){  		/* Column 3, is the vliw length value */
+			length = pb_scan_ulong (token, p, &end, &overflow);
+
+		}else{
+			lprintf (enc, "Error in source at line %u: too many arguments Expect 4. Line is:\n\t%.*s\n", line_num, (int)len, src_line);
+			return (PB_ERROR_TOKENISING);
+		}
+
+		if (overflow || end != p || end == token){	/* Were there any unused chars in the token, eg trailing garbage. */
+			if (na[column]  != '-'){		/* [Also detects empty string, which doesn't happen thanks to the separators and "-" */
+				lprintf (enc, "Error in source at line %u: strtoul() couldn't parse column %d, '%.*s'. Line is:\n\t%.*s\n", line_num, column +1, (int)(p - token), token, (int)len, src_line);
+				return (PB_ERROR_TOKENISING);
+			}
+		}
+	}
+
+	if ((column > 0) && (column < 4)){		/* Too few args in this line! */
+		lprintf (enc, "Error in source at line %u: too few arguments. Expect 4. Line is:\n\t%.*s\n", line_num, (int)len, src_line);
+		return (PB_ERROR_TOKENISING);
+	}
+
+	#if DEBUG==1
+	if (column == 0){				/* Result. */
+		lprintf (enc, " parsed as:   Blank line (or Comment)\n");
+	}else{
+		lprintf (enc, " parsed as:   Output: 0x%02lx   |   OPCODE: %s   |   ARG: 0x%02lx   |   DELAY: 0x%02lx\n", output, opcode, arg, length);
+	}
+	#endif
+
+	if (column == 0){
+		return (-1);					/* Nothing has been appended to the image */
+	}else{
+		if ((ret = pb_encode_vliw (enc, output, opcode, arg, length, na)) == 0){	/* Convert these into a single VLIW, appended to the image. */
+			enc->lines[enc->vliw_number - 1] = line_num;
+		}
+		return (ret);
+	}
+}
+
+/* Parse a (NUL-terminated) line of program source, and append it to the image, as pb_scan_line(). */
+int pb_encode_line (struct pb_encoder *enc, const char *src_line, unsigned int line_num){
+	return (pb_scan_line (enc, src_line, strlen (src_line), line_num));
+}
+
+/* Encode the whole of a .vliw source, buf (len bytes; it needn't be NUL-terminated), one line at a time. The lines are numbered from 1.
+ * Returns 0, or the error code of the first invalid line. */
+int pb_encode_text (struct pb_encoder *enc, const char *buf, size_t len){
+	const char *p = buf, *end = buf + len, *nl;
+	unsigned int line_num = 1;
+	size_t line_len;
+	int ret;
+
+	while (p < end){
+		nl = memchr (p, '\n', end - p);
+		line_len = nl ? (size_t)(nl + 1 - p) : (size_t)(end - p);
+		if ((ret = pb_scan_line (enc, p, line_len, line_num)) > 0){
+			return (ret);
+		}
+		p += line_len;
+		line_num++;
+	}
+	return (0);
+}
+
+/* Get the whole of the source which can be read from fd, into src. A regular file is mmap()ed; anything else (eg a pipe) is read in.
+ * Returns 0, or PB_ERROR_GENERIC (with the explanation printed to log, if it isn't NULL). Release it with pb_source_close(). */
+int pb_source_open (struct pb_source *src, int fd, FILE *log){
+	struct stat stat_buf;
+	char *buf = NULL, *bigger;
+	void *mapped;
+	size_t len = 0, size = 0;
+	ssize_t ret;
+
+	src->buf = NULL;
+	src->len = 0;
+	src->mapped = 0;
+	if ((fstat (fd, &stat_buf) == 0) && S_ISREG(stat_buf.st_mode) && (stat_buf.st_size > 0)){
+		len = stat_buf.st_size;
+		if ((mapped = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+			madvise (mapped, len, MADV_SEQUENTIAL);
+			src->buf = mapped;
+			src->len = len;
+			src->mapped = 1;
+			return (0);
+		}
+		len = 0;				/* Can't map it (unusual); read it instead */
+	}
+
+	do {
+		if (len == size){
+			size = size ? size * 2 : 65536;
+			if ((bigger = realloc (buf, size)) == NULL){
+				if (log) fprintf (log, "Error: out of memory, reading the source.\n");
+				free (buf);
+				return (PB_ERROR_GENERIC);
+			}
+			buf = bigger;
+		}
+		if ((ret = read (fd, buf + len, size - len)) < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			if (log) fprintf (log, "Error: could not read the source: %s\n", strerror(errno));
+			free (buf);
+			return (PB_ERROR_GENERIC);
+		}
+		len += ret;
+	} while (ret > 0);
+
+	src->buf = buf;
+	src->len = len;
+	return (0);
+}
+
+void pb_source_close (struct pb_source *src){
+	if (src->mapped){
+		munmap ((void *)src->buf, src->len);
+	}else{
+		free ((void *)src->buf);
+	}
+	src->buf = NULL;
+	src->len = 0;
+	src->mapped = 0;
+}
+
+/* Encode the whole of the .vliw source which can be read from fd (mapped if possible, see pb_source_open()), as pb_encode_text().
+ * Returns 0, or the error code. */
+int pb_encode_fd (struct pb_encoder *enc, int fd){
+	struct pb_source src;
+	int error;
+
+	if ((error = pb_source_open (&src, fd, enc->log)) != 0){
+		return (error);
+	}
+	error = pb_encode_text (enc, src.buf, src.len);
+	pb_source_close (&src);
+	return (error);
+}
+
+/* At end of vliw parsing. The loop_depth should be zero. Returns 0, or PB_ERROR_LOOPDEPTH */
+int pb_encoder_finish (struct pb_encoder *enc){
+	if (enc->loop_depth != 0){
+		lprintf (enc, "Error: reached end of file: (number_of_loops - number_of_endloops) isn't zero, but %d.\n", enc->loop_depth);
+		return (PB_ERROR_LOOPDEPTH);
+	}else{
+		return (0);
+	}
+}
+
+/* The program image, so far */
+const unsigned char *pb_encoder_image (const struct pb_encoder *enc){
+	return (enc->image);
+}
+
+/* Length of the image, in bytes */
+size_t pb_encoder_len (const struct pb_encoder *enc){
+	return ((size_t)enc->vliw_number * PB_BPW_VLIW);
+}
+
+/* Number of VLIW words in the image */
+unsigned int pb_encoder_words (const struct pb_encoder *enc){
+	return (enc->vliw_number);
+}
+
+/* Number of warnings (and notices) given since the encoder was created (or reset) */
+unsigned int pb_encoder_warnings (const struct pb_encoder *enc){
+	return (enc->warnings);
+}
+
+/* The .vliw source line of each word in the image (for the source map of a .bin container: see pb_image.h) */
+const unsigned int *pb_encoder_lines (const struct pb_encoder *enc){
+	return (enc->lines);
+}
+
+
+/* Decoder */
+
+/* Decode one word of an image back into the values of its .vliw source: the inverse of pb_encode_vliw() (for any word it can produce).
+ * The length has PB_INTERNAL_LATENCY added back; a LOOP's count has PB_BUG_LOOP_OFFSET, and a LONGDELAY's has PB_BUG_LONGDELAY_OFFSET. */
+void pb_decode_vliw (const unsigned char *word, struct pb_vliw *v){
+	v->output = ((unsigned long)word[0] << 16) | (word[1] << 8) | word[2];
+	v->arg = ((unsigned long)word[3] << 12) | (word[4] << 4) | (word[5] >> 4);
+	v->opcode = word[5] & 0x0f;
+	v->length = (((unsigned long)word[6] << 24) | ((unsigned long)word[7] << 16) | (word[8] << 8) | word[9]) + PB_INTERNAL_LATENCY;
+	if (v->opcode == PB_OPCODE_LOOP){
+		v->arg += PB_BUG_LOOP_OFFSET;
+	}else if (v->opcode == PB_OPCODE_LONGDELAY){
+		v->arg += PB_BUG_LONGDELAY_OFFSET;
+	}
+}
+
+/* The opcodes' names, as in .vliw source, indexed by PB_OPCODE_* */
+static const char *const pb_opcode_names[] = { "cont", "stop", "loop", "endloop", "call", "return", "goto", "longdelay", "wait" };
+
+const char *pb_opcode_name (unsigned int opcode){
+	if (opcode >= sizeof(pb_opcode_names) / sizeof(pb_opcode_names[0])){
+		return (NULL);
+	}
+	return (pb_opcode_names[opcode]);
+}
+
+
+/* Print the configuration compiled in from pulseblaster.h, as "NAME: value" lines. This is the output of pb_print_config, which
+ * is how pb_parse learns the configuration; it also goes into the key of each image in the cache (pb_cache.c). Returns as fprintf() */
+int pb_config_print (FILE *fh){
+	return (fprintf (fh, "DEBUG: %d\n"
+		"PB_VERSION: %s\n"
+		"PB_CLOCK_MHZ: %d\n"
+		"PB_TICK_NS: %d\n"
+		"PB_MEMORY: %d\n"
+		"PB_LOOP_MAXDEPTH: %d\n"
+		"PB_SUB_MAXDEPTH: %d\n"
+		"PB_INTERNAL_LATENCY: %d\n"
+		"PB_MINIMUM_DELAY: %d\n"
+		"PB_WAIT_LATENCY: %d\n"
+		"PB_MINIMUM_WAIT_DELAY: %d\n"
+		"PB_BUG_PRESTOP_EXTRADELAY: %d\n"
+		"PB_BUG_WAIT_NOTFIRST: %d\n"
+		"PB_BUG_WAIT_MINFIRSTDELAY: %d\n"
+		"PB_OUTPUTS_24BIT: %u\n"
+		"PB_DELAY_32BIT: %u\n"
+		"PB_ARG_20BIT: %u\n"
+		"PB_LOOP_ARG_MIN: %d\n"
+		"PB_BUG_LOOP_OFFSET: %d\n"
+		"PB_LONGDELAY_ARG_MIN: %d\n"
+		"PB_BUG_LONGDELAY_OFFSET: %d\n"
+		"VLIWLINE_MAXLEN: %d\n"
+		,
+		DEBUG,
+		PB_VERSION,
+		PB_CLOCK_MHZ,
+		PB_TICK_NS,
+		PB_MEMORY,
+		PB_LOOP_MAXDEPTH,
+		PB_SUB_MAXDEPTH,
+		PB_INTERNAL_LATENCY,
+		PB_MINIMUM_DELAY,
+		PB_WAIT_LATENCY,
+		PB_MINIMUM_WAIT_DELAY,
+		PB_BUG_PRESTOP_EXTRADELAY,
+		PB_BUG_WAIT_NOTFIRST,
+		PB_BUG_WAIT_MINFIRSTDELAY,
+		PB_OUTPUTS_24BIT,
+		PB_DELAY_32BIT,
+		PB_ARG_20BIT,
+		PB_LOOP_ARG_MIN,
+		PB_BUG_LOOP_OFFSET,
+		PB_LONGDELAY_ARG_MIN,
+		PB_BUG_LONGDELAY_OFFSET,
+		VLIWLINE_MAXLEN));
+}
+
+/* Describe an error code, as in pulseblaster.h */
+const char *pb_strerror (int error){
+	switch (error){
+		case PB_EXIT_OK:			return ("Success");
+		case PB_ERROR_GENERIC:			return ("Error");
+		case PB_ERROR_WRONGARGS:		return ("Wrong arguments");
+		case PB_ERROR_NODEVICE:			return ("Could not open, or write to, the PulseBlaster device");
+		case PB_ERROR_BUG:			return ("Program bug");
+		case PB_ERROR_INVALIDINSTRUCTION:	return ("Invalid instruction or opcode");
+		case PB_ERROR_OUTOFMEM:			return ("Too many instructions to fit in memory");
+		case PB_ERROR_LOOPDEPTH:		return ("Loops incorrectly nested, or too deep");
+		case PB_ERROR_TOKENISING:		return ("Could not tokenise the line");
+		case PB_ERROR_EMPTYVLIWFILE:		return ("Program file is empty");
+		case PB_ERROR_BADVLIWFILE:		return ("Program file contains no program, or an invalid one");
+	}
+	return ("Unknown error");
+}
@@ -0,0 +1,124 @@
+/* This is libpulseblaster.h, the interface to libpulseblaster (libpulseblaster.c), which does the real work for pb_utils.
+ * There are two independent parts:
+ *   1) The device: open the PulseBlaster's control files in sysfs (and its character device), and program, start, stop, arm and continue it.
+ *   2) The encoder: parse and check .vliw source, compensate for the hardware's misfeatures, and build up a program image (.bin).
+ * Nothing in the library calls exit() or abort(). Each function returns 0, or one of the PB_ERROR_* codes (from pulseblaster.h),
+ * and the explanation is printed to the handle's log stream (stderr by default; NULL for silence).
+ * There are no globals: each handle carries its own state, so separate handles may be used independently, eg in separate threads.
+ * The software emulator of the card is also part of the library: see pb_emulator.h.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#ifndef LIBPULSEBLASTER_H
+#define LIBPULSEBLASTER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+
+/* The device directory, containing the control files. (With '#define HAVE_PB 0', a dummy directory in /tmp is used instead) */
+#if HAVE_PB == 1
+    #define PB_DEVICE_DIR	PB_SYS_DIR
+#else
+    #define PB_DEVICE_DIR	DEBUG_PB_TMP_DIR
+#endif
+
+struct pb_device;	/* Opaque: an open PulseBlaster */
+struct pb_encoder;	/* Opaque: the state of an assembly, and its program image */
+
+
+/* Device */
+
+/* Open the PulseBlaster whose control files are in sys_dir (NULL for PB_DEVICE_DIR). Returns NULL on failure, with *error set (if error isn't NULL) */
+struct pb_device *pb_device_open (const char *sys_dir, int *error);
+void pb_device_close (struct pb_device *dev);
+void pb_device_set_log (struct pb_device *dev, FILE *log);
+const char *pb_device_dir (const struct pb_device *dev);
+
+/* Start (or stop and restart) the program; stop it (un-armed); arm it; continue from a WAIT. See libpulseblaster.c for the details */
+int pb_device_start (struct pb_device *dev);
+int pb_device_stop (struct pb_device *dev);
+int pb_device_arm (struct pb_device *dev);
+int pb_device_cont (struct pb_device *dev);
+
+/* Program the device with a whole image (len bytes). It is checked first, so that an invalid image never reaches the hardware. The driver
+ * is given the whole image at once (via /dev/pulseblasterN, if there is one), so that it reprograms only the part which has changed */
+int pb_device_program (struct pb_device *dev, const unsigned char *image, size_t len);
+
+/* Set the outputs (24 bits), by programming and running a trivial program. This replaces any program already loaded */
+int pb_device_init (struct pb_device *dev, unsigned long output);
+
+
+/* Encoder */
+
+/* Create a new, empty encoder. Returns NULL if out of memory */
+struct pb_encoder *pb_encoder_new (void);
+void pb_encoder_free (struct pb_encoder *enc);
+void pb_encoder_set_log (struct pb_encoder *enc, FILE *log);
+
+/* Start again, with an empty image, at address 0 */
+void pb_encoder_reset (struct pb_encoder *enc);
+
+/* Encode one instruction (as documented in pb_encode_vliw(), in libpulseblaster.c), and append it to the image */
+int pb_encode_vliw (struct pb_encoder *enc, unsigned long output, const char *opcode, unsigned long arg, unsigned long length, const char na[5]);
+
+/* Parse one line of .vliw source (1-based line_num, for messages) and encode it. Returns -1 for a blank line or comment (nothing is appended) */
+int pb_encode_line (struct pb_encoder *enc, const char *src_line, unsigned int line_num);
+
+/* Parse and encode a whole .vliw source: from memory (len bytes, not necessarily NUL-terminated), or from a file descriptor (mmap()ed if
+ * possible). Lines are numbered from 1. Returns 0, or the error of the first invalid line */
+int pb_encode_text (struct pb_encoder *enc, const char *buf, size_t len);
+int pb_encode_fd (struct pb_encoder *enc, int fd);
+
+/* A whole source file in memory: mmap()ed if it's a regular file, else read in (eg from a pipe) */
+struct pb_source {
+	const char *buf;
+	size_t len;
+	int mapped;
+};
+int pb_source_open (struct pb_source *src, int fd, FILE *log);
+void pb_source_close (struct pb_source *src);
+
+/* Call at the end of the source: checks that every loop has been closed */
+int pb_encoder_finish (struct pb_encoder *enc);
+
+/* The program image so far: its bytes, length in bytes, and number of VLIW words */
+const unsigned char *pb_encoder_image (const struct pb_encoder *enc);
+size_t pb_encoder_len (const struct pb_encoder *enc);
+unsigned int pb_encoder_words (const struct pb_encoder *enc);
+
+/* Number of warnings (and notices, eg of a DEBUG) given (so far) about the source. A program with any isn't cached, so that they are always given */
+unsigned int pb_encoder_warnings (const struct pb_encoder *enc);
+
+/* The (1-based) source line of each word in the image; 0 for a word which was encoded directly, by pb_encode_vliw() */
+const unsigned int *pb_encoder_lines (const struct pb_encoder *enc);
+
+
+/* Decoder */
+
+/* One VLIW word, decoded: the values as written in .vliw source, i.e. with the compensations of pb_encode_vliw() undone */
+struct pb_vliw {
+	unsigned long output;			/* 24 bits */
+	unsigned int opcode;			/* PB_OPCODE_*; (but a damaged word may have any value up to 15) */
+	unsigned long arg;			/* LOOP: the count; LONGDELAY: the multiplier; ENDLOOP, GOTO, CALL: the address */
+	unsigned long length;			/* The actual length, in ticks (of each repeat, for a LONGDELAY) */
+};
+
+/* Decode the word (PB_BPW_VLIW bytes) into v */
+void pb_decode_vliw (const unsigned char *word, struct pb_vliw *v);
+
+/* Name of an opcode, in lower case (as .vliw source); NULL if it isn't a valid one */
+const char *pb_opcode_name (unsigned int opcode);
+
+
+/* Print the configuration (from pulseblaster.h), as "NAME: value" lines. This is the output of pb_print_config */
+int pb_config_print (FILE *fh);
+
+/* Brief description of a PB_ERROR_* code */
+const char *pb_strerror (int error);
+
+#endif /* LIBPULSEBLASTER_H */
@@ -1,8 +1,9 @@
 /* This is pb_arm.c  It arms the already-programmed pulseblaster. *
- * Most of the important, shared stuff is in pb_functions.c 
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL v3+ */
 
-#include "pb_functions.c"
+#include <stdlib.h>
+#include "libpulseblaster.h"
 
 void printhelp(){
 	fprintf(stderr,"pb_arm places the (already-programmed) PulseBlaster into the ARMED state, ready for HW_Trigger.\n"
@@ -12,20 +13,28 @@ void printhelp(){
 }
 		       
 int main(int argc, char *argv[] __attribute__ ((unused)) ){
+	struct pb_device *dev;
+	int ret;
+
 	if (argc > 1){
 		printhelp();
 		exit (PB_ERROR_WRONGARGS);
 	}
 
 	/* Open pulseblaster; check device is present */
-	pb_fopen();
+	if ((dev = pb_device_open(NULL, &ret)) == NULL){
+		exit (ret);
+	}
 
 	/* Trigger the pulseblaster */
-	pb_arm();
+	if ((ret = pb_device_arm(dev)) != 0){
+		pb_device_close(dev);
+		exit (ret);
+	}
 	fprintf(stderr, "Pulseblaster has been armed, and is ready for HW_Trigger.\n");
 
        	/* Close the device */
-	pb_fclose();
+	pb_device_close(dev);
 
         return PB_EXIT_OK;      /* i.e. zero */
 }
@@ -1,39 +1,73 @@
 /* This is pb_asm.c  It is similar to pb_prog, but outputs a .bin file, rather than writing to the PulseBlaster hardware. Special case of pb_prog.c
- * Most of the important, shared stuff is in pb_functions.c
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "libpulseblaster.h"
+#include "pb_imgcache.h"
+#include "pb_image.h"
+#include "pb_flow.h"
 
 void printhelp(){
 	fprintf(stderr, "pb_asm is a special case of pb_prog. It reads in a VLIW file, and parses/checks/compensates it.\n"
 		"It outputs the binary PulseBlaster executable to a file, rather than programming it into the hardware.\n"
 		"If output filename isn't specified given, the input will be renamed from file.vliw to file.bin\n"
 		"(If input or output filename is '-', data will be read from/written to stdin/stdout respectively.)\n"
-		"USAGE:    pb_asm INPUT.vliw [ OUTPUT.bin ]\n"
-		"          pb_asm - - \n");
+		"An unchanged source is not assembled again: the image is taken from the cache (see pb_cache -h).\n"
+		"By default, the .bin file is raw: just the VLIW words, exactly as written to the device. With -c or -C, it is a container,\n"
+		"whose header records the model, clock and memory size it was assembled for, the number of instructions, the total run time\n"
+		"(if simple), and a CRC: so that pb_prog can reject a damaged file, or one for the wrong hardware. See doc/bin.txt.\n"
+		"USAGE:    pb_asm [-c|-C] INPUT.vliw [ OUTPUT.bin ]\n"
+		"          pb_asm [-c|-C] - - \n\n"
+		"OPTIONS:  -c           write a container, with a map from each instruction to its line of source.\n"
+		"          -C           write a container, without the source map.\n"
+		"          -h           show this help.\n");
 }
 
 int main(int argc, char *argv[]){
-
-	unsigned int line_num;		/* Line number in file. one-based, for human-readability */
+	int opt; extern int optind;	/* getopt */
+	int container = 0, source_map = 0;
 	unsigned int prog_lines = 0;	/* Lines of actual code "programmed" into the bin file */
 	int ret, len;
+	size_t image_len = 0;
+	const unsigned char *image = NULL;
+	static unsigned char cached_image[PB_MEMORY * PB_BPW_VLIW];
+	char key[PB_CACHE_KEYLEN];
+	int hit = 0;
+	double t_start, encode_seconds = 0, saved = 0;
 	int is_stdin = 0, is_stdout = 0;
 	int fatal_error = 0;
 	int error_exit = PB_ERROR_GENERIC;
-	char buffer[VLIWLINE_MAXLEN];   /* 1024 */
 	char outfile[255];		/* Output filename */
 	char backup[255];		/* Backup filename.*/
 	FILE *source_fh, *dest_fh;
+	struct pb_encoder *enc;
+	struct pb_source src;
+	struct pb_cache *cache;
 	struct stat stat_p;		/* pointer to stat structure */
 
-	if ((argc < 2) || (argc > 3)){
-		fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
+	if ((argc > 1) && (!strcmp (argv[1], "--help"))){
+		printhelp();
 		exit (PB_ERROR_WRONGARGS);
 	}
-	if ((!strcmp (argv[1], "-h")) || (!strcmp (argv[1], "--help"))){
-		printhelp();
+	while ((opt = getopt(argc, argv, "cCh")) != -1){
+		switch (opt){
+			case 'c':  container = 1;  source_map = 1;  break;
+			case 'C':  container = 1;  source_map = 0;  break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	argc -= optind - 1;		/* From here on, as if there were no options: the files are argv[1] and argv[2] */
+	argv += optind - 1;
+	if ((argc < 2) || (argc > 3)){
+		fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
 		exit (PB_ERROR_WRONGARGS);
 	}
 
@@ -108,43 +142,67 @@ int main(int argc, char *argv[]){
 		}
 	}
 
-	/* Iterate over the source file, one line at a time. Note: don't use feof(), or the last line will be duplicated - ugh! */
-	line_num = 1; 		/* Line is one-based */
+	if ((enc = pb_encoder_new()) == NULL){
+		fprintf(stderr, "Error: could not allocate the encoder.\n");
+		exit (PB_ERROR_GENERIC);
+	}
 
-	while (fgets(buffer, VLIWLINE_MAXLEN, source_fh) != NULL){
+	/* Read the whole source file (mapped, if it's a regular file). Unless the cache has it already, parse it one line at a time, in a
+	 * single pass. Each line is parsed into VLIW tokens, compensated, and appended to the image. Blank lines and comments are skipped.
+	 * Stop at the first invalid line. Then the last check on loop depth */
+	cache = source_map ? NULL : pb_cache_open(NULL, stderr);	/* The cache doesn't keep the source lines, which the map needs */
+	if ((ret = pb_source_open (&src, fileno(source_fh), stderr)) != 0){
+		error_exit = ret;
+		fatal_error = 1;
 
-		/* Parse a line of program source code. Parse it into VLIW tokens, compensate, and put the result into vliw_buf[]; then return 0 */
-		/* If the line is invalid, exit with error. If the line is BLANK or a COMMENT, return -1; DO NOT then re-use the buffer, as you would duplicate the last instruction! */
+	}else if ((cache != NULL) && (pb_cache_get (cache, src.buf, src.len, key, cached_image, &image_len, &saved) == 0)){
+		image = cached_image;
+		hit = 1;
 
-		ret = pb_parse_sourceline (buffer, line_num);
-		if (ret > 0){				/* Error encountered during parsing. Clean up and exit */
+	}else{
+		t_start = pb_cache_now();
+		if ((ret = pb_encode_text (enc, src.buf, src.len)) > 0){	/* Error encountered during parsing. Clean up and exit */
 			error_exit = ret;
 			fatal_error = 1;
-			break;
-
-		}else if (ret == 0){			/* Don't duplicate vliw_buf[] if we parsed a comment (and returned -1). */
-
-			ret = fwrite(vliw_buf, sizeof(char), sizeof(vliw_buf), dest_fh);  /* Write the buffer to the output stream (rather than call pb_write_program() ) */
-
-			if (ret == PB_BPW_VLIW){ 	/* Did we succeed in writing the entire buffer? */
-				prog_lines++;
-			}else{
-				fatal_error = 1;		/* Trigger error (and deletion of outfile) below */
-				fprintf (stderr, "Error: could not write the whole %d bytes of the vliw_buffer to output file %s\n", PB_BPW_VLIW, outfile);
-				break;
-			}
 		}
-		line_num++;
+		if ((!fatal_error) && (pb_encoder_finish(enc) != 0)){
+			fatal_error = 1;
+		}
+		image = pb_encoder_image(enc);
+		image_len = pb_encoder_len(enc);
+		encode_seconds = pb_cache_now() - t_start;
 	}
 
-	/* Last check on loop depth */
-	if ((!fatal_error) && (check_loop_depth() != 0)){
+	/* Follow every path through the program (pb_flow.c): this catches what the encoder can't, such as subroutines nested too deep */
+	if ((!fatal_error) && (image_len > 0) && ((ret = pb_verify (image, image_len, hit ? NULL : pb_encoder_lines(enc), NULL, stderr)) != 0)){
+		error_exit = ret;
 		fatal_error = 1;
 	}
+	if ((!hit) && (!fatal_error) && (cache != NULL) && (image_len > 0) && (pb_encoder_warnings(enc) == 0)){	/* Only a good program is cached: a bad one (or one with warnings or notices) must always give its messages */
+		pb_cache_put (cache, key, image, image_len, encode_seconds);
+	}
+	pb_source_close (&src);
+	prog_lines = image_len / PB_BPW_VLIW;
+
+	/* Write the image to the output stream: raw, or in a container */
+	if ((!fatal_error) && (image_len > 0) && (container)){
+		if (pb_image_write (dest_fh, image, image_len, source_map ? pb_encoder_lines(enc) : NULL) != 0){
+			fatal_error = 1;
+			fprintf (stderr, "Error: could not write the whole %lu bytes of the program image to output file %s\n", (unsigned long)image_len, outfile);
+		}
+	}else if ((!fatal_error) && (fwrite(image, sizeof(char), image_len, dest_fh) != image_len)){
+		fatal_error = 1;		/* Trigger error (and deletion of outfile) below */
+		fprintf (stderr, "Error: could not write the whole %lu bytes of the program image to output file %s\n", (unsigned long)image_len, outfile);
+	}
+	pb_encoder_free(enc);
+	pb_cache_close(cache);
 
 	/* close file descriptors */
 	fclose(source_fh);
-	fclose(dest_fh);
+	if ((fclose(dest_fh) != 0) && (!fatal_error)){
+		fatal_error = 1;
+		fprintf (stderr, "Error: could not write output file %s\n", outfile);
+	}
 
 	/* If we don't get here, we already exited with error msg and errorcode */
 
@@ -163,7 +221,10 @@ int main(int argc, char *argv[]){
 	}
 
 	fprintf(stderr, "Source file %s (with %d instructions) has been assembled into binary file %s.\n", argv[1], prog_lines, outfile);
-	fprintf(stderr, "This executable may be loaded with pb_prog, or directly written to PB: %s\n", PB_SYS_PROGRAM);
+	if (hit){
+		fprintf(stderr, "(Unchanged source: the image was in the cache. That saved %.3f ms.)\n", saved * 1e3);
+	}
+	fprintf(stderr, "This executable may be loaded with pb_prog, or directly written to PB: %s\n", PB_DEVICE_DIR"/"PB_PROGRAM);
 
 	return PB_EXIT_OK;	/* i.e. zero */
 }
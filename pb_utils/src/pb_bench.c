@@ -0,0 +1,327 @@
+/* This is pb_bench.c  It benchmarks the programming path, one layer at a time, for images of various sizes:
+ *   parse     pb_encode_text() over the whole .vliw source, as pb_asm and pb_prog do (this includes the encoding)
+ *   encode    pb_encode_vliw() alone, on pre-tokenised lines
+ *   tokenise  parse - encode (derived)
+ *   write     pb_device_program(), i.e. the write() calls to the programming file (of a dummy device, in a temporary directory)
+ *   transfer  the driver's byte-by-byte transfer through the (emulated) AMCC bridge, then arm (see pb_emulator.c)
+ * Results go to stdout as tab-separated lines, one per image and layer, so that they can be compared between versions.
+ * All the state is in the encoder, device and emulator handles, so each run simply starts with a fresh (reset) one.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "libpulseblaster.h"
+#include "pb_emulator.h"
+
+#define eprintf(...)		fprintf (stderr, __VA_ARGS__)
+
+#define PB_BENCH_DEFAULT_RUNS	3			/* Take the fastest of this many runs of each layer */
+#define PB_BENCH_TMP_DIR	"/tmp/pb_bench.XXXXXX"	/* The write layer's dummy device directory (unless -o) */
+#define PB_BENCH_LENGTH		(50000000 / PB_TICK_NS)	/* 50ms: the same as pb_parse/pbsrc_examples/large/32768-words-test.pbsrc */
+
+/* A pre-tokenised line, for the encode layer */
+struct pb_bench_word {
+	unsigned long output, arg, length;
+	char opcode[OPCODE_MAXLEN];
+	char na[5];
+};
+
+/* An image under test: its source lines, and (once parsed) its binary */
+struct pb_bench_image {
+	const char *name;
+	char **lines;				/* Source lines, each (like fgets()) with its '\n' */
+	unsigned int num_lines;
+	char *text;				/* The whole source, as it would be mapped from the file */
+	size_t text_len;
+	struct pb_bench_word *words;		/* Pre-tokenised instructions */
+	unsigned int num_words;
+	unsigned char *bin;			/* The assembled image */
+};
+
+struct pb_encoder *enc;
+struct pb_device *dev;				/* For the write layer */
+const char *dev_dir = NULL;			/* Its directory */
+char tmp_dir[] = PB_BENCH_TMP_DIR;
+struct pb_emu emu;				/* Large: not on the stack */
+
+void printhelp(){
+	fprintf(stderr, "pb_bench benchmarks each layer of the programming path, for images of various sizes.\n"
+		"The layers are: parse (pb_encode_text, including encoding), encode (pb_encode_vliw alone),\n"
+		"tokenise (parse - encode), write (pb_device_program's write() calls) and transfer (the driver's\n"
+		"byte-by-byte transfer, through the emulated AMCC bridge).\n"
+		"Output is tab-separated, one line per image and layer:  image words layer seconds words_per_second\n\n"
+		"USAGE:    pb_bench [OPTIONS] [-g words]... [FILENAME.vliw]...\n\n"
+		"OPTIONS:  -g words     generate an image of this many 50ms conts (like 32768-words-test.pbsrc).\n"
+		"          -r runs      take the fastest of this many runs (default %d).\n"
+		"          -o dir       write layer programs the device in this directory (default: a temporary directory).\n"
+		"                       Beware: if this is the real device in /sys, the PulseBlaster will be programmed!\n"
+		"          -h           show this help.\n", PB_BENCH_DEFAULT_RUNS);
+}
+
+/* Time now, in seconds */
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/* Add a source line to the image */
+void add_line(struct pb_bench_image *img, const char *line, size_t len){
+	if (len >= VLIWLINE_MAXLEN - 1){
+		eprintf("Error: line %d of %s is too long.\n", img->num_lines + 1, img->name);
+		exit (PB_ERROR_TOKENISING);
+	}
+	img->lines = realloc(img->lines, (img->num_lines + 1) * sizeof(*img->lines));
+	if ((img->lines == NULL) || ((img->lines[img->num_lines] = malloc(len + 2)) == NULL)){
+		eprintf("Error: out of memory.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+	memcpy(img->lines[img->num_lines], line, len);
+	img->lines[img->num_lines][len] = '\n';
+	img->lines[img->num_lines][len + 1] = 0;
+	img->num_lines++;
+
+	if ((img->text = realloc(img->text, img->text_len + len + 1)) == NULL){
+		eprintf("Error: out of memory.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+	memcpy(img->text + img->text_len, line, len);
+	img->text[img->text_len + len] = '\n';
+	img->text_len += len + 1;
+}
+
+/* Load a .vliw file */
+void load_file(struct pb_bench_image *img, const char *filename){
+	char buffer[VLIWLINE_MAXLEN];
+	FILE *source_fh;
+
+	if ((source_fh = fopen(filename, "r")) == NULL){
+		eprintf("Could not open program-file %s.\n", filename);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	img->name = filename;
+	while (fgets(buffer, VLIWLINE_MAXLEN, source_fh) != NULL){
+		add_line(img, buffer, strcspn(buffer, "\n"));
+	}
+	fclose(source_fh);
+}
+
+/* Generate an image of n 50ms conts, with the output counting up */
+void generate(struct pb_bench_image *img, unsigned int n){
+	char buffer[VLIWLINE_MAXLEN];
+	char *name;
+	unsigned int j;
+
+	if ((name = malloc(32)) == NULL){
+		eprintf("Error: out of memory.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+	sprintf(name, "generated-%u", n);
+	img->name = name;
+	for (j = 0; j < n; j++){
+		add_line(img, buffer, sprintf(buffer, "0x%06x\tcont\t-\t0x%x", j & PB_OUTPUTS_24BIT, PB_BENCH_LENGTH));
+	}
+}
+
+/* Tokenise the image (untimed), for the encode layer. Only well-formed lines matter: the parse layer has already checked them. */
+void tokenise(struct pb_bench_image *img){
+	char buffer[VLIWLINE_MAXLEN];
+	char *token, *tokens[4];
+	struct pb_bench_word *word;
+	unsigned int j, column;
+
+	img->words = calloc(img->num_lines, sizeof(*img->words));
+	if (img->words == NULL){
+		eprintf("Error: out of memory.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+	for (j = 0; j < img->num_lines; j++){
+		strcpy(buffer, img->lines[j]);
+		column = 0;
+		for (token = strtok(buffer, "\t\n "); token && (column < 4); token = strtok(NULL, "\t\n ")){
+			if ((token[0] == '/') && (token[1] == '/'))
+				break;
+			tokens[column++] = token;
+		}
+		if (column < 4)			/* Blank or comment (or invalid, which the parse layer will reject) */
+			continue;
+		word = &img->words[img->num_words++];
+		strcpy(word->na, "    ");
+		for (column = 0; column < 4; column++){
+			if (tokens[column][0] == '-')
+				word->na[column] = '-';
+		}
+		word->output = strtoul(tokens[0], NULL, 0);
+		snprintf(word->opcode, OPCODE_MAXLEN, "%s", tokens[1]);
+		word->arg = strtoul(tokens[2], NULL, 0);
+		word->length = strtoul(tokens[3], NULL, 0);
+	}
+}
+
+/* Run one layer. Returns the elapsed time in seconds; the parse layer also fills in img->bin. Exits on error. */
+double run_layer(struct pb_bench_image *img, const char *layer){
+	double t_start, elapsed = 0;
+	unsigned int j;
+	int ret;
+
+	if (!strcmp(layer, "parse")){
+		pb_encoder_reset(enc);
+		t_start = now();
+		if ((ret = pb_encode_text(enc, img->text, img->text_len)) != 0)
+			exit (ret);
+		if ((ret = pb_encoder_finish(enc)) != 0)
+			exit (ret);
+		elapsed = now() - t_start;
+		if (pb_encoder_words(enc) != img->num_words){
+			eprintf("Error: parsed %u instructions from image %s, but expected %u.\n", pb_encoder_words(enc), img->name, img->num_words);
+			exit (PB_ERROR_BUG);
+		}
+		memcpy(img->bin, pb_encoder_image(enc), pb_encoder_len(enc));
+
+	}else if (!strcmp(layer, "encode")){
+		pb_encoder_reset(enc);
+		t_start = now();
+		for (j = 0; j < img->num_words; j++){
+			ret = pb_encode_vliw(enc, img->words[j].output, img->words[j].opcode, img->words[j].arg, img->words[j].length, img->words[j].na);
+			if (ret > 0)
+				exit (ret);
+		}
+		elapsed = now() - t_start;
+
+	}else if (!strcmp(layer, "write")){
+		t_start = now();
+		if ((ret = pb_device_program(dev, img->bin, (size_t)img->num_words * PB_BPW_VLIW)) != 0)
+			exit (ret);
+		elapsed = now() - t_start;
+
+	}else if (!strcmp(layer, "transfer")){
+		pb_emu_init(&emu);
+		t_start = now();
+		if ((pb_emu_program(&emu, img->bin, (unsigned long)img->num_words * PB_BPW_VLIW) < 0) || (pb_emu_arm(&emu) < 0)){
+			eprintf("Error: programming the emulator failed.\n");
+			exit (PB_ERROR_NODEVICE);
+		}
+		elapsed = now() - t_start;
+	}
+	return (elapsed);
+}
+
+/* Print one result line */
+void report(struct pb_bench_image *img, const char *layer, double seconds){
+	printf("%s\t%u\t%s\t%.9f\t%.0f\n", img->name, img->num_words, layer, seconds, (seconds > 0) ? img->num_words / seconds : 0);
+}
+
+/* Benchmark every layer for this image */
+void bench(struct pb_bench_image *img, unsigned int runs){
+	const char *layers[] = { "parse", "encode", "write", "transfer" };
+	double best[4];
+	double t;
+	unsigned int j, run;
+	int ret;
+
+	if (enc == NULL){			/* First image: create the encoder and device */
+		if ((enc = pb_encoder_new()) == NULL){
+			eprintf("Error: out of memory.\n");
+			exit (PB_ERROR_GENERIC);
+		}
+		if ((dev_dir == NULL) && ((dev_dir = mkdtemp(tmp_dir)) == NULL)){
+			perror("Could not create temporary directory");
+			exit (PB_ERROR_GENERIC);
+		}
+		if ((dev = pb_device_open(dev_dir, &ret)) == NULL)
+			exit (ret);
+	}
+
+	tokenise(img);
+	if (img->num_words == 0){
+		eprintf("Error: program file %s contains no instructions.\n", img->name);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	if (img->num_words > PB_MEMORY){
+		eprintf("Error: program file %s has %u instructions, but the PulseBlaster only has %d words available!\n", img->name, img->num_words, PB_MEMORY);
+		exit (PB_ERROR_OUTOFMEM);
+	}
+	if ((img->bin = malloc((size_t)img->num_words * PB_BPW_VLIW)) == NULL){
+		eprintf("Error: out of memory.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+
+	for (j = 0; j < 4; j++){		/* Parse comes first: it fills in img->bin */
+		for (run = 0; run < runs; run++){
+			t = run_layer(img, layers[j]);
+			if ((run == 0) || (t < best[j]))
+				best[j] = t;
+		}
+	}
+	report(img, "parse", best[0]);
+	report(img, "encode", best[1]);
+	report(img, "tokenise", (best[0] > best[1]) ? (best[0] - best[1]) : 0);
+	report(img, "write", best[2]);
+	report(img, "transfer", best[3]);
+	fflush(stdout);
+}
+
+/* Remove the temporary device directory (which pb_device_open() filled with the control files) */
+void remove_tmp_dir(const char *dir){
+	const char *files[] = { PB_PROGRAM, PB_START, PB_STOP, PB_ARM, PB_CONT };
+	char path[VLIWLINE_MAXLEN];
+	unsigned int j;
+
+	for (j = 0; j < sizeof(files) / sizeof(files[0]); j++){
+		snprintf(path, sizeof(path), "%s/%s", dir, files[j]);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern char *optarg; extern int optind;	/* getopt */
+	struct pb_bench_image img;
+	unsigned int runs = PB_BENCH_DEFAULT_RUNS;
+	int any = 0;
+
+	printf("#image\twords\tlayer\tseconds\twords_per_second\n");
+	while ((opt = getopt(argc, argv, "g:r:o:h")) != -1){
+		switch (opt){
+			case 'g':
+				memset(&img, 0, sizeof(img));
+				generate(&img, strtoul(optarg, NULL, 0));
+				bench(&img, runs);
+				any = 1;
+				break;
+			case 'r':
+				runs = strtoul(optarg, NULL, 0);
+				if (runs == 0)
+					runs = 1;
+				break;
+			case 'o':
+				if (dev == NULL)		/* (Only before the first image) */
+					dev_dir = optarg;
+				break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	for (; optind < argc; optind++){
+		memset(&img, 0, sizeof(img));
+		load_file(&img, argv[optind]);
+		bench(&img, runs);
+		any = 1;
+	}
+	if (!any){
+		printhelp();
+		exit (PB_ERROR_WRONGARGS);
+	}
+
+	pb_device_close(dev);
+	pb_encoder_free(enc);
+	if (dev_dir == tmp_dir){
+		remove_tmp_dir(tmp_dir);
+	}
+	return PB_EXIT_OK;	/* i.e. zero */
+}
@@ -0,0 +1,78 @@
+/* This is pb_cache.c  It reports on (or clears) the cache of assembled program images, which pb_asm and pb_prog use so as not to parse
+ * an unchanged .vliw file again (and pb_parse, an unchanged .pbsrc file). The cache itself is in libpulseblaster (pb_imgcache.c).
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pb_imgcache.h"
+
+void printhelp(){
+	fprintf(stderr, "pb_cache reports on the cache of assembled program images. pb_asm and pb_prog look up each .vliw file here\n"
+		"before parsing it, and store each image they assemble. The key is the SHA-256 of the source, and of the configuration\n"
+		"(as pb_print_config prints it): so an image is only reused if it would be assembled into exactly the same bytes.\n"
+		"pb_parse keeps its output here too: each .vliw it parses, keyed on the .pbsrc, its #includes, the -D values and the\n"
+		"configuration. Its entries and lookups are counted along with the images.\n"
+		"The statistics (lookups, hits, hit rate, time saved) are printed to stdout, as 'name: value' lines.\n\n"
+		"The cache is in $PB_CACHE_DIR, or else $XDG_CACHE_HOME/pb_utils, or else ~/.cache/pb_utils.\n"
+		"Set PB_CACHE_DIR to the empty string to disable it.\n\n"
+		"USAGE:    pb_cache [-d DIR] [-c]\n\n"
+		"OPTIONS:  -d DIR       use the cache in DIR.\n"
+		"          -c           clear the cache (remove every entry, and reset the statistics).\n"
+		"          -h           show this help.\n");
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern char *optarg; extern int optind;	/* getopt */
+	const char *dir = NULL;
+	int clear = 0;
+	struct pb_cache *cache;
+	struct pb_cache_stats stats;
+
+	while ((opt = getopt(argc, argv, "d:ch")) != -1){
+		switch (opt){
+			case 'd':  dir = optarg;  break;
+			case 'c':  clear = 1;  break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if (optind != argc){
+		fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
+		exit (PB_ERROR_WRONGARGS);
+	}
+
+	if ((cache = pb_cache_open(dir, stderr)) == NULL){
+		fprintf(stderr, "The cache is disabled (PB_CACHE_DIR is empty), or can't be used.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+
+	if (clear){
+		if (pb_cache_clear(cache) < 0){
+			fprintf(stderr, "Error: could not clear all of the cache %s.\n", pb_cache_dir(cache));
+			pb_cache_close(cache);
+			exit (PB_ERROR_GENERIC);
+		}
+		fprintf(stderr, "The cache %s has been cleared.\n", pb_cache_dir(cache));
+	}
+
+	if (pb_cache_stats(cache, &stats) < 0){
+		fprintf(stderr, "Error: could not read the cache %s.\n", pb_cache_dir(cache));
+		pb_cache_close(cache);
+		exit (PB_ERROR_GENERIC);
+	}
+	printf("dir: %s\n", pb_cache_dir(cache));
+	printf("entries: %lu\n", stats.entries);
+	printf("bytes: %llu\n", stats.bytes);
+	printf("lookups: %llu\n", stats.lookups);
+	printf("hits: %llu\n", stats.hits);
+	printf("hit_rate: %.3f\n", stats.lookups ? (double)stats.hits / stats.lookups : 0.0);
+	printf("stores: %llu\n", stats.stores);
+	printf("seconds_saved: %.6f\n", stats.seconds_saved);
+
+	pb_cache_close(cache);
+	return PB_EXIT_OK;	/* i.e. zero */
+}
@@ -0,0 +1,231 @@
+/* This is pb_disasm.c  It turns a .bin file (raw, or a container) back into .vliw source: the inverse of pb_asm.
+ * Each word is decoded by pb_decode_vliw() (libpulseblaster), which undoes the compensations of pb_encode_vliw() (PB_INTERNAL_LATENCY,
+ * PB_BUG_LOOP_OFFSET, PB_BUG_LONGDELAY_OFFSET, and the packing of the arg with the opcode), and written in one canonical form:
+ * one instruction per line, output in hex, arg and length in decimal, and '-' exactly where pb_asm expects it. So the .vliw assembles
+ * back into the same bytes, and two images can be compared with diff.
+ * That is checked as it goes: each decoded word is encoded again (with all pb_asm's checks) and compared with the original.
+ * The whole output is built in memory and written at once, so even a full-memory image takes only milliseconds.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libpulseblaster.h"
+#include "pb_image.h"
+
+#define PB_DISASM_LINE_MAXLEN	128	/* Longest line written (an invalid word, as a comment, with its annotation) */
+
+void printhelp(){
+	fprintf(stderr, "pb_disasm disassembles a PulseBlaster executable (.bin file, raw or container) back into .vliw source.\n"
+		"The output is canonical: pb_asm assembles it back into exactly the same bytes (this is checked as it is written).\n"
+		"So, to compare what is loaded with what was compiled, disassemble both and diff them.\n"
+		"A word which pb_asm could not have produced is reported (and the exit status is non-zero).\n\n"
+		"USAGE:    pb_disasm [OPTIONS] [FILENAME.bin | -] [OUTPUT.vliw | -]\n"
+		"          (With no file, or '-', read stdin. Output is to stdout, unless OUTPUT.vliw is given.)\n\n"
+		"OPTIONS:  -a           annotate each line (as a comment) with its address.\n"
+		"          -l           annotate each line with the line of source it came from (if the container has a source map).\n"
+		"          -h           show this help.\n");
+}
+
+/* Write x in decimal at p; return the end */
+static char *put_dec(char *p, unsigned long x){
+	char digits[24];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + (x % 10);
+		x /= 10;
+	} while (x);
+	while (n){
+		*p++ = digits[--n];
+	}
+	return (p);
+}
+
+/* Write x as 0x and 6 hex digits at p; return the end */
+static char *put_hex6(char *p, unsigned long x){
+	static const char hex[] = "0123456789abcdef";
+	int shift;
+
+	*p++ = '0';
+	*p++ = 'x';
+	for (shift = 20; shift >= 0; shift -= 4){
+		*p++ = hex[(x >> shift) & 0xf];
+	}
+	return (p);
+}
+
+static char *put_str(char *p, const char *s){
+	while (*s){
+		*p++ = *s++;
+	}
+	return (p);
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern int optind;	/* getopt */
+	int annotate_address = 0, annotate_line = 0;
+	const char *infile = "-", *outfile = "-";
+	static char out[PB_MEMORY * PB_DISASM_LINE_MAXLEN];
+	static unsigned int lines[PB_MEMORY];
+	char *p = out;
+	const char *name, *na;
+	struct pb_source src;
+	struct pb_image bin;
+	struct pb_vliw v;
+	struct pb_encoder *enc;
+	FILE *source_fh, *dest_fh;
+	unsigned int i, bad = 0;
+	int verifying = 1, have_lines = 0, ret;
+
+	while ((opt = getopt(argc, argv, "alh")) != -1){
+		switch (opt){
+			case 'a':  annotate_address = 1;  break;
+			case 'l':  annotate_line = 1;  break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if (argc - optind > 2){
+		fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if (optind < argc){
+		infile = argv[optind];
+	}
+	if (optind + 1 < argc){
+		outfile = argv[optind + 1];
+	}
+
+	/* Read (or map) the whole image, and check it */
+	if (!strcmp (infile, "-")){
+		source_fh = stdin;
+	}else if ((source_fh = fopen(infile, "r")) == NULL){
+		fprintf(stderr,"Could not open program-file %s.\n", infile);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((ret = pb_source_open(&src, fileno(source_fh), stderr)) != 0){
+		exit (ret);
+	}
+	if (src.len == 0){
+		fprintf(stderr, "Error: file %s is empty!\n", infile);
+		exit (PB_ERROR_EMPTYVLIWFILE);
+	}
+	if (src.len > PB_IMAGE_MAXLEN){
+		fprintf(stderr, "Error: executable file %s is more than %d words long.\n", infile, PB_MEMORY);
+		exit (PB_ERROR_OUTOFMEM);
+	}
+	if (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, stderr) != 0){
+		fprintf(stderr, "Error in program file %s.\n", infile);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	if ((bin.payload_len % PB_BPW_VLIW) || (bin.words > PB_MEMORY)){
+		fprintf(stderr, "Error: executable file %s is %lu bytes long, but should be a multiple of %d, and at most %d words.\n",
+			infile, (unsigned long)bin.payload_len, PB_BPW_VLIW, PB_MEMORY);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	if (annotate_line){
+		if (pb_image_lines(&bin, lines) == 0){
+			have_lines = 1;
+		}else{
+			fprintf(stderr, "Warning: %s has no source map, so the source lines can't be shown.\n", infile);
+		}
+	}
+
+	if ((enc = pb_encoder_new()) == NULL){
+		fprintf(stderr, "Error: could not allocate the encoder.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+
+	/* Decode each word into one line. Then encode it again: it must give back the same word (else pb_asm would not reproduce the image) */
+	for (i = 0; i < bin.words; i++){
+		pb_decode_vliw(bin.payload + i * PB_BPW_VLIW, &v);
+		if ((name = pb_opcode_name(v.opcode)) == NULL){
+			p = put_str(p, "// Invalid opcode ");		/* Keep one line per word, so the line numbers are still the addresses (+1) */
+			p = put_dec(p, v.opcode);
+			fprintf(stderr, "Error at line %u: word has opcode %u, which is not valid.\n", i + 1, v.opcode);
+			verifying = 0;
+			bad++;
+
+		}else{
+			switch (v.opcode){
+				case PB_OPCODE_STOP:
+					na = "- --";
+					p = put_str(p, "-\tstop\t-\t-");
+					break;
+				case PB_OPCODE_CONT:
+				case PB_OPCODE_RETURN:
+				case PB_OPCODE_WAIT:
+					na = "  - ";
+					p = put_hex6(p, v.output);
+					*p++ = '\t';
+					p = put_str(p, name);
+					p = put_str(p, "\t-\t");
+					p = put_dec(p, v.length);
+					break;
+				default:
+					na = "    ";
+					p = put_hex6(p, v.output);
+					*p++ = '\t';
+					p = put_str(p, name);
+					*p++ = '\t';
+					p = put_dec(p, v.arg);
+					*p++ = '\t';
+					p = put_dec(p, v.length);
+					break;
+			}
+			if (verifying){
+				if ((ret = pb_encode_vliw(enc, (v.opcode == PB_OPCODE_STOP) ? 0 : v.output, name, (v.opcode == PB_OPCODE_STOP) ? 0 : v.arg,
+						(v.opcode == PB_OPCODE_STOP) ? 0 : v.length, na)) != 0){
+					verifying = 0;		/* (The encoder's state is now wrong, so the checks of the following words would be meaningless) */
+					bad++;
+				}else if (memcmp(pb_encoder_image(enc) + i * PB_BPW_VLIW, bin.payload + i * PB_BPW_VLIW, PB_BPW_VLIW)){
+					fprintf(stderr, "Error at line %u: this %s would be reassembled differently (pb_asm always writes it in one way).\n", i + 1, name);
+					verifying = 0;
+					bad++;
+				}
+			}
+		}
+		if (annotate_address || have_lines){
+			p = put_str(p, "\t//");
+			if (annotate_address){
+				p = put_str(p, " address ");
+				p = put_dec(p, i);
+			}
+			if (have_lines){
+				p = put_str(p, " line ");
+				p = put_dec(p, lines[i]);
+			}
+		}
+		*p++ = '\n';
+	}
+	if ((verifying) && (pb_encoder_finish(enc) != 0)){
+		bad++;
+	}
+	pb_encoder_free(enc);
+	pb_source_close(&src);
+	fclose(source_fh);
+
+	/* Write it all out */
+	if (!strcmp (outfile, "-")){
+		dest_fh = stdout;
+	}else if ((dest_fh = fopen(outfile, "w")) == NULL){
+		fprintf(stderr,"Could not open destination-file %s for writing.\n", outfile);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((fwrite(out, 1, p - out, dest_fh) != (size_t)(p - out)) || (fclose(dest_fh) != 0)){
+		fprintf(stderr, "Error: could not write output file %s\n", outfile);
+		exit (PB_ERROR_GENERIC);
+	}
+
+	if (bad){
+		fprintf(stderr, "Error: %s can't be reassembled into the same image: pb_asm could not have produced it.%s\n", infile,
+			verifying ? "" : " (Words after the first error were not checked.)");
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	fprintf(stderr, "Binary file %s (with %u instructions) has been disassembled into %s.\n", infile, bin.words, outfile);
+	return PB_EXIT_OK;	/* i.e. zero */
+}
@@ -0,0 +1,250 @@
+/* This is pb_emu.c  It runs a PulseBlaster program on the software emulator (pb_emulator.c, in libpulseblaster), for testing without the hardware.
+ * The .bin file is pushed byte-by-byte through the emulated AMCC bridge, exactly as the kernel driver would program the real card;
+ * the program is then started, and executed with the documented latencies. Throughput of both steps is reported.
+ * With '#define HAVE_PB 0', the other pb_utils write the program into DEBUG_PB_TMP_DIR: by default, pb_emu runs that.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "pb_emulator.h"
+#include "pb_image.h"
+
+#define PB_EMU_DEFAULT_FILE	DEBUG_PB_TMP_DIR"/"PB_PROGRAM	/* What pb_prog (with HAVE_PB 0) leaves behind */
+#define PB_EMU_DEFAULT_STEPS	10000000			/* Stop after this many instructions, since most programs never end */
+#define PB_EMU_MAX_CARDS	16				/* Most cards in a group (-g) */
+
+void printhelp(){
+	fprintf(stderr, "pb_emu runs a PulseBlaster program on the software emulator of the card, without the hardware.\n"
+		"The program is loaded via the emulated AMCC bridge (just as the driver does), then started, and executed.\n"
+		"The loading and execution statistics (and throughput) are printed to stdout, as 'name: value' lines.\n\n"
+		"The .bin file may be raw, or a container (pb_asm -c), whose header and CRC are checked first.\n\n"
+		"USAGE:    pb_emu [OPTIONS] [FILENAME.bin | -]\n"
+		"          (With no file, use "PB_EMU_DEFAULT_FILE", as written by the pb_utils built with HAVE_PB 0).\n\n"
+		"OPTIONS:  -l polls     bridge latency: polls before the bridge responds to each nibble (default 0).\n"
+		"          -p previous  load (and arm) the program previous.bin first, as if it were already on the card.\n"
+		"          -s           shadow: as the driver does, reprogram only as far as the highest word which differs\n"
+		"                       from the previous program (-p), with the driver's own code (pulseblaster_shadow.h).\n"
+		"                       The memory_crc is the same as for a full reprogram.\n"
+		"          -g cards     group: load the program onto this many cards (up to %d), and start them together, as the\n"
+		"                       driver's PB_IOC_GROUP_START does. Report the skew between the first and last start, in ns\n"
+		"                       and in bridge accesses, and check that every card then runs the same.\n"
+		"          -u steps     stop after this many instructions (default %d; 0 for no limit).\n"
+		"          -w           stop at the first WAIT, rather than re-triggering it automatically.\n"
+		"          -t           trace: print 'ticks output' to stdout, at each instruction.\n"
+		"          -h           show this help.\n", PB_EMU_DEFAULT_STEPS, PB_EMU_MAX_CARDS);
+}
+
+/* Read in a program file (raw, or a container), checking it, and return the image and its length. Exit on error. */
+const unsigned char *read_program(const char *filename, unsigned char *file, struct pb_image *bin, size_t *len_ret){
+	FILE *source_fh;
+	size_t len;
+
+	if (!strcmp (filename, "-")){
+		source_fh = stdin;
+	}else if ((source_fh = fopen(filename, "r")) == NULL){
+		fprintf(stderr,"Could not open program-file %s.\n", filename);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	len = fread(file, 1, PB_IMAGE_MAXLEN + 1, source_fh);
+	fclose(source_fh);
+	if (len == 0){
+		fprintf(stderr, "Error: file %s is empty!\n", filename);
+		exit (PB_ERROR_EMPTYVLIWFILE);
+	}
+	if (len > PB_IMAGE_MAXLEN){
+		fprintf(stderr, "Error: executable file %s is more than %d words long.\n", filename, PB_MEMORY);
+		exit (PB_ERROR_OUTOFMEM);
+	}
+	if (pb_image_parse(bin, file, len, stderr) != 0){
+		fprintf(stderr, "Error in program file %s.\n", filename);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	len = bin->payload_len;
+	if (len > (size_t)PB_MEMORY * PB_BPW_VLIW){
+		fprintf(stderr, "Error: executable file %s is more than %d words long.\n", filename, PB_MEMORY);
+		exit (PB_ERROR_OUTOFMEM);
+	}
+	if (len % PB_BPW_VLIW){
+		fprintf(stderr, "Error: executable file %s is %d bytes long, but should be a multple of %d.\n", filename, (int)len, PB_BPW_VLIW);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	*len_ret = len;
+	return (bin->payload);
+}
+
+/* Time now, in seconds */
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern char *optarg; extern int optind;	/* getopt */
+	static struct pb_emu emu;		/* Large: not on the stack */
+	static unsigned char file[PB_IMAGE_MAXLEN + 1];	/* (One byte extra, to detect a file that's too long) */
+	static unsigned char previous_file[PB_IMAGE_MAXLEN + 1];
+	const unsigned char *image, *previous = NULL;
+	struct pb_image bin, previous_bin;
+	unsigned long long max_steps = PB_EMU_DEFAULT_STEPS;
+	unsigned int latency = 0;
+	int auto_trigger = 1;
+	int trace = 0;
+	const char *filename = PB_EMU_DEFAULT_FILE;
+	const char *previous_filename = NULL;
+	int shadow = 0;
+	struct pb_emu *cards[PB_EMU_MAX_CARDS];
+	unsigned int ncards = 1, i;
+	double skew_ns = 0;
+	unsigned long long skew_accesses = 0;
+	int consistent = 1;
+	size_t len, previous_len = 0, program_len;
+	double t_start, t_prog, t_run;
+	int state;
+
+	while ((opt = getopt(argc, argv, "l:p:sg:u:wth")) != -1){
+		switch (opt){
+			case 'l':  latency = strtoul(optarg, NULL, 0);  break;
+			case 'p':  previous_filename = optarg;  break;
+			case 's':  shadow = 1;  break;
+			case 'g':  ncards = strtoul(optarg, NULL, 0);  break;
+			case 'u':  max_steps = strtoull(optarg, NULL, 0);  break;
+			case 'w':  auto_trigger = 0;  break;
+			case 't':  trace = 1;  break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if (argc - optind > 1){
+		fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if (optind < argc){
+		filename = argv[optind];
+	}
+
+	if ((ncards < 1) || (ncards > PB_EMU_MAX_CARDS)){
+		fprintf(stderr,"Error, a group must have from 1 to %d cards. Use -h for help.\n", PB_EMU_MAX_CARDS);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if (shadow && !previous_filename){
+		fprintf(stderr,"Error, -s needs a previous program (-p). Use -h for help.\n");
+		exit (PB_ERROR_WRONGARGS);
+	}
+
+	/* Read in the whole program (and the previous one) */
+	image = read_program(filename, file, &bin, &len);
+	if (previous_filename){
+		previous = read_program(previous_filename, previous_file, &previous_bin, &previous_len);
+	}
+
+	pb_emu_init(&emu);
+	emu.bridge_latency = latency;
+	emu.auto_trigger = auto_trigger;
+	if (trace){
+		emu.trace_fh = stdout;
+	}
+
+	/* Load the previous program, as if it were already there (no trace, no statistics) */
+	if (previous){
+		if ((pb_emu_program(&emu, previous, previous_len) < 0) || (pb_emu_arm(&emu) < 0)){
+			fprintf(stderr, "Error: programming the emulator with the previous program failed.\n");
+			exit (PB_ERROR_NODEVICE);
+		}
+		emu.outs = emu.ins = 0;
+	}
+
+	/* Program it, via the bridge */
+	program_len = shadow ? pb_emu_changed_len(image, len, previous, previous_len) : len;
+	t_start = now();
+	if (pb_emu_program(&emu, image, program_len) < 0){
+		fprintf(stderr, "Error: programming the emulator failed.\n");
+		exit (PB_ERROR_NODEVICE);
+	}
+	if ((ncards == 1) && (pb_emu_start(&emu) < 0)){
+		fprintf(stderr, "Error: starting the emulator failed.\n");
+		exit (PB_ERROR_NODEVICE);
+	}
+	t_prog = now() - t_start;
+
+	/* Or program the other cards in the group, and start them all together */
+	if (ncards > 1){
+		cards[0] = &emu;
+		for (i = 1; i < ncards; i++){
+			if ((cards[i] = malloc(sizeof(struct pb_emu))) == NULL){
+				fprintf(stderr, "Error: could not allocate memory for %u cards.\n", ncards);
+				exit (PB_ERROR_OUTOFMEM);
+			}
+			pb_emu_init(cards[i]);
+			cards[i]->bridge_latency = latency;
+			cards[i]->auto_trigger = auto_trigger;
+			if (pb_emu_program(cards[i], image, len) < 0){
+				fprintf(stderr, "Error: programming emulated card %u failed.\n", i);
+				exit (PB_ERROR_NODEVICE);
+			}
+		}
+		if (pb_emu_group_start(cards, ncards, &skew_ns, &skew_accesses) < 0){
+			fprintf(stderr, "Error: starting the emulated group failed.\n");
+			exit (PB_ERROR_NODEVICE);
+		}
+	}
+
+	/* Run it */
+	t_start = now();
+	state = pb_emu_run(&emu, max_steps);
+	t_run = now() - t_start;
+
+	/* Every card in the group must do the same */
+	for (i = 1; i < ncards; i++){
+		if ((pb_emu_run(cards[i], max_steps) != state) || (cards[i]->steps != emu.steps) || (cards[i]->ticks != emu.ticks) ||
+		    (cards[i]->output != emu.output) || cards[i]->protocol_errors){
+			consistent = 0;
+		}
+	}
+
+	printf("file: %s\n", filename);
+	printf("words: %lu\n", (unsigned long)(len / PB_BPW_VLIW));
+	printf("container: %d\n", bin.container);
+	if (bin.container){
+		printf("container_version: %u\n", bin.version);
+		printf("container_model: %s\n", bin.model);
+		printf("container_clock_mhz: %u\n", bin.clock_mhz);
+		printf("container_runtime_ticks: %llu\n", bin.runtime_ticks);
+		printf("container_source_map: %s\n", bin.map ? "yes" : "no");
+	}
+	printf("programmed_bytes: %lu\n", (unsigned long)program_len);
+	printf("memory_words: %lu\n", emu.words);
+	printf("memory_crc: 0x%08x\n", pb_crc32(0, emu.memory[0], emu.words * PB_BPW_VLIW));
+	printf("bridge_writes: %llu\n", emu.outs);
+	printf("bridge_reads: %llu\n", emu.ins);
+	printf("protocol_errors: %llu\n", emu.protocol_errors);
+	printf("program_seconds: %.6f\n", t_prog);
+	printf("program_bytes_per_second: %.0f\n", len / t_prog);
+	printf("state: %s\n", pb_emu_state_name(state));
+	if (state == PB_EMU_FAULT){
+		printf("fault: %s at address %lu\n", emu.fault, emu.pc);
+	}
+	printf("steps: %llu\n", emu.steps);
+	printf("waits: %llu\n", emu.waits);
+	printf("ticks: %llu\n", emu.ticks);
+	printf("emulated_ns: %.0f\n", (double)emu.ticks * PB_TICK_NS);
+	printf("run_seconds: %.6f\n", t_run);
+	printf("steps_per_second: %.0f\n", emu.steps / t_run);
+	printf("output: 0x%06lx\n", emu.output);
+	if (ncards > 1){
+		printf("group_cards: %u\n", ncards);
+		printf("group_skew_ns: %.0f\n", skew_ns);
+		printf("group_skew_bridge_accesses: %llu\n", skew_accesses);
+		printf("group_consistent: %s\n", consistent ? "yes" : "no");
+	}
+
+	if ((state == PB_EMU_FAULT) || emu.protocol_errors || !consistent){
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	return PB_EXIT_OK;	/* i.e. zero */
+}
@@ -0,0 +1,459 @@
+/* This is pb_emulator.c which contains a software emulation of the PulseBlaster (PCI PBD02PC), for testing without the hardware.
+ * It emulates both halves of the card:
+ *   1) The old AMCC PCI bridge, with its (undocumented) nibble handshake, exactly as driven by pb_old_amcc_writeb() in the kernel driver.
+ *   2) The PulseBlaster core: the register set (reset, start, select BPW, select device, clear address counter, strobe, transfer, finished),
+ *      the VLIW memory, and the execution of the program in it, with the documented latencies (see pulseblaster.h and doc/latencies.txt).
+ * The host side of the driver is emulated too (pb_emu_writeb(), pb_emu_program(), pb_emu_start() etc), so that a .bin file can be pushed through
+ * the bridge byte-by-byte, just as the driver does it, and then run.
+ * It is part of libpulseblaster: the interface is in pb_emulator.h, and the other definitions are in pulseblaster.h. There are no globals.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pb_emulator.h"
+#include "pulseblaster_shadow.h"	/* The driver's own calculation of how much to reprogram. (From driver/kernel, or as installed with the driver) */
+
+/* Print out a protocol error. The real hardware gives no indication at all. */
+static void pb_emu_protocol_error(struct pb_emu *emu, const char *msg, unsigned int value){
+	emu->protocol_errors++;
+	if (emu->log){
+		fprintf(emu->log, "Emulator: protocol error: %s (0x%02x).\n", msg, value);
+	}
+}
+
+/* Reset the emulated card to its power-on state. No words have been loaded: running before programming is a fault. */
+void pb_emu_init(struct pb_emu *emu){
+	memset(emu, 0, sizeof(*emu));
+	emu->bridge_state = emu->bridge_pending = PB_EMU_AMCC_IDLE;
+	emu->state = PB_EMU_STOPPED;
+	emu->log = stderr;
+}
+
+
+/* PulseBlaster core: the register set. */
+
+/* Reset the core (but not the memory) ready to run from address 0 */
+static void pb_emu_core_reset(struct pb_emu *emu){
+	emu->pc = 0;
+	emu->loop_depth = 0;
+	emu->endloop_looped = 0;
+	emu->sub_depth = 0;
+	emu->ticks = 0;
+	emu->fault = NULL;
+}
+
+/* Execute a command which has just been written via the bridge */
+static void pb_emu_command(struct pb_emu *emu, unsigned int address, unsigned int data){
+	if (address >= PB_EMU_NUM_REGISTERS){
+		pb_emu_protocol_error(emu, "no such register", address);
+		return;
+	}
+	emu->commands[address]++;
+
+	switch (address){
+		case PB_EMU_REG_RESET:			/* Stop. The outputs keep their values */
+			emu->state = PB_EMU_STOPPED;
+			pb_emu_core_reset(emu);
+			break;
+
+		case PB_EMU_REG_START:			/* Start if armed; continue if in a WAIT. Otherwise (e.g. already running) a no-op. */
+			if (emu->programming){
+				pb_emu_protocol_error(emu, "start while programming", address);
+			}else if (emu->state == PB_EMU_ARMED){
+				pb_emu_core_reset(emu);
+				emu->state = PB_EMU_RUNNING;
+			}else if (emu->state == PB_EMU_WAITING){
+				emu->state = PB_EMU_RUNNING;
+			}
+			break;
+
+		case PB_EMU_REG_SELECT_BPW:
+			if (data != PB_BPW_VLIW){
+				pb_emu_protocol_error(emu, "bytes per word is not PB_BPW_VLIW", data);
+			}
+			emu->bpw = data;
+			break;
+
+		case PB_EMU_REG_SELECT_DEVICE:
+			if (data != 0){
+				pb_emu_protocol_error(emu, "device is not program memory", data);
+			}
+			emu->device = data;
+			break;
+
+		case PB_EMU_REG_CLEAR_ADDRESS:		/* Begin programming. This also stops the device. */
+			emu->state = PB_EMU_STOPPED;
+			emu->address = 0;		/* The memory (and so the number of words loaded) is untouched until overwritten */
+			emu->programming = 1;
+			break;
+
+		case PB_EMU_REG_STROBE:			/* Nothing to emulate */
+			break;
+
+		case PB_EMU_REG_TRANSFER:
+			if ((!emu->programming) || (emu->bpw != PB_BPW_VLIW)){
+				pb_emu_protocol_error(emu, "transfer while not programming", data);
+				break;
+			}
+			if (emu->address >= (unsigned long)PB_MEMORY * PB_BPW_VLIW){
+				pb_emu_protocol_error(emu, "transfer past the end of memory", data);
+				break;
+			}
+			emu->memory[emu->address / PB_BPW_VLIW][emu->address % PB_BPW_VLIW] = data;
+			emu->address++;
+			if (emu->words < (emu->address + PB_BPW_VLIW - 1) / PB_BPW_VLIW){
+				emu->words = (emu->address + PB_BPW_VLIW - 1) / PB_BPW_VLIW;
+			}
+			break;
+
+		case PB_EMU_REG_FINISHED:		/* Programming finished: armed, ready to run from address 0 */
+			if (emu->address % PB_BPW_VLIW){
+				pb_emu_protocol_error(emu, "programming finished part way through a word", emu->address % PB_BPW_VLIW);
+			}
+			emu->programming = 0;
+			emu->state = PB_EMU_ARMED;
+			pb_emu_core_reset(emu);
+			break;
+	}
+}
+
+
+/* Old AMCC bridge: the nibble handshake. */
+
+/* Write to a bridge port. The host writes 4 nibbles, each with its code in the high nibble:
+ *   0x3X: address high nibble  -> state 0
+ *   0x0X: address low nibble   -> state 1
+ *   0x1X: data high nibble     -> state 2
+ *   0x2X: data low nibble      -> command executed, state 7 (idle)
+ * If the bridge seems stuck (has not yet responded), the driver writes back (state << 4) as a kick: this is harmless. */
+void pb_emu_outb(struct pb_emu *emu, unsigned int value, unsigned int port){
+	unsigned int code = (value >> 4) & 0x0f;
+	unsigned int nibble = value & 0x0f;
+	unsigned int expect;
+
+	value &= 0xff;
+	emu->outs++;
+	if (port != PB_EMU_AMCC_OUT){
+		pb_emu_protocol_error(emu, "write to unknown port", port);
+		return;
+	}
+	if (emu->bridge_delay){
+		if (value != ((emu->bridge_state << 4) & 0xff)){	/* Else, a kick from the driver's retry loop */
+			pb_emu_protocol_error(emu, "nibble written before the bridge responded", value);
+		}
+		return;
+	}
+
+	switch (code){
+		case 0x3:  expect = PB_EMU_AMCC_IDLE;  emu->bridge_address = (nibble << 4);  emu->bridge_pending = 0x00;  break;
+		case 0x0:  expect = 0x00;  emu->bridge_address |= nibble;  emu->bridge_pending = 0x01;  break;
+		case 0x1:  expect = 0x01;  emu->bridge_data = (nibble << 4);  emu->bridge_pending = 0x02;  break;
+		case 0x2:  expect = 0x02;  emu->bridge_data |= nibble;  emu->bridge_pending = PB_EMU_AMCC_IDLE;  break;
+		default:
+			pb_emu_protocol_error(emu, "unknown nibble code", value);
+			return;
+	}
+	if (emu->bridge_state != expect){
+		pb_emu_protocol_error(emu, "nibble out of sequence", value);
+		emu->bridge_pending = emu->bridge_state;
+		return;
+	}
+	if (code == 0x2){
+		pb_emu_command(emu, emu->bridge_address, emu->bridge_data);
+	}
+	emu->bridge_delay = emu->bridge_latency;
+	if (!emu->bridge_delay){
+		emu->bridge_state = emu->bridge_pending;
+	}
+}
+
+/* Read from a bridge port. The state changes only after bridge_latency polls. */
+unsigned int pb_emu_inb(struct pb_emu *emu, unsigned int port){
+	emu->ins++;
+	if (port != PB_EMU_AMCC_IN){
+		pb_emu_protocol_error(emu, "read from unknown port", port);
+		return 0xff;
+	}
+	if (emu->bridge_delay && (--emu->bridge_delay == 0)){
+		emu->bridge_state = emu->bridge_pending;
+	}
+	return (0xf8 | emu->bridge_state);
+}
+
+
+/* Host side: the same sequence of port accesses as the kernel driver. Return 0 on success, else -1 (the driver's -ETIMEDOUT). */
+
+/* Wait for the bridge to reach the given state (pb_old_amcc_wait) */
+int pb_emu_wait(struct pb_emu *emu, unsigned int state){
+	unsigned int polls;
+
+	for (polls = 0; polls < PB_EMU_AMCC_MAX_POLLS; polls++){
+		if ((pb_emu_inb(emu, PB_EMU_AMCC_IN) & 0x07) == state){
+			return (0);
+		}
+	}
+	if (emu->log){
+		fprintf(emu->log, "Emulator: bridge stuck waiting for state 0x%02x\n", state);
+	}
+	return (-1);
+}
+
+/* Write a byte to a register (pb_old_amcc_writeb) */
+int pb_emu_writeb(struct pb_emu *emu, unsigned int address, unsigned int data){
+	if (pb_emu_wait(emu, PB_EMU_AMCC_IDLE) < 0)
+		return (-1);
+	pb_emu_outb(emu, (0x30 | ((address >> 4) & 0x0f)), PB_EMU_AMCC_OUT);
+	if (pb_emu_wait(emu, 0x00) < 0)
+		return (-1);
+	pb_emu_outb(emu, (0x00 | ((address >> 0) & 0x0f)), PB_EMU_AMCC_OUT);
+	if (pb_emu_wait(emu, 0x01) < 0)
+		return (-1);
+	pb_emu_outb(emu, (0x10 | ((data >> 4) & 0x0f)), PB_EMU_AMCC_OUT);
+	if (pb_emu_wait(emu, 0x02) < 0)
+		return (-1);
+	pb_emu_outb(emu, (0x20 | ((data >> 0) & 0x0f)), PB_EMU_AMCC_OUT);
+	if (pb_emu_wait(emu, PB_EMU_AMCC_IDLE) < 0)
+		return (-1);
+	return (0);
+}
+
+/* Load a program (pb_write_enable(), then pb_program()), leaving the device programming: not yet armed */
+int pb_emu_program(struct pb_emu *emu, const unsigned char *buf, unsigned long len){
+	unsigned long i;
+
+	if ((pb_emu_writeb(emu, PB_EMU_REG_RESET, 0) < 0) ||
+	    (pb_emu_writeb(emu, PB_EMU_REG_SELECT_BPW, PB_BPW_VLIW) < 0) ||
+	    (pb_emu_writeb(emu, PB_EMU_REG_SELECT_DEVICE, 0) < 0) ||
+	    (pb_emu_writeb(emu, PB_EMU_REG_CLEAR_ADDRESS, 0) < 0)){
+		return (-1);
+	}
+	for (i = 0; i < len; i++){
+		if (pb_emu_writeb(emu, PB_EMU_REG_TRANSFER, buf[i]) < 0)
+			return (-1);
+	}
+	return (0);
+}
+
+/* Length to reprogram, with the driver's own pb_shadow_changed_len() (as pb_changed_len()): up to the end of the highest word which
+ * differs from the previous image. All of it, if the previous image was shorter (its tail is unknown). */
+unsigned long pb_emu_changed_len(const unsigned char *buf, unsigned long len, const unsigned char *previous, unsigned long previous_len){
+	return (pb_shadow_changed_len(buf, len, previous, previous_len, PB_BPW_VLIW));
+}
+
+/* Arm (pb_arm()): finish programming */
+int pb_emu_arm(struct pb_emu *emu){
+	if (!emu->programming){
+		if ((pb_emu_writeb(emu, PB_EMU_REG_RESET, 0) < 0) ||
+		    (pb_emu_writeb(emu, PB_EMU_REG_SELECT_BPW, PB_BPW_VLIW) < 0) ||
+		    (pb_emu_writeb(emu, PB_EMU_REG_SELECT_DEVICE, 0) < 0) ||
+		    (pb_emu_writeb(emu, PB_EMU_REG_CLEAR_ADDRESS, 0) < 0)){
+			return (-1);
+		}
+	}
+	return (pb_emu_writeb(emu, PB_EMU_REG_FINISHED, 0));
+}
+
+/* Start (pb_start()): arm, then start */
+int pb_emu_start(struct pb_emu *emu){
+	if (pb_emu_arm(emu) < 0)
+		return (-1);
+	return (pb_emu_writeb(emu, PB_EMU_REG_START, 0));
+}
+
+/* Continue (pb_continue()) */
+int pb_emu_cont(struct pb_emu *emu){
+	if (emu->programming && (pb_emu_writeb(emu, PB_EMU_REG_FINISHED, 0) < 0))
+		return (-1);
+	return (pb_emu_writeb(emu, PB_EMU_REG_START, 0));
+}
+
+/* Stop (pb_stop()) */
+int pb_emu_stop(struct pb_emu *emu){
+	if (emu->programming && (pb_emu_writeb(emu, PB_EMU_REG_FINISHED, 0) < 0))
+		return (-1);
+	return (pb_emu_writeb(emu, PB_EMU_REG_RESET, 0));
+}
+
+/* Start a group of cards together (pb_group_start(), with pb_arm() as the preparation): arm each card, then issue the start
+ * register writes back to back. The skew is measured from the completion of the first card's start write to that of the last:
+ * in nanoseconds (as the driver reports it), and in bridge accesses (to all the cards), which doesn't depend on the host. */
+int pb_emu_group_start(struct pb_emu *emus[], unsigned int n, double *skew_ns, unsigned long long *skew_accesses){
+	struct timespec first, last;
+	unsigned long long accesses_first = 0, accesses_last = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < n; i++){
+		if (pb_emu_arm(emus[i]) < 0)
+			return (-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &first);
+	last = first;
+	for (i = 0; i < n; i++){
+		if (pb_emu_writeb(emus[i], PB_EMU_REG_START, 0) < 0)
+			return (-1);
+		clock_gettime(CLOCK_MONOTONIC, &last);
+		accesses_last = 0;
+		for (j = 0; j < n; j++){
+			accesses_last += emus[j]->ins + emus[j]->outs;
+		}
+		if (i == 0){
+			first = last;
+			accesses_first = accesses_last;
+		}
+	}
+	*skew_ns = (last.tv_sec - first.tv_sec) * 1e9 + (last.tv_nsec - first.tv_nsec);
+	*skew_accesses = accesses_last - accesses_first;
+	return (0);
+}
+
+
+/* PulseBlaster core: execution. */
+
+/* Stop with a fault. */
+static void pb_emu_fault(struct pb_emu *emu, const char *fault){
+	emu->state = PB_EMU_FAULT;
+	emu->fault = fault;
+}
+
+/* Execute one instruction. Returns the state afterwards.
+ * The VLIW word in memory is decoded exactly as pb_encode_vliw() encoded it, and the hardware's offsets are applied to it:
+ *   - every instruction takes (delay + PB_INTERNAL_LATENCY) ticks, i.e. the LENGTH which the user asked for;
+ *   - LONGDELAY takes that, times (arg + PB_BUG_LONGDELAY_OFFSET);
+ *   - LOOP runs its body (arg + PB_BUG_LOOP_OFFSET) times; ENDLOOP jumps back to the LOOP instruction itself (which is re-executed, but doesn't nest);
+ *   - WAIT sets the outputs, waits for a trigger, and then delays;
+ *   - STOP doesn't set the outputs, and takes no time. */
+int pb_emu_step(struct pb_emu *emu){
+	unsigned char *word;
+	unsigned long output, arg, length;
+	unsigned int opcode;
+	int looped = 0;
+
+	if (emu->state != PB_EMU_RUNNING){
+		return (emu->state);
+	}
+	if (emu->pc >= emu->words){
+		pb_emu_fault(emu, "ran past the end of the program");
+		return (emu->state);
+	}
+
+	word = emu->memory[emu->pc];
+	output = ((unsigned long)word[0] << 16) | (word[1] << 8) | word[2];
+	arg = ((unsigned long)word[3] << 12) | (word[4] << 4) | (word[5] >> 4);
+	opcode = word[5] & 0x0f;
+	length = (((unsigned long)word[6] << 24) | (word[7] << 16) | (word[8] << 8) | word[9]) + PB_INTERNAL_LATENCY;
+
+	emu->steps++;
+	if (opcode != PB_OPCODE_STOP){
+		emu->output = output;
+	}
+	if (emu->trace_fh){
+		fprintf(emu->trace_fh, "%llu\t0x%06lx\n", emu->ticks, emu->output);
+	}
+
+	switch (opcode){
+		case PB_OPCODE_CONT:
+			emu->pc++;
+			break;
+
+		case PB_OPCODE_STOP:
+			emu->state = PB_EMU_HALTED;
+			return (emu->state);
+
+		case PB_OPCODE_LOOP:
+			if (!emu->endloop_looped){
+				if (emu->loop_depth >= PB_LOOP_MAXDEPTH){
+					pb_emu_fault(emu, "exceeded maximum loop depth");
+					return (emu->state);
+				}
+				emu->loop_stack[emu->loop_depth++] = arg + PB_BUG_LOOP_OFFSET;
+			}
+			emu->pc++;
+			break;
+
+		case PB_OPCODE_ENDLOOP:
+			if (emu->loop_depth == 0){
+				pb_emu_fault(emu, "endloop without loop");
+				return (emu->state);
+			}
+			if (--emu->loop_stack[emu->loop_depth - 1] == 0){
+				emu->loop_depth--;
+				emu->pc++;
+			}else{
+				emu->pc = arg;
+				looped = 1;
+			}
+			break;
+
+		case PB_OPCODE_CALL:
+			if (emu->sub_depth >= PB_SUB_MAXDEPTH){
+				pb_emu_fault(emu, "exceeded maximum subroutine depth");
+				return (emu->state);
+			}
+			emu->sub_stack[emu->sub_depth++] = emu->pc;
+			emu->pc = arg;
+			break;
+
+		case PB_OPCODE_RETURN:
+			if (emu->sub_depth == 0){
+				pb_emu_fault(emu, "return without call");
+				return (emu->state);
+			}
+			emu->pc = emu->sub_stack[--emu->sub_depth] + 1;
+			break;
+
+		case PB_OPCODE_GOTO:
+			emu->pc = arg;
+			break;
+
+		case PB_OPCODE_LONGDELAY:
+			length *= (arg + PB_BUG_LONGDELAY_OFFSET);
+			emu->pc++;
+			break;
+
+		case PB_OPCODE_WAIT:
+			emu->pc++;
+			if (!emu->auto_trigger){
+				emu->state = PB_EMU_WAITING;	/* The delay happens after the trigger: it is counted now anyway. */
+			}else{
+				emu->waits++;
+			}
+			break;
+
+		default:
+			pb_emu_fault(emu, "invalid opcode");
+			return (emu->state);
+	}
+	emu->endloop_looped = looped;
+	emu->ticks += length;
+	return (emu->state);
+}
+
+/* Run until the program stops, faults, waits (unless auto_trigger), or has executed max_steps instructions (0 for no limit). Returns the state. */
+int pb_emu_run(struct pb_emu *emu, unsigned long long max_steps){
+	unsigned long long steps;
+
+	for (steps = 0; (max_steps == 0) || (steps < max_steps); steps++){
+		if (pb_emu_step(emu) != PB_EMU_RUNNING)
+			break;
+	}
+	return (emu->state);
+}
+
+/* Name of a state, for printing */
+const char *pb_emu_state_name(int state){
+	switch (state){
+		case PB_EMU_STOPPED:	return ("stopped");
+		case PB_EMU_ARMED:	return ("armed");
+		case PB_EMU_RUNNING:	return ("running");
+		case PB_EMU_WAITING:	return ("waiting");
+		case PB_EMU_HALTED:	return ("halted");
+		case PB_EMU_FAULT:	return ("fault");
+	}
+	return ("unknown");
+}
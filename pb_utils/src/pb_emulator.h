@@ -0,0 +1,100 @@
+/* This is pb_emulator.h, the interface to the software emulator of the PulseBlaster (pb_emulator.c), which is part of libpulseblaster.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#ifndef PB_EMULATOR_H
+#define PB_EMULATOR_H
+
+#include <stdio.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+
+
+/* Old AMCC bridge ports (offsets from the PCI iobase), and states. These are the same as in the kernel driver. */
+#define PB_EMU_AMCC_OUT			0x0c	/* Bridge output register: the host writes nibbles here */
+#define PB_EMU_AMCC_IN			0x1c	/* Bridge input register: the host polls the state (low 3 bits) here */
+#define PB_EMU_AMCC_IDLE		0x07	/* Bridge is idle (and has just executed a command) */
+#define PB_EMU_AMCC_MAX_POLLS		1000	/* Host gives up on the bridge after this many polls. (The driver spins for spin_budget us, then sleeps 10 times) */
+
+/* PulseBlaster registers, as in the kernel driver's enum pulseblaster_register */
+#define PB_EMU_REG_RESET		0x0	/* Stop the program */
+#define PB_EMU_REG_START		0x1	/* Start (or continue) the program */
+#define PB_EMU_REG_SELECT_BPW		0x2	/* Select bytes per word (must be PB_BPW_VLIW) */
+#define PB_EMU_REG_SELECT_DEVICE	0x3	/* Select device to program (must be 0: program memory) */
+#define PB_EMU_REG_CLEAR_ADDRESS	0x4	/* Clear the address counter; begin programming */
+#define PB_EMU_REG_STROBE		0x5	/* Strobe the output clock signal */
+#define PB_EMU_REG_TRANSFER		0x6	/* Transfer one byte into memory, at the address counter */
+#define PB_EMU_REG_FINISHED		0x7	/* Programming finished; the device is now armed */
+#define PB_EMU_NUM_REGISTERS		8
+
+/* State of the emulated PulseBlaster core */
+#define PB_EMU_STOPPED			0	/* Stopped, not armed. (Start is ignored) */
+#define PB_EMU_ARMED			1	/* Stopped, armed: start (or HW_Trigger) runs the program from address 0 */
+#define PB_EMU_RUNNING			2	/* Running */
+#define PB_EMU_WAITING			3	/* In a WAIT instruction: start (or HW_Trigger) continues */
+#define PB_EMU_HALTED			4	/* Reached a STOP instruction */
+#define PB_EMU_FAULT			5	/* Program failed (e.g. ran off the end of memory, or stack underflow). The real hardware would do something undefined */
+
+/* The emulated card. All counters are cumulative, for reporting throughput */
+struct pb_emu {
+	/* Bridge */
+	unsigned int bridge_state;			/* State, as read back in the low 3 bits of PB_EMU_AMCC_IN */
+	unsigned int bridge_pending;			/* State the bridge is about to reach */
+	unsigned int bridge_delay;			/* Number of polls remaining until it gets there */
+	unsigned int bridge_latency;			/* Number of polls for the bridge to respond to each nibble (0 is instant) */
+	unsigned int bridge_address;			/* Address (register) being assembled from nibbles */
+	unsigned int bridge_data;			/* Data being assembled from nibbles */
+
+	/* Registers */
+	unsigned int bpw;				/* Selected bytes per word */
+	unsigned int device;				/* Selected device */
+	unsigned long address;				/* Address counter (in bytes) */
+	unsigned long words;				/* Number of words ever loaded (high-water mark) */
+	int programming;				/* Address counter has been cleared, and programming is not yet finished */
+	unsigned char memory[PB_MEMORY][PB_BPW_VLIW];	/* The VLIW memory */
+
+	/* Core */
+	int state;					/* PB_EMU_STOPPED etc */
+	unsigned long pc;				/* Program counter */
+	unsigned long loop_stack[PB_LOOP_MAXDEPTH];	/* Loop counters */
+	unsigned int loop_depth;			/* Loop stack depth */
+	int endloop_looped;				/* Just jumped back from an ENDLOOP: don't begin a new loop */
+	unsigned long sub_stack[PB_SUB_MAXDEPTH];	/* Subroutine return addresses */
+	unsigned int sub_depth;				/* Subroutine stack depth */
+	unsigned long output;				/* Current value of the outputs */
+	unsigned long long ticks;			/* Ticks elapsed since the program was started */
+	int auto_trigger;				/* Automatically re-trigger WAIT instructions (as if from HW_Trigger) */
+	FILE *trace_fh;					/* If not NULL, write "ticks output" here at each instruction */
+	const char *fault;				/* Reason for PB_EMU_FAULT */
+	FILE *log;					/* Protocol errors are reported here (stderr, by default; NULL for silence) */
+
+	/* Statistics */
+	unsigned long long outs;			/* Writes to the bridge */
+	unsigned long long ins;				/* Reads from the bridge */
+	unsigned long long commands[PB_EMU_NUM_REGISTERS];	/* Commands executed, by register */
+	unsigned long long protocol_errors;		/* Nibbles out of sequence, bad BPW etc */
+	unsigned long long steps;			/* Instructions executed */
+	unsigned long long waits;			/* WAIT instructions re-triggered */
+};
+
+/* Card, and bridge: pb_emu_outb() and pb_emu_inb() are what the driver's outb() and inb() would reach */
+void pb_emu_init(struct pb_emu *emu);
+void pb_emu_outb(struct pb_emu *emu, unsigned int value, unsigned int port);
+unsigned int pb_emu_inb(struct pb_emu *emu, unsigned int port);
+
+/* Host side, as done by the driver. These return 0, or -1 if the bridge got stuck */
+int pb_emu_wait(struct pb_emu *emu, unsigned int state);
+int pb_emu_writeb(struct pb_emu *emu, unsigned int address, unsigned int data);
+int pb_emu_program(struct pb_emu *emu, const unsigned char *buf, unsigned long len);
+unsigned long pb_emu_changed_len(const unsigned char *buf, unsigned long len, const unsigned char *previous, unsigned long previous_len);
+int pb_emu_arm(struct pb_emu *emu);
+int pb_emu_start(struct pb_emu *emu);
+int pb_emu_cont(struct pb_emu *emu);
+int pb_emu_stop(struct pb_emu *emu);
+int pb_emu_group_start(struct pb_emu *emus[], unsigned int n, double *skew_ns, unsigned long long *skew_accesses);
+
+/* Execution. These return the state afterwards */
+int pb_emu_step(struct pb_emu *emu);
+int pb_emu_run(struct pb_emu *emu, unsigned long long max_steps);
+const char *pb_emu_state_name(int state);
+
+#endif /* PB_EMULATOR_H */
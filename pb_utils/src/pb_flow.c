@@ -0,0 +1,902 @@
+/* This is pb_flow.c  the control-flow analysis of program images: the static verifier, pb_verify() (see pb_flow.h).
+ * It is part of libpulseblaster: nothing here exits.
+ *
+ * The program is abstractly interpreted, with a worklist. A state is (address, loop stack, subroutine stack), where the loop stack
+ * holds the address of each LOOP entered, and the subroutine stack the address of each CALL. The loop counters are left out, which
+ * is what keeps the number of states small; each state's successors are then exactly those which the hardware could reach:
+ *   - ENDLOOP both falls through (popping the loop) and jumps back (to its arg), unless the loop's count is 1: then it only falls through.
+ *     On jumping back to a LOOP, the hardware doesn't enter the loop again (see doc/loops.txt, and pb_emu_step()): so the successor
+ *     is the instruction after it.
+ *   - CALL pushes, and RETURN pops, the subroutine stack; GOTO just branches; STOP has no successor.
+ * Each distinct state is explored once (they are kept in a hash table), so the stacks are bounded by PB_LOOP_MAXDEPTH and
+ * PB_SUB_MAXDEPTH, and the search terminates. A structured program has about one state per word (more only for a subroutine which
+ * is called from several places, or from inside different loops), so this is close to linear in the length of the program.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "libpulseblaster.h"
+#include "pb_flow.h"
+
+#if PB_MEMORY > 65536
+    #error "pb_flow.c keeps addresses in 16 bits, but PB_MEMORY is larger"
+#endif
+
+#define PB_VERIFY_INITIAL_STATES	1024
+#define PB_VERIFY_NOMEM			(-1)	/* Internal return values, as well as 0 and the PB_ERROR_* codes */
+#define PB_VERIFY_LIMIT			(-2)
+
+/* One abstract state. The unused parts of the stacks are always zero, so that states can be hashed and compared as bytes */
+struct pb_vstate {
+	uint16_t pc;
+	uint8_t loops;				/* Depth of each stack */
+	uint8_t subs;
+	uint16_t loop[PB_LOOP_MAXDEPTH];	/* Address of each LOOP entered */
+	uint16_t sub[PB_SUB_MAXDEPTH];		/* Address of each CALL */
+};
+
+struct pb_verifier {
+	const unsigned char *image;
+	unsigned int words;
+	const unsigned int *lines;
+	FILE *log;
+	struct pb_vstate *states;		/* Every state found, in order */
+	unsigned long count, cap;
+	uint32_t *table;			/* Hash table of (index + 1) into states; 0 is empty */
+	unsigned long table_size;		/* Power of 2, at least twice cap */
+	unsigned long *work;			/* Worklist: indices of the states not yet explored */
+	unsigned long pending;
+	unsigned char *reached;			/* Each address, if reached */
+	struct pb_verify_result result;
+};
+
+/* FNV-1a */
+static uint32_t pb_vstate_hash (const struct pb_vstate *s){
+	const unsigned char *p = (const unsigned char *)s;
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < sizeof(*s); i++){
+		h = (h ^ p[i]) * 16777619U;
+	}
+	return (h);
+}
+
+/* Make room for more states. Returns 0, or -1 if out of memory */
+static int pb_verify_grow (struct pb_verifier *v){
+	unsigned long cap = v->cap ? v->cap * 2 : PB_VERIFY_INITIAL_STATES, i, slot;
+	struct pb_vstate *states;
+	unsigned long *work;
+	uint32_t *table;
+
+	if ((states = realloc (v->states, cap * sizeof(*states))) == NULL){
+		return (-1);
+	}
+	v->states = states;
+	if ((work = realloc (v->work, cap * sizeof(*work))) == NULL){
+		return (-1);
+	}
+	v->work = work;
+	if ((table = calloc (cap * 2, sizeof(*table))) == NULL){
+		return (-1);
+	}
+	free (v->table);
+	v->table = table;
+	v->table_size = cap * 2;
+	v->cap = cap;
+	for (i = 0; i < v->count; i++){		/* Rehash */
+		slot = pb_vstate_hash (&v->states[i]) & (v->table_size - 1);
+		while (v->table[slot]){
+			slot = (slot + 1) & (v->table_size - 1);
+		}
+		v->table[slot] = i + 1;
+	}
+	return (0);
+}
+
+/* Add the state s (if it is new) to the worklist. Returns 0, PB_VERIFY_LIMIT if there are too many states, or PB_VERIFY_NOMEM */
+static int pb_verify_add (struct pb_verifier *v, const struct pb_vstate *s){
+	unsigned long slot;
+
+	if (v->count == v->cap){
+		if (v->count >= PB_VERIFY_MAXSTATES){
+			return (PB_VERIFY_LIMIT);
+		}
+		if (pb_verify_grow (v) < 0){
+			return (PB_VERIFY_NOMEM);
+		}
+	}
+	slot = pb_vstate_hash (s) & (v->table_size - 1);
+	while (v->table[slot]){
+		if (!memcmp (&v->states[v->table[slot] - 1], s, sizeof(*s))){
+			return (0);			/* Seen already */
+		}
+		slot = (slot + 1) & (v->table_size - 1);
+	}
+	v->states[v->count] = *s;
+	v->table[slot] = ++v->count;
+	v->work[v->pending++] = v->count - 1;
+	return (0);
+}
+
+/* Print an address (with its source line, if known) */
+static void pb_verify_where (struct pb_verifier *v, unsigned int addr){
+	fprintf (v->log, "address %u", addr);
+	if (v->lines && (addr < v->words) && v->lines[addr]){
+		fprintf (v->log, " (line %u)", v->lines[addr]);
+	}
+}
+
+/* Print an error at s, with the stacks (which are how the program got there), and return code */
+static int pb_verify_error (struct pb_verifier *v, const struct pb_vstate *s, int code, const char *what){
+	unsigned int i;
+
+	if (v->log == NULL){
+		return (code);
+	}
+	fprintf (v->log, "Error at ");
+	pb_verify_where (v, s->pc);
+	fprintf (v->log, ": %s.\n", what);
+	fprintf (v->log, "\tLoops entered: %s", s->loops ? "" : "none");
+	for (i = 0; i < s->loops; i++){
+		fprintf (v->log, "%s", i ? ", " : "");
+		pb_verify_where (v, s->loop[i]);
+	}
+	fprintf (v->log, ".\n\tSubroutines called from: %s", s->subs ? "" : "none");
+	for (i = 0; i < s->subs; i++){
+		fprintf (v->log, "%s", i ? ", " : "");
+		pb_verify_where (v, s->sub[i]);
+	}
+	fprintf (v->log, ".\n");
+	return (code);
+}
+
+/* The opcode and arg of the word at addr */
+static unsigned int pb_verify_opcode (const struct pb_verifier *v, unsigned int addr, unsigned long *arg){
+	struct pb_vliw word;
+
+	pb_decode_vliw (v->image + (size_t)addr * PB_BPW_VLIW, &word);
+	if (arg){
+		*arg = word.arg;
+	}
+	return (word.opcode);
+}
+
+/* Explore the state s: add its successors. Returns 0, the error, or as pb_verify_add() */
+static int pb_verify_step (struct pb_verifier *v, const struct pb_vstate *s){
+	struct pb_vstate next = *s;
+	unsigned long arg, count;
+	unsigned int opcode;
+	int ret;
+
+	opcode = pb_verify_opcode (v, s->pc, &arg);
+	if (((opcode == PB_OPCODE_GOTO) || (opcode == PB_OPCODE_CALL) || (opcode == PB_OPCODE_ENDLOOP)) && (arg >= v->words)){
+		return (pb_verify_error (v, s, PB_ERROR_INVALIDINSTRUCTION, "it branches to an address beyond the end of the program"));
+	}
+	switch (opcode){
+		case PB_OPCODE_CONT:
+		case PB_OPCODE_LONGDELAY:
+		case PB_OPCODE_WAIT:
+			next.pc++;
+			break;
+
+		case PB_OPCODE_STOP:
+			return (0);
+
+		case PB_OPCODE_LOOP:
+			if (s->loops >= PB_LOOP_MAXDEPTH){
+				return (pb_verify_error (v, s, PB_ERROR_LOOPDEPTH, "this LOOP nests loops deeper than PB_LOOP_MAXDEPTH"));
+			}
+			next.loop[next.loops++] = s->pc;
+			next.pc++;
+			break;
+
+		case PB_OPCODE_ENDLOOP:
+			if (s->loops == 0){
+				return (pb_verify_error (v, s, PB_ERROR_LOOPDEPTH, "this ENDLOOP is not inside any loop"));
+			}
+			pb_verify_opcode (v, s->loop[s->loops - 1], &count);
+			if (count > 1){		/* Jump back. (To a LOOP: that doesn't enter the loop again, so go on to the next) */
+				next.pc = arg + (pb_verify_opcode (v, arg, NULL) == PB_OPCODE_LOOP);
+				if (next.pc >= v->words){
+					return (pb_verify_error (v, s, PB_ERROR_INVALIDINSTRUCTION, "it branches back to the last instruction, a LOOP, and so runs off the end"));
+				}
+				if ((ret = pb_verify_add (v, &next)) != 0){
+					return (ret);
+				}
+			}
+			next.loop[--next.loops] = 0;	/* Fall through */
+			next.pc = s->pc + 1;
+			break;
+
+		case PB_OPCODE_CALL:
+			if (s->subs >= PB_SUB_MAXDEPTH){
+				return (pb_verify_error (v, s, PB_ERROR_LOOPDEPTH, "this CALL nests subroutines deeper than PB_SUB_MAXDEPTH"));
+			}
+			next.sub[next.subs++] = s->pc;
+			next.pc = arg;
+			break;
+
+		case PB_OPCODE_RETURN:
+			if (s->subs == 0){
+				return (pb_verify_error (v, s, PB_ERROR_LOOPDEPTH, "this RETURN is not inside any subroutine"));
+			}
+			next.pc = s->sub[s->subs - 1] + 1;
+			next.sub[--next.subs] = 0;
+			break;
+
+		case PB_OPCODE_GOTO:
+			next.pc = arg;
+			break;
+
+		default:
+			return (pb_verify_error (v, s, PB_ERROR_INVALIDINSTRUCTION, "the opcode is invalid"));
+	}
+	if (next.pc >= v->words){
+		return (pb_verify_error (v, s, PB_ERROR_INVALIDINSTRUCTION, "the program runs off the end, after this instruction"));
+	}
+	return (pb_verify_add (v, &next));
+}
+
+/* Verify a program. See pb_flow.h */
+int pb_verify (const unsigned char *image, size_t len, const unsigned int *lines, struct pb_verify_result *result, FILE *log){
+	struct pb_verifier v;
+	struct pb_vstate s;
+	unsigned int i;
+	int ret = 0;
+
+	memset (&v, 0, sizeof(v));
+	v.image = image;
+	v.words = len / PB_BPW_VLIW;
+	v.lines = lines;
+	v.log = log;
+	v.result.words = v.words;
+	v.result.complete = 1;
+
+	if ((v.words == 0) || (v.words > PB_MEMORY)){		/* Not for here: the encoder, or pb_image_parse(), explains these */
+		ret = PB_ERROR_BADVLIWFILE;
+		goto done;
+	}
+	if ((v.reached = calloc (v.words, 1)) == NULL){
+		ret = PB_ERROR_GENERIC;
+		goto done;
+	}
+
+	memset (&s, 0, sizeof(s));		/* Start at address 0, with empty stacks */
+	ret = pb_verify_add (&v, &s);
+	while ((ret == 0) && (v.pending)){
+		s = v.states[v.work[--v.pending]];	/* (A copy: pb_verify_step() may move the states) */
+		v.reached[s.pc] = 1;
+		if (s.loops > v.result.max_loop_depth){
+			v.result.max_loop_depth = s.loops;
+		}
+		if (s.subs > v.result.max_sub_depth){
+			v.result.max_sub_depth = s.subs;
+		}
+		ret = pb_verify_step (&v, &s);
+	}
+	if (ret == PB_VERIFY_LIMIT){
+		if (log) fprintf (log, "Warning: the program has more than %lu states, which is too many to follow them all. It has NOT been verified.\n",
+			PB_VERIFY_MAXSTATES);
+		v.result.complete = 0;
+		ret = 0;
+	}else if (ret == PB_VERIFY_NOMEM){
+		if (log) fprintf (log, "Error: out of memory, verifying the program.\n");
+		ret = PB_ERROR_GENERIC;
+	}
+	for (i = 0; i < v.words; i++){
+		v.result.reachable += v.reached[i];
+	}
+	v.result.states = v.count;
+
+done:
+	if (result){
+		*result = v.result;
+	}
+	free (v.states);
+	free (v.table);
+	free (v.work);
+	free (v.reached);
+	return (ret);
+}
+
+
+/* The timer, pb_time(). The program is run symbolically, one level at a time. A level is the top of the program, or one loop body, or
+ * one subroutine: it runs from where it is entered, to the ENDLOOP or RETURN which ends it (or to a STOP). A LOOP or CALL within it is
+ * a single step, whose time is that of the level it begins: and so on down. Two facts make this cheap:
+ *   - A level which begins at a given address always takes the same time, whatever the counters of the loops around it, and whoever
+ *     called it: nothing in it can see them. (Unless it ends a loop which it didn't begin, or returns from inside a loop: these aren't
+ *     timed.) So each is timed once, and remembered: a segment.
+ *   - Within a level, the stacks are the same at every step. So if it comes back to an address, it will go round the same way for ever.
+ * A loop of n iterations is then its first iteration (from the LOOP), and n-1 more, from where the ENDLOOP jumps back to. These are all
+ * the same, so they are multiplied, not run. (Were the ENDLOOP to jump somewhere else each time, they are added up one by one.)
+ * The first segment to be timed from any address is also the first to run there, so each instruction's first execution is noted as it
+ * is timed; later uses of the segment add nothing. The cost is about one step per word, however many times the loops go round.
+ */
+
+#define PB_TSEG_LOOP		0	/* Kinds of level: a loop body; a subroutine (these two are remembered, as segments); the top */
+#define PB_TSEG_SUB		1
+#define PB_TSEG_TOP		2
+
+#define PB_TSPAN_END		0	/* How a level ended: at its ENDLOOP or RETURN; at a STOP; never */
+#define PB_TSPAN_STOP		1
+#define PB_TSPAN_FOREVER	2
+
+#define PB_TSEG_NEW		0	/* State of a segment: not yet timed; being timed; timed */
+#define PB_TSEG_BUSY		1
+#define PB_TSEG_DONE		2
+
+/* The time taken by part of the program */
+struct pb_tspan {
+	unsigned long long ticks, steps, waits;
+	unsigned int end;			/* The ENDLOOP or RETURN at which it ended */
+	int how;				/* PB_TSPAN_* */
+};
+
+struct pb_tseg {
+	int state;				/* PB_TSEG_NEW etc */
+	struct pb_tspan span;
+	unsigned int seq;			/* Its sequence in the index (if indexing) */
+};
+
+/* The time index (pb_tindex_new()). Each level which is timed is also recorded, as a sequence of entries: one per instruction, and
+ * one per loop or subroutine it contains, which refers to that one's own sequence, in turn. An entry may also be repeated (count
+ * times): a loop of a million identical iterations is one entry. Since a segment is timed once, however often it is used, so is its
+ * sequence recorded once: the index is the same size as the program, not the trace. The entries of a sequence are in order of their
+ * start, so a lookup is a binary search at each level: O(depth * log n) */
+#define PB_TENTRY_INSN		0	/* An instruction: ref is its address */
+#define PB_TENTRY_SEQ		1	/* A loop, subroutine, or iteration: ref is its sequence */
+
+struct pb_tentry {
+	unsigned long long start;		/* In ticks, from the start of the sequence */
+	unsigned long long ticks;		/* Its length (once); PB_TIME_NEVER if it never ends */
+	unsigned long long count;		/* Times it is repeated, one after another */
+	unsigned int ref;
+	int kind;				/* PB_TENTRY_* */
+};
+
+struct pb_tseq {
+	struct pb_tentry *entries;
+	unsigned int n, size;
+	int forever;				/* It never ends: from cycle_start on, it repeats every cycle ticks */
+	unsigned long long cycle_start, cycle;
+};
+
+struct pb_tindex {
+	uint32_t *output;			/* The output of each word */
+	unsigned int words;
+	struct pb_tseq *seqs;			/* (seqs[0] isn't used: 0 is "none") */
+	unsigned int nseqs, size;
+	unsigned int root;			/* The top of the program */
+	int outcome;				/* PB_TIME_STOP or PB_TIME_FOREVER */
+	unsigned long long ticks;		/* If it stops: when */
+	unsigned int stop_pc;			/* ... and the address of the STOP */
+	unsigned long entries;
+	int nomem;
+};
+
+struct pb_timer {
+	struct pb_vliw *code;			/* The program, decoded */
+	unsigned int words;
+	const unsigned int *lines;
+	FILE *log;
+	struct pb_tseg *seg[2];			/* The segment beginning at each address, of each kind */
+	unsigned long long *first;		/* Tick of the first execution of each word */
+	unsigned long long *seen_time;		/* When each address was last reached, in the level numbered seen_gen */
+	unsigned long *seen_gen;
+	unsigned long gen;			/* Number of levels so far */
+	unsigned int loops, subs;		/* Depth of the stacks */
+	int overflow;				/* Some time (or count) was more than 2^64 */
+	unsigned long long period_start, period;
+	unsigned long segments;
+	struct pb_tindex *ix;			/* The index being built, or NULL */
+};
+
+/* a + b, and a * b, saturating at 2^64-1 (and noting it) */
+static unsigned long long pb_time_add (struct pb_timer *t, unsigned long long a, unsigned long long b){
+	if (a > ~0ULL - b){
+		t->overflow = 1;
+		return (~0ULL);
+	}
+	return (a + b);
+}
+
+static unsigned long long pb_time_mul (struct pb_timer *t, unsigned long long a, unsigned long long b){
+	if ((b != 0) && (a > ~0ULL / b)){
+		t->overflow = 1;
+		return (~0ULL);
+	}
+	return (a * b);
+}
+
+/* Add span b (n times) to a */
+static void pb_tspan_add (struct pb_timer *t, struct pb_tspan *a, const struct pb_tspan *b, unsigned long long n){
+	a->ticks = pb_time_add (t, a->ticks, pb_time_mul (t, b->ticks, n));
+	a->steps = pb_time_add (t, a->steps, pb_time_mul (t, b->steps, n));
+	a->waits = pb_time_add (t, a->waits, pb_time_mul (t, b->waits, n));
+}
+
+/* Print an error at addr, and return code */
+static int pb_time_error (struct pb_timer *t, unsigned int addr, int code, const char *what){
+	if (t->log == NULL){
+		return (code);
+	}
+	fprintf (t->log, "Error at address %u", addr);
+	if (t->lines && (addr < t->words) && t->lines[addr]){
+		fprintf (t->log, " (line %u)", t->lines[addr]);
+	}
+	fprintf (t->log, ": %s.\n", what);
+	return (code);
+}
+
+/* A new (empty) sequence in the index: returns its number, or 0 (if not indexing, or out of memory) */
+static unsigned int pb_tindex_seq (struct pb_timer *t){
+	struct pb_tindex *ix = t->ix;
+	struct pb_tseq *seqs;
+
+	if ((ix == NULL) || (ix->nomem)){
+		return (0);
+	}
+	if (ix->nseqs == ix->size){
+		ix->size = ix->size ? ix->size * 2 : 64;
+		if ((seqs = realloc (ix->seqs, ix->size * sizeof(*seqs))) == NULL){
+			ix->nomem = 1;
+			return (0);
+		}
+		ix->seqs = seqs;
+	}
+	memset (&ix->seqs[ix->nseqs], 0, sizeof(ix->seqs[0]));
+	return (ix->nseqs++);
+}
+
+/* Add an entry to sequence seq (if indexing) */
+static void pb_tindex_add (struct pb_timer *t, unsigned int seq, unsigned long long start, unsigned long long ticks, unsigned long long count, int kind, unsigned int ref){
+	struct pb_tseq *s;
+	struct pb_tentry *entries;
+
+	if ((t->ix == NULL) || (seq == 0)){
+		return;
+	}
+	s = &t->ix->seqs[seq];
+	if (s->n == s->size){
+		s->size = s->size ? s->size * 2 : 8;
+		if ((entries = realloc (s->entries, s->size * sizeof(*entries))) == NULL){
+			t->ix->nomem = 1;
+			s->size = s->n;
+			return;
+		}
+		s->entries = entries;
+	}
+	s->entries[s->n].start = start;
+	s->entries[s->n].ticks = ticks;
+	s->entries[s->n].count = count;
+	s->entries[s->n].ref = ref;
+	s->entries[s->n].kind = kind;
+	s->n++;
+	t->ix->entries++;
+}
+
+/* The length of a span, as an entry: PB_TIME_NEVER if it never ends */
+static unsigned long long pb_tspan_ticks (const struct pb_tspan *span){
+	return ((span->how == PB_TSPAN_FOREVER) ? PB_TIME_NEVER : span->ticks);
+}
+
+static int pb_time_level (struct pb_timer *t, unsigned int pc, int kind, unsigned long long now, struct pb_tspan *out, unsigned int seq);
+
+/* The segment of this kind, which begins at pc, at tick now: time it (the first time), or remember it. Its sequence in the index goes to
+ * seq. Returns as pb_time_level() */
+static int pb_time_segment (struct pb_timer *t, unsigned int pc, int kind, unsigned long long now, struct pb_tspan *out, unsigned int *seq){
+	struct pb_tseg *seg;
+	int ret;
+
+	if (pc >= t->words){
+		return (pb_time_error (t, pc, PB_ERROR_INVALIDINSTRUCTION, "the program runs off the end, here"));
+	}
+	seg = &t->seg[kind][pc];
+	if (seg->state == PB_TSEG_DONE){
+		*out = seg->span;
+		*seq = seg->seq;
+		return (0);
+	}
+	if (seg->state == PB_TSEG_BUSY){
+		return (pb_time_error (t, pc, PB_ERROR_LOOPDEPTH, (kind == PB_TSEG_SUB) ? "this subroutine calls itself" : "this loop body begins itself again"));
+	}
+	seg->state = PB_TSEG_BUSY;
+	t->segments++;
+	seg->seq = *seq = pb_tindex_seq (t);
+	if ((ret = pb_time_level (t, pc, kind, now, out, seg->seq)) != 0){
+		return (ret);
+	}
+	seg->state = PB_TSEG_DONE;		/* (Only a span which ends normally is ever used again: after a STOP, or for ever, nothing is) */
+	seg->span = *out;
+	return (0);
+}
+
+/* The loop begun by the LOOP at pc (whose own time is already counted), at tick now, up to and including its last ENDLOOP. Its
+ * iterations go to sequence seq of the index */
+static int pb_time_loop (struct pb_timer *t, unsigned int pc, unsigned long long now, struct pb_tspan *out, unsigned int seq){
+	unsigned long long remaining = t->code[pc].arg - 1, at, n;
+	struct pb_tspan span, iter;
+	unsigned int back, start, body, iseq;
+	int ret;
+
+	if (t->code[pc].arg == 0){
+		return (pb_time_error (t, pc, PB_ERROR_INVALIDINSTRUCTION, "this LOOP has a count of 0"));
+	}
+	if ((ret = pb_time_segment (t, pc + 1, PB_TSEG_LOOP, now, out, &body)) != 0){		/* The first iteration */
+		return (ret);
+	}
+	pb_tindex_add (t, seq, 0, pb_tspan_ticks (out), 1, PB_TENTRY_SEQ, body);
+	while ((remaining) && (out->how == PB_TSPAN_END)){
+		back = t->code[out->end].arg;			/* The next, from where the ENDLOOP jumps back to */
+		memset (&iter, 0, sizeof(iter));
+		start = back;
+		at = out->ticks;
+		iseq = 0;
+		if (t->code[back].opcode == PB_OPCODE_LOOP){	/* A LOOP, jumped back to, doesn't begin a new loop: it just takes its time */
+			if (t->first[back] == PB_TIME_NEVER){
+				t->first[back] = pb_time_add (t, now, out->ticks);
+			}
+			iter.ticks = t->code[back].length;
+			iter.steps = 1;
+			start++;
+			iseq = pb_tindex_seq (t);		/* (Then the iteration is that, and the body) */
+			pb_tindex_add (t, iseq, 0, iter.ticks, 1, PB_TENTRY_INSN, back);
+		}
+		if ((ret = pb_time_segment (t, start, PB_TSEG_LOOP, pb_time_add (t, now, pb_time_add (t, out->ticks, iter.ticks)), &span, &body)) != 0){
+			return (ret);
+		}
+		pb_tspan_add (t, &iter, &span, 1);
+		if (iseq){
+			pb_tindex_add (t, iseq, iter.ticks - span.ticks, pb_tspan_ticks (&span), 1, PB_TENTRY_SEQ, body);
+		}else{
+			iseq = body;
+		}
+		if ((span.how == PB_TSPAN_END) && (t->code[span.end].arg == back)){
+			pb_tspan_add (t, out, &iter, remaining);	/* It ends by jumping back to the same place: so all the rest are the same */
+			n = remaining;
+			remaining = 0;
+		}else{
+			pb_tspan_add (t, out, &iter, 1);
+			n = 1;
+			remaining--;
+		}
+		iter.how = span.how;
+		pb_tindex_add (t, seq, at, pb_tspan_ticks (&iter), n, PB_TENTRY_SEQ, iseq);
+		out->end = span.end;
+		out->how = span.how;
+	}
+	return (0);
+}
+
+/* Time one level (of this kind), from pc, at tick now, into out; and record it in sequence seq of the index. Returns 0, or the
+ * PB_ERROR_* code */
+static int pb_time_level (struct pb_timer *t, unsigned int pc, int kind, unsigned long long now, struct pb_tspan *out, unsigned int seq){
+	unsigned long gen = ++t->gen;
+	unsigned long long at, start;
+	const struct pb_vliw *w;
+	struct pb_tspan inner;
+	unsigned int inner_seq;
+	int ret;
+
+	memset (out, 0, sizeof(*out));
+	for (;;){
+		if (pc >= t->words){
+			return (pb_time_error (t, pc - 1, PB_ERROR_INVALIDINSTRUCTION, "the program runs off the end, after this instruction"));
+		}
+		w = &t->code[pc];
+		at = pb_time_add (t, now, out->ticks);
+		if (t->first[pc] == PB_TIME_NEVER){
+			t->first[pc] = at;
+		}
+		if (t->seen_gen[pc] == gen){		/* Back where it was: this will go round for ever */
+			t->period_start = t->seen_time[pc];
+			t->period = at - t->seen_time[pc];
+			out->how = PB_TSPAN_FOREVER;
+			if ((t->ix) && (seq)){
+				t->ix->seqs[seq].forever = 1;
+				t->ix->seqs[seq].cycle_start = t->seen_time[pc] - now;
+				t->ix->seqs[seq].cycle = t->period;
+			}
+			return (0);
+		}
+		t->seen_gen[pc] = gen;
+		t->seen_time[pc] = at;
+		out->steps = pb_time_add (t, out->steps, 1);
+		start = out->ticks;
+
+		if (((w->opcode == PB_OPCODE_GOTO) || (w->opcode == PB_OPCODE_CALL) || (w->opcode == PB_OPCODE_ENDLOOP)) && (w->arg >= t->words)){
+			return (pb_time_error (t, pc, PB_ERROR_INVALIDINSTRUCTION, "it branches to an address beyond the end of the program"));
+		}
+		switch (w->opcode){
+			case PB_OPCODE_CONT:
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				pc++;
+				break;
+
+			case PB_OPCODE_LONGDELAY:		/* (One entry, however long: the output doesn't change) */
+				out->ticks = pb_time_add (t, out->ticks, pb_time_mul (t, w->length, w->arg));
+				pb_tindex_add (t, seq, start, out->ticks - start, 1, PB_TENTRY_INSN, pc);
+				pc++;
+				break;
+
+			case PB_OPCODE_WAIT:			/* (The time waiting for the trigger isn't known: it is left out) */
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				out->waits = pb_time_add (t, out->waits, 1);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				pc++;
+				break;
+
+			case PB_OPCODE_STOP:
+				out->how = PB_TSPAN_STOP;
+				if (t->ix){
+					t->ix->stop_pc = pc;
+				}
+				return (0);
+
+			case PB_OPCODE_GOTO:
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				pc = w->arg;
+				break;
+
+			case PB_OPCODE_LOOP:
+				if (t->loops >= PB_LOOP_MAXDEPTH){
+					return (pb_time_error (t, pc, PB_ERROR_LOOPDEPTH, "this LOOP nests loops deeper than PB_LOOP_MAXDEPTH"));
+				}
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				inner_seq = pb_tindex_seq (t);
+				t->loops++;
+				ret = pb_time_loop (t, pc, pb_time_add (t, now, out->ticks), &inner, inner_seq);
+				t->loops--;
+				if (ret){
+					return (ret);
+				}
+				pb_tindex_add (t, seq, out->ticks, pb_tspan_ticks (&inner), 1, PB_TENTRY_SEQ, inner_seq);
+				pb_tspan_add (t, out, &inner, 1);
+				if (inner.how != PB_TSPAN_END){
+					out->how = inner.how;
+					return (0);
+				}
+				pc = inner.end + 1;
+				break;
+
+			case PB_OPCODE_ENDLOOP:
+				if (kind != PB_TSEG_LOOP){
+					return (pb_time_error (t, pc, PB_ERROR_LOOPDEPTH, (kind == PB_TSEG_TOP) ? "this ENDLOOP is not inside any loop" :
+						"this ENDLOOP, in a subroutine, ends a loop which was begun outside it: that can't be timed"));
+				}
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				out->end = pc;
+				return (0);
+
+			case PB_OPCODE_CALL:
+				if (t->subs >= PB_SUB_MAXDEPTH){
+					return (pb_time_error (t, pc, PB_ERROR_LOOPDEPTH, "this CALL nests subroutines deeper than PB_SUB_MAXDEPTH"));
+				}
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				t->subs++;
+				ret = pb_time_segment (t, w->arg, PB_TSEG_SUB, pb_time_add (t, now, out->ticks), &inner, &inner_seq);
+				t->subs--;
+				if (ret){
+					return (ret);
+				}
+				pb_tindex_add (t, seq, out->ticks, pb_tspan_ticks (&inner), 1, PB_TENTRY_SEQ, inner_seq);
+				pb_tspan_add (t, out, &inner, 1);
+				if (inner.how != PB_TSPAN_END){
+					out->how = inner.how;
+					return (0);
+				}
+				pc++;
+				break;
+
+			case PB_OPCODE_RETURN:
+				if (kind != PB_TSEG_SUB){
+					return (pb_time_error (t, pc, PB_ERROR_LOOPDEPTH, (kind == PB_TSEG_TOP) ? "this RETURN is not inside any subroutine" :
+						"this RETURN is inside a loop, which it leaves unfinished: that can't be timed"));
+				}
+				out->ticks = pb_time_add (t, out->ticks, w->length);
+				pb_tindex_add (t, seq, start, w->length, 1, PB_TENTRY_INSN, pc);
+				out->end = pc;
+				return (0);
+
+			default:
+				return (pb_time_error (t, pc, PB_ERROR_INVALIDINSTRUCTION, "the opcode is invalid"));
+		}
+	}
+}
+
+/* Time a program, and (if ix isn't NULL) build its index */
+static int pb_time_run (const unsigned char *image, size_t len, const unsigned int *lines, unsigned long long *first, struct pb_time_result *result, struct pb_tindex *ix, FILE *log){
+	struct pb_timer t;
+	struct pb_tspan span;
+	unsigned int i;
+	int ret;
+
+	memset (&t, 0, sizeof(t));
+	t.words = len / PB_BPW_VLIW;
+	t.lines = lines;
+	t.log = log;
+	t.ix = ix;
+	if (result){
+		memset (result, 0, sizeof(*result));
+	}
+	if ((t.words == 0) || (t.words > PB_MEMORY)){
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	t.code = malloc (t.words * sizeof(*t.code));
+	t.seg[PB_TSEG_LOOP] = calloc (t.words, sizeof(struct pb_tseg));
+	t.seg[PB_TSEG_SUB] = calloc (t.words, sizeof(struct pb_tseg));
+	t.first = malloc (t.words * sizeof(*t.first));
+	t.seen_time = malloc (t.words * sizeof(*t.seen_time));
+	t.seen_gen = calloc (t.words, sizeof(*t.seen_gen));
+	if (!t.code || !t.seg[PB_TSEG_LOOP] || !t.seg[PB_TSEG_SUB] || !t.first || !t.seen_time || !t.seen_gen){
+		if (log) fprintf (log, "Error: out of memory, timing the program.\n");
+		ret = PB_ERROR_GENERIC;
+		goto done;
+	}
+	for (i = 0; i < t.words; i++){
+		pb_decode_vliw (image + (size_t)i * PB_BPW_VLIW, &t.code[i]);
+		t.first[i] = PB_TIME_NEVER;
+	}
+
+	if (ix){
+		ix->words = t.words;
+		pb_tindex_seq (&t);		/* (Number 0, which isn't used) */
+		ix->root = pb_tindex_seq (&t);
+		if ((ix->output = malloc (t.words * sizeof(*ix->output))) == NULL){
+			ix->nomem = 1;
+		}else{
+			for (i = 0; i < t.words; i++){
+				ix->output[i] = t.code[i].output;
+			}
+		}
+	}
+
+	if ((ret = pb_time_level (&t, 0, PB_TSEG_TOP, 0, &span, ix ? ix->root : 0)) != 0){
+		goto done;
+	}
+	if (t.overflow){
+		if (log) fprintf (log, "Error: the program runs for more than 2^64 ticks (or executes more than 2^64 instructions), which is too long to time.\n");
+		ret = PB_ERROR_GENERIC;
+		goto done;
+	}
+	if (ix){
+		if (ix->nomem){
+			if (log) fprintf (log, "Error: out of memory, indexing the program.\n");
+			ret = PB_ERROR_GENERIC;
+			goto done;
+		}
+		ix->outcome = (span.how == PB_TSPAN_STOP) ? PB_TIME_STOP : PB_TIME_FOREVER;
+		ix->ticks = span.ticks;
+	}
+	if (result){
+		result->outcome = (span.how == PB_TSPAN_STOP) ? PB_TIME_STOP : PB_TIME_FOREVER;
+		result->ticks = span.ticks;
+		if (span.how == PB_TSPAN_FOREVER){
+			result->period_start = t.period_start;
+			result->period = t.period;
+		}
+		result->steps = span.steps;
+		result->waits = span.waits;
+		for (i = 0; i < t.words; i++){
+			result->reached += (t.first[i] != PB_TIME_NEVER);
+		}
+		result->segments = t.segments;
+	}
+	if (first){
+		memcpy (first, t.first, t.words * sizeof(*first));
+	}
+
+done:
+	free (t.code);
+	free (t.seg[PB_TSEG_LOOP]);
+	free (t.seg[PB_TSEG_SUB]);
+	free (t.first);
+	free (t.seen_time);
+	free (t.seen_gen);
+	return (ret);
+}
+
+/* Time a program. See pb_flow.h */
+int pb_time (const unsigned char *image, size_t len, const unsigned int *lines, unsigned long long *first, struct pb_time_result *result, FILE *log){
+	return (pb_time_run (image, len, lines, first, result, NULL, log));
+}
+
+/* Index a program. See pb_flow.h */
+struct pb_tindex *pb_tindex_new (const unsigned char *image, size_t len, const unsigned int *lines, struct pb_time_result *result, FILE *log){
+	struct pb_tindex *ix;
+
+	if ((ix = calloc (1, sizeof(*ix))) == NULL){
+		if (log) fprintf (log, "Error: out of memory, indexing the program.\n");
+		return (NULL);
+	}
+	if (pb_time_run (image, len, lines, NULL, result, ix, log) != 0){
+		pb_tindex_free (ix);
+		return (NULL);
+	}
+	return (ix);
+}
+
+void pb_tindex_free (struct pb_tindex *ix){
+	unsigned int i;
+
+	if (ix == NULL){
+		return;
+	}
+	for (i = 0; i < ix->nseqs; i++){
+		free (ix->seqs[i].entries);
+	}
+	free (ix->seqs);
+	free (ix->output);
+	free (ix);
+}
+
+unsigned long pb_tindex_entries (const struct pb_tindex *ix){
+	return (ix->entries);
+}
+
+/* Look up the state at a given tick: descend from the top, by binary search at each level. See pb_flow.h */
+void pb_tindex_lookup (const struct pb_tindex *ix, unsigned long long tick, struct pb_tindex_state *state){
+	const struct pb_tseq *s;
+	const struct pb_tentry *e;
+	unsigned long long off = tick, rel;
+	unsigned int seq = ix->root, lo, hi, mid, depth = 0;
+
+	if ((ix->outcome == PB_TIME_STOP) && (tick >= ix->ticks)){	/* After the STOP: the outputs stay as they were */
+		if (ix->ticks){
+			pb_tindex_lookup (ix, ix->ticks - 1, state);
+		}else{
+			memset (state, 0, sizeof(*state));
+		}
+		state->pc = ix->stop_pc;
+		state->start = ix->ticks;
+		state->end = PB_TIME_NEVER;
+		state->stopped = 1;
+		return;
+	}
+	for (;;){
+		s = &ix->seqs[seq];
+		if ((s->forever) && (off >= s->cycle_start) && (off - s->cycle_start >= s->cycle)){
+			off = s->cycle_start + (off - s->cycle_start) % s->cycle;
+		}
+		lo = 0;					/* The last entry which begins at or before off. (Every sequence reached has one at 0) */
+		hi = s->n;
+		while (hi - lo > 1){
+			mid = lo + (hi - lo) / 2;
+			if (s->entries[mid].start <= off){
+				lo = mid;
+			}else{
+				hi = mid;
+			}
+		}
+		e = &s->entries[lo];
+		rel = off - e->start;
+		if (e->count > 1){			/* Which repeat doesn't matter: only how far into it */
+			rel %= e->ticks;
+		}
+		depth++;
+		if (e->kind == PB_TENTRY_INSN){
+			state->pc = e->ref;
+			state->output = ix->output[e->ref];
+			state->start = tick - rel;
+			state->end = (e->ticks == PB_TIME_NEVER) ? PB_TIME_NEVER : state->start + e->ticks;
+			state->depth = depth;
+			state->stopped = 0;
+			return;
+		}
+		seq = e->ref;
+		off = rel;
+	}
+}
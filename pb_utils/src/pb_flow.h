@@ -0,0 +1,96 @@
+/* This is pb_flow.h, the interface to the control-flow analysis of program images (pb_flow.c), which is part of libpulseblaster.
+ * pb_encode_vliw() checks each instruction as it comes, but it can only count LOOPs and ENDLOOPs in the order they are written: it can't
+ * follow a GOTO, CALL or RETURN. pb_verify() follows every path through the program instead, and proves (or disproves) that no path:
+ *   - branches (GOTO, CALL, ENDLOOP) to an address beyond the end of the program, or runs off the end of it;
+ *   - nests loops deeper than PB_LOOP_MAXDEPTH, or reaches an ENDLOOP outside any loop;
+ *   - nests subroutines deeper than PB_SUB_MAXDEPTH, or reaches a RETURN outside any subroutine;
+ *   - reaches an invalid opcode.
+ * pb_asm, pb_prog and pbd run it on every program, so that one which would go wrong is never loaded.
+ * pb_time() works out, without running it, how long the program takes: the total, and when each instruction is first executed.
+ * It times each loop body (and subroutine) once, and multiplies up, so a program which runs for days costs no more than one which
+ * runs for microseconds.
+ * pb_tindex_new() keeps what pb_time() works out, as an index of the program's structure: each loop body, subroutine and LONGDELAY,
+ * with the tick at which each part of it begins. pb_tindex_lookup() then gives the state (the instruction, and the outputs) at any
+ * tick, in O(depth * log n), without expanding the iterations of any loop: so samples can be aligned to the pulses, by the million.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#ifndef PB_FLOW_H
+#define PB_FLOW_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+
+#define PB_VERIFY_MAXSTATES	(1UL << 20)	/* Give up (without an error) after this many distinct states. (A structured program has about one per word) */
+
+/* What was found */
+struct pb_verify_result {
+	unsigned int words;			/* Words in the program */
+	unsigned int reachable;			/* ... of which, reachable from address 0 */
+	unsigned long states;			/* Distinct states (address, loop stack, subroutine stack) explored */
+	unsigned int max_loop_depth;		/* Deepest nesting of loops, on any path */
+	unsigned int max_sub_depth;		/* Deepest nesting of subroutines, on any path */
+	int complete;				/* 1 if every path was followed; 0 if it gave up at PB_VERIFY_MAXSTATES (then nothing is proven) */
+};
+
+/* Verify the program image (len bytes). lines (may be NULL) is the source line of each word, for the messages; these, with the loop
+ * and subroutine stacks at the point of the error, go to log (if it isn't NULL). Returns 0, or the PB_ERROR_* code of the first error
+ * found: PB_ERROR_LOOPDEPTH for the loop and subroutine stacks, else PB_ERROR_INVALIDINSTRUCTION. (PB_ERROR_GENERIC if out of memory.)
+ * result may be NULL */
+int pb_verify (const unsigned char *image, size_t len, const unsigned int *lines, struct pb_verify_result *result, FILE *log);
+
+
+/* How a program ends, for pb_time() */
+#define PB_TIME_STOP		0	/* It reaches a STOP */
+#define PB_TIME_FOREVER		1	/* It never stops: from period_start on, it repeats exactly, every period ticks */
+#define PB_TIME_NEVER		(~0ULL)	/* In first[]: the instruction is never executed */
+
+/* The timing of a program. Ticks are of program time, i.e. not counting the time spent in each WAIT for its trigger */
+struct pb_time_result {
+	int outcome;				/* PB_TIME_STOP or PB_TIME_FOREVER */
+	unsigned long long ticks;		/* Until the STOP (or, if forever, to the end of the first repeat: period_start + period) */
+	unsigned long long period_start;	/* If forever: from this tick on ... */
+	unsigned long long period;		/* ... the program repeats, with this period */
+	unsigned long long steps;		/* Instructions executed (to the same point) */
+	unsigned long long waits;		/* WAITs executed (to the same point) */
+	unsigned int reached;			/* Words which are ever executed */
+	unsigned long segments;			/* Loop bodies and subroutines timed. (Each is timed once, however often it runs) */
+};
+
+/* Time the program image (len bytes). lines (may be NULL) is as for pb_verify(). If first isn't NULL, it gets the tick at which each
+ * word is first executed, or PB_TIME_NEVER. Returns 0, or a PB_ERROR_* code (with the explanation to log, if it isn't NULL):
+ * PB_ERROR_INVALIDINSTRUCTION or PB_ERROR_LOOPDEPTH for a program which pb_verify() would reject, or which is too unstructured to
+ * be timed this way (a RETURN from inside a loop, or an ENDLOOP which closes a loop begun outside the subroutine it is in);
+ * PB_ERROR_GENERIC if out of memory, or if the program runs for more than 2^64 ticks. result may be NULL */
+int pb_time (const unsigned char *image, size_t len, const unsigned int *lines, unsigned long long *first, struct pb_time_result *result, FILE *log);
+
+
+/* The time index of a program (opaque) */
+struct pb_tindex;
+
+/* The state at a given tick */
+struct pb_tindex_state {
+	uint32_t output;			/* The outputs */
+	unsigned int pc;			/* The instruction (or, if stopped, the STOP) */
+	unsigned long long start, end;		/* It began at tick start, and lasts until end (PB_TIME_NEVER: never ends, i.e. stopped) */
+	unsigned int depth;			/* Levels of the index descended, to find it */
+	int stopped;				/* 1 if the program has stopped: the outputs are those of the last instruction before the STOP */
+};
+
+/* Time and index the program image (len bytes): lines, result and log are as for pb_time(). Returns the index (to be freed with
+ * pb_tindex_free()), or NULL, with the explanation to log, on any error which pb_time() would give (or if out of memory). The index
+ * has one entry per instruction or loop of each loop body and subroutine (as timed, i.e. about one per word); not one per step */
+struct pb_tindex *pb_tindex_new (const unsigned char *image, size_t len, const unsigned int *lines, struct pb_time_result *result, FILE *log);
+void pb_tindex_free (struct pb_tindex *ix);
+
+/* The number of entries in the index */
+unsigned long pb_tindex_entries (const struct pb_tindex *ix);
+
+/* The state at tick (of program time: not counting any wait for a trigger). For a program which repeats for ever, any tick may be
+ * given; for one which stops, a tick at or after the STOP gives the state in which it stopped. O(depth * log n): for consecutive
+ * samples, [start, end) also says how long the state lasts, so those within it needn't be looked up again */
+void pb_tindex_lookup (const struct pb_tindex *ix, unsigned long long tick, struct pb_tindex_state *state);
+
+#endif /* PB_FLOW_H */
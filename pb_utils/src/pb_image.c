@@ -0,0 +1,260 @@
+/* This is pb_image.c which reads and writes the program image (.bin) formats: raw words, or the container with a header, a CRC and a
+ * source map. (See pb_image.h, and doc/bin.txt.)
+ * The container's numbers are all little-endian, and are written and read a byte at a time, so the format doesn't depend on the host.
+ * The source map is the .vliw line of each word: the first as an unsigned LEB128 varint, then each as the (zigzag-encoded, signed)
+ * difference from the one before. Since consecutive words usually come from consecutive lines, that is one byte per word.
+ * It is part of libpulseblaster: like the rest of the library, nothing here exits.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pb_image.h"
+#include "pb_flow.h"	/* pb_time() */
+
+/* Offsets of the fields in the (version 1) header */
+#define PB_IMAGE_OFF_VERSION	8	/* 2 bytes */
+#define PB_IMAGE_OFF_HEADER_LEN	10	/* 2 */
+#define PB_IMAGE_OFF_FLAGS	12	/* 4 */
+#define PB_IMAGE_OFF_MODEL	16	/* PB_IMAGE_MODEL_LEN */
+#define PB_IMAGE_OFF_TICK_PS	32	/* 4 */
+#define PB_IMAGE_OFF_CLOCK_MHZ	36	/* 4 */
+#define PB_IMAGE_OFF_MEMORY	40	/* 4 */
+#define PB_IMAGE_OFF_WORDS	44	/* 4 */
+#define PB_IMAGE_OFF_RUNTIME	48	/* 8 */
+#define PB_IMAGE_OFF_CRC	56	/* 4 */
+#define PB_IMAGE_OFF_MAP_LEN	60	/* 4 */
+
+#define PB_IMAGE_TICK_PS	((unsigned long)(PB_TICK_NS * 1000 + 0.5))	/* (PB_TICK_NS may not be an integer) */
+
+
+static const uint32_t pb_crc32_table[256] = {
+	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+	0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+	0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+	0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+	0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+	0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+	0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+	0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+	0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+	0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+	0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+	0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+	0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+	0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+	0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+	0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+	0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+	0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+	0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+	0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+	0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+	0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
+
+uint32_t pb_crc32 (uint32_t crc, const unsigned char *buf, size_t len){
+	crc = ~crc;
+	while (len--){
+		crc = pb_crc32_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	}
+	return (~crc);
+}
+
+static void pb_put16 (unsigned char *p, unsigned int x){
+	p[0] = x;
+	p[1] = x >> 8;
+}
+
+static void pb_put32 (unsigned char *p, uint32_t x){
+	p[0] = x;
+	p[1] = x >> 8;
+	p[2] = x >> 16;
+	p[3] = x >> 24;
+}
+
+static unsigned int pb_get16 (const unsigned char *p){
+	return (p[0] | (p[1] << 8));
+}
+
+static uint32_t pb_get32 (const unsigned char *p){
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+
+/* The run time of a program which stops. See pb_image.h */
+unsigned long long pb_image_runtime (const unsigned char *payload, size_t len){
+	struct pb_time_result result;
+
+	if ((pb_time (payload, len, NULL, NULL, &result, NULL) != 0) || (result.outcome != PB_TIME_STOP)){
+		return (0);			/* Runs for ever, or can't be timed */
+	}
+	return (result.ticks);
+}
+
+
+/* Write a container. See pb_image.h */
+int pb_image_write (FILE *fh, const unsigned char *payload, size_t len, const unsigned int *lines){
+	unsigned char header[PB_IMAGE_HEADER_LEN], *map = NULL;
+	unsigned int words = len / PB_BPW_VLIW, i;
+	unsigned long long runtime, zz;
+	long long delta;
+	size_t map_len = 0;
+	uint32_t crc;
+	int ret = 0;
+
+	if (lines != NULL){
+		if ((map = malloc (PB_IMAGE_MAP_MAXLEN)) == NULL){
+			return (PB_ERROR_GENERIC);
+		}
+		for (i = 0; i < words; i++){
+			delta = (long long)lines[i] - (i ? (long long)lines[i - 1] : 0);
+			zz = i ? (unsigned long long)((delta << 1) ^ (delta >> 63)) : lines[0];	/* zigzag: 0, -1, 1, -2... -> 0, 1, 2, 3... */
+			do {
+				map[map_len++] = (zz & 0x7f) | ((zz > 0x7f) ? 0x80 : 0);
+				zz >>= 7;
+			} while (zz);
+		}
+	}
+
+	runtime = pb_image_runtime (payload, len);
+	crc = pb_crc32 (pb_crc32 (0, payload, len), map, map_len);
+
+	memset (header, 0, sizeof(header));
+	memcpy (header, PB_IMAGE_MAGIC, PB_IMAGE_MAGIC_LEN);
+	pb_put16 (header + PB_IMAGE_OFF_VERSION, PB_IMAGE_VERSION);
+	pb_put16 (header + PB_IMAGE_OFF_HEADER_LEN, PB_IMAGE_HEADER_LEN);
+	pb_put32 (header + PB_IMAGE_OFF_FLAGS, map ? PB_IMAGE_FLAG_SOURCE_MAP : 0);
+	strncpy ((char *)header + PB_IMAGE_OFF_MODEL, PB_VERSION, PB_IMAGE_MODEL_LEN);
+	pb_put32 (header + PB_IMAGE_OFF_TICK_PS, PB_IMAGE_TICK_PS);
+	pb_put32 (header + PB_IMAGE_OFF_CLOCK_MHZ, PB_CLOCK_MHZ);
+	pb_put32 (header + PB_IMAGE_OFF_MEMORY, PB_MEMORY);
+	pb_put32 (header + PB_IMAGE_OFF_WORDS, words);
+	pb_put32 (header + PB_IMAGE_OFF_RUNTIME, runtime & 0xffffffff);
+	pb_put32 (header + PB_IMAGE_OFF_RUNTIME + 4, runtime >> 32);
+	pb_put32 (header + PB_IMAGE_OFF_CRC, crc);
+	pb_put32 (header + PB_IMAGE_OFF_MAP_LEN, map_len);
+
+	if ((fwrite (header, 1, sizeof(header), fh) != sizeof(header)) || (fwrite (payload, 1, len, fh) != len)
+			|| (fwrite (map, 1, map_len, fh) != map_len)){
+		ret = PB_ERROR_GENERIC;
+	}
+	free (map);
+	return (ret);
+}
+
+
+/* Parse a .bin file. See pb_image.h */
+int pb_image_parse (struct pb_image *img, const unsigned char *buf, size_t len, FILE *log){
+	unsigned int header_len;
+	size_t i;
+
+	memset (img, 0, sizeof(*img));
+
+	if ((len < PB_IMAGE_MAGIC_LEN) || memcmp (buf, PB_IMAGE_MAGIC, PB_IMAGE_MAGIC_LEN)){	/* Raw */
+		img->payload = buf;
+		img->payload_len = len;
+		img->words = len / PB_BPW_VLIW;
+		if ((len == 0) || (len % PB_BPW_VLIW) || (len > (size_t)PB_MEMORY * PB_BPW_VLIW)){
+			return (0);	/* These are for the caller to explain, since it knows where the file came from (and pb_device_program() checks again) */
+		}
+		for (i = 0; i < len; i++){	/* Every real program has some byte (eg opcode CONT, or a delay's MSB) which isn't text. A .vliw file is all text */
+			if (((buf[i] < 0x20) || (buf[i] > 0x7e)) && (buf[i] != '\t') && (buf[i] != '\n') && (buf[i] != '\r')){
+				return (0);
+			}
+		}
+		if (log) fprintf (log, "Error: this binary file is entirely text: it's probably .vliw source, not a .bin. Try piping it through 'pb_asm - -'.\n");
+		return (PB_ERROR_BADVLIWFILE);
+	}
+
+	/* Container: check the header (in O(1)), then the CRC */
+	img->container = 1;
+	if (len < PB_IMAGE_HEADER_LEN){
+		if (log) fprintf (log, "Error: binary file is truncated: it has only %lu bytes, which isn't even a whole header.\n", (unsigned long)len);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	img->version = pb_get16 (buf + PB_IMAGE_OFF_VERSION);
+	header_len = pb_get16 (buf + PB_IMAGE_OFF_HEADER_LEN);
+	if ((img->version > PB_IMAGE_VERSION) || (img->version == 0) || (header_len < PB_IMAGE_HEADER_LEN) || (header_len > len)){
+		if (log) fprintf (log, "Error: binary file has format version %u (header %u bytes), but this pb_utils only understands up to version %d.\n",
+			img->version, header_len, PB_IMAGE_VERSION);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	memcpy (img->model, buf + PB_IMAGE_OFF_MODEL, PB_IMAGE_MODEL_LEN);
+	img->tick_ps = pb_get32 (buf + PB_IMAGE_OFF_TICK_PS);
+	img->clock_mhz = pb_get32 (buf + PB_IMAGE_OFF_CLOCK_MHZ);
+	img->memory = pb_get32 (buf + PB_IMAGE_OFF_MEMORY);
+	img->words = pb_get32 (buf + PB_IMAGE_OFF_WORDS);
+	img->runtime_ticks = pb_get32 (buf + PB_IMAGE_OFF_RUNTIME) | ((unsigned long long)pb_get32 (buf + PB_IMAGE_OFF_RUNTIME + 4) << 32);
+	img->crc = pb_get32 (buf + PB_IMAGE_OFF_CRC);
+	img->map_len = pb_get32 (buf + PB_IMAGE_OFF_MAP_LEN);
+
+	if (strcmp (img->model, PB_VERSION) || (img->tick_ps != PB_IMAGE_TICK_PS) || (img->clock_mhz != PB_CLOCK_MHZ) || (img->memory != PB_MEMORY)){
+		if (log) fprintf (log, "Error: binary file was assembled for a %s (%u MHz, tick %lu ps, %u words), but this is a %s (%d MHz, tick %lu ps, %d words).\n",
+			img->model, img->clock_mhz, img->tick_ps, img->memory, PB_VERSION, PB_CLOCK_MHZ, PB_IMAGE_TICK_PS, PB_MEMORY);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	if ((img->words == 0) || (img->words > PB_MEMORY)){
+		if (log) fprintf (log, "Error: binary file has %u VLIW instructions, but must have between 1 and %d.\n", img->words, PB_MEMORY);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	img->payload = buf + header_len;
+	img->payload_len = (size_t)img->words * PB_BPW_VLIW;
+	if ((len - header_len < img->payload_len) || (len - header_len - img->payload_len != img->map_len)){
+		if (log) fprintf (log, "Error: binary file is %lu bytes long, but its header says it should be %lu.\n",
+			(unsigned long)len, (unsigned long)(header_len + img->payload_len + img->map_len));
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	if (pb_get32 (buf + PB_IMAGE_OFF_FLAGS) & PB_IMAGE_FLAG_SOURCE_MAP){
+		img->map = img->payload + img->payload_len;
+	}
+	if (pb_crc32 (0, img->payload, len - header_len) != img->crc){
+		if (log) fprintf (log, "Error: binary file is corrupt: its CRC is wrong.\n");
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	return (0);
+}
+
+/* Decode the source map. See pb_image.h */
+int pb_image_lines (const struct pb_image *img, unsigned int *lines){
+	const unsigned char *p, *end;
+	unsigned long long zz;
+	long long line = 0;
+	unsigned int i;
+	int shift;
+
+	if (img->map == NULL){
+		return (-1);
+	}
+	p = img->map;
+	end = img->map + img->map_len;
+	for (i = 0; i < img->words; i++){
+		zz = 0;
+		shift = 0;
+		do {
+			if ((p == end) || (shift > 35)){
+				return (-1);
+			}
+			zz |= (unsigned long long)(*p & 0x7f) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+		line = i ? line + (long long)((zz >> 1) ^ -(zz & 1)) : (long long)zz;
+		lines[i] = line;
+	}
+	return ((p == end) ? 0 : -1);
+}
@@ -0,0 +1,65 @@
+/* This is pb_image.h, the interface to the program image formats (pb_image.c), which is part of libpulseblaster.
+ * A .bin file is either:
+ *   1) raw: just the VLIW words, 10 bytes each, exactly as written to the device (see doc/raw.txt). This is still the default.
+ *   2) a container (pb_asm -c): a 64-byte header, recording the hardware it was assembled for and a CRC, then the same words, then
+ *      (optionally) a map from each word to its line of .vliw source. See doc/bin.txt for the layout.
+ * The loaders (pb_prog, pb_emu, pbd) accept either: pb_image_parse() tells them apart by the magic number, and checks a container
+ * against the configuration compiled in here (pulseblaster.h), so a program assembled for another model is never loaded.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#ifndef PB_IMAGE_H
+#define PB_IMAGE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+
+#define PB_IMAGE_MAGIC		"\x89PBBIN\r\n"	/* As PNG: the high bit, and the CR LF, detect a file which has been mangled as text */
+#define PB_IMAGE_MAGIC_LEN	8
+#define PB_IMAGE_VERSION	1		/* Readers reject a greater version. (A longer header is fine: fields are only ever added at the end) */
+#define PB_IMAGE_HEADER_LEN	64		/* Length of the version 1 header */
+#define PB_IMAGE_MODEL_LEN	16		/* The model (PB_VERSION), NUL-padded */
+#define PB_IMAGE_FLAG_SOURCE_MAP 0x1		/* The source map follows the words */
+
+#define PB_IMAGE_MAP_MAXLEN	(PB_MEMORY * 5)	/* Longest possible source map: a varint is at most 5 bytes per word */
+#define PB_IMAGE_MAXLEN		(PB_IMAGE_HEADER_LEN + PB_MEMORY * PB_BPW_VLIW + PB_IMAGE_MAP_MAXLEN)	/* Longest .bin file of either kind */
+
+/* A .bin file, as parsed. The pointers are into the caller's buffer */
+struct pb_image {
+	int container;				/* 1 if it has the header; 0 if it's raw (and then only words, payload and payload_len are set) */
+	unsigned int version;
+	char model[PB_IMAGE_MODEL_LEN + 1];
+	unsigned long tick_ps;			/* PB_TICK_NS, in picoseconds */
+	unsigned int clock_mhz;
+	unsigned int memory;			/* PB_MEMORY */
+	unsigned int words;			/* Number of VLIW words */
+	unsigned long long runtime_ticks;	/* Total run time, if it stops (see pb_image_runtime()); else 0 */
+	uint32_t crc;				/* CRC-32 of everything after the header */
+	const unsigned char *payload;		/* The words, as written to the device */
+	size_t payload_len;
+	const unsigned char *map;		/* The source map, or NULL */
+	size_t map_len;
+};
+
+/* Parse (and check) a .bin file of either kind, len bytes at buf. Returns 0, or PB_ERROR_BADVLIWFILE (with the explanation printed
+ * to log, if it isn't NULL). A raw file is only checked to be a whole number of words, which fit, and which don't look like text */
+int pb_image_parse (struct pb_image *img, const unsigned char *buf, size_t len, FILE *log);
+
+/* Write a container, for the payload (len bytes of words) and, if lines isn't NULL, its source map (the .vliw line of each word, as
+ * from pb_encoder_lines()). Returns 0, or PB_ERROR_GENERIC if it could not be written */
+int pb_image_write (FILE *fh, const unsigned char *payload, size_t len, const unsigned int *lines);
+
+/* Decode the source map of img into lines (img->words of them). Returns 0, or -1 if there isn't one (or it's damaged) */
+int pb_image_lines (const struct pb_image *img, unsigned int *lines);
+
+/* The total run time, in ticks, of a program which stops, however it gets there (through loops, subroutines, branches and WAITs), as
+ * pb_time() works it out: program time, not counting any wait for a trigger. For a program which runs for ever, or which pb_time()
+ * can't time, it returns 0, meaning 'unknown' */
+unsigned long long pb_image_runtime (const unsigned char *payload, size_t len);
+
+/* CRC-32 (as zlib), continuing from crc (0 to start) */
+uint32_t pb_crc32 (uint32_t crc, const unsigned char *buf, size_t len);
+
+#endif /* PB_IMAGE_H */
@@ -0,0 +1,403 @@
+/* This is pb_imgcache.c which contains the cache of assembled program images, so that an unchanged .vliw file needn't be parsed again.
+ * It is content-addressed: the key of an image is the SHA-256 of the cache version, the configuration (exactly as pb_print_config prints
+ * it), and the .vliw source. Any change to any of those gives a different key, so there is nothing to invalidate; old entries just
+ * stop being used (pb_cache -c removes them).
+ * Each entry is one file, <key>.img: a short text header ("name: value" lines, ending with a blank line), then the image itself.
+ * pb_parse keeps its parsed output here too, as <key>.vliw (in its own format): these are counted and cleared along with ours.
+ * Entries are written to a temporary file, then renamed into place, so a reader never sees half of one, and concurrent users are safe.
+ * The running totals are in the file "stats", updated under flock().
+ * It is part of libpulseblaster: the interface is in pb_imgcache.h. Like the rest of the library, nothing here exits.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "pb_imgcache.h"
+#include "libpulseblaster.h"	/* pb_config_print() */
+
+#define PB_CACHE_VERSION	"pb_cache 3"		/* First line of each entry; also part of each key. Change it if the encoder's output changes */
+#define PB_CACHE_SUFFIX		".img"
+#define PB_CACHE_PARSE_SUFFIX	".vliw"			/* pb_parse's entries: .vliw output, parsed from .pbsrc. It keeps them here too (see pb_parse.php) */
+#define PB_CACHE_STATS		"stats"
+#define PB_CACHE_HEADER_MAXLEN	256			/* Length of an entry's header */
+#define PB_CACHE_DIR_MAXLEN	512
+#define PB_CACHE_PATH_MAXLEN	(PB_CACHE_DIR_MAXLEN + 1 + 256)	/* The directory, '/', and any file name in it (NAME_MAX is 255) */
+
+/* An open cache directory */
+struct pb_cache {
+	char dir[PB_CACHE_DIR_MAXLEN];
+	char *config;				/* The configuration, as pb_print_config prints it */
+	size_t config_len;
+	unsigned char *entry;			/* Buffer for reading one entry */
+	double t_lookup;			/* When the current lookup started */
+	size_t src_len;				/* Size of the source of the current lookup */
+	FILE *log;
+};
+
+
+/* SHA-256 (FIPS 180-4) */
+
+struct pb_sha256 {
+	uint32_t h[8];
+	unsigned char block[64];
+	size_t used;				/* Bytes in block */
+	uint64_t total;				/* Bytes hashed */
+};
+
+static const uint32_t pb_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void pb_sha256_init (struct pb_sha256 *s){
+	static const uint32_t h0[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy (s->h, h0, sizeof(h0));
+	s->used = 0;
+	s->total = 0;
+}
+
+/* Hash one 64-byte block */
+static void pb_sha256_block (struct pb_sha256 *s, const unsigned char *p){
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++){
+		w[i] = ((uint32_t)p[4*i] << 24) | ((uint32_t)p[4*i + 1] << 16) | ((uint32_t)p[4*i + 2] << 8) | p[4*i + 3];
+	}
+	for (i = 16; i < 64; i++){
+		w[i] = w[i-16] + (ROR32(w[i-15], 7) ^ ROR32(w[i-15], 18) ^ (w[i-15] >> 3)) + w[i-7] + (ROR32(w[i-2], 17) ^ ROR32(w[i-2], 19) ^ (w[i-2] >> 10));
+	}
+	a = s->h[0]; b = s->h[1]; c = s->h[2]; d = s->h[3]; e = s->h[4]; f = s->h[5]; g = s->h[6]; h = s->h[7];
+	for (i = 0; i < 64; i++){
+		t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + pb_sha256_k[i] + w[i];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+	}
+	s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d; s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+static void pb_sha256_update (struct pb_sha256 *s, const void *data, size_t len){
+	const unsigned char *p = data;
+	size_t n;
+
+	s->total += len;
+	if (s->used){					/* Finish the partial block first */
+		n = (len < 64 - s->used) ? len : 64 - s->used;
+		memcpy (s->block + s->used, p, n);
+		s->used += n;
+		p += n;
+		len -= n;
+		if (s->used < 64){
+			return;
+		}
+		pb_sha256_block (s, s->block);
+		s->used = 0;
+	}
+	for (; len >= 64; p += 64, len -= 64){		/* Whole blocks, straight from the data */
+		pb_sha256_block (s, p);
+	}
+	memcpy (s->block, p, len);
+	s->used = len;
+}
+
+/* Finish, and write the hash in hex */
+static void pb_sha256_hex (struct pb_sha256 *s, char hex[PB_CACHE_KEYLEN]){
+	uint64_t bits = s->total * 8;
+	unsigned char pad[72];
+	size_t n;
+	int i;
+
+	n = (s->used < 56) ? 56 - s->used : 120 - s->used;	/* 0x80, zeros, then the length (64 bits, big-endian) */
+	memset (pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	for (i = 0; i < 8; i++){
+		pad[n + i] = bits >> (56 - 8*i);
+	}
+	pb_sha256_update (s, pad, n + 8);
+	for (i = 0; i < 8; i++){
+		sprintf (hex + 8*i, "%08x", s->h[i]);
+	}
+}
+
+
+/* The cache */
+
+/* Time now, in seconds */
+double pb_cache_now (void){
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/* mkdir -p. Returns 0, or -1 */
+static int pb_cache_mkdir (char *path){
+	char *p;
+
+	for (p = path + 1; *p; p++){
+		if (*p == '/'){
+			*p = 0;
+			if ((mkdir (path, 0777) < 0) && (errno != EEXIST)){
+				*p = '/';
+				return (-1);
+			}
+			*p = '/';
+		}
+	}
+	return (((mkdir (path, 0777) < 0) && (errno != EEXIST)) ? -1 : 0);
+}
+
+/* Open the cache directory. See pb_imgcache.h */
+struct pb_cache *pb_cache_open (const char *dir, FILE *log){
+	struct pb_cache *cache;
+	const char *env;
+	FILE *fh;
+	int n;
+
+	if ((cache = calloc (1, sizeof(*cache))) == NULL){
+		return (NULL);
+	}
+	cache->log = log;
+
+	if (dir != NULL){
+		n = snprintf (cache->dir, sizeof(cache->dir), "%s", dir);
+	}else if ((env = getenv ("PB_CACHE_DIR")) != NULL){
+		n = snprintf (cache->dir, sizeof(cache->dir), "%s", env);
+	}else if (((env = getenv ("XDG_CACHE_HOME")) != NULL) && (env[0] == '/')){
+		n = snprintf (cache->dir, sizeof(cache->dir), "%s/pb_utils", env);
+	}else if (((env = getenv ("HOME")) != NULL) && (env[0] == '/')){
+		n = snprintf (cache->dir, sizeof(cache->dir), "%s/.cache/pb_utils", env);
+	}else{
+		n = 0;
+	}
+	if ((n <= 0) || (n >= (int)sizeof(cache->dir))){	/* Disabled (or nowhere to put it) */
+		free (cache);
+		return (NULL);
+	}
+	if (pb_cache_mkdir (cache->dir) < 0){
+		if (log) fprintf (log, "Warning: could not create the cache directory %s: %s. Not using the cache.\n", cache->dir, strerror(errno));
+		free (cache);
+		return (NULL);
+	}
+
+	/* The configuration is part of every key */
+	if ((fh = open_memstream (&cache->config, &cache->config_len)) == NULL){
+		free (cache);
+		return (NULL);
+	}
+	pb_config_print (fh);
+	fclose (fh);
+
+	if ((cache->entry = malloc (PB_CACHE_HEADER_MAXLEN + PB_MEMORY * PB_BPW_VLIW + 1)) == NULL){
+		pb_cache_close (cache);
+		return (NULL);
+	}
+	return (cache);
+}
+
+void pb_cache_close (struct pb_cache *cache){
+	if (cache == NULL){
+		return;
+	}
+	free (cache->config);
+	free (cache->entry);
+	free (cache);
+}
+
+const char *pb_cache_dir (const struct pb_cache *cache){
+	return (cache->dir);
+}
+
+/* Add to the running totals, in the stats file: under a lock, since other processes may be doing the same. (Failure is harmless) */
+static void pb_cache_count (struct pb_cache *cache, int lookups, int hits, int stores, double saved){
+	struct pb_cache_stats s;
+	char path[PB_CACHE_PATH_MAXLEN], buf[256];
+	ssize_t len;
+	int fd;
+
+	snprintf (path, sizeof(path), "%s/%s", cache->dir, PB_CACHE_STATS);
+	if ((fd = open (path, O_RDWR | O_CREAT, 0666)) < 0){
+		return;
+	}
+	if (flock (fd, LOCK_EX) == 0){
+		memset (&s, 0, sizeof(s));
+		if ((len = read (fd, buf, sizeof(buf) - 1)) > 0){
+			buf[len] = 0;
+			sscanf (buf, "lookups: %llu\nhits: %llu\nstores: %llu\nseconds_saved: %lf", &s.lookups, &s.hits, &s.stores, &s.seconds_saved);
+		}
+		s.lookups += lookups;
+		s.hits += hits;
+		s.stores += stores;
+		s.seconds_saved += saved;
+		len = snprintf (buf, sizeof(buf), "lookups: %llu\nhits: %llu\nstores: %llu\nseconds_saved: %.6f\n", s.lookups, s.hits, s.stores, s.seconds_saved);
+		if ((ftruncate (fd, 0) == 0) && (pwrite (fd, buf, len, 0) == len)){
+			/* Done */
+		}
+		flock (fd, LOCK_UN);
+	}
+	close (fd);
+}
+
+/* The key: a hash of everything which determines the image */
+static void pb_cache_key (struct pb_cache *cache, const char *src, size_t len, char key[PB_CACHE_KEYLEN]){
+	struct pb_sha256 s;
+
+	pb_sha256_init (&s);
+	pb_sha256_update (&s, PB_CACHE_VERSION "\n", strlen (PB_CACHE_VERSION "\n"));
+	pb_sha256_update (&s, cache->config, cache->config_len);
+	pb_sha256_update (&s, src, len);
+	pb_sha256_hex (&s, key);
+}
+
+/* Look up a source. See pb_imgcache.h */
+int pb_cache_get (struct pb_cache *cache, const char *src, size_t len, char key[PB_CACHE_KEYLEN], unsigned char *image, size_t *image_len, double *saved){
+	char path[PB_CACHE_PATH_MAXLEN], header[PB_CACHE_HEADER_MAXLEN], *body;
+	unsigned long words, src_bytes;
+	double encode_seconds;
+	ssize_t got, ret, header_len;
+	int fd;
+
+	cache->t_lookup = pb_cache_now ();
+	cache->src_len = len;
+	pb_cache_key (cache, src, len, key);
+
+	snprintf (path, sizeof(path), "%s/%s%s", cache->dir, key, PB_CACHE_SUFFIX);
+	if ((fd = open (path, O_RDONLY)) < 0){
+		pb_cache_count (cache, 1, 0, 0, 0);
+		return (-1);
+	}
+	for (got = 0; got < PB_CACHE_HEADER_MAXLEN + PB_MEMORY * PB_BPW_VLIW + 1; got += ret){
+		if ((ret = read (fd, cache->entry + got, PB_CACHE_HEADER_MAXLEN + PB_MEMORY * PB_BPW_VLIW + 1 - got)) <= 0){
+			break;
+		}
+	}
+	close (fd);
+
+	/* Check the entry is whole, and is what we expect. (The key makes a wrong image impossible, but a truncated file isn't) */
+	header_len = (got < PB_CACHE_HEADER_MAXLEN) ? got : PB_CACHE_HEADER_MAXLEN - 1;
+	memcpy (header, cache->entry, header_len);
+	header[header_len] = 0;
+	if ((sscanf (header, PB_CACHE_VERSION "\nwords: %lu\nsource_bytes: %lu\nencode_seconds: %lf\n", &words, &src_bytes, &encode_seconds) != 3)
+			|| ((body = strstr (header, "\n\n")) == NULL) || (words == 0) || (words > PB_MEMORY) || (src_bytes != len)
+			|| (got - (body + 2 - header) != (ssize_t)(words * PB_BPW_VLIW))){
+		if (cache->log) fprintf (cache->log, "Warning: ignoring damaged cache entry %s\n", path);
+		pb_cache_count (cache, 1, 0, 0, 0);
+		return (-1);
+	}
+	*image_len = words * PB_BPW_VLIW;
+	memcpy (image, cache->entry + (body + 2 - header), *image_len);
+
+	*saved = encode_seconds - (pb_cache_now () - cache->t_lookup);
+	if (*saved < 0){		/* A tiny program may be quicker to encode than to look up: then nothing was saved (but nothing much was lost) */
+		*saved = 0;
+	}
+	pb_cache_count (cache, 1, 1, 0, *saved);
+	return (0);
+}
+
+/* Store an image. See pb_imgcache.h */
+int pb_cache_put (struct pb_cache *cache, const char key[PB_CACHE_KEYLEN], const unsigned char *image, size_t image_len, double encode_seconds){
+	char path[PB_CACHE_PATH_MAXLEN], tmp[PB_CACHE_PATH_MAXLEN], header[PB_CACHE_HEADER_MAXLEN];
+	int fd, n, ok;
+
+	if ((image_len == 0) || (image_len % PB_BPW_VLIW) || (image_len > (size_t)PB_MEMORY * PB_BPW_VLIW)){
+		return (-1);
+	}
+	snprintf (path, sizeof(path), "%s/%s%s", cache->dir, key, PB_CACHE_SUFFIX);
+	snprintf (tmp, sizeof(tmp), "%s/.tmp.XXXXXX", cache->dir);
+	if ((fd = mkstemp (tmp)) < 0){
+		return (-1);
+	}
+	n = snprintf (header, sizeof(header), PB_CACHE_VERSION "\nwords: %lu\nsource_bytes: %lu\nencode_seconds: %.9f\n\n",
+		(unsigned long)(image_len / PB_BPW_VLIW), (unsigned long)cache->src_len, encode_seconds);
+	ok = (write (fd, header, n) == n) && (write (fd, image, image_len) == (ssize_t)image_len);
+	fchmod (fd, 0644);
+	if ((close (fd) != 0) || (!ok) || (rename (tmp, path) < 0)){
+		unlink (tmp);
+		return (-1);
+	}
+	pb_cache_count (cache, 0, 0, 1, 0);
+	return (0);
+}
+
+/* Is this the name of an entry with this suffix? */
+static int pb_cache_is_named (const char *name, const char *suffix){
+	size_t len = strlen (name);
+	return ((len == PB_CACHE_KEYLEN - 1 + strlen (suffix)) && (!strcmp (name + len - strlen (suffix), suffix)));
+}
+
+/* Is this the name of an entry (ours or pb_parse's), or a temporary file? */
+static int pb_cache_is_entry (const char *name){
+	return ((!strncmp (name, ".tmp.", 5)) || pb_cache_is_named (name, PB_CACHE_SUFFIX) || pb_cache_is_named (name, PB_CACHE_PARSE_SUFFIX));
+}
+
+int pb_cache_stats (struct pb_cache *cache, struct pb_cache_stats *stats){
+	char path[PB_CACHE_PATH_MAXLEN], buf[256];
+	struct dirent *d;
+	struct stat st;
+	FILE *fh;
+	DIR *dh;
+	size_t len;
+
+	memset (stats, 0, sizeof(*stats));
+	snprintf (path, sizeof(path), "%s/%s", cache->dir, PB_CACHE_STATS);
+	if ((fh = fopen (path, "r")) != NULL){
+		len = fread (buf, 1, sizeof(buf) - 1, fh);
+		buf[len] = 0;
+		sscanf (buf, "lookups: %llu\nhits: %llu\nstores: %llu\nseconds_saved: %lf", &stats->lookups, &stats->hits, &stats->stores, &stats->seconds_saved);
+		fclose (fh);
+	}
+	if ((dh = opendir (cache->dir)) == NULL){
+		return (-1);
+	}
+	while ((d = readdir (dh)) != NULL){
+		snprintf (path, sizeof(path), "%s/%s", cache->dir, d->d_name);
+		if ((d->d_name[0] != '.') && pb_cache_is_entry (d->d_name) && (stat (path, &st) == 0)){
+			stats->entries++;
+			stats->bytes += st.st_size;
+		}
+	}
+	closedir (dh);
+	return (0);
+}
+
+int pb_cache_clear (struct pb_cache *cache){
+	char path[PB_CACHE_PATH_MAXLEN];
+	struct dirent *d;
+	DIR *dh;
+	int ret = 0;
+
+	if ((dh = opendir (cache->dir)) == NULL){
+		return (-1);
+	}
+	while ((d = readdir (dh)) != NULL){
+		if (pb_cache_is_entry (d->d_name) || (!strcmp (d->d_name, PB_CACHE_STATS))){
+			snprintf (path, sizeof(path), "%s/%s", cache->dir, d->d_name);
+			if (unlink (path) < 0){
+				ret = -1;
+			}
+		}
+	}
+	closedir (dh);
+	return (ret);
+}
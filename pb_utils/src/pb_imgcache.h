@@ -0,0 +1,52 @@
+/* This is pb_imgcache.h, the interface to the cache of assembled program images (pb_imgcache.c), which is part of libpulseblaster.
+ * Each image is stored under the SHA-256 of its .vliw source, together with the configuration (as printed by pb_print_config) and the
+ * version of the encoder: so an image is only found again if the same source would be assembled into exactly the same bytes.
+ * pb_asm and pb_prog look up every .vliw source here before encoding it, and store what they encode.
+ * The cache is a directory: $PB_CACHE_DIR if it is set (set it empty to disable the cache), else $XDG_CACHE_HOME/pb_utils, else
+ * ~/.cache/pb_utils. It also keeps the running totals (lookups, hits, time saved), which pb_cache prints.
+ * pb_parse keeps its parsed output in the same directory, as <key>.vliw, and adds to the same totals.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#ifndef PB_IMGCACHE_H
+#define PB_IMGCACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+
+#define PB_CACHE_KEYLEN		65	/* A key is the SHA-256, in hex, +1 for the terminating NUL */
+
+struct pb_cache;	/* Opaque: an open cache directory */
+
+/* Running totals, since the cache was created (or cleared) */
+struct pb_cache_stats {
+	unsigned long long lookups;
+	unsigned long long hits;
+	unsigned long long stores;
+	double seconds_saved;		/* Encoding time saved by the hits (net of the time taken to look them up; never negative) */
+	unsigned long entries;		/* Images in the cache now */
+	unsigned long long bytes;	/* ... and their total size */
+};
+
+/* Open the cache in dir (NULL for the default, above), creating it if need be. Returns NULL if the cache is disabled, or can't be used:
+ * that is never an error, since the cache is only an optimisation. (Any explanation goes to log, if it isn't NULL) */
+struct pb_cache *pb_cache_open (const char *dir, FILE *log);
+void pb_cache_close (struct pb_cache *cache);
+const char *pb_cache_dir (const struct pb_cache *cache);
+
+/* Look up the .vliw source src (len bytes). On a hit, returns 0, with the image (at most PB_MEMORY * PB_BPW_VLIW bytes) in image,
+ * its length in *image_len, and the time saved in *saved. On a miss, returns -1. Either way, key is filled in, for pb_cache_put() */
+int pb_cache_get (struct pb_cache *cache, const char *src, size_t len, char key[PB_CACHE_KEYLEN], unsigned char *image, size_t *image_len, double *saved);
+
+/* Store an image, which took encode_seconds to assemble from its source. Returns 0, or -1 if it couldn't be stored */
+int pb_cache_put (struct pb_cache *cache, const char key[PB_CACHE_KEYLEN], const unsigned char *image, size_t image_len, double encode_seconds);
+
+/* Get the running totals; remove every image (and reset the totals). Each returns 0, or -1 */
+int pb_cache_stats (struct pb_cache *cache, struct pb_cache_stats *stats);
+int pb_cache_clear (struct pb_cache *cache);
+
+/* Time now, in seconds (CLOCK_MONOTONIC): for timing the encoding, for pb_cache_put() */
+double pb_cache_now (void);
+
+#endif /* PB_IMGCACHE_H */
@@ -2,11 +2,14 @@
  * Very old ISA models used to support explicit setting of the Flags output, but this feature isn't present on PCI PulseBlasters
  * Programming a PB doesn't change the output states, so it's OK to pb_init() and then pb_prog().
  * pb_zero is a special case of this, so it #define's pb_zero, then includes this file.
- * Most of the important, shared stuff is in pb_functions.c 
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libpulseblaster.h"
 
 void printhelp(){
 #ifdef pb_zero
@@ -31,6 +34,8 @@ int main(int argc, char *argv[] __attribute__ ((unused)) ){
 	int count = 0;
 	unsigned char flags[3]; 	/* Flags are optional command-line parameters, (2,1,0 are CBA) */
 	unsigned long long_flag = 0; 
+	struct pb_device *dev;
+	int ret;
 
 	flags[2] = flags[1] = flags[0] = 0; /* Outputs default to zeros */
 
@@ -76,16 +81,21 @@ int main(int argc, char *argv[] __attribute__ ((unused)) ){
 #endif
 
 	/* Open pulseblaster; check device is present */
-	pb_fopen();
+	if ((dev = pb_device_open(NULL, &ret)) == NULL){
+		exit (ret);
+	}
 	
 	/* Write a short program to the device and run it. */
-	pb_init(flags);		
+	if ((ret = pb_device_init(dev, (flags[2] << 16) | (flags[1] << 8) | flags[0])) != 0){
+		pb_device_close(dev);
+		exit (ret);
+	}
 	
 	fprintf(stderr, "PulseBlaster outputs have been set to: 0x%02x 0x%02x 0x%02x.\n", flags[2],flags[1],flags[0]);
 	fprintf(stderr, "Now, (re-)program the PulseBlaster with pb_prog.\n");
 
        	/* Close the device */
-	pb_fclose();
+	pb_device_close(dev);
 
 	return PB_EXIT_OK;	/* i.e. zero */
 }
@@ -1,9 +1,11 @@
 /* This is pb_start.c  It starts the pulseblaster. *
- * Most of the important, shared stuff is in pb_functions.c 
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include "libpulseblaster.h"	/* The dump itself is in libpulseblaster, since it's also part of the key of a cached image */
 
 void printhelp(){
 	fprintf(stderr,"pb_print_config prints out the configuration settings compiled into pb_utils.\n"
@@ -19,51 +21,7 @@ int main(int argc, char *argv[] __attribute__ ((unused)) ){
 	}
 
 	/* Print config dump. Format is:  NAME colon space value newline. */
-	printf ("DEBUG: %d\n"
-		"PB_VERSION: %s\n"
-		"PB_CLOCK_MHZ: %d\n"
-		"PB_TICK_NS: %d\n"
-		"PB_MEMORY: %d\n"
-		"PB_LOOP_MAXDEPTH: %d\n"
-		"PB_SUB_MAXDEPTH: %d\n"
-		"PB_INTERNAL_LATENCY: %d\n"
-		"PB_MINIMUM_DELAY: %d\n"
-		"PB_WAIT_LATENCY: %d\n"
-		"PB_MINIMUM_WAIT_DELAY: %d\n"
-		"PB_BUG_PRESTOP_EXTRADELAY: %d\n"
-		"PB_BUG_WAIT_NOTFIRST: %d\n"
-		"PB_BUG_WAIT_MINFIRSTDELAY: %d\n"
-		"PB_OUTPUTS_24BIT: %u\n"
-		"PB_DELAY_32BIT: %u\n"
-		"PB_ARG_20BIT: %u\n"
-		"PB_LOOP_ARG_MIN: %d\n"
-		"PB_BUG_LOOP_OFFSET: %d\n"
-		"PB_LONGDELAY_ARG_MIN: %d\n"
-		"PB_BUG_LONGDELAY_OFFSET: %d\n"
-		"VLIWLINE_MAXLEN: %d\n"
-		,
-		DEBUG, 
-		PB_VERSION, 
-		PB_CLOCK_MHZ, 
-		PB_TICK_NS, 
-		PB_MEMORY,
-		PB_LOOP_MAXDEPTH,
-		PB_SUB_MAXDEPTH,
-		PB_INTERNAL_LATENCY,
-		PB_MINIMUM_DELAY,
-		PB_WAIT_LATENCY,
-		PB_MINIMUM_WAIT_DELAY,
-		PB_BUG_PRESTOP_EXTRADELAY,
-		PB_BUG_WAIT_NOTFIRST,
-		PB_BUG_WAIT_MINFIRSTDELAY,
-		PB_OUTPUTS_24BIT,
-		PB_DELAY_32BIT,
-		PB_ARG_20BIT,
-		PB_LOOP_ARG_MIN,
-		PB_BUG_LOOP_OFFSET,
-		PB_LONGDELAY_ARG_MIN,
-		PB_BUG_LONGDELAY_OFFSET,
-		VLIWLINE_MAXLEN);
+	pb_config_print (stdout);
 
         return PB_EXIT_OK;      /* i.e. zero */
 }
@@ -1,38 +1,61 @@
 /* This is pb_prog.c  It programs the pulseblaster with the contents of a program-file supplied. If the program-file is a .vliw file, it will
  * Parse it and then program the device. If the Program file is a .bin file, it will just write it to the device.
+ * An unchanged .vliw file isn't parsed again: its image is taken from the cache (pb_imgcache.c). A .bin file is mmap()ed, and its size checked before the device is even opened; then the mapping is written to the device in one go.
+ * A .bin file may be raw, or a container (pb_image.c): a container's header and CRC are checked, also before the device is opened.
  * If saving (rather than programming) the .bin file is desired, use pb_asm (which is a special case of this file)
  * Invoke it as pb_prog FILENAME.vliw   or pb_prog FILENAME.bin.
- * Most of the important, shared stuff is in pb_functions.c 
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "libpulseblaster.h"
+#include "pb_imgcache.h"
+#include "pb_image.h"
+#include "pb_flow.h"
 
 void printhelp(){
 	fprintf(stderr, "pb_prog programs the PulseBlaster from a VLIW or binary file.\n"
 		"VLIW (.vliw) files are parsed, checked and compensated before programming the device.\n"
-		"Alternatively, a binary (.bin) file previously generated by pb_asm may be used.\n"
+		"(An unchanged .vliw file is not parsed again: the image is taken from the cache. See pb_cache -h.)\n"
+		"Alternatively, a binary (.bin) file previously generated by pb_asm may be used. If it is a container (pb_asm -c),\n"
+		"its CRC, and the model, clock and memory size it was assembled for, are checked first.\n"
 		"If the PulseBlaster is running, pb_prog will implicitly stop it first.\n"
 		"After programming, the PulseBlaster is left in the STOPPED, NOT_ARMED state.\n"
 		"Programming doesn't change the state of the outputs: Use pb_init, then pb_prog.\n\n"
 		"USAGE:    pb_prog FILENAME.vliw      (human-readable VLIW format, with validation)\n"
-		"          pb_prog FILENAME.bin       (pre-compiled binary 'blob', minimal validation)\n"
+		"          pb_prog FILENAME.bin       (pre-compiled binary: raw 'blob' with minimal validation, or checked container)\n"
 		"          pb_prog -                  (binary format, from stdin)\n"
 		"          pb asm - - | pb_prog -     (vliw format, from stdin)\n");
 }
 
 int main(int argc, char *argv[]){
 
-	unsigned int line_num;		/* Line number in source file. one-based, for human-readability */
 	unsigned int prog_lines = 0;	/* Lines of actal code programmed */
-	unsigned char flags[3];
 	unsigned int is_vliw = 0;	/* File extension => type */
 	unsigned int is_bin = 0;
 	int ret = 0;			/* General retval */
 	int fatal_error = 0;
 	int error_exit = PB_ERROR_GENERIC;
-	char buffer[VLIWLINE_MAXLEN];   /* 1024 */
+	static unsigned char bin_image[PB_IMAGE_MAXLEN + 1];	/* A .bin file from a pipe is read in here. (One byte extra, to detect a file that's too long) */
+	static unsigned char cached_image[PB_MEMORY * PB_BPW_VLIW];	/* An image found in the cache */
+	static unsigned int map_lines[PB_MEMORY];			/* The source map of a container */
+	char key[PB_CACHE_KEYLEN];
+	int hit = 0;
+	double t_start, encode_seconds = 0, saved = 0;
+	const unsigned char *image = NULL;
+	size_t len = 0, file_len = 0;
+	void *mapped = MAP_FAILED;	/* A .bin regular file is mapped here instead */
+	struct pb_image bin;
 	FILE *source_fh;
+	struct pb_device *dev;
+	struct pb_encoder *enc = NULL;
+	struct pb_source src;
+	struct pb_cache *cache = NULL;
 	struct stat stat_p;		/* pointer to stat structure */
 
 	if (argc != 2){
@@ -75,55 +98,108 @@ int main(int argc, char *argv[]){
 		}
 	}
 
-	/* Open pulseblaster; check device is present */
-	pb_fopen();
-
-
 	if (is_vliw == 1){	/* VLIW file. Read it, parse it, and program it. */
 
-		/* Iterate over the file, one line at a time. Note: don't use feof(), or the last line will be duplicated - ugh! */
-		line_num = 1; 		/* Line is one-based */
+		if ((enc = pb_encoder_new()) == NULL){
+			fprintf(stderr, "Error: could not allocate the encoder.\n");
+			exit (PB_ERROR_GENERIC);
+		}
 
-		while (fgets(buffer, VLIWLINE_MAXLEN, source_fh) != NULL){
+		/* Read the whole file (mapped, if it's a regular file). Unless the cache has it already, parse it one line at a time, in a single
+		 * pass. Each line is parsed into VLIW tokens, compensated, and appended to the program image. Blank lines and comments are skipped.
+		 * Stop at the first invalid line. */
+		cache = pb_cache_open(NULL, stderr);
+		if ((ret = pb_source_open (&src, fileno(source_fh), stderr)) != 0){
+			error_exit = ret;
+			fatal_error = 1;
 
-			/* Parse a line of program source code. Parse it into VLIW tokens, compensate, and put the result into vliw_buf[]; then return 0 */
-			/* If the line is invalid, exit with error. If the line is BLANK or a COMMENT, return -1; DO NOT then call pb_write_program(), as you would duplicate the last instruction! */
-			ret = pb_parse_sourceline (buffer, line_num);
-			if (ret > 0){ 			/* Error encountered during parsing. Clean up and exit */
+		}else if ((cache != NULL) && (pb_cache_get (cache, src.buf, src.len, key, cached_image, &len, &saved) == 0)){
+			image = cached_image;
+			hit = 1;
+
+		}else{
+			t_start = pb_cache_now();
+			if ((ret = pb_encode_text (enc, src.buf, src.len)) > 0){	/* Error encountered during parsing. Clean up and exit */
 				error_exit = ret;
 				fatal_error = 1;
-				break;
-
-			}else if (ret == -1){
-				continue;		/* Don't double-program the previous line. */
-			}else{
-				prog_lines++;
-				pb_write_program();	/* Write the vliw buffer to the pulseblaster device. */
 			}
-			line_num++;
+			if ((!fatal_error) && (pb_encoder_finish(enc) != 0)){	/* Last check on loop depth */
+				fatal_error = 1;
+			}
+			image = pb_encoder_image(enc);
+			len = pb_encoder_len(enc);
+			encode_seconds = pb_cache_now() - t_start;
 		}
 
-		if ((!fatal_error) && (check_loop_depth() != 0)){	/* Last check on loop depth */
+		/* Follow every path through the program (pb_flow.c): this catches what the encoder can't, such as subroutines nested too deep */
+		if ((!fatal_error) && (len > 0) && ((ret = pb_verify (image, len, hit ? NULL : pb_encoder_lines(enc), NULL, stderr)) != 0)){
+			error_exit = ret;
 			fatal_error = 1;
 		}
+		if ((!hit) && (!fatal_error) && (cache != NULL) && (len > 0) && (pb_encoder_warnings(enc) == 0)){	/* Only a good program is cached: a bad one (or one with warnings or notices) must always give its messages */
+			pb_cache_put (cache, key, image, len, encode_seconds);
+		}
+		pb_source_close (&src);
+		pb_cache_close (cache);
+		prog_lines = len / PB_BPW_VLIW;
+
+	}else if (is_bin){	/* Bin file. Just blat it to the device. A container is checked; for a raw file, the only checks we can do are that there is an exact multiple of 10 bytes, and it fits */
+
+		/* A regular file is mapped (if it's not obviously too big): the device is programmed straight from the mapping. Else (eg a pipe), read it all in. */
+		if ((fstat (fileno(source_fh), &stat_p) == 0) && S_ISREG(stat_p.st_mode) && (stat_p.st_size > 0)){
+			len = file_len = stat_p.st_size;
+			if (len <= PB_IMAGE_MAXLEN){
+				if ((mapped = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fileno(source_fh), 0)) == MAP_FAILED){
+					perror ("Could not mmap the program-file");
+					exit (PB_ERROR_GENERIC);
+				}
+				image = mapped;
+			}
+		}else{
+			while ((len < sizeof(bin_image)) && ((ret = fread(bin_image + len, sizeof(char), sizeof(bin_image) - len, source_fh)) != 0)){
+				len += ret;
+			}
+			image = bin_image;
+		}
+		prog_lines = len / PB_BPW_VLIW;
+
+		if (len == 0){
+			fprintf(stderr, "Error: program file %s contains no instructions.\n", argv[1]);
+			fatal_error = 1;
+			error_exit = PB_ERROR_BADVLIWFILE;
 
-	}else if (is_bin){	/* Bin file. Just blat it to the device. The only check we can do is that there is an exact multiple of 10 bytes */
+		}else if ((image != NULL) && (pb_image_parse (&bin, image, len, stderr) != 0)){	/* A damaged container, or (raw) text */
+			fatal_error = 1;
+			error_exit = PB_ERROR_BADVLIWFILE;
 
-		/* Read bytes from the stream, in groups of 10 */
-		while ((ret = fread(vliw_buf, sizeof(char), sizeof(vliw_buf), source_fh)) != 0){
+		}else if ((image != NULL) && (bin.container)){	/* Good: program just the words */
+			image = bin.payload;
+			len = bin.payload_len;
+			prog_lines = bin.words;
 
-			if (ret != PB_BPW_VLIW){ 	/* We read > 0 but not 10 bytes. Suggests a partial VLIW instruction */
-				fprintf(stderr, "Error: executable file %s is %d bytes long, but should be a multple of %d.\n", argv[1], (int)stat_p.st_size, PB_BPW_VLIW);
-				if (source_fh == stdin){  /* Hint...,if we sent a vliw file to stdin (but this isn't reliable: 1 time in 10, can still accidentally program a vliw as if it were a bin). */
-					fprintf(stderr, "Hint: when input file is stdin, filetype must be .bin, nor .vliw. Try piping though 'pb_asm - -'.\n");
-				}
-				fatal_error = 1;	/* Fatal error - ensure the PB is zeroed below */
-				error_exit = PB_ERROR_BADVLIWFILE;
-				break;
-			}else{
-				prog_lines++;
-				pb_write_program();
+		}else if (len % PB_BPW_VLIW){ 	/* Not a whole number of VLIW words. Suggests a partial VLIW instruction */
+			fprintf(stderr, "Error: executable file %s is %lu bytes long, but should be a multple of %d.\n", argv[1], (unsigned long)len, PB_BPW_VLIW);
+			if (source_fh == stdin){  /* Hint...,if we sent a vliw file to stdin (but this isn't reliable: 1 time in 10, can still accidentally program a vliw as if it were a bin). */
+				fprintf(stderr, "Hint: when input file is stdin, filetype must be .bin, nor .vliw. Try piping though 'pb_asm - -'.\n");
 			}
+			fatal_error = 1;
+			error_exit = PB_ERROR_BADVLIWFILE;
+
+		}else if (len > (size_t)PB_MEMORY * PB_BPW_VLIW){	/* Check we haven't used too much memory. */
+			fprintf(stderr, "Error: executable file %s has more than %d VLIW instructions, which is all the PulseBlaster has available!\n", argv[1], PB_MEMORY);
+			fatal_error = 1;
+			error_exit = PB_ERROR_OUTOFMEM;
+		}
+
+		/* Follow every path through the program (pb_flow.c). A container's source map, if any, gives the lines for the messages */
+		if ((!fatal_error) && ((ret = pb_verify (image, len, (bin.container && (pb_image_lines (&bin, map_lines) == 0)) ? map_lines : NULL, NULL, stderr)) != 0)){
+			fatal_error = 1;
+			error_exit = ret;
+		}
+
+		if (fatal_error){	/* Rejected before the device was opened: the PulseBlaster hasn't been touched, so it doesn't need to be zeroed. */
+			fprintf(stderr, "Error in program %s.\nPulseBlaster has not been touched.\n", argv[1]);
+			exit (error_exit);
 		}
 	}
 
@@ -138,20 +214,38 @@ int main(int argc, char *argv[]){
 		error_exit = PB_ERROR_BADVLIWFILE;
 	}
 
+	/* Open pulseblaster; check device is present */
+	if ((dev = pb_device_open(NULL, &ret)) == NULL){
+		exit (ret);
+	}
+
+	/* Now, write the whole program to the device, in one go. (This checks it again first) */
+	if ((!fatal_error) && ((ret = pb_device_program(dev, image, len)) != 0)){
+		error_exit = ret;
+		fatal_error = 1;
+	}
+	pb_encoder_free(enc);
+	if (mapped != MAP_FAILED){
+		munmap (mapped, file_len);
+	}
+
 	if (fatal_error){
-		/* Something went wrong. We might have a partial program loaded. Or worse, if we programmed exactly nothing, we actually left the old program present! */
+		/* Something went wrong. The partial program hasn't been written, but the old program is still present! */
 		/* On the "least-surprise principle", write in a program to zero the outputs */
-		flags[2] = flags[1] = flags[0] = 0;
-		pb_init(flags);
+		pb_device_init(dev, 0);
 
 		fprintf(stderr, "Error in program %s.\nPulseBlaster has been zeroed, to prevent accidentally re-running the previous program.\n", argv[1]);
+		pb_device_close(dev);
 		exit (error_exit);
 	}
 
 	fprintf(stderr, "PulseBlaster has been programmed with %d instructions from file %s. Not armed nor started; run: pb_start / pb_arm + HW_Trigger.\n", prog_lines, argv[1]);
+	if (hit){
+		fprintf(stderr, "(Unchanged source: the image was in the cache. That saved %.3f ms.)\n", saved * 1e3);
+	}
 
         /* Close the device */
-        pb_fclose();
+        pb_device_close(dev);
 
 	return PB_EXIT_OK;	/* i.e. zero */
 }
@@ -0,0 +1,354 @@
+/* This is pb_sim.c  It simulates a program (.vliw or .bin), instruction by instruction, exactly as pb_parse's full simulation (-f) does,
+ * but natively, and so hundreds of times faster: see pb_simulator.h. It writes the same simulation replay log (.pbsim) and value
+ * change dump (.vcd); or the replay log as a binary timeline (.pbtl: see pb_timeline.h). pb_parse hands a full simulation over to
+ * it, when nothing interactive is wanted (see pb_parse/doc/simulation.txt).
+ * MARK and NEVER are encoded as CONT, so they are only recognised in a .vliw: they are taken from the opcode column of its source.
+ * Without a .pbsim or .vcd, a loop which repeats itself exactly is fast-forwarded (and written to a .pbtl as repeats): -S turns this
+ * off, to check it.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libpulseblaster.h"
+#include "pb_image.h"
+#include "pb_simulator.h"
+
+void printhelp(){
+	fprintf(stderr, "pb_sim simulates a PulseBlaster program, executing every instruction every time, exactly as pb_parse -f does\n"
+		"(with the same checks), but natively, so it runs at hundreds of millions of instructions per second. It can write the\n"
+		"simulation replay log (.pbsim) and the value change dump (.vcd) which pb_parse -g and -G write. WAITs are triggered at once.\n"
+		"The results are printed to stdout, as 'name: value' lines.\n\n"
+		"USAGE:    pb_sim [OPTIONS] FILENAME.vliw | FILENAME.bin | -\n"
+		"          (From stdin, a .bin, raw or container, is recognised as such; anything else is taken as .vliw.)\n\n"
+		"OPTIONS:  -u steps     stop after this many instructions (default: no limit; the simulation may then never end).\n"
+		"          -g FILE      write the simulation replay log to FILE.pbsim; or, if the name ends .pbtl, as a binary timeline,\n"
+		"                       several times smaller (thousands of times, for loops), which pb_tl converts back to .pbsim.\n"
+		"          -G FILE      write the value change dump to FILE.vcd.\n"
+		"                       (For either, a name ending .gz is compressed, through gzip: gtkwave reads .vcd.gz directly.)\n"
+		"          -L labels    label the bits in the .vcd, as pb_parse -L: a comma-separated list, from the most significant bit\n"
+		"                       down, with '-' to leave a bit out. (Default: all %d bits.)\n"
+		"          -H           the files already begin with their headers (as written by pb_parse): append to them, and don't\n"
+		"                       write the header or the footer.\n"
+		"          -a           list each instruction which was never reached, by address (with its source line, if known).\n"
+		"          -S           execute every step, even of a loop which has been seen to repeat exactly. (Otherwise, unless a\n"
+		"                       .pbsim or .vcd is being written, the rest of such a loop is added up, not executed; a .pbtl is\n"
+		"                       still exact, since the skipped iterations are written as repeats. The results are the same.)\n"
+		"          -h           show this help.\n", PB_SIM_VCD_BITS);
+}
+
+/* Time now, in seconds */
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/* Tell the simulator about the MARKs and NEVERs, from the opcode column (and the comment) of each line of the .vliw source */
+static int annotate(struct pb_sim *sim, const char *buf, size_t len, const unsigned int *lines){
+	const char **line_start;
+	const char *p, *end, *token, *cmt;
+	char comment[VLIWLINE_MAXLEN];
+	size_t i, nlines = 0, n;
+	unsigned int w, column;
+
+	for (i = 0; i < len; i++){
+		nlines += (buf[i] == '\n');
+	}
+	if ((line_start = malloc((nlines + 2) * sizeof(*line_start))) == NULL){
+		return (-1);
+	}
+	line_start[nlines = 0] = buf;
+	for (i = 0; i < len; i++){
+		if (buf[i] == '\n'){
+			line_start[++nlines] = buf + i + 1;
+		}
+	}
+	line_start[++nlines] = buf + len;
+
+	for (w = 0; w < sim->words; w++){
+		if ((lines[w] == 0) || (lines[w] >= nlines) || (sim->code[w].opcode != PB_OPCODE_CONT)){
+			continue;
+		}
+		p = line_start[lines[w] - 1];
+		end = line_start[lines[w]];
+		for (column = 0, token = NULL, cmt = NULL; (p < end) && (cmt == NULL); column++){	/* Find the opcode (column 1), and the comment */
+			while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n'))){
+				p++;
+			}
+			if ((end - p > 1) && (p[0] == '/') && (p[1] == '/')){
+				cmt = p;
+			}else if (column == 1){
+				token = p;
+			}
+			while ((p < end) && (*p != ' ') && (*p != '\t') && (*p != '\n')){
+				p++;
+			}
+		}
+		if (token == NULL){
+			continue;
+		}
+		if (!strncasecmp(token, "mark", 4) && ((token + 4 == end) || (token[4] == ' ') || (token[4] == '\t') || (token[4] == '\n'))){
+			comment[0] = '\0';
+			if (cmt){
+				for (n = end - cmt; (n) && ((cmt[n - 1] == ' ') || (cmt[n - 1] == '\t') || (cmt[n - 1] == '\r') || (cmt[n - 1] == '\n')); n--);
+				if (n > sizeof(comment) - 1){
+					n = sizeof(comment) - 1;
+				}
+				memcpy(comment, cmt, n);
+				comment[n] = '\0';
+			}
+			if (pb_sim_annotate(sim, w, PB_SIM_OPCODE_MARK, comment) != 0){
+				free(line_start);
+				return (-1);
+			}
+		}else if (!strncasecmp(token, "never", 5) && ((token + 5 == end) || (token[5] == ' ') || (token[5] == '\t') || (token[5] == '\n'))){
+			pb_sim_annotate(sim, w, PB_SIM_OPCODE_NEVER, NULL);
+		}
+	}
+	free(line_start);
+	return (0);
+}
+
+/* Open an output file. If the name ends in .gz, it is written through gzip (a child process); gtkwave reads a .vcd.gz directly */
+static FILE *open_output(const char *name, int append, pid_t *gzip){
+	FILE *fh = NULL;
+	size_t n = strlen(name);
+	int fd, pipefd[2];
+
+	*gzip = 0;
+	if ((n < 3) || (strcmp(name + n - 3, ".gz"))){
+		fh = fopen(name, append ? "a" : "w");
+	}else if ((fd = open(name, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0666)) >= 0){	/* (Appended, it's another gzip member: still valid) */
+		if ((pipe(pipefd) == 0) && (fcntl(pipefd[1], F_SETFD, FD_CLOEXEC) == 0) && ((*gzip = fork()) >= 0)){
+			if (*gzip == 0){
+				dup2(pipefd[0], STDIN_FILENO);
+				dup2(fd, STDOUT_FILENO);
+				close(pipefd[0]);
+				close(fd);
+				execlp("gzip", "gzip", "-1", "-c", (char *)NULL);	/* Fastest: it has to keep up with the simulation */
+				fprintf(stderr, "Error: could not run gzip, to compress %s.\n", name);
+				_exit(PB_ERROR_GENERIC);
+			}
+			close(pipefd[0]);
+			fh = fdopen(pipefd[1], "w");
+		}
+		close(fd);
+	}
+	if (fh == NULL){
+		fprintf(stderr, "Error: could not open output file %s for writing.\n", name);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	return (fh);
+}
+
+/* Does name end with suffix? */
+static int has_suffix(const char *name, const char *suffix){
+	return ((strlen(name) >= strlen(suffix)) && (!strcmp(name + strlen(name) - strlen(suffix), suffix)));
+}
+
+/* Close an output file (and wait for its gzip). Returns 0, or -1 if anything could not be written */
+static int close_output(FILE *fh, pid_t gzip){
+	int ret = 0, status;
+
+	if (fclose(fh) != 0){
+		ret = -1;
+	}
+	if ((gzip) && ((waitpid(gzip, &status, 0) != gzip) || (!WIFEXITED(status)) || (WEXITSTATUS(status) != 0))){
+		ret = -1;
+	}
+	return (ret);
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern char *optarg; extern int optind;	/* getopt */
+	unsigned long long max_steps = 0;
+	const char *pbsim_file = NULL, *vcd_file = NULL, *labels = NULL;
+	int headers = 1, all = 0, every_step = 0;
+	const char *filename;
+	const unsigned char *image;
+	const unsigned int *lines = NULL;
+	static unsigned int map_lines[PB_MEMORY];
+	size_t len;
+	unsigned int w, reached = 0;
+	int is_vliw, ret, result;
+	double start, run_seconds;
+	char *end;
+	FILE *source_fh, *pbsim_fh = NULL, *vcd_fh = NULL;
+	pid_t pbsim_gzip = 0, vcd_gzip = 0;
+	struct pb_source src;
+	struct pb_image bin;
+	struct pb_encoder *enc;
+	struct pb_sim *sim;
+	struct pb_tl_writer *timeline = NULL;
+
+	while ((opt = getopt(argc, argv, "u:g:G:L:HaSh")) != -1){
+		switch (opt){
+			case 'u':
+				max_steps = strtoull(optarg, &end, 10);
+				if ((*optarg == '\0') || (*optarg == '-') || (*end != '\0')){
+					fprintf(stderr, "Error: the step limit (-u) must be a number, not '%s'.\n", optarg);
+					exit (PB_ERROR_WRONGARGS);
+				}
+				break;
+			case 'g':  pbsim_file = optarg;  break;
+			case 'G':  vcd_file = optarg;  break;
+			case 'L':  labels = optarg;  break;
+			case 'H':  headers = 0;  break;
+			case 'a':  all = 1;  break;
+			case 'S':  every_step = 1;  break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if (argc - optind != 1){
+		printhelp();
+		exit (PB_ERROR_WRONGARGS);
+	}
+	filename = argv[optind];
+	if ((labels) && (!vcd_file)){
+		fprintf(stderr, "Warning: option -L requires -G too. Ignoring it.\n");
+	}
+
+	if (!strcmp (filename, "-")){
+		source_fh = stdin;
+	}else if ((source_fh = fopen(filename, "r")) == NULL){
+		fprintf(stderr,"Could not open program-file %s.\n", filename);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((ret = pb_source_open(&src, fileno(source_fh), stderr)) != 0){
+		exit (ret);
+	}
+	if (src.len == 0){
+		fprintf(stderr, "Error: file %s is empty!\n", filename);
+		exit (PB_ERROR_EMPTYVLIWFILE);
+	}
+
+	/* Get the image: assemble a .vliw; check a .bin */
+	if (!strcmp (filename, "-")){
+		is_vliw = (src.len > PB_IMAGE_MAXLEN) || (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, NULL) != 0) || ((!bin.container) && (src.len % PB_BPW_VLIW));	/* (Raw, it must be whole words) */
+	}else{
+		is_vliw = (strlen(filename) > 5) && (!strcmp (filename + strlen(filename) - 5, ".vliw"));
+	}
+	if (is_vliw){
+		if ((enc = pb_encoder_new()) == NULL){
+			fprintf(stderr, "Error: could not allocate the encoder.\n");
+			exit (PB_ERROR_GENERIC);
+		}
+		if (((ret = pb_encode_text(enc, src.buf, src.len)) > 0) || ((ret = pb_encoder_finish(enc)) != 0)){
+			fprintf(stderr, "Error in program %s.\n", filename);
+			exit (ret);
+		}
+		image = pb_encoder_image(enc);
+		len = pb_encoder_len(enc);
+		lines = pb_encoder_lines(enc);
+	}else{
+		if ((src.len > PB_IMAGE_MAXLEN) || (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, stderr) != 0)){
+			fprintf(stderr, "Error in program file %s.\n", filename);
+			exit (PB_ERROR_BADVLIWFILE);
+		}
+		image = bin.payload;
+		len = bin.payload_len;
+		if (pb_image_lines(&bin, map_lines) == 0){
+			lines = map_lines;
+		}
+	}
+	if ((sim = pb_sim_new(image, len, stderr)) == NULL){
+		fprintf(stderr, "Error: program %s can't be simulated.\n", filename);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	if ((is_vliw) && (annotate(sim, src.buf, src.len, lines) != 0)){
+		fprintf(stderr, "Error: out of memory.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+	sim->fastforward = !every_step;
+
+	if (pbsim_file){
+		if ((!headers) && ((has_suffix(pbsim_file, ".pbtl")) || (has_suffix(pbsim_file, ".pbtl.gz")))){
+			fprintf(stderr, "Error: a binary timeline (%s) can't be appended to (-H).\n", pbsim_file);
+			exit (PB_ERROR_WRONGARGS);
+		}
+		pbsim_fh = open_output(pbsim_file, !headers, &pbsim_gzip);
+		if ((has_suffix(pbsim_file, ".pbtl")) || (has_suffix(pbsim_file, ".pbtl.gz"))){
+			if (((timeline = pb_tl_writer_new(pbsim_fh, stderr)) == NULL) || (pb_sim_timeline_open(sim, timeline, headers, filename, max_steps) != 0)){
+				fprintf(stderr, "Error: could not begin the timeline %s.\n", pbsim_file);
+				exit (PB_ERROR_GENERIC);
+			}
+		}else if (pb_sim_pbsim_open(sim, pbsim_fh, headers, filename, max_steps) != 0){
+			fprintf(stderr, "Error: out of memory.\n");
+			exit (PB_ERROR_GENERIC);
+		}
+	}
+	if (vcd_file){
+		vcd_fh = open_output(vcd_file, !headers, &vcd_gzip);
+		if (pb_sim_vcd_open(sim, vcd_fh, labels, headers, filename, max_steps) != 0){
+			fprintf(stderr, "Error: could not set up the value change dump %s.\n", vcd_file);
+			exit (PB_ERROR_WRONGARGS);
+		}
+	}
+
+	start = now();
+	result = pb_sim_run(sim, max_steps);
+	run_seconds = now() - start;
+
+	if ((pb_sim_close(sim) != 0) || ((timeline) && (pb_tl_writer_close(timeline) != 0)) || ((pbsim_fh) && (close_output(pbsim_fh, pbsim_gzip) != 0)) || ((vcd_fh) && (close_output(vcd_fh, vcd_gzip) != 0))){
+		fprintf(stderr, "Error: could not write the output files.\n");
+		exit (PB_ERROR_GENERIC);
+	}
+
+	for (w = 0; w < sim->words; w++){
+		reached += sim->visited[w];
+	}
+	printf("file: %s\n", filename);
+	printf("words: %u\n", sim->words);
+	printf("result: %s\n", pb_sim_result_name(result));
+	printf("steps: %llu\n", sim->steps);
+	printf("elapsed_ticks: %llu\n", sim->ticks);
+	printf("elapsed_seconds: %.9f\n", (double)sim->ticks * PB_TICK_NS / 1e9);
+	printf("waits: %llu\n", sim->waits);
+	printf("pc: %u\n", sim->pc);
+	printf("output: 0x%06x\n", sim->output);
+	printf("reached: %u\n", reached);
+	printf("run_seconds: %.6f\n", run_seconds);
+	printf("steps_per_second: %.0f\n", (sim->steps - sim->ff_steps) / (run_seconds + 1e-9));	/* Only those actually executed */
+	printf("fastforward_steps: %llu\n", sim->ff_steps);
+	printf("fastforwards: %llu\n", sim->ff_count);
+	if (all){
+		for (w = 0; w < sim->words; w++){
+			if (!sim->visited[w]){
+				printf("unreached: %u", w);
+				if ((lines) && (lines[w])){
+					printf(" line %u", lines[w]);
+				}
+				printf("\n");
+			}
+		}
+	}
+
+	/* A simulation which proves that the program would fail is an error */
+	switch (result){
+		case PB_SIM_STOPPED:
+		case PB_SIM_REACHED_STEP_LIMIT:
+			ret = PB_EXIT_OK;
+			break;
+		case PB_SIM_LOOP_DEPTH_EXCEEDED:
+		case PB_SIM_NON_EXISTENT_ENDLOOP:
+		case PB_SIM_STACK_DEPTH_EXCEEDED:
+		case PB_SIM_NON_EXISTENT_RETURN:
+			ret = PB_ERROR_LOOPDEPTH;
+			break;
+		default:
+			ret = PB_ERROR_INVALIDINSTRUCTION;
+			break;
+	}
+	pb_sim_free(sim);
+	return (ret);
+}
@@ -0,0 +1,741 @@
+/* This is pb_simulator.c which contains the native simulator: it runs a program, exactly as pb_parse's full simulation does, but fast.
+ * The semantics (and the extra checks, such as that each ENDLOOP's arg is the address of its own LOOP) are those of the simulation loop in
+ * pb_parse.php, and it writes the same .pbsim and .vcd files; so pb_parse can hand the simulation over to it (see pb_sim.c).
+ * The speed comes from three things:
+ *   - Each word is decoded once, in advance, into a pb_sim_insn: the duration (including the LONGDELAY multiplier) is ready to add.
+ *   - The state is kept in local variables, and the step is a single switch: there are no per-step function calls, unless tracing.
+ *   - The word after the end of the program is a sentinel (PB_SIM_OPCODE_END), and every branch beyond the end is pointed at it: so
+ *     there is no bounds check per step.
+ * The .pbsim and .vcd are formatted by hand into a buffer, and written in large blocks.
+ * Beyond that, a loop of a million iterations needn't be run a million times: see pb_sim_loop_cycle(). So, without a .pbsim or .vcd
+ * (which have a line per step, however they are made), the time taken is that of the distinct behaviour, not the number of steps.
+ * It is part of libpulseblaster: the interface is in pb_simulator.h. There are no globals.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libpulseblaster.h"
+#include "pb_simulator.h"
+
+#define PB_SIM_RECORD_MAXLEN	(VLIWLINE_MAXLEN + 256)	/* Longest record written at one step (a MARK line, with its comment) */
+#define PB_SIM_MARK_PREFIX	"MARK:"			/* As pb_parse's $MARK_PREFIX */
+
+/* Make a simulator. See pb_simulator.h */
+struct pb_sim *pb_sim_new(const unsigned char *image, size_t len, FILE *log){
+	struct pb_sim *sim;
+	struct pb_vliw v;
+	struct pb_sim_insn *in;
+	unsigned int i, words = len / PB_BPW_VLIW;
+
+	if ((words == 0) || (words > PB_MEMORY) || (len % PB_BPW_VLIW)){
+		if (log){
+			fprintf(log, "Error: the program is %lu bytes long, but should be a non-zero multiple of %d, and at most %d words.\n",
+				(unsigned long)len, PB_BPW_VLIW, PB_MEMORY);
+		}
+		return (NULL);
+	}
+	if ((sim = calloc(1, sizeof(*sim))) == NULL){
+		goto nomem;
+	}
+	sim->words = words;
+	sim->log = log;
+	sim->fastforward = 1;
+	sim->code = calloc(words + 1, sizeof(*sim->code));
+	sim->comments = calloc(words, sizeof(*sim->comments));
+	sim->visits = calloc(words, sizeof(*sim->visits));
+	sim->visited = calloc(words + 1, 1);
+	if (!sim->code || !sim->comments || !sim->visits || !sim->visited){
+		pb_sim_free(sim);
+		goto nomem;
+	}
+
+	for (i = 0; i < words; i++){
+		pb_decode_vliw(image + (size_t)i * PB_BPW_VLIW, &v);
+		in = &sim->code[i];
+		in->output = v.output;
+		in->opcode = v.opcode;
+		in->arg = v.arg;
+		in->length = v.length;
+		in->ticks = v.length;
+		switch (v.opcode){
+			case PB_OPCODE_STOP:
+				in->ticks = 0;		/* (STOP doesn't delay) */
+				break;
+			case PB_OPCODE_LONGDELAY:
+				in->ticks *= v.arg;
+				break;
+			case PB_OPCODE_GOTO:
+			case PB_OPCODE_CALL:
+				if (v.arg >= words){
+					in->arg = words;	/* To the sentinel */
+				}
+				break;
+		}
+		in->ns = (uint64_t)(in->ticks * PB_TICK_NS);
+	}
+	sim->code[words].opcode = PB_SIM_OPCODE_END;
+	return (sim);
+
+nomem:
+	if (log){
+		fprintf(log, "Error: out of memory, for the simulator.\n");
+	}
+	return (NULL);
+}
+
+void pb_sim_free(struct pb_sim *sim){
+	unsigned int i;
+
+	if (sim == NULL){
+		return;
+	}
+	if (sim->comments){
+		for (i = 0; i < sim->words; i++){
+			free(sim->comments[i]);
+		}
+	}
+	for (i = 0; i < PB_SIM_VCD_BITS; i++){
+		free(sim->vcd_labels[i]);
+	}
+	free(sim->comments);
+	free(sim->code);
+	free(sim->visits);
+	free(sim->visited);
+	free(sim->pbsim);
+	free(sim->vcd);
+	free(sim);
+}
+
+/* Mark a word as MARK or NEVER. See pb_simulator.h */
+int pb_sim_annotate(struct pb_sim *sim, unsigned int addr, unsigned int opcode, const char *comment){
+	if ((addr >= sim->words) || (sim->code[addr].opcode != PB_OPCODE_CONT) || ((opcode != PB_SIM_OPCODE_MARK) && (opcode != PB_SIM_OPCODE_NEVER))){
+		return (-1);
+	}
+	sim->code[addr].opcode = opcode;
+	if ((opcode == PB_SIM_OPCODE_MARK) && (comment)){
+		free(sim->comments[addr]);
+		if ((sim->comments[addr] = malloc(strnlen(comment, VLIWLINE_MAXLEN) + 1)) == NULL){
+			return (-1);
+		}
+		memcpy(sim->comments[addr], comment, strnlen(comment, VLIWLINE_MAXLEN));
+		sim->comments[addr][strnlen(comment, VLIWLINE_MAXLEN)] = '\0';
+	}
+	return (0);
+}
+
+
+/* Output */
+
+/* Write out what is in the buffer */
+static void pb_sim_flush(struct pb_sim_out *out){
+	if ((out->len) && (fwrite(out->buf, 1, out->len, out->fh) != out->len)){
+		out->error = 1;
+	}
+	out->len = 0;
+}
+
+/* Make room for one record: returns where to write it */
+static char *pb_sim_reserve(struct pb_sim_out *out){
+	if (out->len + PB_SIM_RECORD_MAXLEN > PB_SIM_BUFSIZE){
+		pb_sim_flush(out);
+	}
+	return (out->buf + out->len);
+}
+
+static char *pb_sim_put_str(char *p, const char *s){
+	while (*s){
+		*p++ = *s++;
+	}
+	return (p);
+}
+
+/* x in decimal, two digits at a time (a timestamp is written at every step) */
+static char *pb_sim_put_dec(char *p, unsigned long long x){
+	static const char pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+				    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+				    "8081828384858687888990919293949596979899";
+	char digits[24], *d = digits + sizeof(digits);
+	size_t n;
+
+	while (x >= 100){
+		d -= 2;
+		memcpy(d, pairs + (x % 100) * 2, 2);
+		x /= 100;
+	}
+	if (x >= 10){
+		d -= 2;
+		memcpy(d, pairs + x * 2, 2);
+	}else{
+		*--d = '0' + x;
+	}
+	n = digits + sizeof(digits) - d;
+	memcpy(p, d, n);
+	return (p + n);
+}
+
+/* 0x, and 6 hex digits (as pb_parse's "0x%06x") */
+static char *pb_sim_put_hex6(char *p, uint32_t x){
+	static const char hex[] = "0123456789abcdef";
+	int shift;
+
+	*p++ = '0';
+	*p++ = 'x';
+	for (shift = 20; shift >= 0; shift -= 4){
+		*p++ = hex[(x >> shift) & 0xf];
+	}
+	return (p);
+}
+
+static struct pb_sim_out *pb_sim_out_new(FILE *fh){
+	struct pb_sim_out *out;
+
+	if ((out = malloc(sizeof(*out))) == NULL){
+		return (NULL);
+	}
+	out->fh = fh;
+	out->len = 0;
+	out->error = 0;
+	out->footer = 0;
+	return (out);
+}
+
+/* Today's date, as pb_parse's $date */
+static void pb_sim_date(char *date, size_t size){
+	time_t now = time(NULL);
+
+	if (strftime(date, size, "%Y-%m-%d %H:%M:%S", localtime(&now)) == 0){
+		date[0] = '\0';
+	}
+}
+
+/* pb_parse's header of the .pbsim, naming the source */
+static void pb_sim_pbsim_header(char *buf, size_t size, const char *source, unsigned long long max_steps){
+	char date[64];
+	size_t n;
+
+	pb_sim_date(date, sizeof(date));
+	n = snprintf(buf, size, "//This simulation replay-log file was generated by pb_sim by simulating program file '%s' on date %s. \n"
+		"//File format: 'OUTPUT (uint32,hex)  \\t  LENGTH (uint64,dec) \\n'. Comments start '//'. Note that length is in ns, not PulseBlaster ticks.\n"
+		"//Mark opcode: '//%s  \\t  step=...  \\t  ticks=...  \\t  ns=...  \\t  pc=...  \\t  visit=...  \\t  length=...  \\t  out=...  \\t  cmt=//... \\n'.\n",
+		source, date, PB_SIM_MARK_PREFIX);
+	if (n >= size){
+		return;
+	}
+	if (max_steps){
+		snprintf(buf + n, size - n, "//Simulation will stop (-u) after %llu steps, if not before.\n", max_steps);
+	}else{
+		snprintf(buf + n, size - n, "//Simulation has no step-limit (-u); this file could be very very long.\n");
+	}
+}
+
+/* Begin the .pbsim. See pb_simulator.h */
+int pb_sim_pbsim_open(struct pb_sim *sim, FILE *fh, int header, const char *source, unsigned long long max_steps){
+	char text[PB_SIM_RECORD_MAXLEN + 1024];
+
+	free(sim->pbsim);
+	if ((sim->pbsim = pb_sim_out_new(fh)) == NULL){
+		return (-1);
+	}
+	if (header){		/* As pb_parse writes it */
+		pb_sim_pbsim_header(text, sizeof(text), source, max_steps);
+		fputs(text, fh);
+		sim->pbsim->footer = 1;
+	}
+	return (0);
+}
+
+/* Begin the .pbtl. See pb_simulator.h */
+int pb_sim_timeline_open(struct pb_sim *sim, struct pb_tl_writer *tl, int header, const char *source, unsigned long long max_steps){
+	char text[PB_SIM_RECORD_MAXLEN + 1024];
+
+	sim->timeline = tl;
+	sim->timeline_footer = header;
+	if (header){		/* The same lines, as TEXT records */
+		pb_sim_pbsim_header(text, sizeof(text), source, max_steps);
+		return (pb_tl_write_text(tl, text));
+	}
+	return (0);
+}
+
+/* The VCD identifier of a bit (as pb_parse's vcd_lbl()) */
+static char pb_sim_vcd_id(int bit){
+	return ('A' + bit);
+}
+
+/* Begin the .vcd. See pb_simulator.h */
+int pb_sim_vcd_open(struct pb_sim *sim, FILE *fh, const char *labels, int header, const char *source, unsigned long long max_steps){
+	char date[64], name[VLIWLINE_MAXLEN];
+	const char *p, *end;
+	int bit, n, i;
+	size_t len;
+
+	sim->vcd_mask = 0;
+	for (bit = 0; bit < PB_SIM_VCD_BITS; bit++){
+		free(sim->vcd_labels[bit]);
+		sim->vcd_labels[bit] = NULL;
+	}
+	if (labels == NULL){					/* The default: every bit */
+		for (bit = 0; bit < PB_SIM_VCD_BITS; bit++){
+			snprintf(name, sizeof(name), "Bit_%d", bit);
+			if ((sim->vcd_labels[bit] = strdup(name)) == NULL){
+				return (-1);
+			}
+			sim->vcd_mask |= 1UL << bit;
+		}
+	}else{							/* The first name is of the highest bit given */
+		for (n = 1, p = labels; *p; p++){
+			n += (*p == ',');
+		}
+		if (n > PB_SIM_VCD_BITS){
+			if (sim->log){
+				fprintf(sim->log, "Error: the labels list ('%s') contains too many labels: there aren't that many bits in the output.\n", labels);
+			}
+			return (-1);
+		}
+		for (i = 0, p = labels; i < n; i++, p = end + 1){
+			if ((end = strchr(p, ',')) == NULL){
+				end = p + strlen(p);
+			}
+			while ((p < end) && ((*p == ' ') || (*p == '\t'))){
+				p++;
+			}
+			for (len = end - p; (len) && ((p[len - 1] == ' ') || (p[len - 1] == '\t')); len--);
+			if ((len == 0) || ((len == 1) && (*p == '-'))){
+				continue;
+			}
+			bit = n - 1 - i;
+			if ((sim->vcd_labels[bit] = strndup(p, len)) == NULL){
+				return (-1);
+			}
+			sim->vcd_mask |= 1UL << bit;
+		}
+	}
+
+	free(sim->vcd);
+	if ((sim->vcd = pb_sim_out_new(fh)) == NULL){
+		return (-1);
+	}
+	if (header){		/* As pb_parse writes it (see doc/vcd.txt) */
+		pb_sim_date(date, sizeof(date));
+		fprintf(fh, "$date\n%s\n$end\n$version\npb_sim (pb_utils)\n$end\n$comment\nGenerated from program file: '%s'", date, source);
+		if (max_steps){
+			fprintf(fh, " (Simulation will stop (-u) after %llu steps, if not before.)", max_steps);
+		}
+		fprintf(fh, "\n$end\n$timescale %g ns $end\n$scope module PulseBlaster $end\n", (double)PB_TICK_NS);
+		for (bit = 0; bit < PB_SIM_VCD_BITS; bit++){
+			if (sim->vcd_labels[bit]){
+				fprintf(fh, "$var wire 1 %c %s $end\n", pb_sim_vcd_id(bit), sim->vcd_labels[bit]);
+			}
+		}
+		fprintf(fh, "$upscope $end\n$enddefinitions $end\n$dumpvars\n");
+		for (bit = 0; bit < PB_SIM_VCD_BITS; bit++){
+			if (sim->vcd_labels[bit]){
+				fprintf(fh, "x%c\n", pb_sim_vcd_id(bit));
+			}
+		}
+		fprintf(fh, "$end\n");
+	}
+	return (0);
+}
+
+/* Write the .pbsim line(s) for the instruction in, about to be executed at pc (as pb_parse's sim_mark_time() and write_pbsim()) */
+static void pb_sim_trace_pbsim(struct pb_sim *sim, const struct pb_sim_insn *in, unsigned int pc, unsigned long long ticks, unsigned long long steps){
+	char *p = pb_sim_reserve(sim->pbsim);
+
+	switch (in->opcode){
+		case PB_SIM_OPCODE_MARK:
+			p = pb_sim_put_str(p, "//" PB_SIM_MARK_PREFIX "\tstep=");
+			p = pb_sim_put_dec(p, steps);
+			p = pb_sim_put_str(p, "\tticks=");
+			p = pb_sim_put_dec(p, ticks);
+			p = pb_sim_put_str(p, "\tns=");
+			p = pb_sim_put_dec(p, (unsigned long long)(ticks * PB_TICK_NS));
+			p = pb_sim_put_str(p, "\tpc=");
+			p = pb_sim_put_dec(p, pc);
+			p = pb_sim_put_str(p, "\tvisit=");
+			p = pb_sim_put_dec(p, sim->visits[pc]++);
+			p = pb_sim_put_str(p, "\tlength=");
+			p = pb_sim_put_dec(p, in->length);
+			p += sprintf(p, "\tout=0x%x\tcmt=", in->output);
+			p = pb_sim_put_str(p, sim->comments[pc] ? sim->comments[pc] : "");
+			*p++ = '\n';
+			break;
+		case PB_OPCODE_STOP:
+			p = pb_sim_put_str(p, "//Encountered STOP instruction. STOP doesn't change the outputs.\n");
+			sim->pbsim->len = p - sim->pbsim->buf;
+			return;
+		case PB_OPCODE_WAIT:
+			p = pb_sim_put_str(p, "//Encountered WAIT instruction. Continuing. Inserting extra line with length=0, parser can detect this.\n");
+			p = pb_sim_put_hex6(p, in->output);
+			p = pb_sim_put_str(p, "\t0x0\n");
+			break;
+	}
+	p = pb_sim_put_hex6(p, in->output);
+	*p++ = '\t';
+	p = pb_sim_put_dec(p, in->ns);
+	*p++ = '\n';
+	sim->pbsim->len = p - sim->pbsim->buf;
+}
+
+/* Add the record(s) for the instruction in, about to be executed at pc, to the .pbtl: the same lines as pb_sim_trace_pbsim() */
+static void pb_sim_trace_timeline(struct pb_sim *sim, const struct pb_sim_insn *in, unsigned int pc){
+	struct pb_tl_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	switch (in->opcode){
+		case PB_SIM_OPCODE_MARK:
+			ev.type = PB_TL_MARK;
+			ev.pc = pc;
+			ev.output = in->output;
+			ev.length = in->length;
+			ev.text = sim->comments[pc] ? sim->comments[pc] : "";
+			ev.text_len = strlen(ev.text);
+			pb_tl_write(sim->timeline, &ev);	/* (An error is kept by the writer, for pb_sim_close()) */
+			break;
+		case PB_OPCODE_STOP:
+			ev.type = PB_TL_STOP;
+			pb_tl_write(sim->timeline, &ev);
+			return;
+		case PB_OPCODE_WAIT:
+			ev.wait = 1;
+			break;
+	}
+	ev.type = PB_TL_DATA;
+	ev.output = in->output;
+	ev.length_ns = in->ns;
+	pb_tl_write(sim->timeline, &ev);
+}
+
+/* Write the .vcd timestamp and changes for the instruction in, about to be executed (as pb_parse's write_vcd()). Only the bits which
+ * changed are visited: XOR with the previous output gives them, and count-trailing-zeros finds each in turn */
+static void pb_sim_trace_vcd(struct pb_sim *sim, const struct pb_sim_insn *in, unsigned long long ticks, unsigned long long steps){
+	char *p = pb_sim_reserve(sim->vcd), *time;
+	uint32_t changed;
+	int bit;
+
+	time = p;
+	*p++ = '#';
+	p = pb_sim_put_dec(p, ticks);
+	*p++ = '\n';
+	if (in->opcode == PB_OPCODE_STOP){			/* STOP doesn't set the outputs: just the time */
+		sim->vcd->len = p - sim->vcd->buf;
+		return;
+	}
+	if (in->opcode == PB_OPCODE_WAIT){			/* WAIT: an extra copy of the timestamp, so that it can be detected */
+		memmove(p, time, p - time);
+		p += p - time;
+	}
+	changed = (steps == 0) ? sim->vcd_mask : ((in->output ^ sim->vcd_prev) & sim->vcd_mask);	/* At the first step, every bit */
+	while (changed){					/* (In order, from bit 0, as pb_parse) */
+		bit = __builtin_ctz(changed);
+		changed &= changed - 1;
+		*p++ = '0' + ((in->output >> bit) & 1);
+		*p++ = pb_sim_vcd_id(bit);
+		*p++ = '\n';
+	}
+	sim->vcd_prev = in->output;
+	sim->vcd->len = p - sim->vcd->buf;
+}
+
+
+/* Execution */
+
+/* Fast-forward by times repeats of a cycle which began at c (and ends now), if the .pbtl (if any) can repeat its records. Returns the
+ * number of steps skipped */
+static unsigned long long pb_sim_skip(struct pb_sim *sim, const struct pb_sim_cycle *c, unsigned long long times, unsigned long long *ticks,
+		unsigned long long *steps, unsigned long long *waits){
+	unsigned long long ds = *steps - c->steps;
+
+	if ((times == 0) || ((sim->timeline) && (pb_tl_write_repeat(sim->timeline, sim->timeline->items - c->items, times) != 0))){
+		return (0);
+	}
+	*ticks += times * (*ticks - c->ticks);		/* (Wrapping, if at all, just as stepping would) */
+	*waits += times * (*waits - c->waits);
+	*steps += times * ds;
+	sim->ff_steps += times * ds;
+	sim->ff_count++;
+	return (times * ds);
+}
+
+/* Remember the machine, in c */
+static void pb_sim_remember(struct pb_sim *sim, struct pb_sim_cycle *c, unsigned int pc, unsigned int ld, unsigned int sd, unsigned long long ticks,
+		unsigned long long steps, unsigned long long waits){
+	c->valid = 1;
+	c->pc = pc;
+	c->ld = ld;
+	c->sd = sd;
+	memcpy(c->loop_count, sim->loop_count, ld * sizeof(c->loop_count[0]));
+	memcpy(c->loop_addr, sim->loop_addr, ld * sizeof(c->loop_addr[0]));
+	memcpy(c->sub, sim->sub, sd * sizeof(c->sub[0]));
+	c->ticks = ticks;
+	c->steps = steps;
+	c->waits = waits;
+	c->items = sim->timeline ? sim->timeline->items : 0;
+}
+
+/* The ENDLOOP of the loop at depth ld has just jumped back (to pc), at step steps (not counting the ENDLOOP). If it did so last time
+ * in the same state (the same subroutine stack, and the loop not ended and begun again since), then the iteration between depended on
+ * its counter only at the ENDLOOPs, where it went down by d and was never 0. So every further iteration does exactly the same, while
+ * the counter stays above d: skip all of those (but not beyond the step limit). Returns the number of steps skipped */
+static unsigned long long pb_sim_loop_cycle(struct pb_sim *sim, unsigned int pc, unsigned int ld, unsigned int sd, unsigned long long limit,
+		unsigned long long *ticks, unsigned long long *steps, unsigned long long *waits){
+	struct pb_sim_cycle *c = &sim->loop_cycle[ld - 1];
+	uint32_t count = sim->loop_count[ld - 1], d;
+	unsigned long long times, skipped = 0;
+
+	if ((c->valid) && (c->pc == pc) && (c->sd == sd) && (!memcmp(c->sub, sim->sub, sd * sizeof(c->sub[0]))) && (c->loop_count[0] > count)){
+		d = c->loop_count[0] - count;
+		times = (count - 1) / d;
+		if (times > (limit - *steps - 1) / (*steps - c->steps)){
+			times = (limit - *steps - 1) / (*steps - c->steps);
+		}
+		if ((skipped = pb_sim_skip(sim, c, times, ticks, steps, waits)) != 0){
+			sim->loop_count[ld - 1] -= times * d;
+		}
+	}
+	pb_sim_remember(sim, c, pc, 0, sd, *ticks, *steps, *waits);
+	c->loop_count[0] = sim->loop_count[ld - 1];
+	return (skipped);
+}
+
+/* A GOTO (at step steps, not counting it) back to pc. If the machine was in exactly this state before, it is in a cycle, which it
+ * can never leave: skip as many turns round it as the step limit allows. The states are kept in a hash table, the last at each slot */
+static unsigned long long pb_sim_goto_cycle(struct pb_sim *sim, unsigned int pc, unsigned int ld, unsigned int sd, unsigned long long limit,
+		unsigned long long *ticks, unsigned long long *steps, unsigned long long *waits){
+	struct pb_sim_cycle *c;
+	uint32_t h = pc * 2654435761u;
+	unsigned long long skipped = 0;
+	unsigned int i;
+
+	for (i = 0; i < ld; i++){
+		h = (h ^ sim->loop_count[i] ^ (sim->loop_addr[i] << 16)) * 2654435761u;
+	}
+	for (i = 0; i < sd; i++){
+		h = (h ^ sim->sub[i]) * 2654435761u;
+	}
+	h = (h ^ (ld << 8) ^ sd) * 2654435761u;
+	c = &sim->goto_cycle[(h >> 16) % PB_SIM_GOTO_SLOTS];
+	if ((c->valid) && (c->pc == pc) && (c->ld == ld) && (c->sd == sd) && (!memcmp(c->loop_count, sim->loop_count, ld * sizeof(c->loop_count[0])))
+			&& (!memcmp(c->loop_addr, sim->loop_addr, ld * sizeof(c->loop_addr[0]))) && (!memcmp(c->sub, sim->sub, sd * sizeof(c->sub[0])))
+			&& (limit != ~0ULL)){	/* (With no limit, it would never end: so nothing is gained) */
+		skipped = pb_sim_skip(sim, c, (limit - *steps - 1) / (*steps - c->steps), ticks, steps, waits);
+	}
+	pb_sim_remember(sim, c, pc, ld, sd, *ticks, *steps, *waits);
+	return (skipped);
+}
+
+/* Run. See pb_simulator.h */
+int pb_sim_run(struct pb_sim *sim, unsigned long long max_steps){
+	const struct pb_sim_insn *code = sim->code, *in;
+	unsigned char *visited = sim->visited;
+	unsigned int pc = sim->pc, ld = sim->ld, sd = sim->sd;
+	unsigned long long ticks = sim->ticks, steps = sim->steps, waits = sim->waits;
+	unsigned long long limit = max_steps ? max_steps : ~0ULL;
+	uint32_t output = sim->output;
+	int ell = sim->ell, result = PB_SIM_RUNNING;
+	int trace = (sim->pbsim != NULL) || (sim->vcd != NULL) || (sim->timeline != NULL);
+	int ff = (sim->fastforward) && (sim->pbsim == NULL) && (sim->vcd == NULL);
+
+	sim->max_steps = max_steps;
+	if (sim->result != PB_SIM_RUNNING){
+		return (sim->result);
+	}
+	while (steps < limit){
+		in = &code[pc];
+		visited[pc] = 1;
+		if ((trace) && (in->opcode <= PB_SIM_OPCODE_NEVER) && ((in->opcode <= PB_OPCODE_WAIT) || (in->opcode >= PB_SIM_OPCODE_MARK))){
+			if (sim->pbsim){
+				pb_sim_trace_pbsim(sim, in, pc, ticks, steps);
+			}
+			if (sim->timeline){
+				pb_sim_trace_timeline(sim, in, pc);
+			}
+			if (sim->vcd){
+				pb_sim_trace_vcd(sim, in, ticks, steps);
+			}
+		}
+
+		switch (in->opcode){
+			case PB_OPCODE_CONT:
+			case PB_SIM_OPCODE_MARK:
+			case PB_OPCODE_LONGDELAY:
+				output = in->output;
+				pc++;
+				ell = 0;
+				break;
+
+			case PB_OPCODE_WAIT:			/* The trigger comes at once */
+				output = in->output;
+				pc++;
+				ell = 0;
+				waits++;
+				break;
+
+			case PB_OPCODE_GOTO:
+				output = in->output;
+				if ((ff) && (in->arg <= pc)){
+					pb_sim_goto_cycle(sim, in->arg, ld, sd, limit, &ticks, &steps, &waits);
+				}
+				pc = in->arg;
+				ell = 0;
+				break;
+
+			case PB_OPCODE_LOOP:
+				output = in->output;
+				if (!ell){			/* Jumped back by our own ENDLOOP: don't begin a deeper loop */
+					if (ld >= PB_LOOP_MAXDEPTH){
+						result = PB_SIM_LOOP_DEPTH_EXCEEDED;
+						goto end;
+					}
+					sim->loop_count[ld] = in->arg;
+					sim->loop_cycle[ld].valid = 0;
+					sim->loop_addr[ld++] = pc;
+				}
+				pc++;
+				ell = 0;
+				break;
+
+			case PB_OPCODE_ENDLOOP:
+				output = in->output;
+				if (ld == 0){
+					result = PB_SIM_NON_EXISTENT_ENDLOOP;
+					goto end;
+				}
+				if (sim->loop_addr[ld - 1] != in->arg){
+					result = PB_SIM_WRONG_LOOP_STARTADDR;
+					goto end;
+				}
+				if (--sim->loop_count[ld - 1] == 0){
+					ld--;
+					pc++;
+					ell = 0;
+				}else{
+					pc = in->arg;		/* Back to the LOOP itself, not the one after it */
+					ell = 1;
+					if (ff){
+						pb_sim_loop_cycle(sim, pc, ld, sd, limit, &ticks, &steps, &waits);
+					}
+				}
+				break;
+
+			case PB_OPCODE_CALL:
+				output = in->output;
+				if (sd >= PB_SUB_MAXDEPTH){
+					result = PB_SIM_STACK_DEPTH_EXCEEDED;
+					goto end;
+				}
+				sim->sub[sd++] = pc;
+				pc = in->arg;
+				ell = 0;
+				break;
+
+			case PB_OPCODE_RETURN:
+				output = in->output;
+				if (sd == 0){
+					result = PB_SIM_NON_EXISTENT_RETURN;
+					goto end;
+				}
+				pc = sim->sub[--sd] + 1;
+				ell = 0;
+				break;
+
+			case PB_OPCODE_STOP:			/* (Doesn't change the outputs) */
+				steps++;
+				result = PB_SIM_STOPPED;
+				goto end;
+
+			case PB_SIM_OPCODE_NEVER:		/* Executed; then the simulation fails */
+				output = in->output;
+				pc++;
+				ticks += in->ticks;
+				steps++;
+				result = PB_SIM_ENCOUNTERED_NEVER;
+				goto end;
+
+			case PB_SIM_OPCODE_END:
+				visited[pc] = 0;
+				result = PB_SIM_RAN_PAST_END;
+				goto end;
+
+			default:
+				result = PB_SIM_INVALID_OPCODE;
+				goto end;
+		}
+		ticks += in->ticks;
+		steps++;
+	}
+	result = PB_SIM_REACHED_STEP_LIMIT;
+
+end:
+	sim->pc = pc;
+	sim->ld = ld;
+	sim->sd = sd;
+	sim->ell = ell;
+	sim->output = output;
+	sim->ticks = ticks;
+	sim->steps = steps;
+	sim->waits = waits;
+	sim->result = result;
+	return (result);
+}
+
+/* Finish the outputs. See pb_simulator.h */
+int pb_sim_close(struct pb_sim *sim){
+	struct pb_sim_out *outs[2];
+	char text[128];
+	int i, ret = 0;
+
+	if ((sim->pbsim) && (sim->result == PB_SIM_REACHED_STEP_LIMIT)){
+		sim->pbsim->len += sprintf(pb_sim_reserve(sim->pbsim), "//Simulation stopped at step-limit of %llu steps.\n", sim->max_steps);
+	}
+	if ((sim->pbsim) && (sim->pbsim->footer)){
+		sim->pbsim->len += sprintf(pb_sim_reserve(sim->pbsim), "//End of file.\n");
+	}
+	if (sim->timeline){
+		if (sim->result == PB_SIM_REACHED_STEP_LIMIT){
+			sprintf(text, "//Simulation stopped at step-limit of %llu steps.\n", sim->max_steps);
+			pb_tl_write_text(sim->timeline, text);
+		}
+		if (sim->timeline_footer){
+			pb_tl_write_text(sim->timeline, "//End of file.\n");
+		}
+		if (sim->timeline->error){
+			ret = -1;
+		}
+	}
+	outs[0] = sim->pbsim;
+	outs[1] = sim->vcd;
+	for (i = 0; i < 2; i++){
+		if (outs[i]){
+			pb_sim_flush(outs[i]);
+			if ((fflush(outs[i]->fh) != 0) || (outs[i]->error)){
+				ret = -1;
+			}
+		}
+	}
+	return (ret);
+}
+
+/* Name of a result */
+const char *pb_sim_result_name(int result){
+	switch (result){
+		case PB_SIM_RUNNING:			return ("RUNNING");
+		case PB_SIM_STOPPED:			return ("STOPPED");
+		case PB_SIM_REACHED_STEP_LIMIT:		return ("REACHED_STEP_LIMIT");
+		case PB_SIM_RAN_PAST_END:		return ("RAN_PAST_END");
+		case PB_SIM_LOOP_DEPTH_EXCEEDED:	return ("LOOP_DEPTH_EXCEEDED");
+		case PB_SIM_NON_EXISTENT_ENDLOOP:	return ("NON_EXISTENT_ENDLOOP");
+		case PB_SIM_WRONG_LOOP_STARTADDR:	return ("WRONG_LOOP_STARTADDR");
+		case PB_SIM_STACK_DEPTH_EXCEEDED:	return ("STACK_DEPTH_EXCEEDED");
+		case PB_SIM_NON_EXISTENT_RETURN:	return ("NON_EXISTENT_RETURN");
+		case PB_SIM_ENCOUNTERED_NEVER:		return ("ENCOUNTERED_NEVER");
+		case PB_SIM_INVALID_OPCODE:		return ("INVALID_OPCODE");
+	}
+	return ("UNKNOWN");
+}
@@ -0,0 +1,145 @@
+/* This is pb_simulator.h, the interface to the native simulator (pb_simulator.c), which is part of libpulseblaster.
+ * It runs a program image (from pb_asm, or a .bin) with exactly the semantics of pb_parse's full simulation (pb_parse -f), including its
+ * extra checks, and writes the same simulation replay log (.pbsim: see pb_parse/doc/pbsim.txt) and value change dump (.vcd: see
+ * pb_parse/doc/vcd.txt). Unlike the emulator (pb_emulator.h), there is no bridge and no device: just the program, run as fast as possible.
+ * Unless a .pbsim or .vcd is being written, it also fast-forwards: when a loop comes round to the same state again (the same
+ * subroutine stack, and the same loop counters, but its own, which has gone down by the same amount), every further iteration until
+ * the count runs out must do exactly the same; so they are added up, not executed. The same for a GOTO back to an exact state seen
+ * before, up to the step limit. The .pbtl is still exact: the skipped iterations are written as "repeat" records (COPY).
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#ifndef PB_SIMULATOR_H
+#define PB_SIMULATOR_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+#include "pb_timeline.h"
+
+/* Why the simulation ended. The names (pb_sim_result_name()) are pb_parse's $EXIT_REASON */
+#define PB_SIM_RUNNING			0	/* Not yet ended */
+#define PB_SIM_STOPPED			1	/* Reached a STOP */
+#define PB_SIM_REACHED_STEP_LIMIT	2	/* Executed max_steps instructions */
+#define PB_SIM_RAN_PAST_END		3	/* Ran (or branched) past the end of the program */
+#define PB_SIM_LOOP_DEPTH_EXCEEDED	4	/* A LOOP nested loops deeper than PB_LOOP_MAXDEPTH */
+#define PB_SIM_NON_EXISTENT_ENDLOOP	5	/* An ENDLOOP, with the loop stack empty */
+#define PB_SIM_WRONG_LOOP_STARTADDR	6	/* An ENDLOOP whose arg isn't the address of the LOOP which began the loop */
+#define PB_SIM_STACK_DEPTH_EXCEEDED	7	/* A CALL nested subroutines deeper than PB_SUB_MAXDEPTH */
+#define PB_SIM_NON_EXISTENT_RETURN	8	/* A RETURN, with the subroutine stack empty */
+#define PB_SIM_ENCOUNTERED_NEVER	9	/* Reached a NEVER (dead code, according to pb_parse) */
+#define PB_SIM_INVALID_OPCODE		10	/* Reached a word with an invalid opcode */
+
+/* Opcodes which pb_asm encodes as CONT, but which the simulator treats specially, if told of them (pb_sim_annotate()) */
+#define PB_SIM_OPCODE_MARK		16	/* Writes a MARK: line to the .pbsim, before it executes */
+#define PB_SIM_OPCODE_NEVER		17	/* Ends the simulation, as PB_SIM_ENCOUNTERED_NEVER, after it executes */
+#define PB_SIM_OPCODE_END		18	/* (Internal: the word after the end of the program) */
+
+#define PB_SIM_VCD_BITS			24	/* Output bits */
+#define PB_SIM_GOTO_SLOTS		64	/* States remembered at backward GOTOs (a hash table), to find a cycle */
+#define PB_SIM_BUFSIZE			(1 << 20)	/* Output is built up in a buffer of this size, then written */
+
+/* One instruction, decoded ready to execute */
+struct pb_sim_insn {
+	uint64_t ticks;				/* Its duration: the length (times the arg, for LONGDELAY) */
+	uint64_t ns;				/* ... in ns, as written to the .pbsim */
+	uint32_t output;
+	uint32_t arg;				/* The count (LOOP), or the address (GOTO, CALL, ENDLOOP) */
+	uint32_t length;			/* The length, as in .vliw source */
+	uint32_t opcode;			/* PB_OPCODE_*, or PB_SIM_OPCODE_* */
+};
+
+/* An output file (.pbsim or .vcd), written through a buffer */
+struct pb_sim_out {
+	FILE *fh;				/* NULL if not being written */
+	char buf[PB_SIM_BUFSIZE];
+	size_t len;
+	int error;				/* A write failed */
+	int footer;				/* End with pb_parse's footer */
+};
+
+/* A state of the machine, as it was at an ENDLOOP jumping back, or at a backward GOTO: and where the simulation had got to */
+struct pb_sim_cycle {
+	int valid;
+	unsigned int pc, ld, sd;
+	uint32_t loop_count[PB_LOOP_MAXDEPTH];	/* (For an ENDLOOP, only that of its own loop) */
+	uint32_t loop_addr[PB_LOOP_MAXDEPTH];
+	uint32_t sub[PB_SUB_MAXDEPTH];
+	unsigned long long ticks, steps, waits;
+	uint64_t items;				/* Records written to the .pbtl */
+};
+
+/* The simulator */
+struct pb_sim {
+	struct pb_sim_insn *code;		/* The program, and one more word: PB_SIM_OPCODE_END */
+	unsigned int words;
+	char **comments;			/* The comment of each MARK (or NULL) */
+	unsigned long *visits;			/* Times each MARK has been reached */
+	unsigned char *visited;			/* Each word, if it has been executed */
+
+	/* The state of the machine (as in pb_parse: $PC, $LOOP_STACK, $LD, $ELL, $SUB_STACK, $SD) */
+	unsigned int pc;
+	uint32_t loop_count[PB_LOOP_MAXDEPTH];	/* Loop counters */
+	uint32_t loop_addr[PB_LOOP_MAXDEPTH];	/* Address of the LOOP which began each loop (pb_parse's extra check; the hardware has no such stack) */
+	unsigned int ld;			/* Loop depth */
+	int ell;				/* The last instruction was an ENDLOOP, which jumped back */
+	uint32_t sub[PB_SUB_MAXDEPTH];		/* Address of each CALL */
+	unsigned int sd;			/* Subroutine depth */
+	uint32_t output;			/* Current output */
+	unsigned long long ticks;		/* Elapsed (pb_parse's $ELAPSED_TICKS) */
+	unsigned long long steps;		/* Instructions executed (including a final STOP) */
+	unsigned long long waits;		/* WAITs executed (the trigger is simulated at once) */
+	int result;				/* PB_SIM_RUNNING, or why it ended */
+	unsigned long long max_steps;		/* The step limit (0 for none) */
+
+	/* Fast-forwarding */
+	int fastforward;			/* Allowed (the default). It is only done if no .pbsim or .vcd is being written */
+	struct pb_sim_cycle loop_cycle[PB_LOOP_MAXDEPTH];	/* Each loop, when its ENDLOOP last jumped back */
+	struct pb_sim_cycle goto_cycle[PB_SIM_GOTO_SLOTS];
+	unsigned long long ff_steps;		/* Steps added up, rather than executed */
+	unsigned long long ff_count;		/* ... in this many fast-forwards */
+
+	/* Outputs */
+	struct pb_sim_out *pbsim;		/* Simulation replay log, or NULL */
+	struct pb_sim_out *vcd;			/* Value change dump, or NULL */
+	struct pb_tl_writer *timeline;		/* The replay log as a binary timeline (.pbtl), or NULL */
+	int timeline_footer;			/* ... to end with pb_parse's footer */
+	uint32_t vcd_mask;			/* The bits in the VCD */
+	char *vcd_labels[PB_SIM_VCD_BITS];	/* ... and their names */
+	uint32_t vcd_prev;			/* The output at the previous step */
+	FILE *log;				/* Errors go here (or NULL) */
+};
+
+/* Make a simulator for the program image (len bytes). Returns NULL (with the reason to log) if the image is empty or too big, or if
+ * out of memory. */
+struct pb_sim *pb_sim_new(const unsigned char *image, size_t len, FILE *log);
+void pb_sim_free(struct pb_sim *sim);
+
+/* Tell the simulator that the word at addr was written as MARK (with comment) or NEVER (opcode is PB_SIM_OPCODE_*), which pb_asm
+ * encodes as CONT. Returns 0, or -1 */
+int pb_sim_annotate(struct pb_sim *sim, unsigned int addr, unsigned int opcode, const char *comment);
+
+/* Write the .pbsim to fh. If header, begin it with pb_parse's header (naming the source), and end it with pb_parse's footer.
+ * Returns 0, or -1 (out of memory) */
+int pb_sim_pbsim_open(struct pb_sim *sim, FILE *fh, int header, const char *source, unsigned long long max_steps);
+
+/* Write the replay log, as a binary timeline (.pbtl: see pb_timeline.h), to tl; otherwise as pb_sim_pbsim_open(). The caller
+ * made tl (pb_tl_writer_new()), and finishes it (pb_tl_writer_close()) after pb_sim_close(). Returns 0, or -1 */
+int pb_sim_timeline_open(struct pb_sim *sim, struct pb_tl_writer *tl, int header, const char *source, unsigned long long max_steps);
+
+/* Write the .vcd to fh. labels is as pb_parse -L: up to 24 comma-separated names, of the bits from the most significant down, '-'
+ * for a bit to leave out; NULL for all 24 bits, named Bit_0 etc. If header, begin with the VCD header (else the caller has written
+ * it, as pb_parse does). Returns 0, or -1 (bad labels, or out of memory) */
+int pb_sim_vcd_open(struct pb_sim *sim, FILE *fh, const char *labels, int header, const char *source, unsigned long long max_steps);
+
+/* Run, until the program ends, or max_steps instructions have been executed (0 for no limit). Returns sim->result */
+int pb_sim_run(struct pb_sim *sim, unsigned long long max_steps);
+
+/* Finish the output files (flush them, and add the footers). Returns 0, or -1 if anything could not be written */
+int pb_sim_close(struct pb_sim *sim);
+
+/* Name of a result, as pb_parse's $EXIT_REASON */
+const char *pb_sim_result_name(int result);
+
+#endif /* PB_SIMULATOR_H */
@@ -1,9 +1,10 @@
 /* This is pb_start.c  It starts the pulseblaster. *
- * Most of the important, shared stuff is in pb_functions.c
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdlib.h>
+#include "libpulseblaster.h"
 
 void printhelp(){
 	fprintf(stderr,"pb_start starts the (already-programmed) PulseBlaster with a software trigger.\n"
@@ -13,20 +14,28 @@ void printhelp(){
 }
 		       
 int main(int argc, char *argv[] __attribute__ ((unused)) ){
+	struct pb_device *dev;
+	int ret;
+
 	if (argc > 1){
 		printhelp();
 		exit (PB_ERROR_WRONGARGS);
 	}
 
 	/* Open pulseblaster; check device is present */
-	pb_fopen();
+	if ((dev = pb_device_open(NULL, &ret)) == NULL){
+		exit (ret);
+	}
 
 	/* Trigger the pulseblaster */
-	pb_start();
+	if ((ret = pb_device_start(dev)) != 0){
+		pb_device_close(dev);
+		exit (ret);
+	}
 	fprintf(stderr, "Pulseblaster has been triggered, and is now running the program.\n");
 
        	/* Close the device */
-	pb_fclose();
+	pb_device_close(dev);
 
         return PB_EXIT_OK;      /* i.e. zero */
 }
@@ -1,10 +1,11 @@
 /* This is pb_stop-arm.c  It stops the pulseblaster and re-arms it to restart
  * It's exactly the same as pb_stop;pb_arm,  indeed, it's the same as just doing pb_arm (which implicitly stops the PB first). Pure syntactic sugar ;-)
- * Most of the important, shared stuff is in pb_functions.c
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdlib.h>
+#include "libpulseblaster.h"
 
 void printhelp(){
 	fprintf(stderr,"pb_stop-arm places the (already-programmed) PulseBlaster into the STOPPED,ARMED state.\n"
@@ -14,21 +15,32 @@ void printhelp(){
 }
 
 int main(int argc, char *argv[] __attribute__ ((unused)) ){
+	struct pb_device *dev;
+	int ret;
+
 	if (argc > 1){
 		printhelp();
 		exit (PB_ERROR_WRONGARGS);
 	}
 
 	/* Open pulseblaster; check device is present */
-	pb_fopen();
+	if ((dev = pb_device_open(NULL, &ret)) == NULL){
+		exit (ret);
+	}
 
 	/* Stop the pulseblaster. Then re-arm it. */
-	pb_stop();
-	pb_arm();
+	if ((ret = pb_device_stop(dev)) != 0){
+		pb_device_close(dev);
+		exit (ret);
+	}
+	if ((ret = pb_device_arm(dev)) != 0){
+		pb_device_close(dev);
+		exit (ret);
+	}
 	fprintf(stderr, "PulseBlaster has been stopped and re-armed (ready for HW_Trigger or pb_start).\n");
 
 	/* Close the device */
-	pb_fclose();
+	pb_device_close(dev);
 
         return PB_EXIT_OK;      /* i.e. zero */
 }
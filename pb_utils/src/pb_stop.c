@@ -1,9 +1,10 @@
 /* This is pb_stop.c  It stops the pulseblaster (and doesn't arm it to restart).
- * Most of the important, shared stuff is in pb_functions.c
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdlib.h>
+#include "libpulseblaster.h"
 
 void printhelp(){
 	fprintf(stderr,"pb_stop places the (already-programmed) PulseBlaster into the STOPped state.\n"
@@ -12,20 +13,28 @@ void printhelp(){
 }
 
 int main(int argc, char *argv[] __attribute__ ((unused)) ){
+	struct pb_device *dev;
+	int ret;
+
 	if (argc > 1){
 		printhelp();
 		exit (PB_ERROR_WRONGARGS);
 	}
 
 	/* Open pulseblaster; check device is present */
-	pb_fopen();
+	if ((dev = pb_device_open(NULL, &ret)) == NULL){
+		exit (ret);
+	}
 
 	/* Stop the pulseblaster. Do not re-arm it (though a pb_start() will still work) */
-	pb_stop();
+	if ((ret = pb_device_stop(dev)) != 0){
+		pb_device_close(dev);
+		exit (ret);
+	}
 	fprintf(stderr, "PulseBlaster has been stopped. (Not armed; ignoring HW_Trigger).\n");
 
 	/* Close the device */
-	pb_fclose();
+	pb_device_close(dev);
 	
         return PB_EXIT_OK;      /* i.e. zero */
 }
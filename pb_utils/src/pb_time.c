@@ -0,0 +1,236 @@
+/* This is pb_time.c  It works out how long a program (.vliw or .bin) runs, without running it: see pb_time() in pb_flow.h.
+ * Each loop body and subroutine is timed once, and multiplied by its count; so the answer is exact, and immediate, even for a program
+ * which runs for days. It also gives the tick at which each labelled instruction (or, with -a, every instruction) is first executed.
+ * Labels are as pb_parse writes them into the .vliw, in the comment: "LBL:name".
+ * With -t, it also gives the state (instruction and outputs) at given ticks, from the time index (pb_tindex_lookup()).
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libpulseblaster.h"
+#include "pb_image.h"
+#include "pb_flow.h"
+
+#define PB_TIME_LABEL	"LBL:"		/* pb_parse marks the label of each line with this, in its comment */
+
+void printhelp(){
+	fprintf(stderr, "pb_time works out exactly how long a PulseBlaster program runs, from its loops, longdelays and subroutines,\n"
+		"without running it (so it takes no longer for a program which runs for days). It prints the total, in ticks (of %d ns)\n"
+		"and seconds; or, for a program which never stops, when it starts to repeat, and the period. Then, for each labelled\n"
+		"instruction (LBL:name in the comment, as written by pb_parse), the tick at which it is first executed.\n"
+		"Time spent in a WAIT, waiting for the trigger, is not counted. Everything is printed to stdout, as 'name: value' lines.\n\n"
+		"USAGE:    pb_time [-a] [-t tick]... FILENAME.vliw | FILENAME.bin | -\n"
+		"          (From stdin, a .bin, raw or container, is recognised as such; anything else is taken as .vliw.)\n\n"
+		"OPTIONS:  -a           give the first execution of every instruction, by address (with its source line, if known).\n"
+		"          -t tick      give the state at this tick: the address and outputs of the instruction in force, and the ticks\n"
+		"                       from which, and until which, it lasts. (From an index of the loops, without expanding them: a\n"
+		"                       tick days in is found as fast as the first.) May be given many times.\n"
+		"          -h           show this help.\n", PB_TICK_NS);
+}
+
+/* Find the label in line (up to end), as "LBL:name"; copy it to label. Returns 1 if there is one */
+static int find_label(const char *line, const char *end, char *label, size_t size){
+	size_t n = strlen(PB_TIME_LABEL), i;
+	const char *p;
+
+	for (p = line; p + n <= end; p++){
+		if (!memcmp(p, PB_TIME_LABEL, n)){
+			p += n;
+			for (i = 0; (p + i < end) && (i + 1 < size) && (p[i] != ' ') && (p[i] != '\t') && (p[i] != '\r') && (p[i] != '\n'); i++){
+				label[i] = p[i];
+			}
+			label[i] = '\0';
+			return (i > 0);
+		}
+	}
+	return (0);
+}
+
+static void print_ticks(const char *name, unsigned long long ticks){
+	printf("%s_ticks: %llu\n", name, ticks);
+	printf("%s_seconds: %.9f\n", name, (double)ticks * PB_TICK_NS / 1e9);
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern int optind;	/* getopt */
+	int all = 0;
+	unsigned long long *at = NULL;
+	unsigned int nat = 0, k;
+	char *end;
+	const char *filename;
+	const unsigned char *image;
+	const unsigned int *lines = NULL;
+	static unsigned int map_lines[PB_MEMORY];
+	static unsigned long long first[PB_MEMORY];
+	const char **line_start = NULL;
+	char label[VLIWLINE_MAXLEN];
+	size_t len, i, nlines = 0;
+	unsigned int words, w;
+	int is_vliw, ret;
+	FILE *source_fh;
+	struct pb_source src;
+	struct pb_image bin;
+	struct pb_encoder *enc;
+	struct pb_time_result result;
+	struct pb_tindex *ix = NULL;
+	struct pb_tindex_state state;
+
+	while ((opt = getopt(argc, argv, "at:h")) != -1){
+		switch (opt){
+			case 'a':  all = 1;  break;
+			case 't':
+				if ((at == NULL) && ((at = malloc(argc * sizeof(*at))) == NULL)){
+					fprintf(stderr, "Error: out of memory.\n");
+					exit (PB_ERROR_GENERIC);
+				}
+				at[nat] = strtoull(optarg, &end, 10);
+				if ((*optarg == '\0') || (*optarg == '-') || (*end != '\0')){
+					fprintf(stderr, "Error: the tick (-t) must be a number, not '%s'.\n", optarg);
+					exit (PB_ERROR_WRONGARGS);
+				}
+				nat++;
+				break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if (argc - optind != 1){
+		printhelp();
+		exit (PB_ERROR_WRONGARGS);
+	}
+	filename = argv[optind];
+
+	if (!strcmp (filename, "-")){
+		source_fh = stdin;
+	}else if ((source_fh = fopen(filename, "r")) == NULL){
+		fprintf(stderr,"Could not open program-file %s.\n", filename);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((ret = pb_source_open(&src, fileno(source_fh), stderr)) != 0){
+		exit (ret);
+	}
+	if (src.len == 0){
+		fprintf(stderr, "Error: file %s is empty!\n", filename);
+		exit (PB_ERROR_EMPTYVLIWFILE);
+	}
+
+	/* Get the image: assemble a .vliw; check a .bin */
+	if (!strcmp (filename, "-")){
+		is_vliw = (src.len > PB_IMAGE_MAXLEN) || (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, NULL) != 0) || ((!bin.container) && (src.len % PB_BPW_VLIW));	/* (Raw, it must be whole words) */
+	}else{
+		is_vliw = (strlen(filename) > 5) && (!strcmp (filename + strlen(filename) - 5, ".vliw"));
+	}
+	if (is_vliw){
+		if ((enc = pb_encoder_new()) == NULL){
+			fprintf(stderr, "Error: could not allocate the encoder.\n");
+			exit (PB_ERROR_GENERIC);
+		}
+		if (((ret = pb_encode_text(enc, src.buf, src.len)) > 0) || ((ret = pb_encoder_finish(enc)) != 0)){
+			fprintf(stderr, "Error in program %s.\n", filename);
+			exit (ret);
+		}
+		image = pb_encoder_image(enc);
+		len = pb_encoder_len(enc);
+		lines = pb_encoder_lines(enc);
+	}else{
+		if ((src.len > PB_IMAGE_MAXLEN) || (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, stderr) != 0)){
+			fprintf(stderr, "Error in program file %s.\n", filename);
+			exit (PB_ERROR_BADVLIWFILE);
+		}
+		image = bin.payload;
+		len = bin.payload_len;
+		if (pb_image_lines(&bin, map_lines) == 0){
+			lines = map_lines;
+		}
+	}
+	if ((len == 0) || (len % PB_BPW_VLIW) || (len > (size_t)PB_MEMORY * PB_BPW_VLIW)){
+		fprintf(stderr, "Error: program %s is %lu bytes long, but should be a non-zero multiple of %d, and at most %d words.\n",
+			filename, (unsigned long)len, PB_BPW_VLIW, PB_MEMORY);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	words = len / PB_BPW_VLIW;
+
+	if ((ret = pb_time(image, len, lines, first, &result, stderr)) != 0){
+		fprintf(stderr, "Error: program %s can't be timed.\n", filename);
+		exit (ret);
+	}
+
+	printf("file: %s\n", filename);
+	printf("words: %u\n", words);
+	printf("result: %s\n", (result.outcome == PB_TIME_STOP) ? "stop" : "forever");
+	if (result.outcome == PB_TIME_STOP){
+		print_ticks("total", result.ticks);
+	}else{
+		print_ticks("period_start", result.period_start);
+		print_ticks("period", result.period);
+	}
+	printf("steps: %llu\n", result.steps);
+	printf("waits: %llu\n", result.waits);
+	printf("reached: %u\n", result.reached);
+	printf("segments: %lu\n", result.segments);
+
+	/* The state at each tick asked for */
+	if (nat){
+		if ((ix = pb_tindex_new(image, len, lines, NULL, stderr)) == NULL){
+			fprintf(stderr, "Error: program %s can't be indexed.\n", filename);
+			exit (PB_ERROR_GENERIC);
+		}
+		printf("index_entries: %lu\n", pb_tindex_entries(ix));
+		for (k = 0; k < nat; k++){
+			pb_tindex_lookup(ix, at[k], &state);
+			printf("at: %llu pc %u output 0x%06x from %llu", at[k], state.pc, state.output, state.start);
+			if (state.end == PB_TIME_NEVER){
+				printf(" %s\n", state.stopped ? "stopped" : "never");
+			}else{
+				printf(" to %llu\n", state.end);
+			}
+		}
+		pb_tindex_free(ix);
+		free(at);
+	}
+
+	/* The labels are in the source: find the start of each line (lines[] is 1-based) */
+	if (is_vliw){
+		for (i = 0; i < src.len; i++){
+			nlines += (src.buf[i] == '\n');
+		}
+		if ((line_start = malloc((nlines + 2) * sizeof(*line_start))) == NULL){
+			fprintf(stderr, "Error: out of memory.\n");
+			exit (PB_ERROR_GENERIC);
+		}
+		line_start[nlines = 0] = src.buf;
+		for (i = 0; i < src.len; i++){
+			if (src.buf[i] == '\n'){
+				line_start[++nlines] = src.buf + i + 1;
+			}
+		}
+		line_start[++nlines] = src.buf + src.len;
+	}
+	for (w = 0; w < words; w++){
+		if ((line_start) && (lines[w]) && (lines[w] < nlines) && (find_label(line_start[lines[w] - 1], line_start[lines[w]], label, sizeof(label)))){
+			if (first[w] == PB_TIME_NEVER){
+				printf("label: %s %u never\n", label, w);
+			}else{
+				printf("label: %s %u %llu\n", label, w, first[w]);
+			}
+		}
+		if (all){
+			if (first[w] == PB_TIME_NEVER){
+				printf("address: %u never", w);
+			}else{
+				printf("address: %u %llu", w, first[w]);
+			}
+			if ((lines) && (lines[w])){
+				printf(" line %u", lines[w]);
+			}
+			printf("\n");
+		}
+	}
+
+	free(line_start);
+	return PB_EXIT_OK;	/* i.e. zero */
+}
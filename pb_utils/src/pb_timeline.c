@@ -0,0 +1,1148 @@
+/* This is pb_timeline.c which writes and reads the binary timeline (.pbtl): the simulation replay log, compacted. (See pb_timeline.h,
+ * and doc/pbtl.txt.)
+ * A .pbsim line is ~18 bytes of text; as a record, a typical data line is 1 to 3 bytes: the tag byte, then (unless it is the same as
+ * before) the output XORed with the previous one, as a LEB128 varint, then (unless it is one of the last few, which the tag says)
+ * the length, in ticks. Then, since the trace of a loop is the same records, again and again, the writer looks for repeats, as LZ77
+ * does, but of whole records: a hash of each record gives the last place it was seen (within the window); if the records which
+ * follow go on matching, the whole run is written as one COPY. The distance is then the length of the loop body, and the count is
+ * as long as the loop (up to the end of the block). So a loop of a million iterations is a few bytes per block.
+ * Numbers in the header, index and footer are little-endian, and are written and read a byte at a time, as in pb_image.c.
+ * It is part of libpulseblaster: like the rest of the library, nothing here exits.
+ *
+ * Copyright (C) Richard Neill 2004-2013, <pulseblaster at REMOVE.ME.richardneill.org>. This program is Free Software. You can
+ * redistribute and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version. There is NO WARRANTY, neither express nor implied.
+ * For the details, please see: http://www.gnu.org/licenses/gpl.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pb_timeline.h"
+#include "pb_image.h"		/* pb_crc32() */
+
+/* Offsets of the fields in the (version 1) header */
+#define PB_TL_OFF_VERSION	8	/* 2 bytes */
+#define PB_TL_OFF_HEADER_LEN	10	/* 2 */
+#define PB_TL_OFF_FLAGS		12	/* 4 */
+#define PB_TL_OFF_TICK_PS	16	/* 4 */
+#define PB_TL_OFF_BLOCK		20	/* 4 */
+#define PB_TL_OFF_WINDOW	24	/* 4 */
+
+/* ... and in the footer (from its start, PB_TL_FOOTER_LEN bytes before the end of the file) */
+#define PB_TL_OFF_INDEX		0	/* 8 */
+#define PB_TL_OFF_BLOCKS	8	/* 8 */
+#define PB_TL_OFF_ITEMS		16	/* 8 */
+#define PB_TL_OFF_STEPS		24	/* 8 */
+#define PB_TL_OFF_TIME		32	/* 8 */
+#define PB_TL_OFF_CRC		40	/* 4 */
+#define PB_TL_OFF_END_MAGIC	44	/* 4 */
+
+#define PB_TL_TICK_PS		((unsigned long)(PB_TICK_NS * 1000 + 0.5))	/* (PB_TICK_NS may not be an integer) */
+#define PB_TL_MIN_COPY		3	/* A shorter repeat is written as it is: a COPY costs about as much as 3 records */
+#define PB_TL_LINE_MAXLEN	256	/* Longest line which is formatted (a MARK's comment is not: it's written separately) */
+
+/* The lines which pb_parse and pb_sim write for STOP and WAIT, and the start of a MARK (pb_parse's $MARK_PREFIX) */
+#define PB_TL_STOP_LINE		"//Encountered STOP instruction. STOP doesn't change the outputs."
+#define PB_TL_WAIT_LINE		"//Encountered WAIT instruction. Continuing. Inserting extra line with length=0, parser can detect this."
+#define PB_TL_MARK_PREFIX	"//MARK:\tstep="
+
+
+/* Numbers */
+
+static void pb_tl_put32 (unsigned char *p, uint32_t x){
+	p[0] = x;
+	p[1] = x >> 8;
+	p[2] = x >> 16;
+	p[3] = x >> 24;
+}
+
+static void pb_tl_put64 (unsigned char *p, uint64_t x){
+	pb_tl_put32 (p, x & 0xffffffff);
+	pb_tl_put32 (p + 4, x >> 32);
+}
+
+static uint32_t pb_tl_get32 (const unsigned char *p){
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static uint64_t pb_tl_get64 (const unsigned char *p){
+	return (pb_tl_get32 (p) | ((uint64_t)pb_tl_get32 (p + 4) << 32));
+}
+
+/* Read a LEB128 varint at *p (not beyond end). Returns 0, or -1 if it is damaged */
+static int pb_tl_get_varint (const unsigned char **p, const unsigned char *end, uint64_t *x){
+	const unsigned char *q = *p;
+	int shift = 0;
+
+	*x = 0;
+	do {
+		if ((q == end) || (shift > 63)){
+			return (-1);
+		}
+		*x |= (uint64_t)(*q & 0x7f) << shift;
+		shift += 7;
+	} while (*q++ & 0x80);
+	*p = q;
+	return (0);
+}
+
+
+/* Formatting the .pbsim lines, exactly as pb_parse and pb_sim do */
+
+static char *pb_tl_put_str (char *p, const char *s){
+	while (*s){
+		*p++ = *s++;
+	}
+	return (p);
+}
+
+static char *pb_tl_put_dec (char *p, unsigned long long x){
+	char digits[24], *d = digits + sizeof(digits);
+	size_t n;
+
+	do {
+		*--d = '0' + (x % 10);
+		x /= 10;
+	} while (x);
+	n = digits + sizeof(digits) - d;
+	memcpy (p, d, n);
+	return (p + n);
+}
+
+/* 0x, and at least min hex digits (as "0x%06x" or "0x%x") */
+static char *pb_tl_put_hex (char *p, uint32_t x, int min){
+	static const char hex[] = "0123456789abcdef";
+	int digits = 1;
+
+	while ((digits < 8) && (x >> (4 * digits))){
+		digits++;
+	}
+	if (digits < min){
+		digits = min;
+	}
+	*p++ = '0';
+	*p++ = 'x';
+	while (digits--){
+		*p++ = hex[(x >> (4 * digits)) & 0xf];
+	}
+	return (p);
+}
+
+/* A data line, with its newline */
+static char *pb_tl_put_data (char *p, uint32_t output, uint64_t length_ns){
+	p = pb_tl_put_hex (p, output, 6);
+	*p++ = '\t';
+	p = pb_tl_put_dec (p, length_ns);
+	*p++ = '\n';
+	return (p);
+}
+
+/* The line(s) for ev (at the time and step given, with tick_ps picoseconds per tick), with their newlines. A MARK is formatted only
+ * as far as "cmt=": the comment, and the newline, are for the caller to add */
+static char *pb_tl_format (char *p, const struct pb_tl_event *ev, unsigned long tick_ps){
+	uint64_t ticks;
+
+	switch (ev->type){
+		case PB_TL_DATA:
+			if (ev->wait){
+				p = pb_tl_put_str (p, PB_TL_WAIT_LINE "\n");
+				p = pb_tl_put_hex (p, ev->output, 6);
+				p = pb_tl_put_str (p, "\t0x0\n");
+			}
+			p = pb_tl_put_data (p, ev->output, ev->length_ns);
+			break;
+		case PB_TL_MARK:
+			ticks = (tick_ps % 1000 == 0) ? ev->time_ns / (tick_ps / 1000) : ev->time_ns * 1000 / tick_ps;
+			p = pb_tl_put_str (p, PB_TL_MARK_PREFIX);
+			p = pb_tl_put_dec (p, ev->step);
+			p = pb_tl_put_str (p, "\tticks=");
+			p = pb_tl_put_dec (p, ticks);
+			p = pb_tl_put_str (p, "\tns=");
+			p = pb_tl_put_dec (p, ev->time_ns);
+			p = pb_tl_put_str (p, "\tpc=");
+			p = pb_tl_put_dec (p, ev->pc);
+			p = pb_tl_put_str (p, "\tvisit=");
+			p = pb_tl_put_dec (p, ev->visit);
+			p = pb_tl_put_str (p, "\tlength=");
+			p = pb_tl_put_dec (p, ev->length);
+			p = pb_tl_put_str (p, "\tout=");
+			p = pb_tl_put_hex (p, ev->output, 1);
+			p = pb_tl_put_str (p, "\tcmt=");
+			break;
+		case PB_TL_STOP:
+			p = pb_tl_put_str (p, PB_TL_STOP_LINE "\n");
+			break;
+	}
+	return (p);
+}
+
+
+/* Writing */
+
+/* Write out what is in the buffer */
+static void pb_tl_flush (struct pb_tl_writer *w){
+	w->crc = pb_crc32 (w->crc, w->buf, w->len);
+	if ((w->len) && (fwrite (w->buf, 1, w->len, w->fh) != w->len)){
+		w->error = 1;
+	}
+	w->offset += w->len;
+	w->len = 0;
+}
+
+/* Make room for n bytes (at most PB_TL_BUFSIZE) */
+static unsigned char *pb_tl_reserve (struct pb_tl_writer *w, size_t n){
+	if (w->len + n > PB_TL_BUFSIZE){
+		pb_tl_flush (w);
+	}
+	return (w->buf + w->len);
+}
+
+static void pb_tl_out_bytes (struct pb_tl_writer *w, const void *data, size_t n){
+	const unsigned char *d = data;
+	size_t chunk;
+
+	while (n){
+		chunk = (n < PB_TL_BUFSIZE) ? n : PB_TL_BUFSIZE;
+		memcpy (pb_tl_reserve (w, chunk), d, chunk);
+		w->len += chunk;
+		d += chunk;
+		n -= chunk;
+	}
+}
+
+static void pb_tl_out_varint (struct pb_tl_writer *w, uint64_t x){
+	unsigned char *p = pb_tl_reserve (w, 10), *start = p;
+
+	do {
+		*p++ = (x & 0x7f) | ((x > 0x7f) ? 0x80 : 0);
+		x >>= 7;
+	} while (x);
+	w->len += p - start;
+}
+
+static void pb_tl_out_tag (struct pb_tl_writer *w, unsigned int tag){
+	*pb_tl_reserve (w, 1) = tag;
+	w->len++;
+}
+
+/* Move on the state past a DATA */
+static void pb_tl_advance (struct pb_tl_state *state, uint32_t output, uint64_t length_ns){
+	unsigned int i;
+
+	state->output = output;
+	for (i = 0; (i < PB_TL_RECENT - 1) && (state->recent[i] != length_ns); i++);
+	memmove (state->recent + 1, state->recent, i * sizeof(state->recent[0]));
+	state->recent[0] = length_ns;
+}
+
+/* Write one record, as it is */
+static void pb_tl_out_item (struct pb_tl_writer *w, const struct pb_tl_item *it){
+	unsigned int tag = it->type, code, i;
+
+	switch (it->type){
+		case PB_TL_DATA:
+			for (i = 0; (i < PB_TL_RECENT) && (w->state.recent[i] != it->length_ns); i++);
+			if (i < PB_TL_RECENT){
+				code = PB_TL_LENGTH_RECENT + i;
+			}else if ((PB_TL_TICK_PS % 1000 == 0) && (it->length_ns % (PB_TL_TICK_PS / 1000) == 0)){
+				code = PB_TL_LENGTH_TICKS;
+			}else{
+				code = PB_TL_LENGTH_NS;
+			}
+			tag |= (it->output == w->state.output) ? PB_TL_FLAG_SAME_OUTPUT : 0;
+			tag |= it->wait ? PB_TL_FLAG_WAIT : 0;
+			tag |= code << PB_TL_LENGTH_SHIFT;
+			pb_tl_out_tag (w, tag);
+			if (!(tag & PB_TL_FLAG_SAME_OUTPUT)){
+				pb_tl_out_varint (w, it->output ^ w->state.output);
+			}
+			if (code == PB_TL_LENGTH_TICKS){
+				pb_tl_out_varint (w, it->length_ns / (PB_TL_TICK_PS / 1000));
+			}else if (code == PB_TL_LENGTH_NS){
+				pb_tl_out_varint (w, it->length_ns);
+			}
+			pb_tl_advance (&w->state, it->output, it->length_ns);
+			break;
+		case PB_TL_MARK:
+			pb_tl_out_tag (w, tag);
+			pb_tl_out_varint (w, it->pc);
+			pb_tl_out_varint (w, it->output);
+			pb_tl_out_varint (w, it->length);
+			pb_tl_out_varint (w, w->string_lens[it->text]);
+			pb_tl_out_bytes (w, w->strings[it->text], w->string_lens[it->text]);
+			break;
+		case PB_TL_STOP:
+			pb_tl_out_tag (w, tag);
+			break;
+	}
+}
+
+/* The repeat being followed has ended: write it, as a COPY if it is long enough */
+static void pb_tl_end_match (struct pb_tl_writer *w){
+	uint64_t i;
+
+	if (w->match_len >= PB_TL_MIN_COPY){
+		pb_tl_out_tag (w, PB_TL_COPY);
+		pb_tl_out_varint (w, w->match_dist);
+		pb_tl_out_varint (w, w->match_len);
+		w->state = w->match_state;
+	}else{
+		for (i = w->pos - w->match_len; i < w->pos; i++){
+			pb_tl_out_item (w, &w->hist[i % PB_TL_WINDOW]);
+		}
+	}
+	w->match_len = 0;
+}
+
+/* Begin a block: index it, forget the history, and say how often each MARK has been reached */
+static void pb_tl_begin_block (struct pb_tl_writer *w){
+	struct pb_tl_index *index;
+	unsigned int i;
+
+	pb_tl_end_match (w);
+	if (w->nindex == w->index_size){
+		w->index_size = w->index_size ? w->index_size * 2 : 256;
+		if ((index = realloc (w->index, w->index_size * sizeof(*index))) == NULL){
+			w->error = 1;
+			return;
+		}
+		w->index = index;
+	}
+	w->index[w->nindex].offset = w->offset + w->len;
+	w->index[w->nindex].item = w->items;
+	w->index[w->nindex].step = w->steps;
+	w->index[w->nindex].time_ns = w->time_ns;
+	w->nindex++;
+
+	w->pos = 0;
+	memset (w->hash, 0, sizeof(w->hash));
+	memset (&w->state, 0, sizeof(w->state));
+	if (w->nmarks){
+		pb_tl_out_tag (w, PB_TL_VISITS);
+		pb_tl_out_varint (w, w->nmarks);
+		for (i = 0; i < w->nmarks; i++){
+			pb_tl_out_varint (w, w->marks[i]);
+			pb_tl_out_varint (w, w->visits[w->marks[i]]);
+		}
+	}
+}
+
+/* FNV-1a */
+static uint32_t pb_tl_hash_bytes (const char *s, size_t n){
+	uint32_t h = 2166136261u;
+
+	while (n--){
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	}
+	return (h);
+}
+
+/* The string (n bytes at s), kept once: returns its index (from 1), or 0 if out of memory */
+static uint32_t pb_tl_intern (struct pb_tl_writer *w, const char *s, size_t n){
+	uint32_t h, i, j, *table;
+	char **strings;
+	size_t *lens;
+
+	if (w->nstrings + 1 >= w->strings_size){
+		w->strings_size = w->strings_size ? w->strings_size * 2 : 64;
+		strings = realloc (w->strings, w->strings_size * sizeof(*strings));
+		if (strings){
+			w->strings = strings;
+		}
+		lens = realloc (w->string_lens, w->strings_size * sizeof(*lens));
+		if (lens){
+			w->string_lens = lens;
+		}
+		free (w->string_hash);		/* Twice as many slots as strings: rebuild it */
+		w->string_hash_size = w->strings_size * 2;
+		w->string_hash = calloc (w->string_hash_size, sizeof(*w->string_hash));
+		if ((!strings) || (!lens) || (!w->string_hash)){
+			return (0);
+		}
+		for (j = 1; j <= w->nstrings; j++){
+			for (i = pb_tl_hash_bytes (w->strings[j], w->string_lens[j]) & (w->string_hash_size - 1); w->string_hash[i]; i = (i + 1) & (w->string_hash_size - 1));
+			w->string_hash[i] = j;
+		}
+	}
+	table = w->string_hash;
+	h = pb_tl_hash_bytes (s, n);
+	for (i = h & (w->string_hash_size - 1); table[i]; i = (i + 1) & (w->string_hash_size - 1)){
+		j = table[i];
+		if ((w->string_lens[j] == n) && (!memcmp (w->strings[j], s, n))){
+			return (j);
+		}
+	}
+	j = ++w->nstrings;
+	if ((w->strings[j] = malloc (n + 1)) == NULL){
+		w->nstrings--;
+		return (0);
+	}
+	memcpy (w->strings[j], s, n);
+	w->strings[j][n] = '\0';
+	w->string_lens[j] = n;
+	table[i] = j;
+	return (j);
+}
+
+static uint32_t pb_tl_hash_item (const struct pb_tl_item *it){
+	uint64_t h;
+
+	h = (it->output * 0x9e3779b97f4a7c15ULL) ^ (it->length_ns * 0xc2b2ae3d27d4eb4fULL) ^ ((uint64_t)it->pc << 32) ^ ((uint64_t)it->length << 16)
+		^ ((uint64_t)it->text << 40) ^ it->type ^ ((uint64_t)it->wait << 8);
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return (h & (PB_TL_WINDOW - 1));
+}
+
+static int pb_tl_same_item (const struct pb_tl_item *a, const struct pb_tl_item *b){
+	return ((a->type == b->type) && (a->output == b->output) && (a->length_ns == b->length_ns) && (a->wait == b->wait) && (a->pc == b->pc)
+		&& (a->length == b->length) && (a->text == b->text));
+}
+
+/* Start writing. See pb_timeline.h */
+struct pb_tl_writer *pb_tl_writer_new (FILE *fh, FILE *log){
+	struct pb_tl_writer *w;
+	unsigned char header[PB_TL_HEADER_LEN];
+
+	if ((w = calloc (1, sizeof(*w))) == NULL){
+		if (log) fprintf (log, "Error: out of memory, for the timeline writer.\n");
+		return (NULL);
+	}
+	w->fh = fh;
+	w->log = log;
+	w->visits = calloc (PB_MEMORY, sizeof(*w->visits));
+	w->marks = calloc (PB_MEMORY, sizeof(*w->marks));
+	w->period = malloc (PB_TL_WINDOW * sizeof(*w->period));
+	if ((!w->visits) || (!w->marks) || (!w->period)){
+		if (log) fprintf (log, "Error: out of memory, for the timeline writer.\n");
+		free (w->visits);
+		free (w->marks);
+		free (w->period);
+		free (w);
+		return (NULL);
+	}
+
+	memset (header, 0, sizeof(header));
+	memcpy (header, PB_TL_MAGIC, PB_TL_MAGIC_LEN);
+	header[PB_TL_OFF_VERSION] = PB_TL_VERSION;
+	header[PB_TL_OFF_HEADER_LEN] = PB_TL_HEADER_LEN;
+	pb_tl_put32 (header + PB_TL_OFF_FLAGS, 0);
+	pb_tl_put32 (header + PB_TL_OFF_TICK_PS, PB_TL_TICK_PS);
+	pb_tl_put32 (header + PB_TL_OFF_BLOCK, PB_TL_BLOCK);
+	pb_tl_put32 (header + PB_TL_OFF_WINDOW, PB_TL_WINDOW);
+	if (fwrite (header, 1, sizeof(header), fh) != sizeof(header)){
+		if (log) fprintf (log, "Error: could not write the timeline header.\n");
+		free (w->visits);
+		free (w->marks);
+		free (w->period);
+		free (w);
+		return (NULL);
+	}
+	w->offset = PB_TL_HEADER_LEN;
+	return (w);
+}
+
+/* Add a record (it, with text if it is TEXT): begin a block if it is time to, count it, then follow a repeat, or look for one */
+static int pb_tl_add (struct pb_tl_writer *w, struct pb_tl_item *it, const char *text, size_t text_len){
+	struct pb_tl_item *match;
+	uint32_t h, q;
+
+	if (w->items % PB_TL_BLOCK == 0){
+		pb_tl_begin_block (w);
+	}
+	switch (it->type){
+		case PB_TL_DATA:
+			w->steps++;
+			w->time_ns += it->length_ns;
+			break;
+		case PB_TL_MARK:
+			if (w->visits[it->pc]++ == 0){
+				w->marks[w->nmarks++] = it->pc;
+			}
+			break;
+		case PB_TL_TEXT:		/* Never repeated: written at once */
+			pb_tl_end_match (w);
+			pb_tl_out_tag (w, PB_TL_TEXT);
+			pb_tl_out_varint (w, text_len);
+			pb_tl_out_bytes (w, text, text_len);
+			it->text = ~0U;		/* (Matches nothing) */
+			break;
+	}
+	w->items++;
+
+	w->hist[w->pos % PB_TL_WINDOW] = *it;
+	if (w->match_len){
+		match = &w->hist[(w->pos - w->match_dist) % PB_TL_WINDOW];
+		if (pb_tl_same_item (it, match)){
+			w->match_len++;
+			if (it->type == PB_TL_DATA){
+				pb_tl_advance (&w->match_state, it->output, it->length_ns);
+			}
+			w->hash[pb_tl_hash_item (it)] = w->pos + 1;
+			w->pos++;
+			return (w->error ? -1 : 0);
+		}
+		pb_tl_end_match (w);
+	}
+	if (it->type != PB_TL_TEXT){
+		h = pb_tl_hash_item (it);
+		q = w->hash[h];
+		if ((q) && (w->pos - (q - 1) < PB_TL_WINDOW) && (pb_tl_same_item (it, &w->hist[(q - 1) % PB_TL_WINDOW]))){
+			w->match_dist = w->pos - (q - 1);
+			w->match_len = 1;
+			w->match_state = w->state;
+			if (it->type == PB_TL_DATA){
+				pb_tl_advance (&w->match_state, it->output, it->length_ns);
+			}
+		}else{
+			pb_tl_out_item (w, it);
+		}
+		w->hash[h] = w->pos + 1;
+	}
+	w->pos++;
+	return (w->error ? -1 : 0);
+}
+
+/* Add an event. See pb_timeline.h */
+int pb_tl_write (struct pb_tl_writer *w, const struct pb_tl_event *ev){
+	struct pb_tl_item it;
+
+	memset (&it, 0, sizeof(it));
+	it.type = ev->type;
+	switch (ev->type){
+		case PB_TL_DATA:
+			it.output = ev->output;
+			it.length_ns = ev->length_ns;
+			it.wait = (ev->wait != 0);
+			break;
+		case PB_TL_MARK:
+			if (ev->pc >= PB_MEMORY){
+				if (w->log) fprintf (w->log, "Error: timeline MARK at address %u, which is beyond the end of memory.\n", (unsigned int)ev->pc);
+				return (-1);
+			}
+			it.output = ev->output;
+			it.pc = ev->pc;
+			it.length = ev->length;
+			if ((it.text = pb_tl_intern (w, ev->text ? ev->text : "", ev->text ? ev->text_len : 0)) == 0){
+				w->error = 1;
+				return (-1);
+			}
+			break;
+		case PB_TL_STOP:
+		case PB_TL_TEXT:
+			break;
+		default:
+			if (w->log) fprintf (w->log, "Error: timeline event of unknown type %d.\n", ev->type);
+			return (-1);
+	}
+	return (pb_tl_add (w, &it, ev->text, ev->text_len));
+}
+
+/* Repeat. See pb_timeline.h
+ * The repeats are COPY records, of distance n, up to the end of each block. A new block can't reach back into the one before: so it
+ * begins with the period (from wherever in it the block begins) written out, and the COPY goes on from there. Everything else which
+ * the records would change is worked out from the period: the steps, time and MARK visits (for the index, and the VISITS at the
+ * start of each block) by multiplying up; the recent lengths, by advancing past the last period of records only (since every length
+ * in the period is moved to the front by each repeat of it, only the last one decides their order); and the history, only where the
+ * repeats end (a block which they fill is forgotten by the next). So it costs O(n) per block, however many times it repeats */
+int pb_tl_write_repeat (struct pb_tl_writer *w, uint64_t n, uint64_t times){
+	struct pb_tl_item *period = w->period, *it;
+	uint64_t left, count, whole, period_steps = 0, period_ns = 0, i, j, phase = 0;
+
+	if ((n == 0) || (times == 0)){
+		return (0);
+	}
+	if ((n > w->pos) || (n >= PB_TL_WINDOW) || (times > ~0ULL / n)){
+		return (-1);
+	}
+	for (i = 0; i < n; i++){
+		period[i] = w->hist[(w->pos - n + i) % PB_TL_WINDOW];
+		if ((period[i].type != PB_TL_DATA) && (period[i].type != PB_TL_MARK)){
+			return (-1);		/* (TEXT is never repeated, and a STOP is the last record) */
+		}
+		if (period[i].type == PB_TL_DATA){
+			period_steps++;
+			period_ns += period[i].length_ns;
+		}
+	}
+
+	pb_tl_end_match (w);
+	for (left = n * times; left; left -= count){
+		if (w->items % PB_TL_BLOCK == 0){	/* A new block: write out the period, from the phase which begins it */
+			for (count = 0; (count < n) && (count < left); count++){
+				it = &period[(phase + count) % n];
+				if (pb_tl_add (w, it, NULL, 0) != 0){
+					return (-1);
+				}
+			}
+			pb_tl_end_match (w);
+			phase = (phase + count) % n;
+			continue;
+		}
+		count = PB_TL_BLOCK - w->items % PB_TL_BLOCK;
+		if (count > left){
+			count = left;
+		}
+		pb_tl_out_tag (w, PB_TL_COPY);
+		pb_tl_out_varint (w, n);
+		pb_tl_out_varint (w, count);
+
+		whole = count / n;
+		w->steps += whole * period_steps;
+		w->time_ns += whole * period_ns;
+		for (i = 0; i < n; i++){		/* Each record of the period is in the count whole times, or once more */
+			it = &period[i];
+			j = whole + ((i + n - phase) % n < count % n);
+			if (it->type == PB_TL_DATA){
+				w->steps += j - whole;
+				w->time_ns += (j - whole) * it->length_ns;
+			}else{
+				w->visits[it->pc] += j;
+			}
+		}
+		if (count == left){			/* (Else the block ends here, and the next forgets them) */
+			for (i = (count > n) ? count - n : 0; i < count; i++){	/* The last period of them decides the state */
+				it = &period[(phase + i) % n];
+				if (it->type == PB_TL_DATA){
+					pb_tl_advance (&w->state, it->output, it->length_ns);
+				}
+			}
+			for (i = (count > PB_TL_WINDOW) ? count - PB_TL_WINDOW : 0; i < count; i++){	/* ... and are the history */
+				it = &period[(phase + i) % n];
+				w->hist[(w->pos + i) % PB_TL_WINDOW] = *it;
+				if (i + n >= count){
+					w->hash[pb_tl_hash_item (it)] = w->pos + i + 1;
+				}
+			}
+		}
+		w->items += count;
+		w->pos += count;
+		phase = (phase + count) % n;
+	}
+	return (w->error ? -1 : 0);
+}
+
+/* Add lines of text. See pb_timeline.h */
+int pb_tl_write_text (struct pb_tl_writer *w, const char *text){
+	struct pb_tl_event ev;
+	const char *nl;
+
+	memset (&ev, 0, sizeof(ev));
+	ev.type = PB_TL_TEXT;
+	while (*text){
+		nl = strchr (text, '\n');
+		ev.text = text;
+		ev.text_len = nl ? (size_t)(nl - text) : strlen (text);
+		if (pb_tl_write (w, &ev) != 0){
+			return (-1);
+		}
+		text += ev.text_len + (nl != NULL);
+	}
+	return (0);
+}
+
+/* Finish. See pb_timeline.h */
+int pb_tl_writer_close (struct pb_tl_writer *w){
+	unsigned char entry[PB_TL_INDEX_ENTRY_LEN], footer[PB_TL_FOOTER_LEN];
+	uint64_t index_offset;
+	uint32_t i;
+	size_t n;
+	int ret;
+
+	pb_tl_end_match (w);
+	index_offset = w->offset + w->len;
+	for (n = 0; n < w->nindex; n++){
+		pb_tl_put64 (entry, w->index[n].offset);
+		pb_tl_put64 (entry + 8, w->index[n].item);
+		pb_tl_put64 (entry + 16, w->index[n].step);
+		pb_tl_put64 (entry + 24, w->index[n].time_ns);
+		pb_tl_out_bytes (w, entry, sizeof(entry));
+	}
+	pb_tl_put64 (footer + PB_TL_OFF_INDEX, index_offset);
+	pb_tl_put64 (footer + PB_TL_OFF_BLOCKS, w->nindex);
+	pb_tl_put64 (footer + PB_TL_OFF_ITEMS, w->items);
+	pb_tl_put64 (footer + PB_TL_OFF_STEPS, w->steps);
+	pb_tl_put64 (footer + PB_TL_OFF_TIME, w->time_ns);
+	pb_tl_out_bytes (w, footer, PB_TL_OFF_CRC);
+	pb_tl_flush (w);			/* The CRC covers everything up to itself */
+	pb_tl_put32 (footer + PB_TL_OFF_CRC, w->crc);
+	memcpy (footer + PB_TL_OFF_END_MAGIC, PB_TL_END_MAGIC, 4);
+	if (fwrite (footer + PB_TL_OFF_CRC, 1, PB_TL_FOOTER_LEN - PB_TL_OFF_CRC, w->fh) != PB_TL_FOOTER_LEN - PB_TL_OFF_CRC){
+		w->error = 1;
+	}
+	if (fflush (w->fh) != 0){
+		w->error = 1;
+	}
+	ret = w->error ? -1 : 0;
+
+	for (i = 1; i <= w->nstrings; i++){
+		free (w->strings[i]);
+	}
+	free (w->strings);
+	free (w->string_lens);
+	free (w->string_hash);
+	free (w->index);
+	free (w->visits);
+	free (w->marks);
+	free (w->period);
+	free (w);
+	return (ret);
+}
+
+
+/* Reading */
+
+/* Is it a .pbtl? See pb_timeline.h */
+int pb_tl_is_timeline (const unsigned char *buf, size_t len){
+	return ((len >= PB_TL_MAGIC_LEN) && (!memcmp (buf, PB_TL_MAGIC, PB_TL_MAGIC_LEN)));
+}
+
+/* Open, and check. See pb_timeline.h */
+int pb_tl_reader_open (struct pb_tl_reader *r, const unsigned char *buf, size_t len, FILE *log){
+	const unsigned char *footer;
+	unsigned int header_len;
+	uint64_t index_offset;
+
+	memset (r, 0, sizeof(*r));
+	r->buf = buf;
+	r->len = len;
+	r->log = log;
+	if (!pb_tl_is_timeline (buf, len)){
+		if (log) fprintf (log, "Error: this isn't a timeline (.pbtl) file: it doesn't begin with the magic number.\n");
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	if (len < PB_TL_HEADER_LEN + PB_TL_FOOTER_LEN){
+		if (log) fprintf (log, "Error: timeline file is truncated: it has only %lu bytes.\n", (unsigned long)len);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	r->version = buf[PB_TL_OFF_VERSION] | (buf[PB_TL_OFF_VERSION + 1] << 8);
+	header_len = buf[PB_TL_OFF_HEADER_LEN] | (buf[PB_TL_OFF_HEADER_LEN + 1] << 8);
+	if ((r->version > PB_TL_VERSION) || (r->version == 0) || (header_len < PB_TL_HEADER_LEN) || (header_len > len - PB_TL_FOOTER_LEN)){
+		if (log) fprintf (log, "Error: timeline file has format version %u (header %u bytes), but this pb_utils only understands up to version %d.\n",
+			r->version, header_len, PB_TL_VERSION);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	r->tick_ps = pb_tl_get32 (buf + PB_TL_OFF_TICK_PS);
+	r->block = pb_tl_get32 (buf + PB_TL_OFF_BLOCK);
+	r->window = pb_tl_get32 (buf + PB_TL_OFF_WINDOW);
+	if ((r->tick_ps == 0) || (r->block == 0) || (r->window == 0) || (r->window > PB_TL_WINDOW_MAX)){
+		if (log) fprintf (log, "Error: timeline file has a bad header (tick %lu ps, block %lu, window %lu).\n",
+			r->tick_ps, (unsigned long)r->block, (unsigned long)r->window);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+
+	footer = buf + len - PB_TL_FOOTER_LEN;
+	if (memcmp (footer + PB_TL_OFF_END_MAGIC, PB_TL_END_MAGIC, 4)){
+		if (log) fprintf (log, "Error: timeline file is truncated: it has no footer (was the writer interrupted?).\n");
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	index_offset = pb_tl_get64 (footer + PB_TL_OFF_INDEX);
+	r->blocks = pb_tl_get64 (footer + PB_TL_OFF_BLOCKS);
+	r->total_items = pb_tl_get64 (footer + PB_TL_OFF_ITEMS);
+	r->total_steps = pb_tl_get64 (footer + PB_TL_OFF_STEPS);
+	r->total_ns = pb_tl_get64 (footer + PB_TL_OFF_TIME);
+	if ((index_offset < header_len) || (index_offset > len - PB_TL_FOOTER_LEN) || (r->blocks != (len - PB_TL_FOOTER_LEN - index_offset) / PB_TL_INDEX_ENTRY_LEN)
+			|| ((len - PB_TL_FOOTER_LEN - index_offset) % PB_TL_INDEX_ENTRY_LEN)){
+		if (log) fprintf (log, "Error: timeline file is %lu bytes long, but its footer doesn't fit (index at %llu, of %llu blocks).\n",
+			(unsigned long)len, (unsigned long long)index_offset, (unsigned long long)r->blocks);
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	if (pb_crc32 (0, buf + header_len, len - header_len - (PB_TL_FOOTER_LEN - PB_TL_OFF_CRC)) != pb_tl_get32 (footer + PB_TL_OFF_CRC)){
+		if (log) fprintf (log, "Error: timeline file is corrupt: its CRC is wrong.\n");
+		return (PB_ERROR_BADVLIWFILE);
+	}
+	r->index = buf + index_offset;
+	r->end = r->index;
+
+	r->hist = malloc ((size_t)r->window * sizeof(*r->hist));
+	r->visits = malloc (PB_MEMORY * sizeof(*r->visits));
+	if ((!r->hist) || (!r->visits)){
+		if (log) fprintf (log, "Error: out of memory, for the timeline reader.\n");
+		pb_tl_reader_close (r);
+		return (PB_ERROR_GENERIC);
+	}
+	pb_tl_rewind (r);
+	return (0);
+}
+
+void pb_tl_reader_close (struct pb_tl_reader *r){
+	free (r->hist);
+	free (r->visits);
+	r->hist = NULL;
+	r->visits = NULL;
+}
+
+/* Start decoding at block b (the first may also be at the start of the records) */
+static int pb_tl_goto_block (struct pb_tl_reader *r, uint64_t b){
+	const unsigned char *e = r->index + b * PB_TL_INDEX_ENTRY_LEN;
+	uint64_t offset = pb_tl_get64 (e);
+
+	if ((offset < (uint64_t)(r->buf[PB_TL_OFF_HEADER_LEN] | (r->buf[PB_TL_OFF_HEADER_LEN + 1] << 8))) || (offset > (uint64_t)(r->end - r->buf))){
+		return (-1);
+	}
+	r->p = r->buf + offset;
+	r->item = pb_tl_get64 (e + 8);
+	r->step = pb_tl_get64 (e + 16);
+	r->time_ns = pb_tl_get64 (e + 24);
+	r->pos = 0;
+	r->copy_left = 0;
+	memset (&r->state, 0, sizeof(r->state));
+	r->has_pending = 0;
+	memset (r->visits, 0, PB_MEMORY * sizeof(*r->visits));
+	return (0);
+}
+
+/* Back to the beginning. See pb_timeline.h */
+void pb_tl_rewind (struct pb_tl_reader *r){
+	if ((r->blocks == 0) || (pb_tl_goto_block (r, 0) != 0)){
+		r->p = r->end;		/* Empty (or damaged, which pb_tl_next() then can't see: but the CRC was right) */
+		r->has_pending = 0;
+		r->copy_left = 0;
+	}
+}
+
+static int pb_tl_damaged (struct pb_tl_reader *r){
+	if (r->log) fprintf (r->log, "Error: timeline file is damaged, at byte %lu (record %llu).\n", (unsigned long)(r->p - r->buf), (unsigned long long)r->item);
+	return (-1);
+}
+
+/* The next event. See pb_timeline.h */
+int pb_tl_next (struct pb_tl_reader *r, struct pb_tl_event *ev){
+	uint64_t x, y, n;
+	unsigned int tag, code;
+
+	if (r->has_pending){
+		*ev = r->pending;
+		r->has_pending = 0;
+		return (1);
+	}
+	if (r->copy_left){
+		*ev = r->hist[(r->pos - r->copy_dist) % r->window];
+		r->copy_left--;
+		goto emit;
+	}
+	if (r->pos == r->block){		/* The next block (which the writer began exactly here) */
+		r->pos = 0;
+		memset (&r->state, 0, sizeof(r->state));
+	}
+	for (;;){
+		if (r->p >= r->end){
+			return (0);
+		}
+		memset (ev, 0, sizeof(*ev));
+		tag = *r->p++;
+		ev->type = tag & PB_TL_TYPE_MASK;
+		switch (ev->type){
+			case PB_TL_DATA:
+				ev->output = r->state.output;
+				ev->wait = ((tag & PB_TL_FLAG_WAIT) != 0);
+				if (!(tag & PB_TL_FLAG_SAME_OUTPUT)){
+					if ((pb_tl_get_varint (&r->p, r->end, &x) != 0) || (x >> 32)){
+						return (pb_tl_damaged (r));
+					}
+					ev->output ^= x;
+				}
+				code = tag >> PB_TL_LENGTH_SHIFT;
+				if (code >= PB_TL_LENGTH_RECENT){
+					ev->length_ns = r->state.recent[code - PB_TL_LENGTH_RECENT];
+				}else if (pb_tl_get_varint (&r->p, r->end, &ev->length_ns) != 0){
+					return (pb_tl_damaged (r));
+				}else if (code == PB_TL_LENGTH_TICKS){
+					ev->length_ns = ev->length_ns * r->tick_ps / 1000;
+				}
+				goto emit;
+			case PB_TL_MARK:
+				if ((pb_tl_get_varint (&r->p, r->end, &x) != 0) || (x >= PB_MEMORY)){
+					return (pb_tl_damaged (r));
+				}
+				ev->pc = x;
+				if ((pb_tl_get_varint (&r->p, r->end, &x) != 0) || (x >> 32) || (pb_tl_get_varint (&r->p, r->end, &y) != 0) || (y >> 32)){
+					return (pb_tl_damaged (r));
+				}
+				ev->output = x;
+				ev->length = y;
+				if ((pb_tl_get_varint (&r->p, r->end, &n) != 0) || (n > (uint64_t)(r->end - r->p))){
+					return (pb_tl_damaged (r));
+				}
+				ev->text = (const char *)r->p;
+				ev->text_len = n;
+				r->p += n;
+				goto emit;
+			case PB_TL_STOP:
+				goto emit;
+			case PB_TL_TEXT:
+				if ((pb_tl_get_varint (&r->p, r->end, &n) != 0) || (n > (uint64_t)(r->end - r->p))){
+					return (pb_tl_damaged (r));
+				}
+				ev->text = (const char *)r->p;
+				ev->text_len = n;
+				r->p += n;
+				goto emit;
+			case PB_TL_COPY:
+				if ((pb_tl_get_varint (&r->p, r->end, &x) != 0) || (pb_tl_get_varint (&r->p, r->end, &n) != 0)
+						|| (x == 0) || (x > r->pos) || (x >= r->window) || (n == 0) || (n > r->block - r->pos)){
+					return (pb_tl_damaged (r));
+				}
+				r->copy_dist = x;
+				r->copy_left = n - 1;
+				*ev = r->hist[(r->pos - x) % r->window];
+				goto emit;
+			case PB_TL_VISITS:
+				if (pb_tl_get_varint (&r->p, r->end, &n) != 0){
+					return (pb_tl_damaged (r));
+				}
+				while (n--){
+					if ((pb_tl_get_varint (&r->p, r->end, &x) != 0) || (x >= PB_MEMORY) || (pb_tl_get_varint (&r->p, r->end, &y) != 0)){
+						return (pb_tl_damaged (r));
+					}
+					r->visits[x] = y;
+				}
+				break;
+			default:
+				r->p--;
+				return (pb_tl_damaged (r));
+		}
+	}
+
+emit:
+	ev->item = r->item++;
+	ev->step = r->step;
+	ev->time_ns = r->time_ns;
+	switch (ev->type){
+		case PB_TL_DATA:
+			r->step++;
+			r->time_ns += ev->length_ns;
+			pb_tl_advance (&r->state, ev->output, ev->length_ns);
+			break;
+		case PB_TL_MARK:
+			ev->visit = r->visits[ev->pc]++;
+			break;
+	}
+	r->hist[r->pos % r->window] = *ev;
+	r->pos++;
+	return (1);
+}
+
+/* Seek. See pb_timeline.h */
+int pb_tl_seek (struct pb_tl_reader *r, uint64_t time_ns){
+	struct pb_tl_event ev;
+	uint64_t lo = 0, hi = r->blocks, mid;
+	int ret;
+
+	if (r->blocks == 0){
+		return (0);
+	}
+	while (hi - lo > 1){			/* The last block to begin at or before time_ns */
+		mid = lo + (hi - lo) / 2;
+		if (pb_tl_get64 (r->index + mid * PB_TL_INDEX_ENTRY_LEN + 24) <= time_ns){
+			lo = mid;
+		}else{
+			hi = mid;
+		}
+	}
+	if (pb_tl_goto_block (r, lo) != 0){
+		return (pb_tl_damaged (r));
+	}
+	while ((ret = pb_tl_next (r, &ev)) == 1){
+		if ((ev.type == PB_TL_DATA) && (ev.time_ns + ev.length_ns > time_ns)){
+			r->pending = ev;
+			r->has_pending = 1;
+			return (0);
+		}
+	}
+	return (ret);
+}
+
+
+/* Conversion */
+
+/* Write to .pbsim. See pb_timeline.h */
+int pb_tl_to_pbsim (struct pb_tl_reader *r, FILE *fh){
+	struct pb_tl_event ev;
+	char *buf, *p;
+	int ret;
+
+	if ((buf = malloc (PB_TL_BUFSIZE)) == NULL){
+		if (r->log) fprintf (r->log, "Error: out of memory, for the timeline reader.\n");
+		return (-1);
+	}
+	p = buf;
+	while ((ret = pb_tl_next (r, &ev)) == 1){
+		if (p - buf + PB_TL_LINE_MAXLEN + ev.text_len + 1 > PB_TL_BUFSIZE){
+			if (fwrite (buf, 1, p - buf, fh) != (size_t)(p - buf)){
+				ret = -1;
+				break;
+			}
+			p = buf;
+		}
+		if ((ev.type == PB_TL_TEXT) || (ev.type == PB_TL_MARK)){
+			if (ev.type == PB_TL_MARK){
+				p = pb_tl_format (p, &ev, r->tick_ps);
+			}
+			if (p - buf + ev.text_len + 1 > PB_TL_BUFSIZE){	/* A very long line: straight out */
+				if ((fwrite (buf, 1, p - buf, fh) != (size_t)(p - buf)) || (fwrite (ev.text, 1, ev.text_len, fh) != ev.text_len)){
+					ret = -1;
+					break;
+				}
+				p = buf;
+			}else{
+				memcpy (p, ev.text, ev.text_len);
+				p += ev.text_len;
+			}
+			*p++ = '\n';
+		}else{
+			p = pb_tl_format (p, &ev, r->tick_ps);
+		}
+	}
+	if ((ret == 0) && (fwrite (buf, 1, p - buf, fh) != (size_t)(p - buf))){
+		ret = -1;
+	}
+	free (buf);
+	return ((ret == 0) ? 0 : -1);
+}
+
+/* Parse a data line (from p, up to end): "0x" and hex, a tab, decimal. Returns 0, or -1 if it isn't one */
+static int pb_tl_parse_data (const char *p, const char *end, uint32_t *output, uint64_t *length_ns){
+	uint64_t x = 0, y = 0;
+	int digits = 0;
+
+	if ((end - p < 2) || (p[0] != '0') || (p[1] != 'x')){
+		return (-1);
+	}
+	for (p += 2; (p < end) && (*p != '\t'); p++, digits++){
+		if ((digits >= 8) || !(((*p >= '0') && (*p <= '9')) || ((*p >= 'a') && (*p <= 'f')))){
+			return (-1);
+		}
+		x = (x << 4) | ((*p <= '9') ? *p - '0' : *p - 'a' + 10);
+	}
+	if ((digits == 0) || (p == end)){
+		return (-1);
+	}
+	for (p++, digits = 0; p < end; p++, digits++){
+		if ((digits >= 19) || (*p < '0') || (*p > '9')){
+			return (-1);
+		}
+		y = y * 10 + (*p - '0');
+	}
+	if (digits == 0){
+		return (-1);
+	}
+	*output = x;
+	*length_ns = y;
+	return (0);
+}
+
+/* The number after name, in the line from p to end (decimal, or with hex set, "0x" and hex). Returns 0, or -1 if there isn't one */
+static int pb_tl_parse_field (const char *p, const char *end, const char *name, int hex, uint64_t *x){
+	size_t n = strlen (name);
+	int digits = 0;
+
+	for (; (p + n <= end) && (memcmp (p, name, n)); p++);
+	if (p + n > end){
+		return (-1);
+	}
+	p += n;
+	if (hex){
+		if ((end - p < 2) || (p[0] != '0') || (p[1] != 'x')){
+			return (-1);
+		}
+		p += 2;
+	}
+	for (*x = 0; (p < end) && (digits < (hex ? 8 : 19)); p++, digits++){
+		if ((*p >= '0') && (*p <= '9')){
+			*x = *x * (hex ? 16 : 10) + (*p - '0');
+		}else if ((hex) && (*p >= 'a') && (*p <= 'f')){
+			*x = *x * 16 + (*p - 'a' + 10);
+		}else{
+			break;
+		}
+	}
+	return (digits ? 0 : -1);
+}
+
+/* Convert .pbsim text. See pb_timeline.h */
+int pb_tl_from_pbsim (struct pb_tl_writer *w, const char *buf, size_t len){
+	const char *p = buf, *end = buf + len, *line, *line_end, *next, *l2, *l2_end, *l3, *l3_end, *cmt;
+	char expect[PB_TL_LINE_MAXLEN], *e;
+	struct pb_tl_event ev;
+	uint64_t x;
+
+	while (p < end){
+		line = p;
+		line_end = memchr (p, '\n', end - p);
+		next = line_end ? line_end + 1 : end;
+		line_end = line_end ? line_end : end;
+		memset (&ev, 0, sizeof(ev));
+		ev.type = PB_TL_TEXT;
+
+		if ((line_end - line == sizeof(PB_TL_STOP_LINE) - 1) && (!memcmp (line, PB_TL_STOP_LINE, line_end - line))){
+			ev.type = PB_TL_STOP;
+
+		}else if ((line_end - line == sizeof(PB_TL_WAIT_LINE) - 1) && (!memcmp (line, PB_TL_WAIT_LINE, line_end - line)) && (next < end)){
+			l2 = next;							/* Then "output 0x0", and the data line */
+			l2_end = memchr (l2, '\n', end - l2);
+			l3 = l2_end ? l2_end + 1 : end;
+			l3_end = (l3 < end) ? memchr (l3, '\n', end - l3) : NULL;
+			if ((l2_end) && (l3_end) && (pb_tl_parse_data (l3, l3_end, &ev.output, &ev.length_ns) == 0)){
+				ev.type = PB_TL_DATA;
+				ev.wait = 1;
+				e = pb_tl_format (expect, &ev, PB_TL_TICK_PS);
+				if ((e - expect == l3_end + 1 - line) && (!memcmp (expect, line, e - expect))){
+					next = l3_end + 1;
+				}else{
+					ev.type = PB_TL_TEXT;
+				}
+			}
+
+		}else if ((line_end - line > (long)sizeof(PB_TL_MARK_PREFIX) - 1) && (!memcmp (line, PB_TL_MARK_PREFIX, sizeof(PB_TL_MARK_PREFIX) - 1))){
+			for (cmt = line; (cmt + 5 <= line_end) && (memcmp (cmt, "\tcmt=", 5)); cmt++);
+			if (cmt + 5 <= line_end){
+				ev.type = PB_TL_MARK;
+				if ((pb_tl_parse_field (line, cmt, "\tpc=", 0, &x) == 0) && (x < PB_MEMORY)){
+					ev.pc = x;
+				}else{
+					ev.type = PB_TL_TEXT;
+				}
+				if ((pb_tl_parse_field (line, cmt, "\tlength=", 0, &x) == 0) && (x <= 0xffffffffULL)){
+					ev.length = x;
+				}else{
+					ev.type = PB_TL_TEXT;
+				}
+				if (pb_tl_parse_field (line, cmt, "\tout=", 1, &x) == 0){
+					ev.output = x;
+				}else{
+					ev.type = PB_TL_TEXT;
+				}
+				ev.step = w->steps;			/* What the reader will work out */
+				ev.time_ns = w->time_ns;
+				ev.visit = w->visits[ev.pc];
+				e = pb_tl_format (expect, &ev, PB_TL_TICK_PS);
+				if ((ev.type == PB_TL_MARK) && (e - expect == cmt + 5 - line) && (!memcmp (expect, line, e - expect))){
+					ev.text = cmt + 5;
+					ev.text_len = line_end - (cmt + 5);
+				}else{
+					ev.type = PB_TL_TEXT;
+				}
+			}
+
+		}else if ((line_end < end) && (pb_tl_parse_data (line, line_end, &ev.output, &ev.length_ns) == 0)){
+			ev.type = PB_TL_DATA;
+			e = pb_tl_format (expect, &ev, PB_TL_TICK_PS);
+			if ((e - expect != line_end + 1 - line) || (memcmp (expect, line, e - expect))){
+				ev.type = PB_TL_TEXT;
+			}
+		}
+
+		if (ev.type == PB_TL_TEXT){
+			ev.text = line;
+			ev.text_len = line_end - line;
+		}
+		if (pb_tl_write (w, &ev) != 0){
+			return (-1);
+		}
+		p = next;
+	}
+	return (0);
+}
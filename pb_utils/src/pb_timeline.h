@@ -0,0 +1,204 @@
+/* This is pb_timeline.h, the interface to the binary timeline format (pb_timeline.c), which is part of libpulseblaster.
+ * A .pbtl file holds exactly what a simulation replay log (.pbsim: see pb_parse/doc/pbsim.txt) holds, but several times smaller, or
+ * (for a program with loops) thousands of times smaller, and it can be read without being parsed:
+ *   - Each line is a record: the output is XORed with the previous one (and left out if it's the same); the length (which is the
+ *     timestamp delta) is either one of the last few lengths, given by the tag byte, or a varint, in ticks. MARK, WAIT and STOP lines
+ *     are records too, and any other line is kept verbatim.
+ *   - A run of records which repeats (one record, or a whole loop body) is a single COPY record: "the last D records, again, N times".
+ *     A writer which already knows that the records repeat (the simulator, fast-forwarding a loop) says so: pb_tl_write_repeat().
+ *   - The records are in blocks (of PB_TL_BLOCK records), each of which can be decoded on its own; an index of the blocks, at the
+ *     end of the file, gives the record number, step and time at which each begins: so pb_tl_seek() is a binary search, then at most
+ *     one block.
+ * See doc/pbtl.txt for the layout. pb_tl (the tool) converts .pbsim to .pbtl and back, exactly; pb_sim writes it directly.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#ifndef PB_TIMELINE_H
+#define PB_TIMELINE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
+
+#define PB_TL_MAGIC		"\x89PBTL\r\n\x1a"	/* As PNG (and pb_image.h's PB_IMAGE_MAGIC) */
+#define PB_TL_MAGIC_LEN		8
+#define PB_TL_END_MAGIC		"PBTL"		/* The last 4 bytes: a file which lacks them wasn't finished */
+#define PB_TL_VERSION		1		/* Readers reject a greater version. (A longer header is fine: fields are only ever added at the end) */
+#define PB_TL_HEADER_LEN	32		/* Length of the version 1 header */
+#define PB_TL_FOOTER_LEN	48
+#define PB_TL_INDEX_ENTRY_LEN	32
+
+#define PB_TL_BLOCK		65536		/* Records (after expanding COPYs) per block: the most that a seek has to decode */
+#define PB_TL_WINDOW		4096		/* A COPY reaches back at most this many records (less one): a loop body longer than this isn't found */
+#define PB_TL_WINDOW_MAX	(1 << 20)	/* Readers reject a file which needs more history than this */
+#define PB_TL_BUFSIZE		(1 << 20)	/* Records are built up in a buffer of this size, then written */
+
+/* Record types (the low 3 bits of the tag byte). The reader returns only the first four: the others are expanded */
+#define PB_TL_DATA		0		/* A data line: output, and length in ns (after, if wait, the WAIT comment and the zero-length line) */
+#define PB_TL_MARK		1		/* A MARK: line: pc, output, length (in ticks) and comment. The step, time and visit are implicit */
+#define PB_TL_STOP		2		/* The STOP comment */
+#define PB_TL_TEXT		3		/* Any other line (the header, the footer, comments, anything unusual), verbatim */
+#define PB_TL_COPY		4		/* Repeat: distance D, count N */
+#define PB_TL_VISITS		5		/* At the start of a block: how often each MARK has been reached so far */
+
+#define PB_TL_TYPE_MASK		0x07
+#define PB_TL_FLAG_SAME_OUTPUT	0x08		/* DATA: the output is the previous DATA's (and isn't stored) */
+#define PB_TL_FLAG_WAIT		0x10		/* DATA: it was a WAIT */
+#define PB_TL_LENGTH_SHIFT	5		/* DATA: the top 3 bits say where the length is: */
+#define PB_TL_LENGTH_NS		0		/*   a varint, in ns */
+#define PB_TL_LENGTH_TICKS	1		/*   a varint, in ticks (only if the tick is a whole number of ns) */
+#define PB_TL_LENGTH_RECENT	2		/*   (2 to 7) not stored: it's recent[code - 2] */
+#define PB_TL_RECENT		6		/* Number of recent lengths */
+
+/* What a DATA record is relative to: the last DATA before it in the block (including those in a COPY) */
+struct pb_tl_state {
+	uint32_t output;			/* Its output */
+	uint64_t recent[PB_TL_RECENT];		/* The last distinct lengths, most recent first (move-to-front) */
+};
+
+/* One line (or three, for a WAIT) of the .pbsim */
+struct pb_tl_event {
+	int type;				/* PB_TL_DATA, _MARK, _STOP or _TEXT */
+	uint32_t output;			/* DATA, MARK */
+	uint64_t length_ns;			/* DATA: how long the output lasts (the time to the next DATA) */
+	int wait;				/* DATA: it was a WAIT */
+	uint32_t pc;				/* MARK: its address */
+	uint32_t length;			/* MARK: its length, in ticks (as in .vliw source) */
+	const char *text;			/* MARK: the comment; TEXT: the line, without its newline */
+	size_t text_len;
+
+	/* Where it is: set by the reader, and ignored by the writer (which works them out) */
+	uint64_t item;				/* Records before this one */
+	uint64_t step;				/* Instructions before this one (i.e. DATAs) */
+	uint64_t time_ns;			/* Time at which it begins (the sum of the lengths before it) */
+	unsigned long visit;			/* MARK: times this MARK was reached before */
+};
+
+/* One entry of the index: where a block begins */
+struct pb_tl_index {
+	uint64_t offset;			/* In the file */
+	uint64_t item;
+	uint64_t step;
+	uint64_t time_ns;
+};
+
+/* One record, as the writer remembers it, to find repeats */
+struct pb_tl_item {
+	uint64_t length_ns;
+	uint32_t output;
+	uint32_t pc;
+	uint32_t length;
+	uint32_t text;				/* Index into strings, or 0 for none */
+	uint8_t type;
+	uint8_t wait;
+};
+
+/* The writer */
+struct pb_tl_writer {
+	FILE *fh;
+	unsigned char buf[PB_TL_BUFSIZE];
+	size_t len;
+	uint64_t offset;			/* Bytes written before buf */
+	uint32_t crc;				/* Of everything written after the header */
+	int error;				/* A write failed, or out of memory */
+	FILE *log;
+
+	/* Where we are */
+	uint64_t items, steps, time_ns;
+	unsigned long *visits;			/* Times each MARK has been reached (PB_MEMORY of them) */
+	uint32_t *marks;			/* The addresses of the MARKs reached, in order */
+	unsigned int nmarks;
+
+	/* The current block, and the search for repeats */
+	struct pb_tl_item hist[PB_TL_WINDOW];	/* The last records of the block (the record at pos is at hist[pos % PB_TL_WINDOW]) */
+	uint32_t hash[PB_TL_WINDOW];		/* The last pos (plus 1) of a record with each hash */
+	uint64_t pos;				/* Records in this block */
+	uint64_t match_dist, match_len;		/* A repeat being followed: the last match_len records (not yet written) copy those match_dist before */
+	struct pb_tl_state state;		/* As of the last record written */
+	struct pb_tl_state match_state;		/* ... and as of the last in the repeat, which it becomes if that is written as a COPY */
+
+	/* The index */
+	struct pb_tl_index *index;
+	size_t nindex, index_size;
+
+	/* The comments of the MARKs, each kept once (they repeat, with the loops). TEXT lines are never repeated: they are written at once */
+	char **strings;
+	size_t *string_lens;
+	uint32_t nstrings, strings_size;
+	uint32_t *string_hash;			/* Open addressing: index into strings, or 0 */
+	uint32_t string_hash_size;
+
+	struct pb_tl_item *period;		/* pb_tl_write_repeat()'s copy of what it repeats (PB_TL_WINDOW of them) */
+};
+
+/* The reader. The pointers are into the caller's buffer */
+struct pb_tl_reader {
+	const unsigned char *buf;
+	size_t len;
+	unsigned int version;
+	unsigned long tick_ps;			/* PB_TICK_NS of the simulation, in picoseconds */
+	uint32_t block;				/* Records per block */
+	uint32_t window;			/* History needed for COPY */
+	uint64_t blocks;			/* Entries in the index */
+	const unsigned char *index;
+	uint64_t total_items, total_steps, total_ns;	/* For the whole file */
+	FILE *log;
+
+	/* The decoder */
+	const unsigned char *p, *end;		/* The next record, and the end of the records (the index) */
+	struct pb_tl_event *hist;		/* The last window records of the block */
+	uint64_t pos;				/* Records in this block, so far */
+	uint64_t copy_dist, copy_left;		/* A COPY being expanded */
+	struct pb_tl_state state;
+	uint64_t item, step, time_ns;		/* Where we are */
+	unsigned long *visits;			/* Times each MARK has been reached (PB_MEMORY of them) */
+	struct pb_tl_event pending;		/* pb_tl_seek() found this, and pb_tl_next() returns it */
+	int has_pending;
+};
+
+/* Start writing a .pbtl to fh (the header is written at once). Returns NULL (with the reason to log) if out of memory, or if the
+ * header could not be written */
+struct pb_tl_writer *pb_tl_writer_new (FILE *fh, FILE *log);
+
+/* Add an event. (Its item, step, time_ns and visit are worked out; for a MARK, pc must be less than PB_MEMORY.) Returns 0, or -1 */
+int pb_tl_write (struct pb_tl_writer *w, const struct pb_tl_event *ev);
+
+/* Repeat the last n records (DATA and MARK only) times more, as if each had been written again, in order: but in O(n) per block,
+ * however large times is. (This is how the simulator writes a loop which it has fast-forwarded.) The n records must all be in the
+ * current block, and n less than PB_TL_WINDOW: returns -1, having written nothing, if not (or on a write error); else 0 */
+int pb_tl_write_repeat (struct pb_tl_writer *w, uint64_t n, uint64_t times);
+
+/* Add a TEXT record, for each line of text (a NUL-terminated string, of lines ending '\n'). Returns 0, or -1 */
+int pb_tl_write_text (struct pb_tl_writer *w, const char *text);
+
+/* Finish (write the index and footer), and free the writer; fh is left open. Returns 0, or -1 if anything could not be written */
+int pb_tl_writer_close (struct pb_tl_writer *w);
+
+/* Open a .pbtl, len bytes at buf (which must stay valid until pb_tl_reader_close()), and check it: the header and footer (in O(1)),
+ * then the CRC. Returns 0, or PB_ERROR_BADVLIWFILE (with the explanation printed to log, if it isn't NULL) */
+int pb_tl_reader_open (struct pb_tl_reader *r, const unsigned char *buf, size_t len, FILE *log);
+void pb_tl_reader_close (struct pb_tl_reader *r);
+
+/* Is this (the first len bytes of a file) a .pbtl? */
+int pb_tl_is_timeline (const unsigned char *buf, size_t len);
+
+/* The next event (ev's pointers are into the buffer). Returns 1, 0 at the end, or -1 if the file is damaged */
+int pb_tl_next (struct pb_tl_reader *r, struct pb_tl_event *ev);
+
+/* Go to time_ns: the next event is then the DATA in force at that time (the last to begin at or before it), or the end. Events
+ * before it (in particular, a MARK just before it) are skipped. Decodes at most one block. Returns 0, or -1 if the file is damaged */
+int pb_tl_seek (struct pb_tl_reader *r, uint64_t time_ns);
+
+/* Go back to the beginning */
+void pb_tl_rewind (struct pb_tl_reader *r);
+
+/* Write the events, from here to the end, as .pbsim text to fh. Returns 0, or -1 (damaged, or could not write) */
+int pb_tl_to_pbsim (struct pb_tl_reader *r, FILE *fh);
+
+/* Convert .pbsim text (len bytes at buf) to records. Each line which is exactly what pb_parse or pb_sim would write (a data line, a
+ * WAIT, a STOP, or a MARK whose step, ticks, ns and visit are right) becomes the record for it; anything else becomes TEXT. So
+ * pb_tl_to_pbsim() gives back exactly the same bytes (except that a missing final newline is added). Returns 0, or -1 */
+int pb_tl_from_pbsim (struct pb_tl_writer *w, const char *buf, size_t len);
+
+#endif /* PB_TIMELINE_H */
@@ -0,0 +1,135 @@
+/* This is pb_tl.c  It converts a simulation replay log (.pbsim, from pb_parse -g or pb_sim -g) to a binary timeline (.pbtl), and
+ * back; or gives the summary of a .pbtl (from its footer, without reading the records); or writes a .pbtl as .pbsim from a given
+ * time onwards (via the index, so without decoding what comes before). See pb_timeline.h, and doc/pbtl.txt.
+ * Which way to convert is decided by the magic number of the input, so either may come from stdin.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libpulseblaster.h"
+#include "pb_timeline.h"
+
+void printhelp(){
+	fprintf(stderr, "pb_tl converts a simulation replay log (.pbsim, as written by pb_parse -g or pb_sim -g) to a binary timeline (.pbtl),\n"
+		"or a .pbtl back to .pbsim, exactly. A .pbtl is several times smaller; a program with loops is thousands of times smaller,\n"
+		"since each repeat of a loop body is a single record. It is read without parsing, and indexed by time.\n"
+		"(pb_sim -g FILE.pbtl writes one directly.) Which way to convert is decided by the contents of the input.\n\n"
+		"USAGE:    pb_tl [OPTIONS] INPUT.pbsim|INPUT.pbtl|- [OUTPUT.pbtl|OUTPUT.pbsim|-]\n"
+		"          (The output defaults to stdout.)\n\n"
+		"OPTIONS:  -i           don't convert: print the summary of a .pbtl (from its footer), as 'name: value' lines.\n"
+		"          -s time_ns   write the .pbsim from this time (in ns) onwards: from the line in force at that time.\n"
+		"                       (Only the block of the .pbtl which contains it is decoded.)\n"
+		"          -h           show this help.\n");
+}
+
+int main(int argc, char *argv[]){
+	int opt; extern char *optarg; extern int optind;	/* getopt */
+	int info = 0, seek = 0, ret;
+	unsigned long long seek_ns = 0;
+	const char *filename, *outname = "-";
+	char *end;
+	FILE *source_fh, *out_fh;
+	struct pb_source src;
+	struct pb_tl_reader r;
+	struct pb_tl_writer *w;
+
+	while ((opt = getopt(argc, argv, "is:h")) != -1){
+		switch (opt){
+			case 'i':  info = 1;  break;
+			case 's':
+				seek_ns = strtoull(optarg, &end, 10);
+				if ((*optarg == '\0') || (*optarg == '-') || (*end != '\0')){
+					fprintf(stderr, "Error: the time (-s) must be a number of ns, not '%s'.\n", optarg);
+					exit (PB_ERROR_WRONGARGS);
+				}
+				seek = 1;
+				break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if ((argc - optind < 1) || (argc - optind > 2)){
+		printhelp();
+		exit (PB_ERROR_WRONGARGS);
+	}
+	filename = argv[optind];
+	if (argc - optind == 2){
+		outname = argv[optind + 1];
+	}
+
+	if (!strcmp (filename, "-")){
+		source_fh = stdin;
+	}else if ((source_fh = fopen(filename, "r")) == NULL){
+		fprintf(stderr,"Could not open input file %s.\n", filename);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((ret = pb_source_open(&src, fileno(source_fh), stderr)) != 0){
+		exit (ret);
+	}
+
+	/* .pbsim to .pbtl */
+	if (!pb_tl_is_timeline((const unsigned char *)src.buf, src.len)){
+		if ((info) || (seek)){
+			fprintf(stderr, "Error: options -i and -s need a .pbtl, but %s isn't one.\n", filename);
+			exit (PB_ERROR_WRONGARGS);
+		}
+		if ((!strcmp (outname, "-")) && (isatty(STDOUT_FILENO))){
+			fprintf(stderr, "Error: the output is binary: it shouldn't be written to a terminal.\n");
+			exit (PB_ERROR_WRONGARGS);
+		}
+		if ((out_fh = strcmp (outname, "-") ? fopen(outname, "w") : stdout) == NULL){
+			fprintf(stderr, "Error: could not open output file %s for writing.\n", outname);
+			exit (PB_ERROR_WRONGARGS);
+		}
+		if ((w = pb_tl_writer_new(out_fh, stderr)) == NULL){
+			exit (PB_ERROR_GENERIC);
+		}
+		ret = pb_tl_from_pbsim(w, src.buf, src.len);
+		if ((pb_tl_writer_close(w) != 0) || (ret != 0) || (fclose(out_fh) != 0)){
+			fprintf(stderr, "Error: could not write the timeline %s.\n", outname);
+			exit (PB_ERROR_GENERIC);
+		}
+		pb_source_close(&src);
+		return PB_EXIT_OK;
+	}
+
+	/* .pbtl to .pbsim (or its summary) */
+	if ((ret = pb_tl_reader_open(&r, (const unsigned char *)src.buf, src.len, stderr)) != 0){
+		fprintf(stderr, "Error in timeline file %s.\n", filename);
+		exit (ret);
+	}
+	if (info){
+		printf("file: %s\n", filename);
+		printf("bytes: %lu\n", (unsigned long)src.len);
+		printf("version: %u\n", r.version);
+		printf("tick_ps: %lu\n", r.tick_ps);
+		printf("blocks: %llu\n", (unsigned long long)r.blocks);
+		printf("records: %llu\n", (unsigned long long)r.total_items);
+		printf("steps: %llu\n", (unsigned long long)r.total_steps);
+		printf("elapsed_ns: %llu\n", (unsigned long long)r.total_ns);
+		printf("elapsed_seconds: %.9f\n", r.total_ns / 1e9);
+		printf("bytes_per_step: %.3f\n", r.total_steps ? (double)src.len / r.total_steps : 0.0);
+		pb_tl_reader_close(&r);
+		pb_source_close(&src);
+		return PB_EXIT_OK;
+	}
+	if ((out_fh = strcmp (outname, "-") ? fopen(outname, "w") : stdout) == NULL){
+		fprintf(stderr, "Error: could not open output file %s for writing.\n", outname);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((seek) && (pb_tl_seek(&r, seek_ns) != 0)){
+		fprintf(stderr, "Error in timeline file %s.\n", filename);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+	if ((pb_tl_to_pbsim(&r, out_fh) != 0) || (fclose(out_fh) != 0)){
+		fprintf(stderr, "Error: could not convert timeline %s to %s.\n", filename, outname);
+		exit (PB_ERROR_GENERIC);
+	}
+	pb_tl_reader_close(&r);
+	pb_source_close(&src);
+	return PB_EXIT_OK;
+}
@@ -0,0 +1,103 @@
+/* This is pb_verify.c  It verifies a program (.vliw or .bin) statically, by following every path through it: see pb_flow.h.
+ * pb_asm, pb_prog and pbd do this anyway, before anything is written; this reports what was found, without touching the PulseBlaster.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libpulseblaster.h"
+#include "pb_image.h"
+#include "pb_flow.h"
+
+void printhelp(){
+	fprintf(stderr, "pb_verify checks a PulseBlaster program, by following every path through it (including GOTO, CALL and RETURN).\n"
+		"It proves that no path branches beyond the end of the program, or runs off the end; nests loops deeper than %d,\n"
+		"or subroutines deeper than %d; reaches an ENDLOOP outside a loop, or a RETURN outside a subroutine.\n"
+		"(pb_asm and pb_prog do the same, before writing anything.) The statistics are printed to stdout, as 'name: value' lines.\n\n"
+		"USAGE:    pb_verify FILENAME.vliw | FILENAME.bin | -\n"
+		"          (From stdin, a .bin, raw or container, is recognised as such; anything else is taken as .vliw.)\n", PB_LOOP_MAXDEPTH, PB_SUB_MAXDEPTH);
+}
+
+int main(int argc, char *argv[]){
+	const char *filename;
+	const unsigned char *image;
+	const unsigned int *lines = NULL;
+	static unsigned int map_lines[PB_MEMORY];
+	size_t len;
+	int is_vliw, ret;
+	FILE *source_fh;
+	struct pb_source src;
+	struct pb_image bin;
+	struct pb_encoder *enc;
+	struct pb_verify_result result;
+
+	if ((argc != 2) || (!strcmp (argv[1], "-h")) || (!strcmp (argv[1], "--help"))){
+		printhelp();
+		exit (PB_ERROR_WRONGARGS);
+	}
+	filename = argv[1];
+
+	if (!strcmp (filename, "-")){
+		source_fh = stdin;
+	}else if ((source_fh = fopen(filename, "r")) == NULL){
+		fprintf(stderr,"Could not open program-file %s.\n", filename);
+		exit (PB_ERROR_WRONGARGS);
+	}
+	if ((ret = pb_source_open(&src, fileno(source_fh), stderr)) != 0){
+		exit (ret);
+	}
+	if (src.len == 0){
+		fprintf(stderr, "Error: file %s is empty!\n", filename);
+		exit (PB_ERROR_EMPTYVLIWFILE);
+	}
+
+	/* Get the image: assemble a .vliw; check a .bin */
+	if (!strcmp (filename, "-")){
+		is_vliw = (src.len > PB_IMAGE_MAXLEN) || (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, NULL) != 0) || ((!bin.container) && (src.len % PB_BPW_VLIW));	/* (Raw, it must be whole words) */
+	}else{
+		is_vliw = (strlen(filename) > 5) && (!strcmp (filename + strlen(filename) - 5, ".vliw"));
+	}
+	if (is_vliw){
+		if ((enc = pb_encoder_new()) == NULL){
+			fprintf(stderr, "Error: could not allocate the encoder.\n");
+			exit (PB_ERROR_GENERIC);
+		}
+		if (((ret = pb_encode_text(enc, src.buf, src.len)) > 0) || ((ret = pb_encoder_finish(enc)) != 0)){
+			fprintf(stderr, "Error in program %s.\n", filename);
+			exit (ret);
+		}
+		image = pb_encoder_image(enc);
+		len = pb_encoder_len(enc);
+		lines = pb_encoder_lines(enc);
+	}else{
+		if ((src.len > PB_IMAGE_MAXLEN) || (pb_image_parse(&bin, (const unsigned char *)src.buf, src.len, stderr) != 0)){
+			fprintf(stderr, "Error in program file %s.\n", filename);
+			exit (PB_ERROR_BADVLIWFILE);
+		}
+		image = bin.payload;
+		len = bin.payload_len;
+		if (pb_image_lines(&bin, map_lines) == 0){
+			lines = map_lines;
+		}
+	}
+	if ((len == 0) || (len % PB_BPW_VLIW) || (len > (size_t)PB_MEMORY * PB_BPW_VLIW)){
+		fprintf(stderr, "Error: program %s is %lu bytes long, but should be a non-zero multiple of %d, and at most %d words.\n",
+			filename, (unsigned long)len, PB_BPW_VLIW, PB_MEMORY);
+		exit (PB_ERROR_BADVLIWFILE);
+	}
+
+	ret = pb_verify(image, len, lines, &result, stderr);
+
+	printf("file: %s\n", filename);
+	printf("words: %u\n", result.words);
+	printf("reachable: %u\n", result.reachable);
+	printf("states: %lu\n", result.states);
+	printf("max_loop_depth: %u\n", result.max_loop_depth);
+	printf("max_sub_depth: %u\n", result.max_sub_depth);
+	printf("complete: %s\n", result.complete ? "yes" : "no");
+	printf("result: %s\n", ret ? pb_strerror(ret) : (result.complete ? "ok" : "unknown"));
+
+	return (ret);
+}
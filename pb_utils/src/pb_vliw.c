@@ -1,9 +1,11 @@
 /* This is pb_vliw.c  It prints a short example VLIW program, with comments
- * Most of the important, shared stuff is in pb_functions.c
+ * Most of the important, shared stuff is in libpulseblaster (libpulseblaster.c)
  * This is Free Software, released under the GNU GPL, version 3 or later.
  */
 
-#include "pb_functions.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include "pulseblaster.h"	/* Pulseblaster configuration/hardware info */
 
 void printhelp(){
 	fprintf(stderr,"pb_vliw prints an example VLIW file, with OpCode summary\n");
@@ -0,0 +1,656 @@
+/* This is pbd.c  the resident PulseBlaster daemon. It holds the device open, and accepts requests over a local (Unix) socket:
+ * load a program (as .vliw source, or as a .bin image), arm, start, stop, continue, init, and status. This saves each step of an
+ * experiment from starting php, pb_prog and pb_start (and reopening sysfs) in turn: a request is just a socket round-trip.
+ * .vliw source is parsed, checked and encoded in memory, by the same encoder as pb_asm and pb_prog (libpulseblaster), and an invalid
+ * program is rejected without touching the PulseBlaster.
+ *
+ * The protocol is line-based, so it can also be driven from a shell (eg socat) or php (fsockopen("unix://...")).
+ * A request is one line:
+ *      LOAD_VLIW n		followed by n bytes of .vliw source
+ *      LOAD_BIN n		followed by n bytes of .bin image (raw, or a container: see pb_image.h)
+ *      INIT flags		set the outputs (as pb_init; replaces the program)
+ *      ARM | START | STOP | CONT
+ *      STATUS
+ * Each reply is a line "status seq n", followed by n bytes of text (the messages, or for STATUS, 'name: value' lines). status is 0 for
+ * success, else the PB_ERROR_* code; seq counts the requests executed by this daemon, from 1.
+ * Ordering: requests are executed one at a time, to completion. Those from one connection are executed (and answered) in the order
+ * they were sent; between connections, a queued request is taken from each in turn. Each connection has at most one request queued in
+ * the daemon: further ones wait in the socket. So seq gives the exact order in which everything reached the PulseBlaster.
+ *
+ * With -c, pbd is instead a client: it sends one request to the daemon, prints the reply, and exits with its status.
+ * This is Free Software, released under the GNU GPL, version 3 or later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "libpulseblaster.h"
+#include "pb_image.h"
+#include "pb_flow.h"
+
+#if HAVE_PB == 1
+    #define PBD_DEFAULT_SOCKET	"/var/run/pbd.socket"
+#else
+    #define PBD_DEFAULT_SOCKET	DEBUG_PB_TMP_DIR"/pbd.socket"
+#endif
+#define PBD_SOCKET_MODE		0660				/* Anyone in the daemon's group may use it */
+#define PBD_MAXCLIENTS		32				/* Connections at once */
+#define PBD_LINE_MAXLEN		256				/* Length of a request line, including the '\n' */
+#define PBD_LOAD_MAXLEN		(PB_MEMORY * VLIWLINE_MAXLEN)	/* Largest payload of a LOAD_*: the longest sensible .vliw file */
+
+/* A connection, with its input. buf holds what has been read but not yet executed: at most one complete request is parsed from it at a time */
+struct pbd_client {
+	int fd;					/* -1 if this slot is free */
+	char *buf;
+	size_t used, size;
+	size_t need;				/* Length of the complete request at the head of buf (line + payload), or 0 if not yet known */
+	int closing;				/* EOF (or error) seen: drop the connection once nothing complete remains */
+};
+
+/* What the daemon knows. (The PulseBlaster itself can't be read back: the state is as last commanded) */
+struct pbd_state {
+	struct pb_device *dev;
+	struct pb_encoder *enc;
+	const char *socket_path;
+	unsigned long long seq;			/* Requests executed */
+	unsigned long long errors;		/* ... of which failed */
+	unsigned long long loads;
+	const char *state;			/* "unknown", "programmed", "armed", "running", "stopped" */
+	const char *program;			/* "none", "vliw", "bin", "init" */
+	unsigned int words;			/* Size of the program loaded */
+	unsigned int lines[PB_MEMORY];		/* The source map of a container, for pb_verify()'s messages */
+	double started;				/* Time the daemon started */
+	double busy;				/* Total time spent executing requests */
+	int verbose;
+};
+
+static volatile sig_atomic_t quit = 0;
+
+void printhelp(){
+	fprintf(stderr, "pbd is the resident PulseBlaster daemon. It holds the device open, and takes requests from a Unix socket.\n"
+		"Programs are parsed, checked and encoded in memory; an invalid program never touches the PulseBlaster.\n"
+		"Requests are executed one at a time, in order; each reply carries the sequence number of its request.\n\n"
+		"USAGE:    pbd [-s SOCKET] [-v]                      (run the daemon, in the foreground; SIGTERM or ^C to end)\n"
+		"          pbd [-s SOCKET] -c COMMAND [ARG]          (client: send one request, print the reply, exit with its status)\n\n"
+		"COMMANDS: load FILE.vliw | FILE.bin | -        (load a program. '-' reads a .bin from stdin)\n"
+		"          init [FLAGS]                         (set the outputs to FLAGS, as pb_init. Replaces the program)\n"
+		"          arm | start | stop | cont            (as pb_arm, pb_start, pb_stop, pb_cont)\n"
+		"          status                               (print the daemon's status, as 'name: value' lines)\n\n"
+		"OPTIONS:  -s SOCKET    the socket (default: %s).\n"
+		"          -v           (daemon) log each request to stderr.\n"
+		"          -h           show this help.\n\n"
+		"PROTOCOL: one request line: 'LOAD_VLIW n' or 'LOAD_BIN n' (then n bytes of file), 'INIT flags', 'ARM', 'START', 'STOP',\n"
+		"          'CONT' or 'STATUS'. The reply is a line 'status seq n', then n bytes of text. status is 0, or a PB_ERROR_* code.\n",
+		PBD_DEFAULT_SOCKET);
+}
+
+/* Time now, in seconds */
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+void handle_signal(int sig __attribute__ ((unused)) ){
+	quit = 1;
+}
+
+/* Write all of buf to fd. Returns 0, or -1 */
+int write_all(int fd, const void *buf, size_t len){
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len > 0){
+		if ((ret = send(fd, p, len, MSG_NOSIGNAL)) < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK){	/* A client which doesn't read its replies: wait for it (briefly) */
+				struct pollfd pfd = { fd, POLLOUT, 0 };
+				if (poll(&pfd, 1, 1000) > 0){
+					continue;
+				}
+			}
+			return (-1);
+		}
+		p += ret;
+		len -= ret;
+	}
+	return (0);
+}
+
+/* Fill in the unix socket address. Returns 0, or -1 if the path is too long */
+int socket_address(struct sockaddr_un *addr, const char *path){
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)){
+		fprintf(stderr, "Error: socket name is too long: %s\n", path);
+		return (-1);
+	}
+	strcpy(addr->sun_path, path);
+	return (0);
+}
+
+
+/* Daemon */
+
+/* Parse the request line at the head of c->buf, to find the length of the whole request. Returns 0 (with c->need set, or still 0 if the
+ * line is incomplete), or -1 if the line (or its payload) is too long. (An unknown command is only rejected when it's executed, so that it gets a reply) */
+int parse_head(struct pbd_client *c){
+	char *nl, line[PBD_LINE_MAXLEN], cmd[PBD_LINE_MAXLEN];
+	unsigned long n;
+
+	if ((nl = memchr(c->buf, '\n', c->used)) == NULL){
+		return ((c->used >= PBD_LINE_MAXLEN) ? -1 : 0);
+	}
+	if (nl - c->buf + 1 > PBD_LINE_MAXLEN){
+		return (-1);
+	}
+	c->need = nl - c->buf + 1;
+	memcpy(line, c->buf, c->need - 1);		/* (buf isn't NUL-terminated, and the payload mustn't be read as part of the line) */
+	line[c->need - 1] = 0;
+	if ((sscanf(line, "%255s %lu", cmd, &n) == 2) && ((!strcasecmp(cmd, "LOAD_VLIW")) || (!strcasecmp(cmd, "LOAD_BIN")))){
+		if (n > PBD_LOAD_MAXLEN){	/* We can't skip it, since it isn't worth reading: so nothing more on this connection makes sense */
+			fprintf(stderr, "Error: %s of %lu bytes is too long (the limit is %d).\n", cmd, n, PBD_LOAD_MAXLEN);
+			return (-1);
+		}
+		c->need += n;
+	}
+	return (0);
+}
+
+/* Read whatever is waiting from the client. Returns 0, or -1 if it must be dropped at once */
+int client_read(struct pbd_client *c){
+	ssize_t ret;
+	size_t want;
+	char *bigger;
+
+	for (;;){
+		want = (c->need > c->used) ? c->need : c->used + 4096;		/* Room for the rest of the request (a LOAD is read straight in) */
+		if (want > c->size){
+			if ((bigger = realloc(c->buf, want)) == NULL){
+				fprintf(stderr, "Error: out of memory, reading a request.\n");
+				return (-1);
+			}
+			c->buf = bigger;
+			c->size = want;
+		}
+		if ((ret = read(c->fd, c->buf + c->used, c->size - c->used)) < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK){
+				return (0);
+			}
+			c->closing = 1;
+			return (0);
+		}
+		if (ret == 0){
+			c->closing = 1;
+			return (0);
+		}
+		c->used += ret;
+		if ((c->need == 0) && (parse_head(c) < 0)){
+			fprintf(stderr, "Error: bad request; dropping the connection.\n");
+			return (-1);
+		}
+		if ((c->need != 0) && (c->used >= c->need)){	/* A complete request: leave the rest in the socket */
+			return (0);
+		}
+	}
+}
+
+void client_close(struct pbd_client *c){
+	close(c->fd);
+	free(c->buf);
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+}
+
+/* Execute one request (line, then payload of len bytes), writing the messages to log. Returns 0, or the PB_ERROR_* code */
+int execute(struct pbd_state *s, const char *line, const char *payload, size_t len, FILE *log){
+	char cmd[PBD_LINE_MAXLEN], arg[PBD_LINE_MAXLEN], *end;
+	struct pb_image bin;
+	unsigned long flags;
+	int ret = 0;
+
+	arg[0] = 0;
+	if (sscanf(line, "%255s %255s", cmd, arg) < 1){
+		fprintf(log, "Error: empty request.\n");
+		return (PB_ERROR_WRONGARGS);
+	}
+
+	pb_device_set_log(s->dev, log);
+	pb_encoder_set_log(s->enc, log);
+
+	if (!strcasecmp(cmd, "LOAD_VLIW")){
+		pb_encoder_reset(s->enc);
+		if ((ret = pb_encode_text(s->enc, payload, len)) == 0){
+			ret = pb_encoder_finish(s->enc);
+		}
+		if ((ret == 0) && (pb_encoder_len(s->enc) > 0)){	/* (An empty program is explained by pb_device_program()) */
+			ret = pb_verify(pb_encoder_image(s->enc), pb_encoder_len(s->enc), pb_encoder_lines(s->enc), NULL, log);
+		}
+		if (ret == 0){
+			ret = pb_device_program(s->dev, pb_encoder_image(s->enc), pb_encoder_len(s->enc));
+		}else{
+			fprintf(log, "Error in program.\nPulseBlaster has not been touched.\n");
+		}
+		if (ret == 0){
+			s->program = "vliw";
+			s->words = pb_encoder_words(s->enc);
+		}
+
+	}else if (!strcasecmp(cmd, "LOAD_BIN")){
+		ret = pb_image_parse(&bin, (const unsigned char *)payload, len, log);
+		if ((ret == 0) && (bin.payload_len > 0) && (bin.payload_len % PB_BPW_VLIW == 0) && (bin.words <= PB_MEMORY)){	/* (Else as above) */
+			ret = pb_verify(bin.payload, bin.payload_len, (pb_image_lines(&bin, s->lines) == 0) ? s->lines : NULL, NULL, log);
+		}
+		if (ret == 0){
+			ret = pb_device_program(s->dev, bin.payload, bin.payload_len);
+		}else{
+			fprintf(log, "Error in program.\nPulseBlaster has not been touched.\n");
+		}
+		if (ret == 0){
+			s->program = "bin";
+			s->words = bin.words;
+		}
+
+	}else if (!strcasecmp(cmd, "INIT")){
+		flags = strtoul(arg[0] ? arg : "0", &end, 0);
+		if ((*end != 0) || (flags > PB_OUTPUTS_24BIT)){
+			fprintf(log, "Error: flags should be between 0 and 0x%06X, but they are '%s'.\n", PB_OUTPUTS_24BIT, arg);
+			return (PB_ERROR_WRONGARGS);
+		}
+		if ((ret = pb_device_init(s->dev, flags)) == 0){
+			fprintf(log, "PulseBlaster outputs have been set to: 0x%06lx.\n", flags);
+			s->program = "init";
+			s->words = 2;
+			s->state = "stopped";	/* It ran the program, and stopped */
+		}
+		return (ret);
+
+	}else if (!strcasecmp(cmd, "ARM")){
+		if ((ret = pb_device_arm(s->dev)) == 0){
+			s->state = "armed";
+		}
+		return (ret);
+	}else if (!strcasecmp(cmd, "START")){
+		if ((ret = pb_device_start(s->dev)) == 0){
+			s->state = "running";
+		}
+		return (ret);
+	}else if (!strcasecmp(cmd, "STOP")){
+		if ((ret = pb_device_stop(s->dev)) == 0){
+			s->state = "stopped";
+		}
+		return (ret);
+	}else if (!strcasecmp(cmd, "CONT")){
+		if ((ret = pb_device_cont(s->dev)) == 0){
+			s->state = "running";
+		}
+		return (ret);
+
+	}else if (!strcasecmp(cmd, "STATUS")){
+		fprintf(log, "device: %s\n", pb_device_dir(s->dev));
+		fprintf(log, "state: %s\n", s->state);
+		fprintf(log, "program: %s\n", s->program);
+		fprintf(log, "words: %u\n", s->words);
+		fprintf(log, "loads: %llu\n", s->loads);
+		fprintf(log, "requests: %llu\n", s->seq);
+		fprintf(log, "errors: %llu\n", s->errors);
+		fprintf(log, "uptime_seconds: %.3f\n", now() - s->started);
+		fprintf(log, "mean_request_seconds: %.9f\n", (s->seq > 1) ? s->busy / (s->seq - 1) : 0.0);
+		return (0);
+
+	}else{
+		fprintf(log, "Error: unknown request '%s'. Use one of: LOAD_VLIW n, LOAD_BIN n, INIT flags, ARM, START, STOP, CONT, STATUS.\n", cmd);
+		return (PB_ERROR_WRONGARGS);
+	}
+
+	/* Only the LOADs get here */
+	s->loads++;
+	if (ret == 0){
+		fprintf(log, "PulseBlaster has been programmed with %u instructions. Not armed nor started.\n", s->words);
+		s->state = "programmed";
+	}
+	return (ret);
+}
+
+/* Execute the request at the head of c->buf, and reply to it. Returns 0, or -1 if the client must be dropped */
+int serve(struct pbd_state *s, struct pbd_client *c){
+	char *line, *msg = NULL, head[64];
+	size_t line_len, msg_len = 0;
+	double t_start;
+	FILE *log;
+	int ret, head_len, fail = 0;
+
+	line = c->buf;
+	line_len = (char *)memchr(line, '\n', c->need) - line + 1;
+	line[line_len - 1] = 0;
+
+	if ((log = open_memstream(&msg, &msg_len)) == NULL){
+		fprintf(stderr, "Error: out of memory, executing a request.\n");
+		return (-1);
+	}
+	t_start = now();
+	s->seq++;
+	ret = execute(s, line, c->buf + line_len, c->need - line_len, log);
+	s->busy += now() - t_start;
+	if (ret != 0){
+		s->errors++;
+	}
+	fclose(log);
+	pb_device_set_log(s->dev, stderr);
+	pb_encoder_set_log(s->enc, stderr);
+
+	if (s->verbose){
+		fprintf(stderr, "%llu: %s: %d\n", s->seq, line, ret);
+	}
+
+	head_len = snprintf(head, sizeof(head), "%d %llu %lu\n", ret, s->seq, (unsigned long)msg_len);
+	if ((write_all(c->fd, head, head_len) < 0) || (write_all(c->fd, msg, msg_len) < 0)){
+		fail = -1;
+	}
+	free(msg);
+
+	/* Remove it from the buffer, and look at the next */
+	memmove(c->buf, c->buf + c->need, c->used - c->need);
+	c->used -= c->need;
+	c->need = 0;
+	if ((c->used > 0) && (parse_head(c) < 0)){
+		fail = -1;
+	}
+	return (fail);
+}
+
+/* Listen on the socket. If there is one there already, make sure no daemon is using it. Returns the fd, or -1 */
+int listen_socket(const char *path){
+	struct sockaddr_un addr;
+	int fd;
+
+	if (socket_address(&addr, path) < 0){
+		return (-1);
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0){
+		perror("Could not create the socket");
+		return (-1);
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0){
+		fprintf(stderr, "Error: pbd is already running, on %s.\n", path);
+		close(fd);
+		return (-1);
+	}
+	unlink(path);		/* Left behind by a daemon which died */
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (chmod(path, PBD_SOCKET_MODE) < 0) || (listen(fd, PBD_MAXCLIENTS) < 0)){
+		fprintf(stderr, "Could not listen on socket %s: %s\n", path, strerror(errno));
+		close(fd);
+		return (-1);
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return (fd);
+}
+
+int run_daemon(const char *socket_path, int verbose){
+	static struct pbd_client clients[PBD_MAXCLIENTS];
+	struct pollfd pfd[PBD_MAXCLIENTS + 1];
+	int slot[PBD_MAXCLIENTS + 1];
+	static struct pbd_state s;	/* Large: not on the stack */
+	struct sigaction sa;
+	int listen_fd, fd, i, n, ret, pending;
+
+	memset(&s, 0, sizeof(s));
+	s.socket_path = socket_path;
+	s.state = "unknown";
+	s.program = "none";
+	s.verbose = verbose;
+	s.started = now();
+	for (i = 0; i < PBD_MAXCLIENTS; i++){
+		clients[i].fd = -1;
+	}
+
+	/* Open pulseblaster; check device is present. It stays open until we exit */
+	if ((s.dev = pb_device_open(NULL, &ret)) == NULL){
+		return (ret);
+	}
+	if ((s.enc = pb_encoder_new()) == NULL){
+		fprintf(stderr, "Error: could not allocate the encoder.\n");
+		pb_device_close(s.dev);
+		return (PB_ERROR_GENERIC);
+	}
+	if ((listen_fd = listen_socket(socket_path)) < 0){
+		pb_encoder_free(s.enc);
+		pb_device_close(s.dev);
+		return (PB_ERROR_GENERIC);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	fprintf(stderr, "pbd: listening on %s, for PulseBlaster %s.\n", socket_path, pb_device_dir(s.dev));
+
+	while (!quit){
+		/* Listen for new connections, and for the input of each connection which doesn't have a complete request queued. */
+		n = 0;
+		pending = 0;
+		pfd[n].fd = listen_fd;
+		pfd[n].events = POLLIN;
+		slot[n++] = -1;
+		for (i = 0; i < PBD_MAXCLIENTS; i++){
+			if (clients[i].fd < 0){
+				continue;
+			}
+			if ((clients[i].need != 0) && (clients[i].used >= clients[i].need)){
+				pending = 1;
+			}else if (!clients[i].closing){
+				pfd[n].fd = clients[i].fd;
+				pfd[n].events = POLLIN;
+				slot[n++] = i;
+			}
+		}
+		if (poll(pfd, n, pending ? 0 : -1) < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			perror("poll");
+			break;
+		}
+
+		for (i = 0; i < n; i++){
+			if (!pfd[i].revents){
+				continue;
+			}
+			if (slot[i] < 0){
+				while ((fd = accept(listen_fd, NULL, NULL)) >= 0){
+					for (ret = 0; (ret < PBD_MAXCLIENTS) && (clients[ret].fd >= 0); ret++);
+					if (ret == PBD_MAXCLIENTS){
+						fprintf(stderr, "Error: too many connections (%d); refusing another.\n", PBD_MAXCLIENTS);
+						close(fd);
+						continue;
+					}
+					fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+					clients[ret].fd = fd;
+				}
+			}else if (client_read(&clients[slot[i]]) < 0){
+				client_close(&clients[slot[i]]);
+			}
+		}
+
+		/* Execute one queued request from each connection, in turn. Then drop those which have closed, and have nothing left to do */
+		for (i = 0; i < PBD_MAXCLIENTS; i++){
+			if (clients[i].fd < 0){
+				continue;
+			}
+			if ((clients[i].need != 0) && (clients[i].used >= clients[i].need)){
+				if (serve(&s, &clients[i]) < 0){
+					client_close(&clients[i]);
+				}
+			}else if (clients[i].closing){
+				client_close(&clients[i]);
+			}
+		}
+	}
+
+	fprintf(stderr, "pbd: exiting, after %llu requests (%llu failed).\n", s.seq, s.errors);
+	for (i = 0; i < PBD_MAXCLIENTS; i++){
+		if (clients[i].fd >= 0){
+			client_close(&clients[i]);
+		}
+	}
+	close(listen_fd);
+	unlink(socket_path);
+	pb_encoder_free(s.enc);
+	pb_device_close(s.dev);
+	return (PB_EXIT_OK);
+}
+
+
+/* Client */
+
+/* Read all of a file (or stdin, for "-") into memory. Returns the buffer, or NULL */
+char *read_file(const char *filename, size_t *len_p){
+	FILE *fh;
+	char *buf = NULL, *bigger;
+	size_t len = 0, size = 0, ret;
+
+	if (!strcmp(filename, "-")){
+		fh = stdin;
+	}else if ((fh = fopen(filename, "r")) == NULL){
+		fprintf(stderr, "Could not open program-file %s.\n", filename);
+		return (NULL);
+	}
+	do {
+		if (len == size){
+			size = size ? size * 2 : 65536;
+			if ((bigger = realloc(buf, size)) == NULL){
+				fprintf(stderr, "Error: out of memory, reading %s.\n", filename);
+				free(buf);
+				return (NULL);
+			}
+			buf = bigger;
+		}
+		ret = fread(buf + len, 1, size - len, fh);
+		len += ret;
+	} while (ret > 0);
+	if (fh != stdin){
+		fclose(fh);
+	}
+	*len_p = len;
+	return (buf);
+}
+
+int run_client(const char *socket_path, const char *command, const char *arg){
+	struct sockaddr_un addr;
+	char line[PBD_LINE_MAXLEN], head[64];
+	char *payload = NULL, *msg;
+	size_t len = 0, got = 0;
+	unsigned long long seq;
+	unsigned long msg_len;
+	int fd, status, i;
+
+	if (!strcasecmp(command, "load")){
+		if (arg == NULL){
+			fprintf(stderr, "Error, 'load' needs a file. Use -h for help.\n");
+			return (PB_ERROR_WRONGARGS);
+		}
+		if ((strlen(arg) > 5) && (!strcmp(arg + strlen(arg) - 5, ".vliw"))){
+			command = "LOAD_VLIW";
+		}else if ((!strcmp(arg, "-")) || ((strlen(arg) > 4) && (!strcmp(arg + strlen(arg) - 4, ".bin")))){
+			command = "LOAD_BIN";
+		}else{
+			fprintf(stderr, "Error, program file %s is neither a .vliw, nor a .bin file. \n", arg);
+			return (PB_ERROR_WRONGARGS);
+		}
+		if ((payload = read_file(arg, &len)) == NULL){
+			return (PB_ERROR_WRONGARGS);
+		}
+		snprintf(line, sizeof(line), "%s %lu\n", command, (unsigned long)len);
+	}else if (snprintf(line, sizeof(line), "%s%s%s\n", command, arg ? " " : "", arg ? arg : "") >= (int)sizeof(line)){
+		fprintf(stderr, "Error, request is too long.\n");
+		return (PB_ERROR_WRONGARGS);
+	}
+
+	if (socket_address(&addr, socket_path) < 0){
+		return (PB_ERROR_WRONGARGS);
+	}
+	if (((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) || (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)){
+		fprintf(stderr, "Could not connect to pbd on %s: %s. Is it running?\n", socket_path, strerror(errno));
+		return (PB_ERROR_NODEVICE);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if ((write_all(fd, line, strlen(line)) < 0) || (write_all(fd, payload, len) < 0)){
+		fprintf(stderr, "Could not send the request to pbd: %s\n", strerror(errno));
+		return (PB_ERROR_NODEVICE);
+	}
+	free(payload);
+
+	/* The reply: a line, then its text */
+	for (i = 0; i < (int)sizeof(head) - 1; i++){
+		if ((read(fd, head + i, 1) != 1) || (head[i] == '\n')){
+			break;
+		}
+	}
+	head[i] = 0;
+	if (sscanf(head, "%d %llu %lu", &status, &seq, &msg_len) != 3){
+		fprintf(stderr, "Error: bad reply from pbd: '%s'.\n", head);
+		return (PB_ERROR_NODEVICE);
+	}
+	if ((msg = malloc(msg_len + 1)) == NULL){
+		fprintf(stderr, "Error: out of memory.\n");
+		return (PB_ERROR_GENERIC);
+	}
+	while (got < msg_len){
+		ssize_t ret = read(fd, msg + got, msg_len - got);
+		if (ret <= 0){
+			break;
+		}
+		got += ret;
+	}
+	close(fd);
+	fwrite(msg, 1, got, (strcasecmp(command, "status") || status) ? stderr : stdout);	/* As pb_emu: the status is data, so stdout */
+	free(msg);
+	return (status);
+}
+
+
+int main(int argc, char *argv[]){
+	int opt; extern char *optarg; extern int optind;	/* getopt */
+	const char *socket_path = PBD_DEFAULT_SOCKET;
+	const char *command = NULL;
+	int verbose = 0;
+
+	while ((opt = getopt(argc, argv, "s:c:vh")) != -1){
+		switch (opt){
+			case 's':  socket_path = optarg;  break;
+			case 'c':  command = optarg;  break;
+			case 'v':  verbose = 1;  break;
+			default:
+				printhelp();
+				exit (PB_ERROR_WRONGARGS);
+		}
+	}
+	if (command == NULL){
+		if (optind != argc){
+			fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
+			exit (PB_ERROR_WRONGARGS);
+		}
+		exit (run_daemon(socket_path, verbose));
+	}
+	if (argc - optind > 1){
+		fprintf(stderr,"Error, wrong number of arguments. Use -h for help.\n");
+		exit (PB_ERROR_WRONGARGS);
+	}
+	exit (run_client(socket_path, command, (optind < argc) ? argv[optind] : NULL));
+}
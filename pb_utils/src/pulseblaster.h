@@ -1,4 +1,4 @@
-/* This is pulseblaster.h the definitions by pb_functions.c etc. See also the manual.		*
+/* This is pulseblaster.h the definitions used by libpulseblaster etc. See also the manual.		*
  * It is used indirectly, via pb_print_config, by pb_parse.php					*
  * Copright by Richard Neill <pulseblaster at REMOVEME.richardneill.org> 2004-2013.		*
  * This is Free Software, released under the GNU GPL, version 3 or later: http://gnu.org/  	*/
@@ -12,6 +12,7 @@
 #define DEBUG_PB_TMP_DIR		"/tmp/pulseblaster_dummy_sysfs" /* Dummy directory, used instead, if HAVE_PB != 1 */
 
 #define PB_SYS_DIR			"/sys/class/pulseblaster/pulseblaster0" /* The pulseblaster directory in /sys for this device */
+#define PB_DEV_DIR			"/dev"					/* The character devices: each named as its directory in /sys (pulseblaster0) */
 #define PB_PROGRAM 			"program" 				/* Write a program (as a bytestream) to this to program the device */
 #define PB_START 			"start"					/* Write a "1" to this file to start the device */
 #define PB_STOP  			"stop"					/* Write a "1" to this file to stop the device */
@@ -104,7 +105,7 @@
 #define PB_ERROR_BUG			4	/* A program bug exists (or has been created by some incompatible change in a #define). See the comments. */
 #define PB_ERROR_INVALIDINSTRUCTION	5	/* Invalid instruction or opcode */
 #define PB_ERROR_OUTOFMEM		6	/* Too many instructions to fit in memory! */
-#define PB_ERROR_LOOPDEPTH		7	/* Too deeply nested in loops. [Note: pb_prog only catches the simplest-case errors; pb_parse catches them all.] */
+#define PB_ERROR_LOOPDEPTH		7	/* Too deeply nested in loops (or subroutines). [Note: the encoder only catches the simplest-case errors; pb_verify() (pb_flow.c) and pb_parse catch them all.] */
 #define PB_ERROR_TOKENISING		8	/* Some problem in tokenising a line. Eg a vliw instruction with the wrong number of args. or a garbage string for strtoul(). */
 #define PB_ERROR_EMPTYVLIWFILE		9	/* The .vliw (or .bin) file is empty. (This used to occur as a result of any fatal error during pb_parse.) */
 #define PB_ERROR_BADVLIWFILE		10	/* The .vliw (or .bin) file contains no program, or an invalid one. */
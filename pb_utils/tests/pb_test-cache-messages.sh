@@ -0,0 +1,66 @@
+#!/bin/bash
+#This checks that the cache of assembled images (pb_cache) never hides the encoder's messages about the
+#source: each example is assembled twice with pb_asm, into an empty cache, and the second time must give
+#exactly the same WARNINGs and NOTICEs (about its lines) as the first. A source which gives none must come from the cache
+#the second time. It needs no hardware: run it from the source tree, after make (or via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests that pb_asm gives the same warnings and notices when the image is in the cache."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_asm" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+export PB_CACHE_DIR=$TMPDIR/cache
+
+#A '0' where '-' was meant gives a WARNING.
+cat > $TMPDIR/warning.vliw << EOF
+0x000001	cont		0	100
+-		stop		-	-
+EOF
+
+echo "Now checking that the cache keeps pb_asm's warnings and notices."
+
+failed=0
+checked=0
+messages=0
+for file in $EXAMPLES/*.vliw $TMPDIR/*.vliw ; do
+	rm -f $TMPDIR/out.bin*
+	first=$(pb_asm $file $TMPDIR/out.bin 2>&1 | grep -E '^(WARNING|NOTICE) at line|was in the cache')
+	rm -f $TMPDIR/out.bin*
+	second=$(pb_asm $file $TMPDIR/out.bin 2>&1 | grep -E '^(WARNING|NOTICE) at line|was in the cache')
+	if [ "$(echo "$first" | grep -E '^(WARNING|NOTICE)')" != "$(echo "$second" | grep -E '^(WARNING|NOTICE)')" ] ; then
+		echo "$(basename $file): the second assembly gave different warnings or notices:"
+		diff <(echo "$first" | grep -E '^(WARNING|NOTICE)') <(echo "$second" | grep -E '^(WARNING|NOTICE)')
+		failed=1
+	fi
+	if echo "$first" | grep -qE '^(WARNING|NOTICE)' ; then
+		messages=$(( messages + 1 ))
+	elif ! echo "$second" | grep -q 'was in the cache' ; then
+		echo "$(basename $file): gives no warnings, but the second assembly didn't come from the cache."
+		failed=1
+	fi
+	checked=$(( checked + 1 ))
+done
+
+#never.vliw has a DEBUG (a NOTICE), and warning.vliw a WARNING: at least those must have been tested.
+if [ $messages -lt 2 ] ; then
+	echo "Only $messages sources gave warnings or notices: there should be at least 2."
+	failed=1
+fi
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo "Checked $checked sources."
+echo success
+exit 0
@@ -0,0 +1,59 @@
+#!/bin/bash
+#This checks that pb_disasm round-trips every example: each is assembled (raw, and in a container),
+#disassembled, and assembled again, which must give exactly the same bytes; and disassembling that
+#again must give exactly the same (canonical) source. It needs no hardware: run it from the source
+#tree, after make (or via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests that pb_disasm round-trips the examples through pb_asm."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_disasm" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+export PB_CACHE_DIR=
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+echo "Now checking the pb_disasm round trip of the examples."
+
+failed=0
+checked=0
+for file in $EXAMPLES/*.vliw ; do
+	name=$TMPDIR/$(basename $file .vliw)
+	#A container (-c) has a source map, which the disassembly's own line numbers change: so compare its disassembly instead.
+	for container in "" -c ; do
+		if ! pb_asm $container $file $name.bin > $TMPDIR/log 2>&1 || ! pb_disasm $name.bin $name-1.vliw >> $TMPDIR/log 2>&1 ||
+		   ! pb_asm $container $name-1.vliw $name-1.bin >> $TMPDIR/log 2>&1 ; then
+			echo "The round trip of $(basename $file) $container failed:"
+			cat $TMPDIR/log
+			failed=1
+			continue
+		fi
+		if [ -z "$container" ] && ! cmp -s $name.bin $name-1.bin ; then
+			echo "The disassembly of $(basename $file) assembles into different bytes."
+			failed=1
+		fi
+		if ! pb_disasm $name-1.bin 2> /dev/null | cmp -s - $name-1.vliw ; then
+			echo "The disassembly of $(basename $file) $container isn't canonical: disassembling it again differs."
+			diff $name-1.vliw <(pb_disasm $name-1.bin 2> /dev/null) | head
+			failed=1
+		fi
+		checked=$(( checked + 1 ))
+		rm -f $name.bin $name-1.vliw $name-1.bin
+	done
+done
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo "Checked $checked round trips."
+echo success
+exit 0
@@ -0,0 +1,65 @@
+#!/bin/bash
+#This checks, on the emulator, that a group of cards is started with the start register writes back
+#to back (as the driver's PB_IOC_GROUP_START does them): between the first card's start and the
+#last's, there must be exactly one start write per card, and nothing else. The skew in ns must be
+#under SKEW_MAX_NS (default 1 ms; it is only a sanity check, since it depends on the host). Every
+#card must then run the same. It needs no hardware: run it from the source tree, after make (or via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests the start skew of a group of emulated cards."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_emu" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+SKEW_MAX_NS=${SKEW_MAX_NS:-1000000}
+export PB_CACHE_DIR=
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+echo "Now checking the start skew of groups of emulated cards."
+
+failed=0
+for file in $EXAMPLES/example.vliw $EXAMPLES/loop5.vliw $EXAMPLES/wait.vliw ; do
+	bin=$TMPDIR/$(basename $file .vliw).bin
+	if ! pb_asm $file $bin > /dev/null 2>&1 ; then
+		echo "pb_asm $file failed"
+		exit 1
+	fi
+	for latency in 0 10 ; do
+		#With 2 cards, the skew is just the second card's start write.
+		one=$(pb_emu -l $latency -u 1000 -g 2 $bin | sed -n 's/^group_skew_bridge_accesses: //p')
+		for cards in 2 4 16 ; do
+			result=$(pb_emu -l $latency -u 1000 -g $cards $bin)
+			accesses=$(echo "$result" | sed -n 's/^group_skew_bridge_accesses: //p')
+			ns=$(echo "$result" | sed -n 's/^group_skew_ns: //p')
+			consistent=$(echo "$result" | sed -n 's/^group_consistent: //p')
+			echo "$(basename $bin), latency $latency, $cards cards: skew $ns ns, $accesses bridge accesses."
+			if [ -z "$one" ] || [ "$accesses" != $(( (cards - 1) * one )) ] ; then
+				echo "The skew should be $(( cards - 1 )) start writes, i.e. $(( (cards - 1) * one )) bridge accesses."
+				failed=1
+			fi
+			if [ -z "$ns" ] || [ "$ns" -gt $SKEW_MAX_NS ] ; then
+				echo "The skew should be under $SKEW_MAX_NS ns."
+				failed=1
+			fi
+			if [ "$consistent" != yes ] ; then
+				echo "The cards did not all run the same."
+				failed=1
+			fi
+		done
+	done
+done
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo success
+exit 0
@@ -0,0 +1,79 @@
+#!/bin/bash
+#This checks, on the emulator, that reprogramming only as far as the highest changed word (as the
+#driver does, with shadow=1) leaves exactly the same program memory as reprogramming all of it.
+#pb_emu -s works out how far to reprogram with the driver's own code (pb_shadow_changed_len(), from
+#driver/kernel/pulseblaster_shadow.h), so it is that which is tested; the card is the emulator's model.
+#Each example is loaded over each of the others, and over itself with its last, middle and first
+#word changed. It needs no hardware: run it from the source tree, after make (or via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests truncated reprogramming (the driver's shadow=1) against full reprogramming, on the emulator."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_emu" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+export PB_CACHE_DIR=
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+echo "Now checking truncated reprogramming on the emulator."
+
+for file in $EXAMPLES/*.vliw ; do
+	if ! pb_asm $file $TMPDIR/$(basename $file .vliw).bin > /dev/null 2>&1 ; then
+		echo "pb_asm $file failed"
+		exit 1
+	fi
+done
+
+#Make copies of each example, with one byte of its last, middle and first word changed.
+for file in $TMPDIR/*.bin ; do
+	words=$(( $(stat -c %s $file) / 10 ))
+	for word in $(( words - 1 )) $(( words / 2 )) 0 ; do
+		copy=$TMPDIR/$(basename $file .bin)-changed$word.new
+		cp $file $copy
+		printf '\x5a' | dd of=$copy bs=1 seek=$(( word * 10 + 9 )) conv=notrunc 2> /dev/null
+	done
+done
+
+#The memory, and the execution, must be the same either way.
+failed=0
+checked=0
+for previous in $TMPDIR/*.bin ; do
+	for file in $TMPDIR/*.bin $TMPDIR/$(basename $previous .bin)-changed*.new ; do
+		full=$(pb_emu -u 1000 -p $previous $file 2>&1 | grep -E '^(memory_[a-z]*|state|steps|ticks|output):')
+		truncated=$(pb_emu -u 1000 -p $previous -s $file 2>&1 | grep -E '^(memory_[a-z]*|state|steps|ticks|output):')
+		if [ "$full" != "$truncated" ] ; then
+			echo "Truncated reprogramming of $(basename $file) over $(basename $previous) differs from full reprogramming:"
+			diff <(echo "$full") <(echo "$truncated")
+			failed=1
+		fi
+		checked=$(( checked + 1 ))
+	done
+done
+
+#Only the words up to the changed one should have been reprogrammed.
+for file in $TMPDIR/*-changed*.new ; do
+	previous=${file%-changed*}.bin
+	word=${file##*-changed}
+	word=${word%.new}
+	programmed=$(pb_emu -u 1000 -p $previous -s $file | sed -n 's/^programmed_bytes: //p')
+	if [ "$programmed" != $(( (word + 1) * 10 )) ] ; then
+		echo "Truncated reprogramming of $(basename $file) over $(basename $previous) programmed $programmed bytes, not $(( (word + 1) * 10 ))."
+		failed=1
+	fi
+done
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo "Checked $checked reprogrammings."
+echo success
+exit 0
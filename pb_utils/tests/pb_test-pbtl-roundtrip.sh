@@ -0,0 +1,103 @@
+#!/bin/bash
+#This checks that the binary timeline (.pbtl) round-trips the simulation replay log (.pbsim) exactly:
+#each example (and a program, below, with loops, marks and subroutines) is simulated with pb_sim to a
+#.pbsim, converted by pb_tl to a .pbtl and back, which must give exactly the same file. A .pbtl written
+#directly by pb_sim must convert back to the same .pbsim (apart from the date in its header). Then,
+#pb_tl -s must give the same lines as the .pbsim, from the one in force at the given time. It needs
+#no hardware: run it from the source tree, after make (or via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests that .pbsim -> .pbtl -> .pbsim round-trips exactly, with pb_sim and pb_tl."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_tl" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+STEPS=20000
+export PB_CACHE_DIR=
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+#A loop, marked, calling a subroutine with a loop of its own, marked; repeated for ever.
+cat > $TMPDIR/marked-loops.vliw << EOF
+0x000001	cont		-	100
+0x000002	mark		-	120
+0x000003	loop		200	130
+0x000004	call		6	140
+0x000005	endloop		2	150
+0x000006	goto		1	160
+0x000007	loop		3	110
+0x000008	mark		-	115
+0x000009	endloop		6	125
+0x00000a	return		-	135
+EOF
+
+#Simulate $2, every step, to the log $1. This succeeds if the simulation ends, whatever its result (pb_sim exits
+#non-zero if the program would fail, e.g. at a NEVER: which is still logged).
+simulate() {
+	pb_sim -S -u $STEPS -g $1 $2 2> /dev/null | grep -q '^result: '
+}
+
+#The lines of a .pbsim from the one in force at time t (ns) onwards, as pb_tl -s gives them: a line after a WAIT
+#comes with the comment and the zero-length line before it; any other comment (a MARK) just before it is skipped.
+pbsim_from() {
+	awk -v t=$1 'on { print; next }
+		/^\/\/Encountered WAIT/ { wait = $0 "\n"; next }
+		/^\/\// { next }
+		$2 == "0x0" { wait = wait $0 "\n"; next }
+		{ if (s + $2 > t) { on = 1; printf "%s%s\n", wait, $0 } s += $2; wait = "" }' $2
+}
+
+echo "Now checking the .pbtl round trip."
+
+failed=0
+checked=0
+for file in $EXAMPLES/*.vliw $TMPDIR/*.vliw ; do
+	name=$TMPDIR/$(basename $file .vliw)
+	if ! simulate $name.pbsim $file || ! pb_tl $name.pbsim $name.pbtl 2> /dev/null ||
+	   ! pb_tl $name.pbtl $name-1.pbsim 2> /dev/null ; then
+		echo "The round trip of $(basename $file) failed."
+		failed=1
+		continue
+	fi
+	if ! cmp -s $name.pbsim $name-1.pbsim ; then
+		echo "The .pbtl of $(basename $file) converts back to a different .pbsim:"
+		diff $name.pbsim $name-1.pbsim | head
+		failed=1
+	fi
+
+	#Written directly
+	if ! simulate $name-2.pbtl $file || ! pb_tl $name-2.pbtl $name-2.pbsim 2> /dev/null ; then
+		echo "The .pbtl of $(basename $file), written by pb_sim, failed."
+		failed=1
+	elif ! cmp -s <(grep -v ' on date ' $name.pbsim) <(grep -v ' on date ' $name-2.pbsim) ; then
+		echo "The .pbtl of $(basename $file), written by pb_sim, converts back to a different .pbsim:"
+		diff $name.pbsim $name-2.pbsim | head
+		failed=1
+	fi
+
+	#From a time: the start, a third of the way, and two thirds
+	end=$(awk '!/^\/\// { s += $2 } END { printf "%.0f\n", s }' $name.pbsim)
+	for t in 0 $(( end / 3 )) $(( end * 2 / 3 + 1 )) ; do
+		if ! cmp -s <(pbsim_from $t $name.pbsim) <(pb_tl -s $t $name.pbtl 2> /dev/null) ; then
+			echo "pb_tl -s $t of the .pbtl of $(basename $file) differs from the .pbsim at that time."
+			failed=1
+		fi
+	done
+	checked=$(( checked + 1 ))
+	rm -f $name.pbsim $name.pbtl $name-*.pbsim $name-*.pbtl
+done
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo "Checked $checked programs."
+echo success
+exit 0
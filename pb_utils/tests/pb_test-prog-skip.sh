@@ -0,0 +1,56 @@
+#!/bin/bash
+#This loads the same program twice with pb_prog, and checks that the driver skipped the second load:
+#pb_prog gives the driver the whole image at once (PB_IOC_PROGRAM, on /dev/pulseblaster0), so it can
+#compare it with the program already loaded. skips must go up by one, and saved by the size of the image.
+#It needs the card (and the driver loaded with shadow=1, the default).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests that pb_prog, loading the same program again, doesn't reprogram the card."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+SYSDIR=/sys/class/pulseblaster/pulseblaster0
+if [ ! -c /dev/pulseblaster0 ] || [ ! -r $SYSDIR/skips ] ; then
+	echo "There is no /dev/pulseblaster0 (or $SYSDIR/skips): is the driver loaded?"
+	exit 1
+fi
+
+#This file could be either in the source directory, or in the installed directory.
+VLIWFILE=$(dirname $0)/../vliw_examples/walking_4leds_1Hz.vliw
+if [ ! -f "$VLIWFILE" ] ;then
+	VLIWFILE=/usr/local/share/doc/pb_utils/vliw_examples/walking_4leds_1Hz.vliw
+	if [ ! -f "$VLIWFILE" ] ;then
+		echo "Cannot find the .vliw file to load."
+		exit 1
+	fi
+fi
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+if ! pb_asm $VLIWFILE $TMPDIR/walk.bin > /dev/null 2>&1 ; then
+	echo "pb_asm $VLIWFILE failed"
+	exit 1
+fi
+len=$(stat -c %s $TMPDIR/walk.bin)
+
+echo "Now loading $(basename $VLIWFILE) ($len bytes) twice."
+if ! pb_prog $TMPDIR/walk.bin ; then
+	echo pb_prog failed
+	exit 1
+fi
+skips=$(cat $SYSDIR/skips)
+saved=$(cat $SYSDIR/saved)
+if ! pb_prog $TMPDIR/walk.bin ; then
+	echo pb_prog failed
+	exit 1
+fi
+echo "skips: $skips -> $(cat $SYSDIR/skips); saved: $saved -> $(cat $SYSDIR/saved)"
+
+if [ $(cat $SYSDIR/skips) != $(( skips + 1 )) ] || [ $(cat $SYSDIR/saved) != $(( saved + len )) ] ; then
+	echo "The second load should have been skipped: skips should have gone up by 1, and saved by $len."
+	echo "failed"
+	exit 1
+fi
+echo success
+exit 0
@@ -0,0 +1,118 @@
+#!/bin/bash
+#This checks that pb_sim's fast-forward (adding up the rest of a loop which has been seen to repeat exactly,
+#instead of executing it) gives exactly the same results as executing every step (-S): for the examples,
+#and the programs below with nested loops, subroutines, marks and waits, stopped after various numbers of
+#steps (odd ones too, so as to stop part-way through a loop). The .pbtl written with fast-forward must
+#convert back (with pb_tl) to the same .pbsim as is written executing every step. The programs with long
+#loops must actually be fast-forwarded. It needs no hardware: run it from the source tree, after make (or
+#via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests pb_sim's fast-forward against executing every step (pb_sim -S)."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_sim" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+LIMITS="1 7 1000 99991 1000003"
+PBTL_LIMIT=99991
+export PB_CACHE_DIR=
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+#Nested loops (300000 iterations), calling a subroutine with a loop of its own, then a longdelay, and stop.
+cat > $TMPDIR/nested-stop.vliw << EOF
+0x000001	cont		-	100
+0x000002	loop		1000	150
+0x000003	loop		300	120
+0x000004	call		8	110
+0x000005	endloop		2	130
+0x000006	endloop		1	140
+0x000007	longdelay	5	1000
+-		stop		-	-
+0x000008	loop		3	105
+0x000009	endloop		8	115
+0x00000a	return		-	125
+EOF
+
+#A marked loop, calling a subroutine with a marked loop, then a loop with a wait in it; repeated for ever.
+cat > $TMPDIR/marked-forever.vliw << EOF
+0x000001	cont		-	100
+0x000002	mark		-	120
+0x000003	loop		5000	130
+0x000004	call		9	140
+0x000005	endloop		2	150
+0x000006	loop		700	160
+0x000007	wait		-	170
+0x000008	endloop		5	180
+0x000009	goto		1	190
+0x00000a	loop		3	110
+0x00000b	mark		-	115
+0x00000c	endloop		9	125
+0x00000d	return		-	135
+EOF
+
+RESULTS='^(result|steps|elapsed_ticks|waits|pc|output|reached|unreached):'
+
+field() {
+	sed -n "s/^$1: //p"
+}
+
+echo "Now checking pb_sim's fast-forward against executing every step."
+
+failed=0
+checked=0
+for file in $EXAMPLES/*.vliw $TMPDIR/*.vliw ; do
+	name=$TMPDIR/$(basename $file .vliw)
+	limits=$LIMITS
+	if [ "$(pb_sim -S -u 10000000 $file 2> /dev/null | field result)" = STOPPED ] ; then
+		limits="$limits 0"	#No limit: it stops.
+	fi
+	for limit in $limits ; do
+		fast=$(pb_sim -a -u $limit $file 2> /dev/null)
+		slow=$(pb_sim -a -S -u $limit $file 2> /dev/null)
+		if [ "$(echo "$fast" | grep -E "$RESULTS")" != "$(echo "$slow" | grep -E "$RESULTS")" ] ; then
+			echo "$(basename $file), -u $limit: fast-forward gives different results from -S:"
+			diff <(echo "$slow" | grep -E "$RESULTS") <(echo "$fast" | grep -E "$RESULTS")
+			failed=1
+		fi
+		if [ "$(echo "$slow" | field fastforward_steps)" != 0 ] ; then
+			echo "$(basename $file), -u $limit: -S fast-forwarded."
+			failed=1
+		fi
+		checked=$(( checked + 1 ))
+	done
+
+	#Our programs are all long loops: they must be fast-forwarded.
+	if [ $(dirname $file) = $TMPDIR ] && [ "$(pb_sim -u $PBTL_LIMIT $file 2> /dev/null | field fastforward_steps)" = 0 ] ; then
+		echo "$(basename $file) was not fast-forwarded."
+		failed=1
+	fi
+
+	#A .pbtl is written with fast-forward; a .pbsim isn't.
+	pb_sim -u $PBTL_LIMIT -g $name.pbtl $file > /dev/null 2>&1
+	pb_sim -S -u $PBTL_LIMIT -g $name.pbsim $file > /dev/null 2>&1
+	if ! pb_tl $name.pbtl $name-1.pbsim 2> /dev/null ; then
+		echo "$(basename $file): the .pbtl, written with fast-forward, could not be converted."
+		failed=1
+	elif ! cmp -s <(grep -v ' on date ' $name.pbsim) <(grep -v ' on date ' $name-1.pbsim) ; then
+		echo "$(basename $file): the .pbtl, written with fast-forward, differs from the .pbsim, written executing every step:"
+		diff $name.pbsim $name-1.pbsim | head
+		failed=1
+	fi
+	rm -f $name.pbtl $name.pbsim $name-1.pbsim
+done
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo "Checked $checked simulations."
+echo success
+exit 0
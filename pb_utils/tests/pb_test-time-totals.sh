@@ -0,0 +1,124 @@
+#!/bin/bash
+#This checks pb_time's totals against execution, on the simulator (pb_sim) and the emulator (pb_emu):
+#for a program which stops, the total ticks and steps must be exactly those executed; for one which
+#repeats from the start, three periods must take exactly three times the period. A container (pb_asm -c)
+#must record the same total in its header, or 0 if the program doesn't stop. The examples are used,
+#and two programs (below) with long nested loops, subroutines and longdelays. It needs no hardware:
+#run it from the source tree, after make (or via make check).
+
+if [ $# -ge 1 ] ; then
+	echo "This tests pb_time's totals against pb_sim and pb_emu."
+	echo "It takes no arguments."
+	exit 1
+fi
+
+#Use the tools just built, if this is the source tree.
+SRCDIR=$(dirname $0)/../src
+if [ -x "$SRCDIR/pb_time" ] ; then
+	PATH=$SRCDIR:$PATH
+fi
+EXAMPLES=$(dirname $0)/../vliw_examples/good
+export PB_CACHE_DIR=
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+#Nested loops (300000 iterations), calling a subroutine, then a longdelay, and stop.
+cat > $TMPDIR/nested-stop.vliw << EOF
+0x000001	cont		-	100
+0x000002	loop		1000	150
+0x000003	loop		300	120
+0x000004	call		8	110
+0x000005	endloop		2	130
+0x000006	endloop		1	140
+0x000007	longdelay	5	1000
+-		stop		-	-
+0x000008	cont		-	105
+0x000009	return		-	115
+EOF
+
+#Nested subroutines, each with a loop, repeated for ever.
+cat > $TMPDIR/nested-forever.vliw << EOF
+0x000010	call		3	100
+0x000011	longdelay	7	200
+0x000012	goto		0	300
+0x000013	loop		50	110
+0x000014	call		7	120
+0x000015	endloop		3	130
+0x000016	return		-	140
+0x000017	loop		20	150
+0x000018	endloop		7	160
+0x000019	return		-	170
+EOF
+
+field() {
+	sed -n "s/^$1: //p"
+}
+
+echo "Now checking pb_time's totals against pb_sim and pb_emu."
+
+failed=0
+checked=0
+for file in $EXAMPLES/*.vliw $TMPDIR/*.vliw ; do
+	bin=$TMPDIR/$(basename $file .vliw).bin
+	if ! pb_asm $file $bin > /dev/null 2>&1 ; then
+		echo "pb_asm $file failed"
+		failed=1
+		continue
+	fi
+	timed=$(pb_time $bin 2> /dev/null)
+	result=$(echo "$timed" | field result)
+	steps=$(echo "$timed" | field steps)
+
+	#The container's header
+	runtime=0
+	if [ "$result" = stop ] ; then
+		runtime=$(echo "$timed" | field total_ticks)
+	fi
+	if ! pb_asm -c $file $TMPDIR/container.bin > /dev/null 2>&1 ; then
+		echo "pb_asm -c $file failed"
+		failed=1
+	else
+		recorded=$(pb_emu -u 1 $TMPDIR/container.bin 2> /dev/null | field container_runtime_ticks)
+		if [ "$recorded" != "$runtime" ] ; then
+			echo "$(basename $file): the container records a run time of $recorded ticks; pb_time gives $runtime."
+			failed=1
+		fi
+	fi
+	rm -f $TMPDIR/container.bin
+
+	if [ "$result" = stop ] ; then
+		ticks=$(echo "$timed" | field total_ticks)
+		limit=0
+	elif [ "$result" = forever ] && [ "$(echo "$timed" | field period_start_ticks)" = 0 ] ; then
+		ticks=$(( 3 * $(echo "$timed" | field period_ticks) ))
+		steps=$(( 3 * steps ))
+		limit=$steps
+	else
+		echo "$(basename $file): pb_time gave result '$result': not checked."
+		continue
+	fi
+
+	simulated=$(pb_sim -u $limit $bin 2> /dev/null)
+	if [ "$(echo "$simulated" | field result)" = ENCOUNTERED_NEVER ] ; then
+		:	#pb_sim stops at a NEVER, as pb_parse does: the hardware (and so pb_time) doesn't.
+	elif [ "$(echo "$simulated" | field elapsed_ticks)" != "$ticks" ] || [ "$(echo "$simulated" | field steps)" != "$steps" ] ; then
+		echo "$(basename $file): pb_time gives $ticks ticks in $steps steps; pb_sim took $(echo "$simulated" | field elapsed_ticks) ticks in $(echo "$simulated" | field steps) steps."
+		failed=1
+	fi
+
+	emulated=$(pb_emu -u $limit $bin 2> /dev/null)
+	if [ "$(echo "$emulated" | field ticks)" != "$ticks" ] || [ "$(echo "$emulated" | field steps)" != "$steps" ] ; then
+		echo "$(basename $file): pb_time gives $ticks ticks in $steps steps; pb_emu took $(echo "$emulated" | field ticks) ticks in $(echo "$emulated" | field steps) steps."
+		failed=1
+	fi
+	checked=$(( checked + 1 ))
+done
+
+if [ $failed != 0 ] ; then
+	echo "failed"
+	exit 1
+fi
+echo "Checked $checked programs."
+echo success
+exit 0